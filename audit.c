@@ -0,0 +1,478 @@
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "audit.h"
+#include "crc32c.h"
+#include "memuse.h"
+
+#define AUDIT_PREFIX "audit-"
+#define AUDIT_SUFFIX ".log"
+#define AUDIT_DAY 86400
+#define AUDIT_DICT_SLOTS 8192  // potencia de 2, al menos el doble de AUDIT_BLOCK_EVENTS
+#define AUDIT_INDEX_BITS 12    // 1 << AUDIT_INDEX_BITS == AUDIT_BLOCK_EVENTS; la MAC ocupa los 48 bits de arriba
+
+static int64_t audit_day ( int64_t t ) {
+    return t >= 0 ? t / AUDIT_DAY : ( t - AUDIT_DAY + 1 ) / AUDIT_DAY;
+}
+
+static u_int64_t audit_mac_value ( const u_char *mac ) {
+    u_int64_t v = 0;
+
+    for ( int i = 0; i < 6; ++i )
+        v = v << 8 | mac[i];
+    return v;
+}
+
+static u_int64_t audit_zigzag ( int64_t v ) {
+    return ( ( u_int64_t ) v << 1 ) ^ ( u_int64_t ) ( v >> 63 );
+}
+
+static int64_t audit_unzigzag ( u_int64_t v ) {
+    return ( int64_t ) ( v >> 1 ) ^ -( int64_t ) ( v & 1 );
+}
+
+static u_char *audit_put ( u_char *p, u_int64_t v ) {
+    for ( ; v >= 0x80; v >>= 7 )
+        *p++ = v | 0x80;
+    *p++ = v;
+    return p;
+}
+
+// Lee un varint de [*p, end); regresa 0 si está truncado
+static int audit_get ( const u_char **p, const u_char *end, u_int64_t *v ) {
+    u_int64_t r = 0;
+
+    for ( int shift = 0; *p < end && shift < 64; shift += 7 ) {
+        u_char b = *( *p )++;
+
+        r |= ( u_int64_t ) ( b & 0x7f ) << shift;
+        if ( !( b & 0x80 ) ) {
+            *v = r;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void audit_path ( char *out, size_t size, const char *dir, int64_t day ) {
+    time_t    t = day * AUDIT_DAY;
+    struct tm tm;
+
+    gmtime_r ( &t, &tm );
+    snprintf ( out, size, "%s/" AUDIT_PREFIX "%04d%02d%02d" AUDIT_SUFFIX, dir, tm.tm_year + 1900, tm.tm_mon + 1,
+               tm.tm_mday );
+}
+
+// Día de un nombre audit-AAAAMMDD.log, o -1 si no es de un archivo del registro
+static int64_t audit_name_day ( const char *name ) {
+    struct tm tm;
+    int       y, m, d, n = 0;
+
+    if ( sscanf ( name, AUDIT_PREFIX "%4d%2d%2d" AUDIT_SUFFIX "%n", &y, &m, &d, &n ) != 3 || !n || name[n] )
+        return -1;
+
+    memset ( &tm, 0, sizeof ( tm ) );
+    tm.tm_year = y - 1900;
+    tm.tm_mon  = m - 1;
+    tm.tm_mday = d;
+    return audit_day ( timegm ( &tm ) );
+}
+
+static int audit_cmp_u64 ( const void *a, const void *b ) {
+    u_int64_t x = *( const u_int64_t * ) a, y = *( const u_int64_t * ) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int audit_block_sane ( const audit_block *hdr ) {
+    return hdr->magic == AUDIT_BLOCK_MAGIC && hdr->count && hdr->count <= AUDIT_BLOCK_EVENTS
+           && hdr->macs <= hdr->count && hdr->size <= AUDIT_BUF_SIZE;
+}
+
+static u_int32_t audit_block_crc ( const audit_block *hdr, const u_char *cols ) {
+    audit_block h = *hdr;
+
+    h.crc = 0;
+    return crc32c ( crc32c ( 0, &h, sizeof ( h ) ), cols, hdr->size );
+}
+
+// Lee las columnas del bloque en off; regresa 0 si están incompletas o
+// dañadas
+static int audit_read_cols ( int fd, off_t off, const audit_block *hdr, u_char *cols ) {
+    return pread ( fd, cols, hdr->size, off + sizeof ( audit_block ) ) == ( ssize_t ) hdr->size
+           && audit_block_crc ( hdr, cols ) == hdr->crc;
+}
+
+// Fin del último bloque completo y válido del archivo
+static off_t audit_valid_end ( int fd, u_char *cols ) {
+    audit_block hdr;
+    off_t       off = 0;
+
+    while ( pread ( fd, &hdr, sizeof ( hdr ), off ) == sizeof ( hdr ) && audit_block_sane ( &hdr )
+            && audit_read_cols ( fd, off, &hdr, cols ) )
+        off += sizeof ( hdr ) + hdr.size;
+    return off;
+}
+
+// Borra los archivos de días anteriores a la retención
+static void audit_prune ( audit_log *a ) {
+    DIR *          d = opendir ( a->dir );
+    struct dirent *e;
+    char           path[4096];
+
+    if ( !d )
+        return;
+    while ( ( e = readdir ( d ) ) ) {
+        int64_t day = audit_name_day ( e->d_name );
+
+        if ( day >= 0 && day <= a->day - a->days ) {
+            snprintf ( path, sizeof ( path ), "%s/%s", a->dir, e->d_name );
+            unlink ( path );
+        }
+    }
+    closedir ( d );
+}
+
+// Abre (o crea) el archivo del día; uno que quedó con un bloque a medias se
+// corta al final del último válido
+static int audit_switch ( audit_log *a, int64_t day ) {
+    char path[4096];
+
+    if ( a->fd != -1 )
+        close ( a->fd );
+    a->day = day;
+    audit_path ( path, sizeof ( path ), a->dir, day );
+    if ( ( a->fd = open ( path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644 ) ) == -1 )
+        return 0;
+    if ( ftruncate ( a->fd, audit_valid_end ( a->fd, a->buf ) ) == -1 )
+        return 0;
+
+    audit_prune ( a );
+    return 1;
+}
+
+// Registro en dir (se crea si no existe) que conserva days días. Regresa 0
+// con errno si falla.
+int audit_open ( audit_log *a, const char *dir, int days ) {
+    int err;
+
+    memset ( a, 0, sizeof ( audit_log ) );
+    a->fd   = -1;
+    a->days = days;
+    if ( mkdir ( dir, 0755 ) == -1 && errno != EEXIST )
+        return 0;
+    if ( !( a->dir = strdup ( dir ) )
+         || !( a->events = memuse_malloc ( MEMUSE_LOG, AUDIT_BLOCK_EVENTS * sizeof ( audit_event ) ) )
+         || !( a->buf = memuse_malloc ( MEMUSE_LOG, AUDIT_BUF_SIZE ) ) ) {
+        err = errno;
+        audit_close ( a );
+        errno = err;
+        return 0;
+    }
+    return 1;
+}
+
+// Codifica los eventos pendientes en a->buf; regresa el tamaño de las columnas
+static size_t audit_encode ( audit_log *a, audit_block *hdr ) {
+    u_int16_t slots[AUDIT_DICT_SLOTS];  // entrada del diccionario + 1
+    u_int64_t dict[AUDIT_BLOCK_EVENTS];  // MAC << AUDIT_INDEX_BITS | entrada antes de ordenar
+    u_int16_t index[AUDIT_BLOCK_EVENTS];
+    u_int16_t rank[AUDIT_BLOCK_EVENTS];  // entrada -> posición en el diccionario ordenado
+    u_char *  p = a->buf;
+    int64_t   time;
+    u_int32_t ip;
+    int64_t   lease_time = 0;
+    u_int64_t mac;
+
+    memset ( hdr, 0, sizeof ( audit_block ) );
+    memset ( slots, 0, sizeof ( slots ) );
+    hdr->magic    = AUDIT_BLOCK_MAGIC;
+    hdr->count    = a->count;
+    hdr->time_min = hdr->time_max = a->events[0].time;
+    hdr->ip_min = hdr->ip_max = ntohl ( a->events[0].ip );
+    hdr->mac_min = hdr->mac_max = audit_mac_value ( a->events[0].mac );
+
+    // Diccionario de MAC y rangos del encabezado
+    for ( size_t i = 0; i < a->count; ++i ) {
+        const audit_event *ev  = &a->events[i];
+        u_int32_t          h;
+
+        mac = audit_mac_value ( ev->mac );
+        h   = ( mac * 0x9e3779b97f4a7c15ull ) >> 51;
+        while ( slots[h] && dict[slots[h] - 1] >> AUDIT_INDEX_BITS != mac )
+            h = ( h + 1 ) & ( AUDIT_DICT_SLOTS - 1 );
+        if ( !slots[h] ) {
+            dict[hdr->macs] = mac << AUDIT_INDEX_BITS | hdr->macs;
+            slots[h]        = ++hdr->macs;
+        }
+        index[i] = slots[h] - 1;
+
+        if ( ev->time < hdr->time_min )
+            hdr->time_min = ev->time;
+        if ( ev->time > hdr->time_max )
+            hdr->time_max = ev->time;
+        if ( ntohl ( ev->ip ) < hdr->ip_min )
+            hdr->ip_min = ntohl ( ev->ip );
+        if ( ntohl ( ev->ip ) > hdr->ip_max )
+            hdr->ip_max = ntohl ( ev->ip );
+        if ( mac < hdr->mac_min )
+            hdr->mac_min = mac;
+        if ( mac > hdr->mac_max )
+            hdr->mac_max = mac;
+    }
+
+    // El diccionario ordenado se guarda como diferencias desde mac_min: las
+    // MAC de un mismo fabricante quedan a pocos bytes una de otra
+    qsort ( dict, hdr->macs, sizeof ( u_int64_t ), audit_cmp_u64 );
+    mac = hdr->mac_min;
+    for ( u_int32_t i = 0; i < hdr->macs; ++i ) {
+        rank[dict[i] & ( AUDIT_BLOCK_EVENTS - 1 )] = i;
+        p   = audit_put ( p, ( dict[i] >> AUDIT_INDEX_BITS ) - mac );
+        mac = dict[i] >> AUDIT_INDEX_BITS;
+    }
+
+    // Columnas
+    time = hdr->time_min;
+    for ( size_t i = 0; i < a->count; ++i ) {
+        p    = audit_put ( p, audit_zigzag ( a->events[i].time - time ) );
+        time = a->events[i].time;
+    }
+    for ( size_t i = 0; i < a->count; ++i )
+        p = audit_put ( p, ( u_int64_t ) rank[index[i]] << 3 | a->events[i].type );
+    ip = hdr->ip_min;
+    for ( size_t i = 0; i < a->count; ++i ) {
+        p  = audit_put ( p, audit_zigzag ( ( int64_t ) ntohl ( a->events[i].ip ) - ip ) );
+        ip = ntohl ( a->events[i].ip );
+    }
+    for ( size_t i = 0; i < a->count; ++i ) {
+        p          = audit_put ( p, audit_zigzag ( ( int64_t ) a->events[i].lease_time - lease_time ) );
+        lease_time = a->events[i].lease_time;
+    }
+
+    hdr->size = p - a->buf;
+    hdr->crc  = audit_block_crc ( hdr, a->buf );
+    return hdr->size;
+}
+
+// Escribe los eventos pendientes como un bloque. Si falla, el bloque se
+// pierde y regresa 0 con errno.
+int audit_flush ( audit_log *a ) {
+    audit_block hdr;
+    size_t      size;
+    int64_t     day;
+    int         ok;
+
+    if ( !a->count )
+        return 1;
+
+    day = audit_day ( a->events[0].time );
+    if ( ( a->fd == -1 || day != a->day ) && !audit_switch ( a, day ) ) {
+        a->count = 0;
+        return 0;
+    }
+
+    size = audit_encode ( a, &hdr );
+    ok   = write ( a->fd, &hdr, sizeof ( hdr ) ) == sizeof ( hdr ) && write ( a->fd, a->buf, size ) == ( ssize_t ) size;
+    if ( !ok && errno == 0 )
+        errno = ENOSPC;
+
+    a->count = 0;
+    if ( ok ) {
+        a->blocks++;
+        a->bytes += sizeof ( hdr ) + size;
+    }
+    return ok;
+}
+
+// Agrega un evento; el bloque se escribe al llenarse o al cambiar de día.
+// Regresa 0 con errno si falló una escritura.
+int audit_add ( audit_log *a, const audit_event *ev ) {
+    int ok = 1;
+
+    if ( a->count && audit_day ( ev->time ) != audit_day ( a->events[0].time ) )
+        ok = audit_flush ( a );
+
+    if ( !a->count )
+        a->first = ev->time;
+    a->events[a->count++] = *ev;
+
+    if ( a->count == AUDIT_BLOCK_EVENTS && !audit_flush ( a ) )
+        ok = 0;
+    return ok;
+}
+
+// Escribe el bloque pendiente si tiene más de AUDIT_FLUSH_SECONDS
+int audit_tick ( audit_log *a, int64_t now ) {
+    return !a->count || now - a->first < AUDIT_FLUSH_SECONDS || audit_flush ( a );
+}
+
+void audit_close ( audit_log *a ) {
+    if ( a->events )
+        audit_flush ( a );
+    if ( a->fd != -1 )
+        close ( a->fd );
+    free ( a->dir );
+    memuse_free ( MEMUSE_LOG, a->events );
+    memuse_free ( MEMUSE_LOG, a->buf );
+    memset ( a, 0, sizeof ( audit_log ) );
+    a->fd = -1;
+}
+
+// Decodifica el diccionario de MAC de un bloque válido; regresa dónde
+// empiezan las columnas o NULL si está dañado
+static const u_char *audit_decode_dict ( const audit_block *hdr, const u_char *cols, u_int64_t *dict ) {
+    const u_char *p = cols, *end = cols + hdr->size;
+    u_int64_t     v, mac = hdr->mac_min;
+
+    for ( u_int32_t i = 0; i < hdr->macs; ++i ) {
+        if ( !audit_get ( &p, end, &v ) )
+            return NULL;
+        dict[i] = mac += v;
+    }
+    return p;
+}
+
+// Decodifica las columnas de un bloque válido en events
+static int audit_decode ( const audit_block *hdr, const u_char *cols, const u_char *p, const u_int64_t *dict,
+                          audit_event *events ) {
+    const u_char *end = cols + hdr->size;
+    u_int64_t     v;
+    int64_t       time = hdr->time_min, lease_time = 0;
+    u_int32_t     ip   = hdr->ip_min;
+
+    for ( u_int32_t i = 0; i < hdr->count; ++i ) {
+        if ( !audit_get ( &p, end, &v ) )
+            return 0;
+        events[i].time = time += audit_unzigzag ( v );
+    }
+    for ( u_int32_t i = 0; i < hdr->count; ++i ) {
+        if ( !audit_get ( &p, end, &v ) || v >> 3 >= hdr->macs )
+            return 0;
+        events[i].type = v & 7;
+        for ( int b = 0; b < 6; ++b )
+            events[i].mac[b] = dict[v >> 3] >> ( 40 - 8 * b );
+    }
+    for ( u_int32_t i = 0; i < hdr->count; ++i ) {
+        if ( !audit_get ( &p, end, &v ) )
+            return 0;
+        ip += audit_unzigzag ( v );
+        events[i].ip = htonl ( ip );
+    }
+    for ( u_int32_t i = 0; i < hdr->count; ++i ) {
+        if ( !audit_get ( &p, end, &v ) )
+            return 0;
+        events[i].lease_time = lease_time += audit_unzigzag ( v );
+    }
+    return 1;
+}
+
+static int audit_search_file ( const char *path, const audit_query *q, audit_match match, void *ctx,
+                               audit_stats *stats, u_char *cols, u_int64_t *dict, audit_event *events ) {
+    u_int64_t     mac = audit_mac_value ( q->mac );
+    u_int32_t     ip  = ntohl ( q->ip );
+    audit_block   hdr;
+    const u_char *p;
+    off_t         off = 0;
+    int           fd  = open ( path, O_RDONLY | O_CLOEXEC );
+
+    if ( fd == -1 )
+        return errno == ENOENT;
+    stats->files++;
+
+    // Un bloque incompleto o dañado termina el archivo
+    for ( ; pread ( fd, &hdr, sizeof ( hdr ), off ) == sizeof ( hdr ) && audit_block_sane ( &hdr );
+          off += sizeof ( hdr ) + hdr.size ) {
+        stats->blocks++;
+        if ( hdr.time_max < q->from || hdr.time_min > q->to
+             || ( q->by_mac ? mac < hdr.mac_min || mac > hdr.mac_max : ip < hdr.ip_min || ip > hdr.ip_max ) ) {
+            stats->skipped++;
+            continue;
+        }
+
+        if ( !audit_read_cols ( fd, off, &hdr, cols ) )
+            break;
+        stats->bytes += sizeof ( hdr ) + hdr.size;
+        if ( !( p = audit_decode_dict ( &hdr, cols, dict ) ) )
+            break;
+        if ( q->by_mac && !bsearch ( &mac, dict, hdr.macs, sizeof ( u_int64_t ), audit_cmp_u64 ) ) {
+            stats->skipped++;
+            continue;
+        }
+        if ( !audit_decode ( &hdr, cols, p, dict, events ) )
+            break;
+        stats->events += hdr.count;
+
+        for ( u_int32_t i = 0; i < hdr.count; ++i )
+            if ( events[i].time >= q->from && events[i].time <= q->to
+                 && ( q->by_mac ? !memcmp ( events[i].mac, q->mac, 6 ) : events[i].ip == q->ip ) ) {
+                stats->matches++;
+                match ( ctx, &events[i] );
+            }
+    }
+
+    close ( fd );
+    return 1;
+}
+
+static int audit_cmp_day ( const void *a, const void *b ) {
+    int64_t x = *( const int64_t * ) a, y = *( const int64_t * ) b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Entrega en orden de tiempo (por día y por bloque) los eventos de la
+// dirección o MAC de q en [q->from, q->to]. Regresa 0 con errno si falla.
+int audit_search ( const char *dir, const audit_query *q, audit_match match, void *ctx, audit_stats *stats ) {
+    DIR *          d = opendir ( dir );
+    struct dirent *e;
+    int64_t *      days = NULL, *grown;
+    size_t         count = 0, cap = 0;
+    u_char *       cols   = malloc ( AUDIT_BUF_SIZE );
+    audit_event *  events = malloc ( AUDIT_BLOCK_EVENTS * sizeof ( audit_event ) );
+    u_int64_t *    dict   = malloc ( AUDIT_BLOCK_EVENTS * sizeof ( u_int64_t ) );
+    char           path[4096];
+    int            ok = 0;
+
+    memset ( stats, 0, sizeof ( audit_stats ) );
+    if ( !d || !cols || !events || !dict )
+        goto done;
+
+    // Solo los archivos de los días de la ventana
+    while ( ( e = readdir ( d ) ) ) {
+        int64_t day = audit_name_day ( e->d_name );
+
+        if ( day < 0 || day < audit_day ( q->from ) || day > audit_day ( q->to ) )
+            continue;
+        if ( count == cap ) {
+            cap = cap ? cap * 2 : 64;
+            if ( !( grown = realloc ( days, cap * sizeof ( int64_t ) ) ) )
+                goto done;
+            days = grown;
+        }
+        days[count++] = day;
+    }
+    qsort ( days, count, sizeof ( int64_t ), audit_cmp_day );
+
+    for ( size_t i = 0; i < count; ++i ) {
+        audit_path ( path, sizeof ( path ), dir, days[i] );
+        if ( !audit_search_file ( path, q, match, ctx, stats, cols, dict, events ) )
+            goto done;
+    }
+    ok = 1;
+
+done:
+    if ( d )
+        closedir ( d );
+    free ( days );
+    free ( cols );
+    free ( events );
+    free ( dict );
+    return ok;
+}
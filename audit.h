@@ -0,0 +1,102 @@
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Registro de auditoría de concesiones: quién tuvo qué dirección y cuándo.
+ *
+ * Los eventos se acumulan en memoria y se escriben por bloques de hasta
+ * AUDIT_BLOCK_EVENTS (o cada AUDIT_FLUSH_SECONDS) en un archivo por día
+ * (audit-AAAAMMDD.log, día UTC); los archivos de más de los días de
+ * retención se borran al cambiar de día.
+ *
+ * Cada bloque se guarda por columnas: un diccionario ordenado con las MAC
+ * distintas del bloque (como diferencias), los tiempos como diferencias con
+ * el anterior, el índice de la MAC junto con el tipo de evento, las
+ * direcciones como diferencias y el tiempo de concesión como diferencia;
+ * todo en varints (las diferencias en zigzag), de modo que un evento ocupa
+ * unos 7 bytes en lugar de los 24 de audit_event. El encabezado
+ * del bloque lleva mínimo y máximo de tiempo, dirección y MAC, así que una
+ * búsqueda salta sin decodificar los bloques que no pueden tener nada, y un
+ * CRC32C que deja fuera un bloque escrito a medias.
+ */
+
+#define AUDIT_BLOCK_EVENTS 4096
+#define AUDIT_EVENT_MAX 43  // bytes por evento en el peor caso, con su entrada del diccionario
+#define AUDIT_BUF_SIZE ( AUDIT_BLOCK_EVENTS * AUDIT_EVENT_MAX )
+#define AUDIT_FLUSH_SECONDS 60
+#define AUDIT_BLOCK_MAGIC 0x31445541  // "AUD1"
+
+// Tipo de evento
+#define AUDIT_GRANT 1
+#define AUDIT_RENEW 2
+#define AUDIT_RELEASE 3
+#define AUDIT_EXPIRE 4
+#define AUDIT_DECLINE 5
+
+typedef struct audit_event {
+    int64_t   time;  // CLOCK_REALTIME
+    u_int32_t ip;    // orden de red
+    u_int32_t lease_time;
+    u_char    mac[6];
+    u_int8_t  type;  // AUDIT_*
+} audit_event;
+
+typedef struct audit_block {
+    u_int32_t magic;
+    u_int32_t count;
+    int64_t   time_min;
+    int64_t   time_max;
+    u_int32_t ip_min;  // orden del host
+    u_int32_t ip_max;
+    u_int64_t mac_min;  // la MAC como entero de 48 bits
+    u_int64_t mac_max;
+    u_int32_t macs;  // entradas del diccionario
+    u_int32_t size;  // bytes de columnas que siguen al encabezado
+    u_int32_t crc;   // CRC32C del encabezado (con crc en 0) y las columnas
+    u_int32_t reserved;
+} audit_block;
+
+typedef struct audit_log {
+    char *       dir;
+    int          days;  // retención
+    int          fd;
+    int64_t      day;  // día (UTC, desde la época) del archivo abierto
+    audit_event *events;
+    size_t       count;
+    u_char *     buf;
+    int64_t      first;  // tiempo del primer evento sin escribir
+    u_int64_t    blocks;
+    u_int64_t    bytes;
+} audit_log;
+
+typedef struct audit_query {
+    int64_t   from;  // [from, to]
+    int64_t   to;
+    int       by_mac;
+    u_int32_t ip;  // orden de red
+    u_char    mac[6];
+} audit_query;
+
+typedef struct audit_stats {
+    u_int64_t files;
+    u_int64_t blocks;
+    u_int64_t skipped;  // bloques descartados por su encabezado o su diccionario
+    u_int64_t events;   // eventos decodificados
+    u_int64_t matches;
+    u_int64_t bytes;
+} audit_stats;
+
+typedef void ( *audit_match ) ( void *ctx, const audit_event *ev );
+
+int  audit_open ( audit_log *a, const char *dir, int days );
+int  audit_add ( audit_log *a, const audit_event *ev );
+int  audit_tick ( audit_log *a, int64_t now );
+int  audit_flush ( audit_log *a );
+void audit_close ( audit_log *a );
+int  audit_search ( const char *dir, const audit_query *q, audit_match match, void *ctx, audit_stats *stats );
+
+#endif  // AUDIT_H
@@ -0,0 +1,364 @@
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "capture.h"
+#include "memuse.h"
+
+#define CAPTURE_IDLE_NS 2000000
+#define CAPTURE_HEADERS 28  // IPv4 (20) + UDP (8)
+
+// Bloques de pcapng
+#define PCAPNG_SHB 0x0a0d0d0a
+#define PCAPNG_IDB 1
+#define PCAPNG_ISB 5
+#define PCAPNG_EPB 6
+#define PCAPNG_MAGIC 0x1a2b3c4d
+#define PCAPNG_LINKTYPE_IPV4 228
+#define PCAPNG_OPT_END 0
+#define PCAPNG_IF_TSRESOL 9
+#define PCAPNG_EPB_FLAGS 2
+#define PCAPNG_ISB_IFDROP 5
+
+#define DHCP_OPTIONS_OFFSET 240
+
+static const char *capture_type_names[] = {NULL,  "discover", "offer",   "request", "decline",
+                                           "ack", "nak",      "release", "inform"};
+
+// Tipo del mensaje (opción 53), 0 si no lo trae
+static int capture_msg_type ( const u_char *buf, size_t len ) {
+    for ( size_t i = DHCP_OPTIONS_OFFSET; i < len && buf[i] != 255; ) {
+        if ( buf[i] == 0 ) {
+            ++i;
+            continue;
+        }
+        if ( i + 1 >= len || i + 2 + buf[i + 1] > len )
+            return 0;
+        if ( buf[i] == 53 && buf[i + 1] == 1 )
+            return buf[i + 2];
+        i += 2 + buf[i + 1];
+    }
+    return 0;
+}
+
+static int capture_match ( const capture_filter *f, const u_char *buf, size_t len ) {
+    int type;
+
+    if ( len < DHCP_OPTIONS_OFFSET )
+        return !f->has_mac && !f->has_xid && !f->types;
+    if ( f->has_mac && memcmp ( buf + 28, f->mac, 6 ) )
+        return 0;
+    if ( f->has_xid && memcmp ( buf + 4, &f->xid, 4 ) )
+        return 0;
+    if ( f->types ) {
+        type = capture_msg_type ( buf, len );
+        return type < 16 && ( f->types & ( 1 << type ) );
+    }
+    return 1;
+}
+
+// Interpreta el filtro; una cadena vacía deja pasar todo. Regresa 0 con
+// errno = EINVAL si no se entiende.
+int capture_parse_filter ( capture_filter *f, const char *str ) {
+    char  copy[256], *term, *save, *value, *alt;
+    char *end;
+
+    memset ( f, 0, sizeof ( capture_filter ) );
+    if ( strlen ( str ) >= sizeof ( copy ) )
+        goto invalid;
+    strcpy ( copy, str );
+
+    for ( term = strtok_r ( copy, ",", &save ); term; term = strtok_r ( NULL, ",", &save ) ) {
+        while ( isspace ( ( u_char ) *term ) )
+            ++term;
+        if ( !( value = strchr ( term, '=' ) ) )
+            goto invalid;
+        *value++ = '\0';
+
+        if ( !strcmp ( term, "mac" ) ) {
+            unsigned int m[6];
+
+            if ( sscanf ( value, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5] ) != 6 )
+                goto invalid;
+            for ( int i = 0; i < 6; ++i )
+                f->mac[i] = m[i];
+            f->has_mac = 1;
+        } else if ( !strcmp ( term, "xid" ) ) {
+            unsigned long xid = strtoul ( value, &end, 0 );
+
+            if ( end == value || *end || xid > 0xffffffffUL )
+                goto invalid;
+            f->xid     = htonl ( xid );
+            f->has_xid = 1;
+        } else if ( !strcmp ( term, "type" ) ) {
+            for ( char *s2; ( alt = strtok_r ( value, "|", &s2 ) ); value = NULL ) {
+                long type = strtol ( alt, &end, 10 );
+
+                if ( end == alt || *end ) {
+                    type = -1;
+                    for ( size_t i = 1; i < sizeof ( capture_type_names ) / sizeof ( char * ); ++i )
+                        if ( !strcasecmp ( alt, capture_type_names[i] ) )
+                            type = i;
+                }
+                if ( type < 1 || type > 15 )
+                    goto invalid;
+                f->types |= 1 << type;
+            }
+        } else
+            goto invalid;
+    }
+    return 1;
+
+invalid:
+    errno = EINVAL;
+    return 0;
+}
+
+// Copia el datagrama al anillo; se llama solo con la captura encendida
+void capture_copy ( capture *c, int dir, const u_char *buf, size_t len, u_int32_t src, u_int16_t sport,
+                    u_int32_t dst, u_int16_t dport, u_int64_t ns ) {
+    capture_rec *rec;
+
+    if ( !capture_match ( &c->filter, buf, len ) )
+        return;
+
+    if ( c->head == c->limit ) {
+        c->limit = __atomic_load_n ( &c->tail, __ATOMIC_ACQUIRE ) + CAPTURE_SLOTS;
+        if ( c->head == c->limit ) {
+            __atomic_store_n ( &c->dropped, c->dropped + 1, __ATOMIC_RELAXED );
+            return;
+        }
+    }
+
+    rec        = &c->slots[c->head & ( CAPTURE_SLOTS - 1 )];
+    rec->ns    = ns;
+    rec->src   = src;
+    rec->dst   = dst;
+    rec->sport = sport;
+    rec->dport = dport;
+    rec->dir   = dir;
+    rec->len   = len < CAPTURE_SNAPLEN ? len : CAPTURE_SNAPLEN;
+    memcpy ( rec->data, buf, rec->len );
+    __atomic_store_n ( &c->head, c->head + 1, __ATOMIC_RELEASE );
+}
+
+static void capture_write ( capture *c, const char *buf, size_t len ) {
+    for ( size_t done = 0; done < len; ) {
+        ssize_t n = write ( c->fd, buf + done, len - done );
+
+        if ( n == -1 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            return;  // el archivo no acepta más; los bloques se pierden
+        done += n;
+    }
+}
+
+static char *capture_put32 ( char *p, u_int32_t v ) {
+    memcpy ( p, &v, 4 );
+    return p + 4;
+}
+
+static char *capture_put16 ( char *p, u_int16_t v ) {
+    memcpy ( p, &v, 2 );
+    return p + 2;
+}
+
+// Encabezados IPv4 y UDP del datagrama; la suma de UDP va en 0 (opcional
+// en IPv4)
+static char *capture_put_headers ( char *p, const capture_rec *rec ) {
+    u_char *  ip  = ( u_char * ) p;
+    u_int32_t sum = 0;
+
+    memset ( ip, 0, CAPTURE_HEADERS );
+    ip[0] = 0x45;
+    ip[8] = 64;  // TTL
+    ip[9] = 17;  // UDP
+    capture_put16 ( p + 2, htons ( CAPTURE_HEADERS + rec->len ) );
+    capture_put32 ( p + 12, rec->src );
+    capture_put32 ( p + 16, rec->dst );
+    for ( int i = 0; i < 20; i += 2 )
+        sum += ip[i] << 8 | ip[i + 1];
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+    capture_put16 ( p + 10, htons ( ~sum & 0xffff ) );
+
+    capture_put16 ( p + 20, htons ( rec->sport ) );
+    capture_put16 ( p + 22, htons ( rec->dport ) );
+    capture_put16 ( p + 24, htons ( 8 + rec->len ) );
+    return p + CAPTURE_HEADERS;
+}
+
+// Enhanced Packet Block del registro
+static char *capture_put_epb ( char *p, const capture_rec *rec ) {
+    u_int32_t caplen = CAPTURE_HEADERS + rec->len;
+    u_int32_t padded = ( caplen + 3 ) & ~3u;
+    u_int32_t total  = 28 + padded + 12 + 4;  // encabezado, datos, epb_flags y fin de opciones, largo final
+
+    p = capture_put32 ( p, PCAPNG_EPB );
+    p = capture_put32 ( p, total );
+    p = capture_put32 ( p, 0 );  // interfaz
+    p = capture_put32 ( p, rec->ns >> 32 );
+    p = capture_put32 ( p, rec->ns );
+    p = capture_put32 ( p, caplen );
+    p = capture_put32 ( p, caplen );
+    p = capture_put_headers ( p, rec );
+    memcpy ( p, rec->data, rec->len );
+    memset ( p + rec->len, 0, padded - caplen );
+    p += padded - CAPTURE_HEADERS;
+
+    p = capture_put16 ( p, PCAPNG_EPB_FLAGS );
+    p = capture_put16 ( p, 4 );
+    p = capture_put32 ( p, rec->dir );
+    p = capture_put32 ( p, PCAPNG_OPT_END );
+    return capture_put32 ( p, total );
+}
+
+// Section Header Block e Interface Description Block (IPv4, hora en ns)
+static void capture_write_header ( capture *c ) {
+    char buf[64], *p = buf;
+
+    p = capture_put32 ( p, PCAPNG_SHB );
+    p = capture_put32 ( p, 28 );
+    p = capture_put32 ( p, PCAPNG_MAGIC );
+    p = capture_put16 ( p, 1 );  // versión 1.0
+    p = capture_put16 ( p, 0 );
+    p = capture_put32 ( p, 0xffffffff );  // largo de la sección sin especificar
+    p = capture_put32 ( p, 0xffffffff );
+    p = capture_put32 ( p, 28 );
+
+    p = capture_put32 ( p, PCAPNG_IDB );
+    p = capture_put32 ( p, 32 );
+    p = capture_put16 ( p, PCAPNG_LINKTYPE_IPV4 );
+    p = capture_put16 ( p, 0 );
+    p = capture_put32 ( p, CAPTURE_SNAPLEN + CAPTURE_HEADERS );
+    p = capture_put16 ( p, PCAPNG_IF_TSRESOL );
+    p = capture_put16 ( p, 1 );
+    p = capture_put32 ( p, 9 );  // 10^-9 s, relleno a 4 bytes
+    p = capture_put32 ( p, PCAPNG_OPT_END );
+    p = capture_put32 ( p, 32 );
+
+    capture_write ( c, buf, p - buf );
+}
+
+// Interface Statistics Block con los paquetes perdidos
+static void capture_write_stats ( capture *c ) {
+    char            buf[64], *p = buf;
+    struct timespec now;
+    u_int64_t       ns, dropped = __atomic_load_n ( &c->dropped, __ATOMIC_RELAXED );
+
+    clock_gettime ( CLOCK_REALTIME, &now );
+    ns = now.tv_sec * 1000000000ull + now.tv_nsec;
+
+    p = capture_put32 ( p, PCAPNG_ISB );
+    p = capture_put32 ( p, 40 );
+    p = capture_put32 ( p, 0 );
+    p = capture_put32 ( p, ns >> 32 );
+    p = capture_put32 ( p, ns );
+    p = capture_put16 ( p, PCAPNG_ISB_IFDROP );
+    p = capture_put16 ( p, 8 );
+    memcpy ( p, &dropped, 8 );
+    p += 8;
+    p = capture_put32 ( p, PCAPNG_OPT_END );
+    p = capture_put32 ( p, 40 );
+
+    capture_write ( c, buf, p - buf );
+}
+
+// Hilo escritor: vacía el anillo por bloques y duerme mientras no hay nada
+static void *capture_writer ( void *arg ) {
+    capture *             c    = arg;
+    char *                p    = c->buf;
+    u_int64_t             tail = c->tail, head;
+    const struct timespec idle = {0, CAPTURE_IDLE_NS};
+    const size_t          max  = 28 + CAPTURE_HEADERS + CAPTURE_SNAPLEN + 3 + 16;
+
+    for ( ;; ) {
+        head = __atomic_load_n ( &c->head, __ATOMIC_ACQUIRE );
+
+        for ( ; tail != head; ++tail ) {
+            if ( c->buf + CAPTURE_BUF_SIZE - p < ( ssize_t ) max ) {
+                capture_write ( c, c->buf, p - c->buf );
+                p = c->buf;
+            }
+            p = capture_put_epb ( p, &c->slots[tail & ( CAPTURE_SLOTS - 1 )] );
+
+            // Cada registro es grande: se libera en cuanto se copia
+            __atomic_store_n ( &c->tail, tail + 1, __ATOMIC_RELEASE );
+        }
+        if ( p != c->buf ) {
+            capture_write ( c, c->buf, p - c->buf );
+            p = c->buf;
+        }
+
+        if ( __atomic_load_n ( &c->stop, __ATOMIC_ACQUIRE ) && __atomic_load_n ( &c->head, __ATOMIC_ACQUIRE ) == tail )
+            return NULL;
+        nanosleep ( &idle, NULL );
+    }
+}
+
+// Crea el archivo path, reserva el anillo y arranca el escritor. La captura
+// empieza encendida si enabled. Regresa 0 con errno si falla.
+int capture_open ( capture *c, const char *path, const capture_filter *filter, int enabled ) {
+    int err;
+
+    memset ( c, 0, sizeof ( capture ) );
+    c->fd     = -1;
+    c->limit  = CAPTURE_SLOTS;
+    c->filter = *filter;
+
+    if ( ( c->fd = open ( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640 ) ) == -1 )
+        goto fail;
+    if ( !( c->slots = memuse_malloc ( MEMUSE_LOG, CAPTURE_SLOTS * sizeof ( capture_rec ) ) )
+         || !( c->buf = memuse_malloc ( MEMUSE_LOG, CAPTURE_BUF_SIZE ) ) )
+        goto fail;
+
+    // Se tocan todas las páginas ahora para que el ciclo no tenga fallos de
+    // página al copiar
+    memset ( c->slots, 0, CAPTURE_SLOTS * sizeof ( capture_rec ) );
+    capture_write_header ( c );
+    if ( ( err = pthread_create ( &c->thread, NULL, capture_writer, c ) ) ) {
+        errno = err;
+        goto fail;
+    }
+    capture_set ( c, enabled );
+    return 1;
+
+fail:
+    err = errno;
+    if ( c->fd != -1 )
+        close ( c->fd );
+    memuse_free ( MEMUSE_LOG, c->slots );
+    memuse_free ( MEMUSE_LOG, c->buf );
+    memset ( c, 0, sizeof ( capture ) );
+    errno = err;
+    return 0;
+}
+
+// Enciende o apaga; rige desde el siguiente paquete
+void capture_set ( capture *c, int enabled ) {
+    if ( !c->slots )
+        return;
+    __atomic_store_n ( &c->enabled, enabled != 0, __ATOMIC_RELAXED );
+}
+
+// Escribe lo pendiente y las estadísticas y libera todo
+void capture_close ( capture *c ) {
+    if ( !c->slots )
+        return;
+
+    __atomic_store_n ( &c->enabled, 0, __ATOMIC_RELAXED );
+    __atomic_store_n ( &c->stop, 1, __ATOMIC_RELEASE );
+    pthread_join ( c->thread, NULL );
+    capture_write_stats ( c );
+    close ( c->fd );
+    memuse_free ( MEMUSE_LOG, c->slots );
+    memuse_free ( MEMUSE_LOG, c->buf );
+    memset ( c, 0, sizeof ( capture ) );
+}
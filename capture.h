@@ -0,0 +1,87 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Captura dentro del proceso de los mensajes DHCP recibidos y enviados, en
+ * un archivo pcapng que Wireshark o tcpdump abren directamente.
+ *
+ * El ciclo de paquetes solo copia el datagrama con sus direcciones y la hora
+ * a un anillo reservado al abrir (un productor, un consumidor; si está lleno
+ * el paquete se cuenta como perdido). Un hilo escritor lo vacía, le antepone
+ * encabezados IPv4 y UDP sintéticos (el socket UDP no ve los reales) y
+ * escribe por bloques. Al cerrar se agrega un bloque de estadísticas con los
+ * paquetes perdidos.
+ *
+ * El filtro se parece al de BPF pero sobre campos DHCP: términos separados
+ * por comas que deben cumplirse todos, "mac=52:54:00:12:34:56",
+ * "xid=0x1a2b3c4d" y "type=discover|request" (nombres o números; basta uno
+ * de los tipos).
+ *
+ * La captura se enciende y apaga en ejecución con capture_set(), que se
+ * puede llamar desde un manejador de señal. Apagada, capture_packet() es una
+ * sola comparación.
+ */
+
+#define CAPTURE_SLOTS 2048  // potencia de 2
+#define CAPTURE_BUF_SIZE ( 1 << 16 )
+#define CAPTURE_SNAPLEN 1500
+
+#define CAPTURE_RX 1  // como epb_flags de pcapng: entrante
+#define CAPTURE_TX 2  // saliente
+
+typedef struct capture_filter {
+    u_char    mac[6];
+    u_int8_t  has_mac;
+    u_int8_t  has_xid;
+    u_int32_t xid;    // en orden de red, como viaja
+    u_int16_t types;  // bit por tipo de mensaje; 0 = cualquiera
+} capture_filter;
+
+typedef struct capture_rec {
+    u_int64_t ns;  // CLOCK_REALTIME
+    u_int32_t src, dst;  // IPv4 en orden de red
+    u_int16_t sport, dport;
+    u_int16_t len;
+    u_int8_t  dir;  // CAPTURE_RX o CAPTURE_TX
+    u_char    data[CAPTURE_SNAPLEN];
+} capture_rec;
+
+typedef struct capture {
+    int enabled;  // lo único que se lee con la captura apagada
+
+    // Productor
+    u_int64_t      head;
+    u_int64_t      limit;
+    u_int64_t      dropped;
+    capture_filter filter;
+
+    // Consumidor, en otra línea de caché
+    u_int64_t tail __attribute__ ( ( aligned ( 64 ) ) );
+    int       stop;
+
+    capture_rec *slots;
+    int          fd;
+    pthread_t    thread;
+    char *       buf;
+} capture;
+
+int  capture_parse_filter ( capture_filter *f, const char *str );
+int  capture_open ( capture *c, const char *path, const capture_filter *filter, int enabled );
+void capture_set ( capture *c, int enabled );
+void capture_close ( capture *c );
+void capture_copy ( capture *c, int dir, const u_char *buf, size_t len, u_int32_t src, u_int16_t sport,
+                    u_int32_t dst, u_int16_t dport, u_int64_t ns );
+
+// Guarda el datagrama si la captura está encendida y pasa el filtro
+static inline void capture_packet ( capture *c, int dir, const u_char *buf, size_t len, u_int32_t src,
+                                    u_int16_t sport, u_int32_t dst, u_int16_t dport, u_int64_t ns ) {
+    if ( __builtin_expect ( __atomic_load_n ( &c->enabled, __ATOMIC_RELAXED ), 0 ) )
+        capture_copy ( c, dir, buf, len, src, sport, dst, dport, ns );
+}
+
+#endif  // CAPTURE_H
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <string.h>
+#include "classify.h"
+#include "memuse.h"
+
+// Símbolo del marcador de inicio de cada campo
+#define MARKER( c, field ) ( ( c )->nsyms - CLASSIFY_FIELDS + ( field ) )
+
+void classifier_init ( classifier *c ) {
+    memset ( c, 0, sizeof ( classifier ) );
+}
+
+void classifier_free ( classifier *c ) {
+    for ( u_int16_t i = 0; i < c->nrules; ++i )
+        memuse_free ( MEMUSE_INDEX, c->rules[i].pattern );
+    memuse_free ( MEMUSE_INDEX, c->rules );
+    memuse_free ( MEMUSE_INDEX, c->delta );
+    memuse_free ( MEMUSE_INDEX, c->out );
+    memset ( c, 0, sizeof ( classifier ) );
+}
+
+// Regresa 0 si la regla no es válida o no hubo memoria
+int classifier_add ( classifier *c, u_int8_t field, int prefix, const u_char *pattern, size_t len, u_int8_t class_id ) {
+    classify_rule *rule;
+
+    if ( field >= CLASSIFY_FIELDS || len > 255 || ( !len && !prefix ) || c->nrules == CLASSIFY_MAX_RULES )
+        return 0;
+
+    if ( !c->rules && !( c->rules = memuse_calloc ( MEMUSE_INDEX, CLASSIFY_MAX_RULES, sizeof ( classify_rule ) ) ) )
+        return 0;
+
+    rule          = &c->rules[c->nrules];
+    rule->pattern = memuse_malloc ( MEMUSE_INDEX, len + 1 );
+    if ( !rule->pattern )
+        return 0;
+
+    memcpy ( rule->pattern, pattern, len );
+    rule->len      = len;
+    rule->field    = field;
+    rule->prefix   = prefix ? 1 : 0;
+    rule->class_id = class_id;
+    c->nrules++;
+
+    return 1;
+}
+
+static void classifier_set_out ( u_int16_t *out, u_int16_t rule ) {
+    if ( !*out || rule < *out )
+        *out = rule;
+}
+
+int classifier_compile ( classifier *c ) {
+    u_int32_t  max_states = 1, nstates = 1, head = 0, tail = 0;
+    u_int32_t *fail, *queue;
+
+    memuse_free ( MEMUSE_INDEX, c->delta );
+    memuse_free ( MEMUSE_INDEX, c->out );
+    c->delta = NULL;
+    c->out   = NULL;
+
+    // Alfabeto reducido: solo los bytes que aparecen en alguna regla tienen
+    // símbolo propio; los demás comparten el 0
+    memset ( c->sym, 0, sizeof ( c->sym ) );
+    c->nsyms = 1;
+    for ( u_int16_t i = 0; i < c->nrules; ++i ) {
+        for ( u_int16_t j = 0; j < c->rules[i].len; ++j )
+            if ( !c->sym[c->rules[i].pattern[j]] )
+                c->sym[c->rules[i].pattern[j]] = c->nsyms++;
+        max_states += c->rules[i].len + c->rules[i].prefix;
+    }
+    c->nsyms += CLASSIFY_FIELDS;
+
+    c->delta = memuse_calloc ( MEMUSE_INDEX, ( size_t ) max_states * c->nsyms, sizeof ( u_int32_t ) );
+    c->out   = memuse_calloc ( MEMUSE_INDEX, ( size_t ) max_states * CLASSIFY_FIELDS, sizeof ( u_int16_t ) );
+    fail     = memuse_calloc ( MEMUSE_INDEX, max_states, sizeof ( u_int32_t ) );
+    queue    = memuse_calloc ( MEMUSE_INDEX, max_states, sizeof ( u_int32_t ) );
+
+    if ( !c->delta || !c->out || !fail || !queue ) {
+        memuse_free ( MEMUSE_INDEX, fail );
+        memuse_free ( MEMUSE_INDEX, queue );
+        return 0;
+    }
+
+    // Trie; mientras se construye, 0 en delta significa "sin hijo" porque la
+    // raíz nunca es hija de nadie
+    for ( u_int16_t i = 0; i < c->nrules; ++i ) {
+        classify_rule *rule = &c->rules[i];
+        u_int32_t      s    = 0;
+
+        for ( int j = rule->prefix ? -1 : 0; j < rule->len; ++j ) {
+            u_int32_t *next = &c->delta[s * c->nsyms + ( j < 0 ? MARKER ( c, rule->field ) : c->sym[rule->pattern[j]] )];
+
+            if ( !*next )
+                *next = nstates++;
+            s = *next;
+        }
+        classifier_set_out ( &c->out[s * CLASSIFY_FIELDS + rule->field], i + 1 );
+    }
+
+    // Enlaces de falla en anchura; al mismo tiempo se completan las
+    // transiciones que faltan para tener un autómata determinista
+    for ( u_int16_t a = 0; a < c->nsyms; ++a )
+        if ( c->delta[a] )
+            queue[tail++] = c->delta[a];
+
+    while ( head < tail ) {
+        u_int32_t r = queue[head++];
+
+        for ( u_int16_t a = 0; a < c->nsyms; ++a ) {
+            u_int32_t *next = &c->delta[r * c->nsyms + a];
+
+            if ( *next ) {
+                fail[*next] = c->delta[fail[r] * c->nsyms + a];
+                for ( u_int8_t f = 0; f < CLASSIFY_FIELDS; ++f )
+                    if ( c->out[fail[*next] * CLASSIFY_FIELDS + f] )
+                        classifier_set_out ( &c->out[*next * CLASSIFY_FIELDS + f],
+                                             c->out[fail[*next] * CLASSIFY_FIELDS + f] );
+                queue[tail++] = *next;
+            } else
+                *next = c->delta[fail[r] * c->nsyms + a];
+        }
+    }
+
+    c->nstates = nstates;
+    memuse_free ( MEMUSE_INDEX, fail );
+    memuse_free ( MEMUSE_INDEX, queue );
+    return 1;
+}
+
+void classify_begin ( classify_run *run, const classifier *c ) {
+    run->c     = c;
+    run->state = 0;
+    run->best  = 0;
+    run->field = 0;
+}
+
+static void classify_check ( classify_run *run ) {
+    u_int16_t rule = run->c->out[run->state * CLASSIFY_FIELDS + run->field];
+
+    if ( rule && ( !run->best || rule < run->best ) )
+        run->best = rule;
+}
+
+// Empieza un campo nuevo; se llama aunque el campo venga vacío
+void classify_field ( classify_run *run, u_int8_t field ) {
+    if ( !run->c->delta )
+        return;
+
+    run->field = field;
+    run->state = run->c->delta[MARKER ( run->c, field )];
+    classify_check ( run );
+}
+
+// Los campos pueden darse en varios pedazos (p. ej. opciones partidas)
+void classify_feed ( classify_run *run, const u_char *data, size_t len ) {
+    const classifier *c = run->c;
+
+    if ( !c->delta )
+        return;
+
+    for ( size_t i = 0; i < len; ++i ) {
+        run->state = c->delta[run->state * c->nsyms + c->sym[data[i]]];
+        classify_check ( run );
+    }
+}
+
+// Clase de la regla ganadora, 0 si ninguna coincidió
+u_int8_t classify_end ( classify_run *run ) {
+    return run->best ? run->c->rules[run->best - 1].class_id : 0;
+}
@@ -0,0 +1,62 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Clasificador de clientes por patrones (Aho-Corasick).
+ *
+ * Todas las reglas (prefijo o subcadena sobre las opciones 60, 77, 61 o sobre
+ * el OUI de chaddr) se compilan en un solo autómata determinista. Por cada
+ * paquete se recorren una sola vez los bytes de esos campos, separados por un
+ * símbolo marcador propio de cada campo: las reglas de prefijo empiezan con
+ * el marcador y las de subcadena no pueden cruzarlo, así que el costo depende
+ * solo del tamaño de los campos y no del número de reglas. Si varias reglas
+ * coinciden gana la que se declaró primero.
+ */
+
+#define CLASSIFY_FIELD_VENDOR 0  // opción 60
+#define CLASSIFY_FIELD_USER 1    // opción 77
+#define CLASSIFY_FIELD_CLIENT 2  // opción 61
+#define CLASSIFY_FIELD_OUI 3     // 3 primeros bytes de chaddr
+#define CLASSIFY_FIELDS 4
+
+#define CLASSIFY_MAX_RULES 1024
+
+typedef struct classify_rule {
+    u_char *  pattern;
+    u_int16_t len;
+    u_int8_t  field;
+    u_int8_t  prefix;
+    u_int8_t  class_id;
+} classify_rule;
+
+typedef struct classifier {
+    classify_rule *rules;
+    u_int16_t      nrules;
+    // Autómata compilado
+    u_int16_t  sym[256];  // byte -> símbolo (0 = byte que no aparece en ninguna regla)
+    u_int16_t  nsyms;
+    u_int32_t  nstates;
+    u_int32_t *delta;  // nstates * nsyms
+    u_int16_t *out;    // nstates * CLASSIFY_FIELDS: regla + 1 que termina aquí, 0 si ninguna
+} classifier;
+
+typedef struct classify_run {
+    const classifier *c;
+    u_int32_t         state;
+    u_int16_t         best;
+    u_int8_t          field;
+} classify_run;
+
+void     classifier_init ( classifier *c );
+void     classifier_free ( classifier *c );
+int      classifier_add ( classifier *c, u_int8_t field, int prefix, const u_char *pattern, size_t len, u_int8_t class_id );
+int      classifier_compile ( classifier *c );
+void     classify_begin ( classify_run *run, const classifier *c );
+void     classify_field ( classify_run *run, u_int8_t field );
+void     classify_feed ( classify_run *run, const u_char *data, size_t len );
+u_int8_t classify_end ( classify_run *run );
+
+#endif  // CLASSIFY_H
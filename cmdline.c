@@ -50,6 +50,45 @@ const char *gengetopt_args_info_help[] = {
   "      --t3=lease time(t3)       Tiempo de concesión",
   "      --gateway=resolver address\n                                Dirección de la puerta de enlace (Gateway)",
   "      --timeout=timeout         Tiempo de espera para cada msg",
+  "      --class=regla             Regla de clase (nombre:campo:tipo:patrón)",
+  "      --class-range=rango       Rango de una clase (nombre:ip-ip)",
+  "      --class-option=opcion     Opción de una clase (nombre:código:tipo:valor)",
+  "      --boot=arranque           Arranque por red (clase:arq:next-server:archivo)",
+  "      --codec-bench=mensajes    Prueba de rendimiento del codec (N mensajes)",
+  "      --journal=archivo         Bitácora de concesiones (archivo)",
+  "      --lease-db=archivo        Base de concesiones mapeada (archivo)",
+  "      --lease-view=/nombre      Vista de concesiones en memoria compartida",
+  "      --compact-interval=segundos\n                                Segundos entre compactaciones (0 = nunca)",
+  "      --compact-size=MB         MB que crece la bitácora antes de compactar",
+  "      --recover-bench=registros\n                                Prueba de recuperación (N registros)",
+  "      --import=archivo          Importar concesiones de ISC dhcpd o Kea",
+  "      --journal-shards=particiones\n                                Particiones de la bitácora (1-16)",
+  "      --export=destino          Exportar concesiones (archivo o unix:ruta)",
+  "      --export-format=formato   Formato de exportación: csv, json o binary",
+  "      --export-interval=segundos\n                                Segundos entre exportaciones",
+  "      --export-bench=concesiones\n                                Prueba de exportación (N concesiones)",
+  "      --audit-dir=directorio    Directorio del registro de auditoría",
+  "      --audit-days=días         Días que se conserva la auditoría",
+  "      --audit-query=ip|mac      Buscar en la auditoría (IP o MAC)",
+  "      --audit-from=fecha        Inicio de la búsqueda (AAAA-MM-DD[ HH:MM:SS])",
+  "      --audit-to=fecha          Fin de la búsqueda (AAAA-MM-DD[ HH:MM:SS])",
+  "      --log-level=nivel         Nivel del registro (0-3, 3 = depuración)",
+  "      --log-sample=N            Depuración de 1 de cada N paquetes",
+  "      --log-bench=eventos       Prueba del registro (N eventos)",
+  "      --metrics=destino         Métricas (puerto local o unix:ruta)",
+  "      --trace-slow=ms           Registrar intercambios de más de N ms",
+  "      --capture=archivo         Captura pcapng de los mensajes DHCP",
+  "      --capture-filter=filtro   Filtro: mac=M,xid=X,type=T1|T2",
+  "      --capture-start           Empezar con la captura encendida",
+  "      --profile                 Perfil de ciclos por etapa (SIGRTMIN+1)",
+  "      --control=ruta            Socket Unix de control (ruta)",
+  "      --memory-plan             Prever la memoria y salir",
+  "      --lease-events=/nombre    Anillo de eventos en memoria compartida",
+  "      --events-bench=eventos    Prueba del anillo de eventos (N eventos)",
+  "      --hook=ruta               Gancho de concesiones (programa o módulo .so)",
+  "      --hook-workers=hilos      Hilos que ejecutan los ganchos (1-16)",
+  "      --hook-batch=eventos      Eventos por invocación del gancho (1-1024)",
+  "      --hook-timeout=ms         Tiempo máximo de cada invocación (ms)",
     0
 };
 
@@ -116,6 +155,45 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->t3_given = 0 ;
   args_info->gateway_given = 0 ;
   args_info->timeout_given = 0 ;
+  args_info->class_given = 0 ;
+  args_info->class_range_given = 0 ;
+  args_info->class_option_given = 0 ;
+  args_info->boot_given = 0 ;
+  args_info->codec_bench_given = 0 ;
+  args_info->journal_given = 0 ;
+  args_info->lease_db_given = 0 ;
+  args_info->lease_view_given = 0 ;
+  args_info->compact_interval_given = 0 ;
+  args_info->compact_size_given = 0 ;
+  args_info->recover_bench_given = 0 ;
+  args_info->import_given = 0 ;
+  args_info->journal_shards_given = 0 ;
+  args_info->export_given = 0 ;
+  args_info->export_format_given = 0 ;
+  args_info->export_interval_given = 0 ;
+  args_info->export_bench_given = 0 ;
+  args_info->audit_dir_given = 0 ;
+  args_info->audit_days_given = 0 ;
+  args_info->audit_query_given = 0 ;
+  args_info->audit_from_given = 0 ;
+  args_info->audit_to_given = 0 ;
+  args_info->log_level_given = 0 ;
+  args_info->log_sample_given = 0 ;
+  args_info->log_bench_given = 0 ;
+  args_info->metrics_given = 0 ;
+  args_info->trace_slow_given = 0 ;
+  args_info->capture_given = 0 ;
+  args_info->capture_filter_given = 0 ;
+  args_info->capture_start_given = 0 ;
+  args_info->profile_given = 0 ;
+  args_info->control_given = 0 ;
+  args_info->memory_plan_given = 0 ;
+  args_info->lease_events_given = 0 ;
+  args_info->events_bench_given = 0 ;
+  args_info->hook_given = 0 ;
+  args_info->hook_workers_given = 0 ;
+  args_info->hook_batch_given = 0 ;
+  args_info->hook_timeout_given = 0 ;
 }
 
 static
@@ -143,6 +221,62 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->gateway_arg = NULL;
   args_info->gateway_orig = NULL;
   args_info->timeout_orig = NULL;
+  args_info->class_arg = NULL;
+  args_info->class_orig = NULL;
+  args_info->class_range_arg = NULL;
+  args_info->class_range_orig = NULL;
+  args_info->class_option_arg = NULL;
+  args_info->class_option_orig = NULL;
+  args_info->boot_arg = NULL;
+  args_info->boot_orig = NULL;
+  args_info->codec_bench_orig = NULL;
+  args_info->journal_arg = NULL;
+  args_info->journal_orig = NULL;
+  args_info->lease_db_arg = NULL;
+  args_info->lease_db_orig = NULL;
+  args_info->lease_view_arg = NULL;
+  args_info->lease_view_orig = NULL;
+  args_info->compact_interval_orig = NULL;
+  args_info->compact_size_orig = NULL;
+  args_info->recover_bench_orig = NULL;
+  args_info->import_arg = NULL;
+  args_info->import_orig = NULL;
+  args_info->journal_shards_orig = NULL;
+  args_info->export_arg = NULL;
+  args_info->export_orig = NULL;
+  args_info->export_format_arg = NULL;
+  args_info->export_format_orig = NULL;
+  args_info->export_interval_orig = NULL;
+  args_info->export_bench_orig = NULL;
+  args_info->audit_dir_arg = NULL;
+  args_info->audit_dir_orig = NULL;
+  args_info->audit_days_orig = NULL;
+  args_info->audit_query_arg = NULL;
+  args_info->audit_query_orig = NULL;
+  args_info->audit_from_arg = NULL;
+  args_info->audit_from_orig = NULL;
+  args_info->audit_to_arg = NULL;
+  args_info->audit_to_orig = NULL;
+  args_info->log_level_orig = NULL;
+  args_info->log_sample_orig = NULL;
+  args_info->log_bench_orig = NULL;
+  args_info->metrics_arg = NULL;
+  args_info->metrics_orig = NULL;
+  args_info->trace_slow_orig = NULL;
+  args_info->capture_arg = NULL;
+  args_info->capture_orig = NULL;
+  args_info->capture_filter_arg = NULL;
+  args_info->capture_filter_orig = NULL;
+  args_info->control_arg = NULL;
+  args_info->control_orig = NULL;
+  args_info->lease_events_arg = NULL;
+  args_info->lease_events_orig = NULL;
+  args_info->events_bench_orig = NULL;
+  args_info->hook_arg = NULL;
+  args_info->hook_orig = NULL;
+  args_info->hook_workers_orig = NULL;
+  args_info->hook_batch_orig = NULL;
+  args_info->hook_timeout_orig = NULL;
   
 }
 
@@ -171,6 +305,55 @@ void init_args_info(struct gengetopt_args_info *args_info)
   args_info->t3_help = gengetopt_args_info_help[13] ;
   args_info->gateway_help = gengetopt_args_info_help[14] ;
   args_info->timeout_help = gengetopt_args_info_help[15] ;
+  args_info->class_help = gengetopt_args_info_help[16] ;
+  args_info->class_min = 0;
+  args_info->class_max = 0;
+  args_info->class_range_help = gengetopt_args_info_help[17] ;
+  args_info->class_range_min = 0;
+  args_info->class_range_max = 0;
+  args_info->class_option_help = gengetopt_args_info_help[18] ;
+  args_info->class_option_min = 0;
+  args_info->class_option_max = 0;
+  args_info->boot_help = gengetopt_args_info_help[19] ;
+  args_info->boot_min = 0;
+  args_info->boot_max = 0;
+  args_info->codec_bench_help = gengetopt_args_info_help[20] ;
+  args_info->journal_help = gengetopt_args_info_help[21] ;
+  args_info->lease_db_help = gengetopt_args_info_help[22] ;
+  args_info->lease_view_help = gengetopt_args_info_help[23] ;
+  args_info->compact_interval_help = gengetopt_args_info_help[24] ;
+  args_info->compact_size_help = gengetopt_args_info_help[25] ;
+  args_info->recover_bench_help = gengetopt_args_info_help[26] ;
+  args_info->import_help = gengetopt_args_info_help[27] ;
+  args_info->import_min = 0;
+  args_info->import_max = 0;
+  args_info->journal_shards_help = gengetopt_args_info_help[28] ;
+  args_info->export_help = gengetopt_args_info_help[29] ;
+  args_info->export_format_help = gengetopt_args_info_help[30] ;
+  args_info->export_interval_help = gengetopt_args_info_help[31] ;
+  args_info->export_bench_help = gengetopt_args_info_help[32] ;
+  args_info->audit_dir_help = gengetopt_args_info_help[33] ;
+  args_info->audit_days_help = gengetopt_args_info_help[34] ;
+  args_info->audit_query_help = gengetopt_args_info_help[35] ;
+  args_info->audit_from_help = gengetopt_args_info_help[36] ;
+  args_info->audit_to_help = gengetopt_args_info_help[37] ;
+  args_info->log_level_help = gengetopt_args_info_help[38] ;
+  args_info->log_sample_help = gengetopt_args_info_help[39] ;
+  args_info->log_bench_help = gengetopt_args_info_help[40] ;
+  args_info->metrics_help = gengetopt_args_info_help[41] ;
+  args_info->trace_slow_help = gengetopt_args_info_help[42] ;
+  args_info->capture_help = gengetopt_args_info_help[43] ;
+  args_info->capture_filter_help = gengetopt_args_info_help[44] ;
+  args_info->capture_start_help = gengetopt_args_info_help[45] ;
+  args_info->profile_help = gengetopt_args_info_help[46] ;
+  args_info->control_help = gengetopt_args_info_help[47] ;
+  args_info->memory_plan_help = gengetopt_args_info_help[48] ;
+  args_info->lease_events_help = gengetopt_args_info_help[49] ;
+  args_info->events_bench_help = gengetopt_args_info_help[50] ;
+  args_info->hook_help = gengetopt_args_info_help[51] ;
+  args_info->hook_workers_help = gengetopt_args_info_help[52] ;
+  args_info->hook_batch_help = gengetopt_args_info_help[53] ;
+  args_info->hook_timeout_help = gengetopt_args_info_help[54] ;
   
 }
 
@@ -318,6 +501,57 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
   free_string_field (&(args_info->gateway_arg));
   free_string_field (&(args_info->gateway_orig));
   free_string_field (&(args_info->timeout_orig));
+  free_multiple_string_field (args_info->class_given, &(args_info->class_arg), &(args_info->class_orig));
+  free_multiple_string_field (args_info->class_range_given, &(args_info->class_range_arg), &(args_info->class_range_orig));
+  free_multiple_string_field (args_info->class_option_given, &(args_info->class_option_arg), &(args_info->class_option_orig));
+  free_multiple_string_field (args_info->boot_given, &(args_info->boot_arg), &(args_info->boot_orig));
+  free_string_field (&(args_info->codec_bench_orig));
+  free_string_field (&(args_info->journal_arg));
+  free_string_field (&(args_info->journal_orig));
+  free_string_field (&(args_info->lease_db_arg));
+  free_string_field (&(args_info->lease_db_orig));
+  free_string_field (&(args_info->lease_view_arg));
+  free_string_field (&(args_info->lease_view_orig));
+  free_string_field (&(args_info->compact_interval_orig));
+  free_string_field (&(args_info->compact_size_orig));
+  free_string_field (&(args_info->recover_bench_orig));
+  free_multiple_string_field (args_info->import_given, &(args_info->import_arg), &(args_info->import_orig));
+  free_string_field (&(args_info->journal_shards_orig));
+  free_string_field (&(args_info->export_arg));
+  free_string_field (&(args_info->export_orig));
+  free_string_field (&(args_info->export_format_arg));
+  free_string_field (&(args_info->export_format_orig));
+  free_string_field (&(args_info->export_interval_orig));
+  free_string_field (&(args_info->export_bench_orig));
+  free_string_field (&(args_info->audit_dir_arg));
+  free_string_field (&(args_info->audit_dir_orig));
+  free_string_field (&(args_info->audit_days_orig));
+  free_string_field (&(args_info->audit_query_arg));
+  free_string_field (&(args_info->audit_query_orig));
+  free_string_field (&(args_info->audit_from_arg));
+  free_string_field (&(args_info->audit_from_orig));
+  free_string_field (&(args_info->audit_to_arg));
+  free_string_field (&(args_info->audit_to_orig));
+  free_string_field (&(args_info->log_level_orig));
+  free_string_field (&(args_info->log_sample_orig));
+  free_string_field (&(args_info->log_bench_orig));
+  free_string_field (&(args_info->metrics_arg));
+  free_string_field (&(args_info->metrics_orig));
+  free_string_field (&(args_info->trace_slow_orig));
+  free_string_field (&(args_info->capture_arg));
+  free_string_field (&(args_info->capture_orig));
+  free_string_field (&(args_info->capture_filter_arg));
+  free_string_field (&(args_info->capture_filter_orig));
+  free_string_field (&(args_info->control_arg));
+  free_string_field (&(args_info->control_orig));
+  free_string_field (&(args_info->lease_events_arg));
+  free_string_field (&(args_info->lease_events_orig));
+  free_string_field (&(args_info->events_bench_orig));
+  free_string_field (&(args_info->hook_arg));
+  free_string_field (&(args_info->hook_orig));
+  free_string_field (&(args_info->hook_workers_orig));
+  free_string_field (&(args_info->hook_batch_orig));
+  free_string_field (&(args_info->hook_timeout_orig));
   
   
 
@@ -386,6 +620,79 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
     write_into_file(outfile, "gateway", args_info->gateway_orig, 0);
   if (args_info->timeout_given)
     write_into_file(outfile, "timeout", args_info->timeout_orig, 0);
+  write_multiple_into_file(outfile, args_info->class_given, "class", args_info->class_orig, 0);
+  write_multiple_into_file(outfile, args_info->class_range_given, "class-range", args_info->class_range_orig, 0);
+  write_multiple_into_file(outfile, args_info->class_option_given, "class-option", args_info->class_option_orig, 0);
+  write_multiple_into_file(outfile, args_info->boot_given, "boot", args_info->boot_orig, 0);
+  if (args_info->codec_bench_given)
+    write_into_file(outfile, "codec-bench", args_info->codec_bench_orig, 0);
+  if (args_info->journal_given)
+    write_into_file(outfile, "journal", args_info->journal_orig, 0);
+  if (args_info->lease_db_given)
+    write_into_file(outfile, "lease-db", args_info->lease_db_orig, 0);
+  if (args_info->lease_view_given)
+    write_into_file(outfile, "lease-view", args_info->lease_view_orig, 0);
+  if (args_info->compact_interval_given)
+    write_into_file(outfile, "compact-interval", args_info->compact_interval_orig, 0);
+  if (args_info->compact_size_given)
+    write_into_file(outfile, "compact-size", args_info->compact_size_orig, 0);
+  if (args_info->recover_bench_given)
+    write_into_file(outfile, "recover-bench", args_info->recover_bench_orig, 0);
+  write_multiple_into_file(outfile, args_info->import_given, "import", args_info->import_orig, 0);
+  if (args_info->journal_shards_given)
+    write_into_file(outfile, "journal-shards", args_info->journal_shards_orig, 0);
+  if (args_info->export_given)
+    write_into_file(outfile, "export", args_info->export_orig, 0);
+  if (args_info->export_format_given)
+    write_into_file(outfile, "export-format", args_info->export_format_orig, 0);
+  if (args_info->export_interval_given)
+    write_into_file(outfile, "export-interval", args_info->export_interval_orig, 0);
+  if (args_info->export_bench_given)
+    write_into_file(outfile, "export-bench", args_info->export_bench_orig, 0);
+  if (args_info->audit_dir_given)
+    write_into_file(outfile, "audit-dir", args_info->audit_dir_orig, 0);
+  if (args_info->audit_days_given)
+    write_into_file(outfile, "audit-days", args_info->audit_days_orig, 0);
+  if (args_info->audit_query_given)
+    write_into_file(outfile, "audit-query", args_info->audit_query_orig, 0);
+  if (args_info->audit_from_given)
+    write_into_file(outfile, "audit-from", args_info->audit_from_orig, 0);
+  if (args_info->audit_to_given)
+    write_into_file(outfile, "audit-to", args_info->audit_to_orig, 0);
+  if (args_info->log_level_given)
+    write_into_file(outfile, "log-level", args_info->log_level_orig, 0);
+  if (args_info->log_sample_given)
+    write_into_file(outfile, "log-sample", args_info->log_sample_orig, 0);
+  if (args_info->log_bench_given)
+    write_into_file(outfile, "log-bench", args_info->log_bench_orig, 0);
+  if (args_info->metrics_given)
+    write_into_file(outfile, "metrics", args_info->metrics_orig, 0);
+  if (args_info->trace_slow_given)
+    write_into_file(outfile, "trace-slow", args_info->trace_slow_orig, 0);
+  if (args_info->capture_given)
+    write_into_file(outfile, "capture", args_info->capture_orig, 0);
+  if (args_info->capture_filter_given)
+    write_into_file(outfile, "capture-filter", args_info->capture_filter_orig, 0);
+  if (args_info->capture_start_given)
+    write_into_file(outfile, "capture-start", 0, 0 );
+  if (args_info->profile_given)
+    write_into_file(outfile, "profile", 0, 0 );
+  if (args_info->control_given)
+    write_into_file(outfile, "control", args_info->control_orig, 0);
+  if (args_info->memory_plan_given)
+    write_into_file(outfile, "memory-plan", 0, 0 );
+  if (args_info->lease_events_given)
+    write_into_file(outfile, "lease-events", args_info->lease_events_orig, 0);
+  if (args_info->events_bench_given)
+    write_into_file(outfile, "events-bench", args_info->events_bench_orig, 0);
+  if (args_info->hook_given)
+    write_into_file(outfile, "hook", args_info->hook_orig, 0);
+  if (args_info->hook_workers_given)
+    write_into_file(outfile, "hook-workers", args_info->hook_workers_orig, 0);
+  if (args_info->hook_batch_given)
+    write_into_file(outfile, "hook-batch", args_info->hook_batch_orig, 0);
+  if (args_info->hook_timeout_given)
+    write_into_file(outfile, "hook-timeout", args_info->hook_timeout_orig, 0);
   
 
   i = EXIT_SUCCESS;
@@ -637,12 +944,6 @@ cmdline_parser_required2 (struct gengetopt_args_info *args_info, const char *pro
   FIX_UNUSED (additional_error);
 
   /* checks for required options */
-  if (! args_info->interface_given)
-    {
-      fprintf (stderr, "%s: '--interface' ('-i') option required%s\n", prog_name, (additional_error ? additional_error : ""));
-      error_occurred = 1;
-    }
-  
   if (check_multiple_option_occurrences(prog_name, args_info->dns_given, args_info->dns_min, args_info->dns_max, "'--dns'"))
      error_occurred = 1;
   
@@ -908,6 +1209,11 @@ cmdline_parser_internal (
 
   struct generic_list * dns_list = NULL;
   struct generic_list * range_list = NULL;
+  struct generic_list * class_list = NULL;
+  struct generic_list * class_range_list = NULL;
+  struct generic_list * class_option_list = NULL;
+  struct generic_list * boot_list = NULL;
+  struct generic_list * import_list = NULL;
   int error_occurred = 0;
   struct gengetopt_args_info local_args_info;
   
@@ -954,6 +1260,45 @@ cmdline_parser_internal (
         { "t3",	1, NULL, 0 },
         { "gateway",	1, NULL, 0 },
         { "timeout",	1, NULL, 0 },
+        { "class",	1, NULL, 0 },
+        { "class-range",	1, NULL, 0 },
+        { "class-option",	1, NULL, 0 },
+        { "boot",	1, NULL, 0 },
+        { "codec-bench",	1, NULL, 0 },
+        { "journal",	1, NULL, 0 },
+        { "lease-db",	1, NULL, 0 },
+        { "lease-view",	1, NULL, 0 },
+        { "compact-interval",	1, NULL, 0 },
+        { "compact-size",	1, NULL, 0 },
+        { "recover-bench",	1, NULL, 0 },
+        { "import",	1, NULL, 0 },
+        { "journal-shards",	1, NULL, 0 },
+        { "export",	1, NULL, 0 },
+        { "export-format",	1, NULL, 0 },
+        { "export-interval",	1, NULL, 0 },
+        { "export-bench",	1, NULL, 0 },
+        { "audit-dir",	1, NULL, 0 },
+        { "audit-days",	1, NULL, 0 },
+        { "audit-query",	1, NULL, 0 },
+        { "audit-from",	1, NULL, 0 },
+        { "audit-to",	1, NULL, 0 },
+        { "log-level",	1, NULL, 0 },
+        { "log-sample",	1, NULL, 0 },
+        { "log-bench",	1, NULL, 0 },
+        { "metrics",	1, NULL, 0 },
+        { "trace-slow",	1, NULL, 0 },
+        { "capture",	1, NULL, 0 },
+        { "capture-filter",	1, NULL, 0 },
+        { "capture-start",	0, NULL, 0 },
+        { "profile",	0, NULL, 0 },
+        { "control",	1, NULL, 0 },
+        { "memory-plan",	0, NULL, 0 },
+        { "lease-events",	1, NULL, 0 },
+        { "events-bench",	1, NULL, 0 },
+        { "hook",	1, NULL, 0 },
+        { "hook-workers",	1, NULL, 0 },
+        { "hook-batch",	1, NULL, 0 },
+        { "hook-timeout",	1, NULL, 0 },
         { 0,  0, 0, 0 }
       };
 
@@ -1158,6 +1503,537 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Regla de clase (nombre:campo:tipo:patrón).  */
+          else if (strcmp (long_options[option_index].name, "class") == 0)
+          {
+          
+            if (update_multiple_arg_temp(&class_list, 
+                &(local_args_info.class_given), optarg, 0, 0, ARG_STRING,
+                "class", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Rango de una clase (nombre:ip-ip).  */
+          else if (strcmp (long_options[option_index].name, "class-range") == 0)
+          {
+          
+            if (update_multiple_arg_temp(&class_range_list, 
+                &(local_args_info.class_range_given), optarg, 0, 0, ARG_STRING,
+                "class-range", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Opción de una clase (nombre:código:tipo:valor).  */
+          else if (strcmp (long_options[option_index].name, "class-option") == 0)
+          {
+          
+            if (update_multiple_arg_temp(&class_option_list, 
+                &(local_args_info.class_option_given), optarg, 0, 0, ARG_STRING,
+                "class-option", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Arranque por red (clase:arq:next-server:archivo).  */
+          else if (strcmp (long_options[option_index].name, "boot") == 0)
+          {
+          
+            if (update_multiple_arg_temp(&boot_list, 
+                &(local_args_info.boot_given), optarg, 0, 0, ARG_STRING,
+                "boot", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Prueba de rendimiento del codec (N mensajes).  */
+          else if (strcmp (long_options[option_index].name, "codec-bench") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->codec_bench_arg), 
+                 &(args_info->codec_bench_orig), &(args_info->codec_bench_given),
+                &(local_args_info.codec_bench_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "codec-bench", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Bitácora de concesiones (archivo).  */
+          else if (strcmp (long_options[option_index].name, "journal") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->journal_arg), 
+                 &(args_info->journal_orig), &(args_info->journal_given),
+                &(local_args_info.journal_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "journal", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Base de concesiones mapeada (archivo).  */
+          else if (strcmp (long_options[option_index].name, "lease-db") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->lease_db_arg), 
+                 &(args_info->lease_db_orig), &(args_info->lease_db_given),
+                &(local_args_info.lease_db_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "lease-db", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Vista de concesiones en memoria compartida.  */
+          else if (strcmp (long_options[option_index].name, "lease-view") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->lease_view_arg), 
+                 &(args_info->lease_view_orig), &(args_info->lease_view_given),
+                &(local_args_info.lease_view_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "lease-view", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Segundos entre compactaciones (0 = nunca).  */
+          else if (strcmp (long_options[option_index].name, "compact-interval") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->compact_interval_arg), 
+                 &(args_info->compact_interval_orig), &(args_info->compact_interval_given),
+                &(local_args_info.compact_interval_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "compact-interval", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* MB que crece la bitácora antes de compactar.  */
+          else if (strcmp (long_options[option_index].name, "compact-size") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->compact_size_arg), 
+                 &(args_info->compact_size_orig), &(args_info->compact_size_given),
+                &(local_args_info.compact_size_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "compact-size", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Prueba de recuperación (N registros).  */
+          else if (strcmp (long_options[option_index].name, "recover-bench") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->recover_bench_arg), 
+                 &(args_info->recover_bench_orig), &(args_info->recover_bench_given),
+                &(local_args_info.recover_bench_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "recover-bench", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Importar concesiones de ISC dhcpd o Kea.  */
+          else if (strcmp (long_options[option_index].name, "import") == 0)
+          {
+          
+            if (update_multiple_arg_temp(&import_list, 
+                &(local_args_info.import_given), optarg, 0, 0, ARG_STRING,
+                "import", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Particiones de la bitácora (1-16).  */
+          else if (strcmp (long_options[option_index].name, "journal-shards") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->journal_shards_arg), 
+                 &(args_info->journal_shards_orig), &(args_info->journal_shards_given),
+                &(local_args_info.journal_shards_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "journal-shards", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Exportar concesiones (archivo o unix:ruta).  */
+          else if (strcmp (long_options[option_index].name, "export") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->export_arg), 
+                 &(args_info->export_orig), &(args_info->export_given),
+                &(local_args_info.export_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "export", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Formato de exportación: csv, json o binary.  */
+          else if (strcmp (long_options[option_index].name, "export-format") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->export_format_arg), 
+                 &(args_info->export_format_orig), &(args_info->export_format_given),
+                &(local_args_info.export_format_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "export-format", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Segundos entre exportaciones.  */
+          else if (strcmp (long_options[option_index].name, "export-interval") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->export_interval_arg), 
+                 &(args_info->export_interval_orig), &(args_info->export_interval_given),
+                &(local_args_info.export_interval_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "export-interval", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Prueba de exportación (N concesiones).  */
+          else if (strcmp (long_options[option_index].name, "export-bench") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->export_bench_arg), 
+                 &(args_info->export_bench_orig), &(args_info->export_bench_given),
+                &(local_args_info.export_bench_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "export-bench", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Directorio del registro de auditoría.  */
+          else if (strcmp (long_options[option_index].name, "audit-dir") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->audit_dir_arg), 
+                 &(args_info->audit_dir_orig), &(args_info->audit_dir_given),
+                &(local_args_info.audit_dir_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "audit-dir", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Días que se conserva la auditoría.  */
+          else if (strcmp (long_options[option_index].name, "audit-days") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->audit_days_arg), 
+                 &(args_info->audit_days_orig), &(args_info->audit_days_given),
+                &(local_args_info.audit_days_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "audit-days", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Buscar en la auditoría (IP o MAC).  */
+          else if (strcmp (long_options[option_index].name, "audit-query") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->audit_query_arg), 
+                 &(args_info->audit_query_orig), &(args_info->audit_query_given),
+                &(local_args_info.audit_query_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "audit-query", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Inicio de la búsqueda (AAAA-MM-DD[ HH:MM:SS]).  */
+          else if (strcmp (long_options[option_index].name, "audit-from") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->audit_from_arg), 
+                 &(args_info->audit_from_orig), &(args_info->audit_from_given),
+                &(local_args_info.audit_from_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "audit-from", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Fin de la búsqueda (AAAA-MM-DD[ HH:MM:SS]).  */
+          else if (strcmp (long_options[option_index].name, "audit-to") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->audit_to_arg), 
+                 &(args_info->audit_to_orig), &(args_info->audit_to_given),
+                &(local_args_info.audit_to_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "audit-to", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Nivel del registro (0-3, 3 = depuración).  */
+          else if (strcmp (long_options[option_index].name, "log-level") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->log_level_arg), 
+                 &(args_info->log_level_orig), &(args_info->log_level_given),
+                &(local_args_info.log_level_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "log-level", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Depuración de 1 de cada N paquetes.  */
+          else if (strcmp (long_options[option_index].name, "log-sample") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->log_sample_arg), 
+                 &(args_info->log_sample_orig), &(args_info->log_sample_given),
+                &(local_args_info.log_sample_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "log-sample", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Prueba del registro (N eventos).  */
+          else if (strcmp (long_options[option_index].name, "log-bench") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->log_bench_arg), 
+                 &(args_info->log_bench_orig), &(args_info->log_bench_given),
+                &(local_args_info.log_bench_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "log-bench", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Métricas (puerto local o unix:ruta).  */
+          else if (strcmp (long_options[option_index].name, "metrics") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->metrics_arg), 
+                 &(args_info->metrics_orig), &(args_info->metrics_given),
+                &(local_args_info.metrics_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "metrics", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Registrar intercambios de más de N ms.  */
+          else if (strcmp (long_options[option_index].name, "trace-slow") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->trace_slow_arg), 
+                 &(args_info->trace_slow_orig), &(args_info->trace_slow_given),
+                &(local_args_info.trace_slow_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "trace-slow", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Captura pcapng de los mensajes DHCP.  */
+          else if (strcmp (long_options[option_index].name, "capture") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->capture_arg), 
+                 &(args_info->capture_orig), &(args_info->capture_given),
+                &(local_args_info.capture_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "capture", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Filtro: mac=M,xid=X,type=T1|T2.  */
+          else if (strcmp (long_options[option_index].name, "capture-filter") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->capture_filter_arg), 
+                 &(args_info->capture_filter_orig), &(args_info->capture_filter_given),
+                &(local_args_info.capture_filter_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "capture-filter", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Empezar con la captura encendida.  */
+          else if (strcmp (long_options[option_index].name, "capture-start") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->capture_start_given),
+                &(local_args_info.capture_start_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "capture-start", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Perfil de ciclos por etapa (SIGRTMIN+1).  */
+          else if (strcmp (long_options[option_index].name, "profile") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->profile_given),
+                &(local_args_info.profile_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "profile", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Socket Unix de control (ruta).  */
+          else if (strcmp (long_options[option_index].name, "control") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->control_arg), 
+                 &(args_info->control_orig), &(args_info->control_given),
+                &(local_args_info.control_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "control", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Prever la memoria y salir.  */
+          else if (strcmp (long_options[option_index].name, "memory-plan") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->memory_plan_given),
+                &(local_args_info.memory_plan_given), optarg, 0, 0, ARG_NO,
+                check_ambiguity, override, 0, 0,
+                "memory-plan", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Anillo de eventos en memoria compartida.  */
+          else if (strcmp (long_options[option_index].name, "lease-events") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->lease_events_arg), 
+                 &(args_info->lease_events_orig), &(args_info->lease_events_given),
+                &(local_args_info.lease_events_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "lease-events", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Prueba del anillo de eventos (N eventos).  */
+          else if (strcmp (long_options[option_index].name, "events-bench") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->events_bench_arg), 
+                 &(args_info->events_bench_orig), &(args_info->events_bench_given),
+                &(local_args_info.events_bench_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "events-bench", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Gancho de concesiones (programa o módulo .so).  */
+          else if (strcmp (long_options[option_index].name, "hook") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->hook_arg), 
+                 &(args_info->hook_orig), &(args_info->hook_given),
+                &(local_args_info.hook_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "hook", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Hilos que ejecutan los ganchos (1-16).  */
+          else if (strcmp (long_options[option_index].name, "hook-workers") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->hook_workers_arg), 
+                 &(args_info->hook_workers_orig), &(args_info->hook_workers_given),
+                &(local_args_info.hook_workers_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "hook-workers", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Eventos por invocación del gancho (1-1024).  */
+          else if (strcmp (long_options[option_index].name, "hook-batch") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->hook_batch_arg), 
+                 &(args_info->hook_batch_orig), &(args_info->hook_batch_given),
+                &(local_args_info.hook_batch_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "hook-batch", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Tiempo máximo de cada invocación (ms).  */
+          else if (strcmp (long_options[option_index].name, "hook-timeout") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->hook_timeout_arg), 
+                 &(args_info->hook_timeout_orig), &(args_info->hook_timeout_given),
+                &(local_args_info.hook_timeout_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "hook-timeout", '-',
+                additional_error))
+              goto failure;
+          
           }
           
           break;
@@ -1180,11 +2056,41 @@ cmdline_parser_internal (
     &(args_info->range_orig), args_info->range_given,
     local_args_info.range_given, 0,
     ARG_STRING, range_list);
+  update_multiple_arg((void *)&(args_info->class_arg),
+    &(args_info->class_orig), args_info->class_given,
+    local_args_info.class_given, 0,
+    ARG_STRING, class_list);
+  update_multiple_arg((void *)&(args_info->class_range_arg),
+    &(args_info->class_range_orig), args_info->class_range_given,
+    local_args_info.class_range_given, 0,
+    ARG_STRING, class_range_list);
+  update_multiple_arg((void *)&(args_info->class_option_arg),
+    &(args_info->class_option_orig), args_info->class_option_given,
+    local_args_info.class_option_given, 0,
+    ARG_STRING, class_option_list);
+  update_multiple_arg((void *)&(args_info->boot_arg),
+    &(args_info->boot_orig), args_info->boot_given,
+    local_args_info.boot_given, 0,
+    ARG_STRING, boot_list);
+  update_multiple_arg((void *)&(args_info->import_arg),
+    &(args_info->import_orig), args_info->import_given,
+    local_args_info.import_given, 0,
+    ARG_STRING, import_list);
 
   args_info->dns_given += local_args_info.dns_given;
   local_args_info.dns_given = 0;
   args_info->range_given += local_args_info.range_given;
   local_args_info.range_given = 0;
+  args_info->class_given += local_args_info.class_given;
+  local_args_info.class_given = 0;
+  args_info->class_range_given += local_args_info.class_range_given;
+  local_args_info.class_range_given = 0;
+  args_info->class_option_given += local_args_info.class_option_given;
+  local_args_info.class_option_given = 0;
+  args_info->boot_given += local_args_info.boot_given;
+  local_args_info.boot_given = 0;
+  args_info->import_given += local_args_info.import_given;
+  local_args_info.import_given = 0;
   
   if (check_required)
     {
@@ -1201,6 +2107,11 @@ cmdline_parser_internal (
 failure:
   free_list (dns_list, 1 );
   free_list (range_list, 1 );
+  free_list (class_list, 1 );
+  free_list (class_range_list, 1 );
+  free_list (class_option_list, 1 );
+  free_list (boot_list, 1 );
+  free_list (import_list, 1 );
   
   cmdline_parser_release (&local_args_info);
   return (EXIT_FAILURE);
@@ -83,6 +83,127 @@ struct gengetopt_args_info
   int timeout_arg;	/**< @brief Tiempo de espera para cada msg.  */
   char * timeout_orig;	/**< @brief Tiempo de espera para cada msg original value given at command line.  */
   const char *timeout_help; /**< @brief Tiempo de espera para cada msg help description.  */
+  char ** class_arg;	/**< @brief Regla de clase (nombre:campo:tipo:patrón).  */
+  char ** class_orig;	/**< @brief Regla de clase (nombre:campo:tipo:patrón) original value given at command line.  */
+  unsigned int class_min; /**< @brief Regla de clase (nombre:campo:tipo:patrón)'s minimum occurreces */
+  unsigned int class_max; /**< @brief Regla de clase (nombre:campo:tipo:patrón)'s maximum occurreces */
+  const char *class_help; /**< @brief Regla de clase (nombre:campo:tipo:patrón) help description.  */
+  char ** class_range_arg;	/**< @brief Rango de una clase (nombre:ip-ip).  */
+  char ** class_range_orig;	/**< @brief Rango de una clase (nombre:ip-ip) original value given at command line.  */
+  unsigned int class_range_min; /**< @brief Rango de una clase (nombre:ip-ip)'s minimum occurreces */
+  unsigned int class_range_max; /**< @brief Rango de una clase (nombre:ip-ip)'s maximum occurreces */
+  const char *class_range_help; /**< @brief Rango de una clase (nombre:ip-ip) help description.  */
+  char ** class_option_arg;	/**< @brief Opción de una clase (nombre:código:tipo:valor).  */
+  char ** class_option_orig;	/**< @brief Opción de una clase (nombre:código:tipo:valor) original value given at command line.  */
+  unsigned int class_option_min; /**< @brief Opción de una clase (nombre:código:tipo:valor)'s minimum occurreces */
+  unsigned int class_option_max; /**< @brief Opción de una clase (nombre:código:tipo:valor)'s maximum occurreces */
+  const char *class_option_help; /**< @brief Opción de una clase (nombre:código:tipo:valor) help description.  */
+  char ** boot_arg;	/**< @brief Arranque por red (clase:arq:next-server:archivo).  */
+  char ** boot_orig;	/**< @brief Arranque por red (clase:arq:next-server:archivo) original value given at command line.  */
+  unsigned int boot_min; /**< @brief Arranque por red (clase:arq:next-server:archivo)'s minimum occurreces */
+  unsigned int boot_max; /**< @brief Arranque por red (clase:arq:next-server:archivo)'s maximum occurreces */
+  const char *boot_help; /**< @brief Arranque por red (clase:arq:next-server:archivo) help description.  */
+  int codec_bench_arg;	/**< @brief Prueba de rendimiento del codec (N mensajes).  */
+  char * codec_bench_orig;	/**< @brief Prueba de rendimiento del codec (N mensajes) original value given at command line.  */
+  const char *codec_bench_help; /**< @brief Prueba de rendimiento del codec (N mensajes) help description.  */
+  char * journal_arg;	/**< @brief Bitácora de concesiones (archivo).  */
+  char * journal_orig;	/**< @brief Bitácora de concesiones (archivo) original value given at command line.  */
+  const char *journal_help; /**< @brief Bitácora de concesiones (archivo) help description.  */
+  char * lease_db_arg;	/**< @brief Base de concesiones mapeada (archivo).  */
+  char * lease_db_orig;	/**< @brief Base de concesiones mapeada (archivo) original value given at command line.  */
+  const char *lease_db_help; /**< @brief Base de concesiones mapeada (archivo) help description.  */
+  char * lease_view_arg;	/**< @brief Vista de concesiones en memoria compartida.  */
+  char * lease_view_orig;	/**< @brief Vista de concesiones en memoria compartida original value given at command line.  */
+  const char *lease_view_help; /**< @brief Vista de concesiones en memoria compartida help description.  */
+  int compact_interval_arg;	/**< @brief Segundos entre compactaciones (0 = nunca).  */
+  char * compact_interval_orig;	/**< @brief Segundos entre compactaciones (0 = nunca) original value given at command line.  */
+  const char *compact_interval_help; /**< @brief Segundos entre compactaciones (0 = nunca) help description.  */
+  int compact_size_arg;	/**< @brief MB que crece la bitácora antes de compactar.  */
+  char * compact_size_orig;	/**< @brief MB que crece la bitácora antes de compactar original value given at command line.  */
+  const char *compact_size_help; /**< @brief MB que crece la bitácora antes de compactar help description.  */
+  int recover_bench_arg;	/**< @brief Prueba de recuperación (N registros).  */
+  char * recover_bench_orig;	/**< @brief Prueba de recuperación (N registros) original value given at command line.  */
+  const char *recover_bench_help; /**< @brief Prueba de recuperación (N registros) help description.  */
+  char ** import_arg;	/**< @brief Importar concesiones de ISC dhcpd o Kea.  */
+  char ** import_orig;	/**< @brief Importar concesiones de ISC dhcpd o Kea original value given at command line.  */
+  unsigned int import_min; /**< @brief Importar concesiones de ISC dhcpd o Kea's minimum occurreces */
+  unsigned int import_max; /**< @brief Importar concesiones de ISC dhcpd o Kea's maximum occurreces */
+  const char *import_help; /**< @brief Importar concesiones de ISC dhcpd o Kea help description.  */
+  int journal_shards_arg;	/**< @brief Particiones de la bitácora (1-16).  */
+  char * journal_shards_orig;	/**< @brief Particiones de la bitácora (1-16) original value given at command line.  */
+  const char *journal_shards_help; /**< @brief Particiones de la bitácora (1-16) help description.  */
+  char * export_arg;	/**< @brief Exportar concesiones (archivo o unix:ruta).  */
+  char * export_orig;	/**< @brief Exportar concesiones (archivo o unix:ruta) original value given at command line.  */
+  const char *export_help; /**< @brief Exportar concesiones (archivo o unix:ruta) help description.  */
+  char * export_format_arg;	/**< @brief Formato de exportación: csv, json o binary.  */
+  char * export_format_orig;	/**< @brief Formato de exportación: csv, json o binary original value given at command line.  */
+  const char *export_format_help; /**< @brief Formato de exportación: csv, json o binary help description.  */
+  int export_interval_arg;	/**< @brief Segundos entre exportaciones.  */
+  char * export_interval_orig;	/**< @brief Segundos entre exportaciones original value given at command line.  */
+  const char *export_interval_help; /**< @brief Segundos entre exportaciones help description.  */
+  int export_bench_arg;	/**< @brief Prueba de exportación (N concesiones).  */
+  char * export_bench_orig;	/**< @brief Prueba de exportación (N concesiones) original value given at command line.  */
+  const char *export_bench_help; /**< @brief Prueba de exportación (N concesiones) help description.  */
+  char * audit_dir_arg;	/**< @brief Directorio del registro de auditoría.  */
+  char * audit_dir_orig;	/**< @brief Directorio del registro de auditoría original value given at command line.  */
+  const char *audit_dir_help; /**< @brief Directorio del registro de auditoría help description.  */
+  int audit_days_arg;	/**< @brief Días que se conserva la auditoría.  */
+  char * audit_days_orig;	/**< @brief Días que se conserva la auditoría original value given at command line.  */
+  const char *audit_days_help; /**< @brief Días que se conserva la auditoría help description.  */
+  char * audit_query_arg;	/**< @brief Buscar en la auditoría (IP o MAC).  */
+  char * audit_query_orig;	/**< @brief Buscar en la auditoría (IP o MAC) original value given at command line.  */
+  const char *audit_query_help; /**< @brief Buscar en la auditoría (IP o MAC) help description.  */
+  char * audit_from_arg;	/**< @brief Inicio de la búsqueda (AAAA-MM-DD[ HH:MM:SS]).  */
+  char * audit_from_orig;	/**< @brief Inicio de la búsqueda (AAAA-MM-DD[ HH:MM:SS]) original value given at command line.  */
+  const char *audit_from_help; /**< @brief Inicio de la búsqueda (AAAA-MM-DD[ HH:MM:SS]) help description.  */
+  char * audit_to_arg;	/**< @brief Fin de la búsqueda (AAAA-MM-DD[ HH:MM:SS]).  */
+  char * audit_to_orig;	/**< @brief Fin de la búsqueda (AAAA-MM-DD[ HH:MM:SS]) original value given at command line.  */
+  const char *audit_to_help; /**< @brief Fin de la búsqueda (AAAA-MM-DD[ HH:MM:SS]) help description.  */
+  int log_level_arg;	/**< @brief Nivel del registro (0-3, 3 = depuración).  */
+  char * log_level_orig;	/**< @brief Nivel del registro (0-3, 3 = depuración) original value given at command line.  */
+  const char *log_level_help; /**< @brief Nivel del registro (0-3, 3 = depuración) help description.  */
+  int log_sample_arg;	/**< @brief Depuración de 1 de cada N paquetes.  */
+  char * log_sample_orig;	/**< @brief Depuración de 1 de cada N paquetes original value given at command line.  */
+  const char *log_sample_help; /**< @brief Depuración de 1 de cada N paquetes help description.  */
+  int log_bench_arg;	/**< @brief Prueba del registro (N eventos).  */
+  char * log_bench_orig;	/**< @brief Prueba del registro (N eventos) original value given at command line.  */
+  const char *log_bench_help; /**< @brief Prueba del registro (N eventos) help description.  */
+  char * metrics_arg;	/**< @brief Métricas (puerto local o unix:ruta).  */
+  char * metrics_orig;	/**< @brief Métricas (puerto local o unix:ruta) original value given at command line.  */
+  const char *metrics_help; /**< @brief Métricas (puerto local o unix:ruta) help description.  */
+  int trace_slow_arg;	/**< @brief Registrar intercambios de más de N ms.  */
+  char * trace_slow_orig;	/**< @brief Registrar intercambios de más de N ms original value given at command line.  */
+  const char *trace_slow_help; /**< @brief Registrar intercambios de más de N ms help description.  */
+  char * capture_arg;	/**< @brief Captura pcapng de los mensajes DHCP.  */
+  char * capture_orig;	/**< @brief Captura pcapng de los mensajes DHCP original value given at command line.  */
+  const char *capture_help; /**< @brief Captura pcapng de los mensajes DHCP help description.  */
+  char * capture_filter_arg;	/**< @brief Filtro: mac=M,xid=X,type=T1|T2.  */
+  char * capture_filter_orig;	/**< @brief Filtro: mac=M,xid=X,type=T1|T2 original value given at command line.  */
+  const char *capture_filter_help; /**< @brief Filtro: mac=M,xid=X,type=T1|T2 help description.  */
+  const char *capture_start_help; /**< @brief Empezar con la captura encendida help description.  */
+  const char *profile_help; /**< @brief Perfil de ciclos por etapa (SIGRTMIN+1) help description.  */
+  char * control_arg;	/**< @brief Socket Unix de control (ruta).  */
+  char * control_orig;	/**< @brief Socket Unix de control (ruta) original value given at command line.  */
+  const char *control_help; /**< @brief Socket Unix de control (ruta) help description.  */
+  const char *memory_plan_help; /**< @brief Prever la memoria y salir help description.  */
+  char * lease_events_arg;	/**< @brief Anillo de eventos en memoria compartida.  */
+  char * lease_events_orig;	/**< @brief Anillo de eventos en memoria compartida original value given at command line.  */
+  const char *lease_events_help; /**< @brief Anillo de eventos en memoria compartida help description.  */
+  int events_bench_arg;	/**< @brief Prueba del anillo de eventos (N eventos).  */
+  char * events_bench_orig;	/**< @brief Prueba del anillo de eventos (N eventos) original value given at command line.  */
+  const char *events_bench_help; /**< @brief Prueba del anillo de eventos (N eventos) help description.  */
+  char * hook_arg;	/**< @brief Gancho de concesiones (programa o módulo .so).  */
+  char * hook_orig;	/**< @brief Gancho de concesiones (programa o módulo .so) original value given at command line.  */
+  const char *hook_help; /**< @brief Gancho de concesiones (programa o módulo .so) help description.  */
+  int hook_workers_arg;	/**< @brief Hilos que ejecutan los ganchos (1-16).  */
+  char * hook_workers_orig;	/**< @brief Hilos que ejecutan los ganchos (1-16) original value given at command line.  */
+  const char *hook_workers_help; /**< @brief Hilos que ejecutan los ganchos (1-16) help description.  */
+  int hook_batch_arg;	/**< @brief Eventos por invocación del gancho (1-1024).  */
+  char * hook_batch_orig;	/**< @brief Eventos por invocación del gancho (1-1024) original value given at command line.  */
+  const char *hook_batch_help; /**< @brief Eventos por invocación del gancho (1-1024) help description.  */
+  int hook_timeout_arg;	/**< @brief Tiempo máximo de cada invocación (ms).  */
+  char * hook_timeout_orig;	/**< @brief Tiempo máximo de cada invocación (ms) original value given at command line.  */
+  const char *hook_timeout_help; /**< @brief Tiempo máximo de cada invocación (ms) help description.  */
   
   unsigned int help_given ;	/**< @brief Whether help was given.  */
   unsigned int version_given ;	/**< @brief Whether version was given.  */
@@ -100,6 +221,45 @@ struct gengetopt_args_info
   unsigned int t3_given ;	/**< @brief Whether t3 was given.  */
   unsigned int gateway_given ;	/**< @brief Whether gateway was given.  */
   unsigned int timeout_given ;	/**< @brief Whether timeout was given.  */
+  unsigned int class_given ;	/**< @brief Whether class was given.  */
+  unsigned int class_range_given ;	/**< @brief Whether class-range was given.  */
+  unsigned int class_option_given ;	/**< @brief Whether class-option was given.  */
+  unsigned int boot_given ;	/**< @brief Whether boot was given.  */
+  unsigned int codec_bench_given ;	/**< @brief Whether codec-bench was given.  */
+  unsigned int journal_given ;	/**< @brief Whether journal was given.  */
+  unsigned int lease_db_given ;	/**< @brief Whether lease-db was given.  */
+  unsigned int lease_view_given ;	/**< @brief Whether lease-view was given.  */
+  unsigned int compact_interval_given ;	/**< @brief Whether compact-interval was given.  */
+  unsigned int compact_size_given ;	/**< @brief Whether compact-size was given.  */
+  unsigned int recover_bench_given ;	/**< @brief Whether recover-bench was given.  */
+  unsigned int import_given ;	/**< @brief Whether import was given.  */
+  unsigned int journal_shards_given ;	/**< @brief Whether journal-shards was given.  */
+  unsigned int export_given ;	/**< @brief Whether export was given.  */
+  unsigned int export_format_given ;	/**< @brief Whether export-format was given.  */
+  unsigned int export_interval_given ;	/**< @brief Whether export-interval was given.  */
+  unsigned int export_bench_given ;	/**< @brief Whether export-bench was given.  */
+  unsigned int audit_dir_given ;	/**< @brief Whether audit-dir was given.  */
+  unsigned int audit_days_given ;	/**< @brief Whether audit-days was given.  */
+  unsigned int audit_query_given ;	/**< @brief Whether audit-query was given.  */
+  unsigned int audit_from_given ;	/**< @brief Whether audit-from was given.  */
+  unsigned int audit_to_given ;	/**< @brief Whether audit-to was given.  */
+  unsigned int log_level_given ;	/**< @brief Whether log-level was given.  */
+  unsigned int log_sample_given ;	/**< @brief Whether log-sample was given.  */
+  unsigned int log_bench_given ;	/**< @brief Whether log-bench was given.  */
+  unsigned int metrics_given ;	/**< @brief Whether metrics was given.  */
+  unsigned int trace_slow_given ;	/**< @brief Whether trace-slow was given.  */
+  unsigned int capture_given ;	/**< @brief Whether capture was given.  */
+  unsigned int capture_filter_given ;	/**< @brief Whether capture-filter was given.  */
+  unsigned int capture_start_given ;	/**< @brief Whether capture-start was given.  */
+  unsigned int profile_given ;	/**< @brief Whether profile was given.  */
+  unsigned int control_given ;	/**< @brief Whether control was given.  */
+  unsigned int memory_plan_given ;	/**< @brief Whether memory-plan was given.  */
+  unsigned int lease_events_given ;	/**< @brief Whether lease-events was given.  */
+  unsigned int events_bench_given ;	/**< @brief Whether events-bench was given.  */
+  unsigned int hook_given ;	/**< @brief Whether hook was given.  */
+  unsigned int hook_workers_given ;	/**< @brief Whether hook-workers was given.  */
+  unsigned int hook_batch_given ;	/**< @brief Whether hook-batch was given.  */
+  unsigned int hook_timeout_given ;	/**< @brief Whether hook-timeout was given.  */
 
 } ;
 
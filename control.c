@@ -0,0 +1,257 @@
+#define _GNU_SOURCE  // accept4()
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "control.h"
+#include "memuse.h"
+
+static void control_reset ( control_client *cl ) {
+    memuse_free ( MEMUSE_OTHER, cl->state );
+    cl->state   = NULL;
+    cl->fill    = NULL;
+    cl->out_pos = cl->out_len = 0;
+}
+
+static void control_drop ( control_client *cl ) {
+    close ( cl->fd );
+    cl->fd     = -1;
+    cl->in_len = 0;
+    cl->skip   = 0;
+    control_reset ( cl );
+}
+
+void control_printf ( control_client *cl, const char *fmt, ... ) {
+    va_list ap;
+    int     n;
+
+    if ( cl->out_len >= CONTROL_OUT_SIZE )
+        return;
+    va_start ( ap, fmt );
+    n = vsnprintf ( cl->out + cl->out_len, CONTROL_OUT_SIZE - cl->out_len, fmt, ap );
+    va_end ( ap );
+    cl->out_len = n < 0 || cl->out_len + n > CONTROL_OUT_SIZE ? CONTROL_OUT_SIZE : cl->out_len + n;
+}
+
+// Deja la respuesta en curso a cargo de fill, que empieza con cursor
+void control_stream ( control_client *cl, control_fill fill, u_int64_t cursor, u_int64_t end, u_int64_t arg ) {
+    cl->fill   = fill;
+    cl->cursor = cursor;
+    cl->end    = end;
+    cl->arg    = arg;
+}
+
+// Envía lo pendiente y produce más si hay fill. Regresa 1 si la respuesta
+// salió completa y 0 si hay que esperar a que el cliente lea (o se cerró).
+static int control_flush ( control *c, control_client *cl ) {
+    for ( ;; ) {
+        if ( cl->out_pos == cl->out_len ) {
+            cl->out_pos = cl->out_len = 0;
+            if ( !cl->fill ) {
+                control_reset ( cl );
+                return 1;
+            }
+            while ( cl->fill && c->fills > 0 && CONTROL_OUT_SIZE - cl->out_len >= CONTROL_FILL_MIN ) {
+                cl->out_len += cl->fill ( c->ctx, cl, cl->out + cl->out_len, CONTROL_OUT_SIZE - cl->out_len );
+                --c->fills;
+            }
+            if ( !cl->out_len )
+                return 0;  // la respuesta sigue en la siguiente ronda
+            continue;
+        }
+
+        ssize_t n = send ( cl->fd, cl->out + cl->out_pos, cl->out_len - cl->out_pos, MSG_DONTWAIT | MSG_NOSIGNAL );
+
+        if ( n == -1 && errno == EINTR )
+            continue;
+        if ( n == -1 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            return 0;
+        if ( n <= 0 ) {
+            control_drop ( cl );
+            return 0;
+        }
+        cl->out_pos += n;
+    }
+}
+
+// Atiende las líneas completas que haya, una respuesta a la vez
+static void control_serve ( control *c, control_client *cl ) {
+    char *nl;
+
+    while ( control_flush ( c, cl ) ) {
+        if ( !( nl = memchr ( cl->in, '\n', cl->in_len ) ) ) {
+            if ( cl->in_len < CONTROL_LINE_MAX )
+                return;
+            if ( !cl->skip )
+                control_printf ( cl, "ERR línea demasiado larga\n.\n" );
+            cl->skip   = 1;
+            cl->in_len = 0;
+            continue;
+        }
+
+        *nl = '\0';
+        if ( nl > cl->in && nl[-1] == '\r' )
+            nl[-1] = '\0';
+        if ( cl->skip )
+            cl->skip = 0;
+        else {
+            c->handler ( c->ctx, cl, cl->in );
+            if ( !cl->fill )
+                control_printf ( cl, ".\n" );
+        }
+
+        cl->in_len -= nl + 1 - cl->in;
+        memmove ( cl->in, nl + 1, cl->in_len );
+    }
+}
+
+static void control_read ( control *c, control_client *cl ) {
+    ssize_t n = recv ( cl->fd, cl->in + cl->in_len, CONTROL_LINE_MAX - cl->in_len, MSG_DONTWAIT );
+
+    if ( n == -1 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+        return;
+    if ( n <= 0 ) {
+        control_drop ( cl );
+        return;
+    }
+    cl->in_len += n;
+    control_serve ( c, cl );
+}
+
+static void control_accept ( control *c ) {
+    int fd, sndbuf = CONTROL_SNDBUF;
+
+    while ( ( fd = accept4 ( c->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC ) ) != -1 ) {
+        control_client *cl = NULL;
+
+        for ( int i = 0; i < CONTROL_CLIENTS_MAX && !cl; ++i )
+            if ( c->clients[i].fd == -1 )
+                cl = &c->clients[i];
+        if ( !cl ) {
+            close ( fd );  // sin lugar; el cliente ve el cierre
+            continue;
+        }
+        // Un búfer del kernel grande deja salir más de una respuesta larga
+        // por ronda, sin esperar a la siguiente vuelta del ciclo
+        setsockopt ( fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof ( sndbuf ) );
+        cl->fd     = fd;
+        cl->in_len = 0;
+        cl->skip   = 0;
+        control_reset ( cl );
+    }
+}
+
+// Crea el socket en path; handler atiende cada línea con ctx. Regresa 0 con
+// errno si falla.
+int control_open ( control *c, const char *path, control_handler handler, void *ctx ) {
+    struct sockaddr_un addr;
+    int                err;
+
+    memset ( c, 0, sizeof ( control ) );
+    c->fd      = -1;
+    c->handler = handler;
+    c->ctx     = ctx;
+    for ( int i = 0; i < CONTROL_CLIENTS_MAX; ++i )
+        c->clients[i].fd = -1;
+
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.sun_family = AF_UNIX;
+    if ( strlen ( path ) >= sizeof ( addr.sun_path ) ) {
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    strcpy ( addr.sun_path, path );
+
+    // Se reservan ahora los búferes de salida de todos los clientes
+    for ( int i = 0; i < CONTROL_CLIENTS_MAX; ++i )
+        if ( !( c->clients[i].out = memuse_malloc ( MEMUSE_OTHER, CONTROL_OUT_SIZE ) ) )
+            goto fail;
+    if ( !( c->path = strdup ( path ) ) )
+        goto fail;
+
+    unlink ( path );
+    if ( ( c->fd = socket ( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 ) ) == -1
+         || bind ( c->fd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) == -1 || chmod ( path, 0660 ) == -1
+         || listen ( c->fd, CONTROL_CLIENTS_MAX ) == -1 )
+        goto fail;
+    return 1;
+
+fail:
+    err = errno;
+    control_close ( c );
+    errno = err;
+    return 0;
+}
+
+// Llena fds con el socket que escucha y un lugar por cliente (fd -1 si está
+// libre): entrada si espera una petición, salida si tiene respuesta
+// pendiente. Regresa cuántos usó, 1 + CONTROL_CLIENTS_MAX.
+int control_pollfds ( control *c, struct pollfd *fds ) {
+    fds[0].fd     = c->fd;
+    fds[0].events = POLLIN;
+    for ( int i = 0; i < CONTROL_CLIENTS_MAX; ++i ) {
+        const control_client *cl = &c->clients[i];
+
+        fds[1 + i].fd     = cl->fd;
+        fds[1 + i].events = cl->fill || cl->out_pos != cl->out_len ? POLLOUT : POLLIN;
+    }
+    return 1 + CONTROL_CLIENTS_MAX;
+}
+
+// Algún cliente tiene respuesta pendiente
+int control_pending ( control *c ) {
+    for ( int i = 0; i < CONTROL_CLIENTS_MAX; ++i )
+        if ( c->clients[i].fd != -1 && ( c->clients[i].fill || c->clients[i].out_pos != c->clients[i].out_len ) )
+            return 1;
+    return 0;
+}
+
+// Una ronda sin espera: conexiones nuevas, peticiones y respuestas
+void control_run ( control *c ) {
+    struct pollfd fds[1 + CONTROL_CLIENTS_MAX];
+    int           n = control_pollfds ( c, fds );
+
+    if ( c->fd == -1 || poll ( fds, n, 0 ) <= 0 )
+        return;
+    c->fills = CONTROL_RUN_FILLS;
+
+    if ( fds[0].revents & POLLIN )
+        control_accept ( c );
+
+    for ( int i = 0; i < CONTROL_CLIENTS_MAX; ++i ) {
+        control_client *cl      = &c->clients[i];
+        short           revents = fds[1 + i].revents;
+
+        if ( cl->fd == -1 || fds[1 + i].fd != cl->fd || !revents )
+            continue;
+        if ( revents & POLLIN )
+            control_read ( c, cl );
+        else if ( revents & POLLOUT )
+            control_serve ( c, cl );
+        else
+            control_drop ( cl );  // POLLERR o POLLHUP sin nada que leer
+    }
+}
+
+void control_close ( control *c ) {
+    if ( !c->handler )
+        return;
+
+    for ( int i = 0; i < CONTROL_CLIENTS_MAX; ++i ) {
+        if ( c->clients[i].fd != -1 )
+            control_drop ( &c->clients[i] );
+        memuse_free ( MEMUSE_OTHER, c->clients[i].out );
+    }
+    if ( c->fd != -1 )
+        close ( c->fd );
+    if ( c->path )
+        unlink ( c->path );
+    free ( c->path );
+    memset ( c, 0, sizeof ( control ) );
+    c->fd = -1;
+}
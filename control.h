@@ -0,0 +1,77 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Socket Unix de control con un protocolo de líneas.
+ *
+ * Cada petición es una línea de texto; la respuesta empieza con "OK" o
+ * "ERR <motivo>", sigue con cero o más líneas de datos y termina con una
+ * línea ".". Un cliente puede mandar varias peticiones; se responden en
+ * orden.
+ *
+ * Todo corre en el hilo del ciclo de paquetes, así que se puede leer y
+ * cambiar la tabla de concesiones sin candados, pero nada bloquea: los
+ * sockets son no bloqueantes y control_run() hace una sola ronda con lo que
+ * esté listo (un poll() sin espera). Una respuesta larga no se arma
+ * completa: su función fill la produce por partes en el búfer de salida del
+ * cliente conforme éste lo vacía. Una ronda hace a lo más CONTROL_RUN_FILLS
+ * llamadas a fill entre todos los clientes; como cada llamada recorre un
+ * tramo acotado de la tabla, eso acota lo que una ronda le quita al ciclo
+ * aunque la respuesta casi no produzca bytes.
+ */
+
+#define CONTROL_CLIENTS_MAX 8
+#define CONTROL_LINE_MAX 256
+#define CONTROL_OUT_SIZE ( 1 << 16 )
+#define CONTROL_FILL_MIN ( 1 << 14 )  // espacio libre con el que se llama a fill
+#define CONTROL_RUN_FILLS 16  // por ronda, entre todos los clientes
+#define CONTROL_SNDBUF ( 1 << 22 )  // SO_SNDBUF de cada cliente
+
+typedef struct control_client control_client;
+
+// Escribe en buf (size bytes libres, al menos CONTROL_FILL_MIN) la siguiente
+// parte de la respuesta y regresa cuántos bytes usó; al terminar escribe la
+// línea "." final y pone fill en NULL
+typedef size_t ( *control_fill ) ( void *ctx, control_client *cl, char *buf, size_t size );
+
+// Atiende una línea de petición (sin el fin de línea)
+typedef void ( *control_handler ) ( void *ctx, control_client *cl, char *line );
+
+struct control_client {
+    int          fd;  // -1 = libre
+    size_t       in_len;
+    int          skip;  // descartando el resto de una línea demasiado larga
+    char         in[CONTROL_LINE_MAX];
+    char *       out;
+    size_t       out_pos;
+    size_t       out_len;
+    control_fill fill;  // respuesta en curso, NULL si ya se produjo toda
+    u_int64_t    cursor;  // estado de fill
+    u_int64_t    end;
+    u_int64_t    arg;
+    void *       state;  // memoria de fill; se libera al terminar la respuesta
+};
+
+typedef struct control {
+    int             fd;  // socket que escucha, -1 sin control
+    char *          path;
+    control_handler handler;
+    void *          ctx;
+    int             fills;  // llamadas a fill que quedan en esta ronda
+    control_client  clients[CONTROL_CLIENTS_MAX];
+} control;
+
+int  control_open ( control *c, const char *path, control_handler handler, void *ctx );
+int  control_pollfds ( control *c, struct pollfd *fds );
+int  control_pending ( control *c );
+void control_run ( control *c );
+void control_printf ( control_client *cl, const char *fmt, ... ) __attribute__ ( ( format ( printf, 2, 3 ) ) );
+void control_stream ( control_client *cl, control_fill fill, u_int64_t cursor, u_int64_t end, u_int64_t arg );
+void control_close ( control *c );
+
+#endif  // CONTROL_H
@@ -0,0 +1,74 @@
+#include <pthread.h>
+#include <string.h>
+#include "crc32c.h"
+
+#if defined( __x86_64__ )
+#include <nmmintrin.h>
+#elif defined( __aarch64__ ) && defined( __ARM_FEATURE_CRC32 )
+#include <arm_acle.h>
+#endif
+
+#define CRC32C_POLY 0x82f63b78  // polinomio reflejado
+
+typedef u_int32_t ( *crc32c_fn ) ( u_int32_t crc, const u_char *p, size_t len );
+
+static u_int32_t      crc32c_table[256];
+static crc32c_fn      crc32c_impl;
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static u_int32_t crc32c_sw ( u_int32_t crc, const u_char *p, size_t len ) {
+    while ( len-- )
+        crc = crc32c_table[( crc ^ *p++ ) & 0xff] ^ ( crc >> 8 );
+    return crc;
+}
+
+#if defined( __x86_64__ )
+__attribute__ ( ( target ( "sse4.2" ) ) ) static u_int32_t crc32c_hw ( u_int32_t crc, const u_char *p, size_t len ) {
+    u_int64_t crc64 = crc, v;
+
+    for ( ; len >= 8; p += 8, len -= 8 ) {
+        memcpy ( &v, p, 8 );
+        crc64 = _mm_crc32_u64 ( crc64, v );
+    }
+    crc = crc64;
+    while ( len-- )
+        crc = _mm_crc32_u8 ( crc, *p++ );
+    return crc;
+}
+#elif defined( __aarch64__ ) && defined( __ARM_FEATURE_CRC32 )
+static u_int32_t crc32c_hw ( u_int32_t crc, const u_char *p, size_t len ) {
+    u_int64_t v;
+
+    for ( ; len >= 8; p += 8, len -= 8 ) {
+        memcpy ( &v, p, 8 );
+        crc = __crc32cd ( crc, v );
+    }
+    while ( len-- )
+        crc = __crc32cb ( crc, *p++ );
+    return crc;
+}
+#endif
+
+static void crc32c_init ( void ) {
+    for ( u_int32_t i = 0; i < 256; ++i ) {
+        u_int32_t c = i;
+
+        for ( int k = 0; k < 8; ++k )
+            c = c & 1 ? ( c >> 1 ) ^ CRC32C_POLY : c >> 1;
+        crc32c_table[i] = c;
+    }
+
+    crc32c_impl = crc32c_sw;
+#if defined( __x86_64__ )
+    if ( __builtin_cpu_supports ( "sse4.2" ) )
+        crc32c_impl = crc32c_hw;
+#elif defined( __aarch64__ ) && defined( __ARM_FEATURE_CRC32 )
+    crc32c_impl = crc32c_hw;
+#endif
+}
+
+// crc es el resultado de una llamada anterior para continuar, o 0
+u_int32_t crc32c ( u_int32_t crc, const void *data, size_t len ) {
+    pthread_once ( &crc32c_once, crc32c_init );
+    return ~crc32c_impl ( ~crc, data, len );
+}
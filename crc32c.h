@@ -0,0 +1,17 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * CRC32C (Castagnoli), el de iSCSI, ext4 y btrfs.
+ *
+ * Con SSE 4.2 (x86-64) o con la extensión CRC de ARMv8 se usa la instrucción
+ * del procesador, 8 bytes por instrucción; si no, una tabla de 256 entradas.
+ * La implementación se elige una sola vez, en la primera llamada.
+ */
+
+u_int32_t crc32c ( u_int32_t crc, const void *data, size_t len );
+
+#endif  // CRC32C_H
@@ -3,8 +3,46 @@ CONFIG += console
 CONFIG -= app_bundle
 CONFIG -= qt
 
+LIBS += -lpthread -ldl
+
 SOURCES += main.c \
-    cmdline.c
+    audit.c \
+    capture.c \
+    classify.c \
+    cmdline.c \
+    control.c \
+    crc32c.c \
+    eventring.c \
+    export.c \
+    hooks.c \
+    import.c \
+    journal.c \
+    leasedb.c \
+    leaseview.c \
+    logring.c \
+    memuse.c \
+    metrics.c \
+    profile.c \
+    strtab.c \
+    xtrace.c
 
 HEADERS += \
-    cmdline.h
+    audit.h \
+    capture.h \
+    classify.h \
+    cmdline.h \
+    control.h \
+    crc32c.h \
+    eventring.h \
+    export.h \
+    hooks.h \
+    import.h \
+    journal.h \
+    leasedb.h \
+    leaseview.h \
+    logring.h \
+    memuse.h \
+    metrics.h \
+    profile.h \
+    strtab.h \
+    xtrace.h
@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "eventring.h"
+#include "memuse.h"
+
+#define EVENTRING_VERSION 1
+
+// Crea (o reemplaza) el segmento name con el anillo vacío. Regresa 0 con
+// errno si falla.
+int eventring_create ( eventring *r, const char *name ) {
+    int fd, err;
+
+    memset ( r, 0, sizeof ( eventring ) );
+    r->size = EVENTRING_HEADER_SIZE + ( size_t ) EVENTRING_SLOTS * sizeof ( eventring_event );
+    if ( !( r->name = strdup ( name ) ) )
+        return 0;
+
+    // Un lector que aún tenga mapeado el segmento anterior lo conserva; los
+    // nuevos abren este
+    shm_unlink ( name );
+    if ( ( fd = shm_open ( name, O_RDWR | O_CREAT | O_EXCL, 0644 ) ) == -1 )
+        goto fail;
+    if ( ftruncate ( fd, r->size ) == -1 ) {
+        err = errno;
+        close ( fd );
+        shm_unlink ( name );
+        errno = err;
+        goto fail;
+    }
+
+    r->map = mmap ( NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0 );
+    err    = errno;
+    close ( fd );
+    if ( r->map == MAP_FAILED ) {
+        r->map = NULL;
+        shm_unlink ( name );
+        errno = err;
+        goto fail;
+    }
+    memuse_add ( MEMUSE_LOG, r->size );
+    r->hdr    = ( eventring_header * ) r->map;
+    r->events = ( eventring_event * ) ( r->map + EVENTRING_HEADER_SIZE );
+
+    memcpy ( r->hdr->magic, EVENTRING_MAGIC, sizeof ( r->hdr->magic ) );
+    r->hdr->version     = EVENTRING_VERSION;
+    r->hdr->header_size = EVENTRING_HEADER_SIZE;
+    r->hdr->rec_size    = sizeof ( eventring_event );
+    r->hdr->slots       = EVENTRING_SLOTS;
+    r->hdr->pid         = getpid ();
+    r->hdr->started     = time ( NULL );
+    return 1;
+
+fail:
+    err = errno;
+    free ( r->name );
+    r->name = NULL;
+    errno   = err;
+    return 0;
+}
+
+// Escribe el evento en la siguiente posición; solo lo llama el servidor,
+// desde un solo hilo. ev->seq se ignora.
+void eventring_publish ( eventring *r, const eventring_event *ev ) {
+    u_int64_t        pos  = r->hdr->head;
+    eventring_event *slot = &r->events[pos & ( EVENTRING_SLOTS - 1 )];
+
+    __atomic_store_n ( &slot->seq, 0, __ATOMIC_RELAXED );
+    __atomic_thread_fence ( __ATOMIC_RELEASE );
+
+    memcpy ( ( u_char * ) slot + sizeof ( slot->seq ), ( const u_char * ) ev + sizeof ( ev->seq ),
+             sizeof ( eventring_event ) - sizeof ( ev->seq ) );
+
+    __atomic_store_n ( &slot->seq, pos + 1, __ATOMIC_RELEASE );
+    __atomic_store_n ( &r->hdr->head, pos + 1, __ATOMIC_RELEASE );
+}
+
+void eventring_close ( eventring *r ) {
+    if ( r->map ) {
+        munmap ( r->map, r->size );
+        memuse_add ( MEMUSE_LOG, -( int64_t ) r->size );
+    }
+    if ( r->name )
+        shm_unlink ( r->name );
+    free ( r->name );
+    memset ( r, 0, sizeof ( eventring ) );
+}
+
+// Mapea en solo lectura el anillo que publica un servidor. Regresa 0 con
+// errno si falla; EINVAL si no es un anillo de esta versión.
+int eventring_attach ( eventring *r, const char *name ) {
+    struct stat st;
+    int         fd, err;
+
+    memset ( r, 0, sizeof ( eventring ) );
+    if ( ( fd = shm_open ( name, O_RDONLY, 0 ) ) == -1 )
+        return 0;
+    err = fstat ( fd, &st ) == -1 ? errno : ( size_t ) st.st_size < EVENTRING_HEADER_SIZE ? EINVAL : 0;
+    if ( err ) {
+        close ( fd );
+        errno = err;
+        return 0;
+    }
+
+    r->size = st.st_size;
+    r->map  = mmap ( NULL, r->size, PROT_READ, MAP_SHARED, fd, 0 );
+    err     = errno;
+    close ( fd );
+    if ( r->map == MAP_FAILED ) {
+        memset ( r, 0, sizeof ( eventring ) );
+        errno = err;
+        return 0;
+    }
+    r->hdr    = ( eventring_header * ) r->map;
+    r->events = ( eventring_event * ) ( r->map + EVENTRING_HEADER_SIZE );
+
+    if ( memcmp ( r->hdr->magic, EVENTRING_MAGIC, sizeof ( r->hdr->magic ) ) || r->hdr->version != EVENTRING_VERSION
+         || r->hdr->header_size != EVENTRING_HEADER_SIZE || r->hdr->rec_size != sizeof ( eventring_event )
+         || r->hdr->slots != EVENTRING_SLOTS
+         || r->size < EVENTRING_HEADER_SIZE + ( size_t ) EVENTRING_SLOTS * sizeof ( eventring_event ) ) {
+        eventring_detach ( r );
+        errno = EINVAL;
+        return 0;
+    }
+    return 1;
+}
+
+// Posición del siguiente evento que se escribirá; un lector que solo quiere
+// lo nuevo empieza aquí, uno que quiere lo que aún queda en el anillo empieza
+// EVENTRING_SLOTS antes
+u_int64_t eventring_head ( const eventring *r ) {
+    return __atomic_load_n ( &r->hdr->head, __ATOMIC_ACQUIRE );
+}
+
+// Copia en out hasta max eventos desde *cursor y lo avanza. Si el servidor ya
+// reescribió parte de lo pedido, salta al evento más viejo que sigue en el
+// anillo y suma a *lost los que faltaron. Regresa cuántos copió; 0 si no hay
+// eventos nuevos.
+size_t eventring_read ( const eventring *r, u_int64_t *cursor, eventring_event *out, size_t max, u_int64_t *lost ) {
+    u_int64_t head = eventring_head ( r );
+    size_t    count = 0;
+
+    while ( count < max && *cursor < head ) {
+        const eventring_event *slot = &r->events[*cursor & ( EVENTRING_SLOTS - 1 )];
+        u_int64_t              seq;
+
+        if ( head - *cursor > EVENTRING_SLOTS ) {
+            *lost += head - EVENTRING_SLOTS - *cursor;
+            *cursor = head - EVENTRING_SLOTS;
+            continue;
+        }
+
+        seq = __atomic_load_n ( &slot->seq, __ATOMIC_ACQUIRE );
+        if ( seq == *cursor + 1 ) {
+            memcpy ( &out[count], slot, sizeof ( eventring_event ) );
+            __atomic_thread_fence ( __ATOMIC_ACQUIRE );
+            if ( __atomic_load_n ( &slot->seq, __ATOMIC_RELAXED ) == seq ) {
+                ++count;
+                ++*cursor;
+                continue;
+            }
+        }
+
+        // El servidor ya está reescribiendo esta posición: el lector quedó
+        // una vuelta atrás; se vuelve a leer head y se salta lo perdido
+        head = eventring_head ( r );
+        if ( head - *cursor <= EVENTRING_SLOTS ) {
+            *lost += 1;
+            ++*cursor;
+        }
+    }
+    return count;
+}
+
+void eventring_detach ( eventring *r ) {
+    if ( r->map )
+        munmap ( r->map, r->size );
+    memset ( r, 0, sizeof ( eventring ) );
+}
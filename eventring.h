@@ -0,0 +1,83 @@
+#ifndef EVENTRING_H
+#define EVENTRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Anillo de eventos de concesiones en memoria compartida.
+ *
+ * El servidor crea un segmento POSIX (shm_open()) con un encabezado de una
+ * página y EVENTRING_SLOTS registros de tamaño fijo. Cada concesión que se
+ * otorga, renueva, libera, vence o se rechaza escribe un evento en la
+ * siguiente posición y avanza head; no hay llamadas al sistema ni espera por
+ * los lectores, así que un lector lento no frena al servidor.
+ *
+ * Los lectores (cualquier número, en otros procesos) mapean el segmento con
+ * PROT_READ y llevan cada uno su propio cursor: la posición absoluta del
+ * siguiente evento que quieren. El evento de la posición p vive en el
+ * registro p % EVENTRING_SLOTS y su seq vale p + 1 cuando está completo; el
+ * servidor lo pone en 0 mientras lo reescribe. Si el lector se queda más de
+ * EVENTRING_SLOTS atrás, los eventos se pierden: eventring_read() salta al
+ * más viejo que sigue en el anillo y cuenta cuántos faltaron. Un lector que
+ * no tenga nada que leer decide él si espera activamente o duerme.
+ *
+ * El segmento se borra al cerrar el servidor. Si el servidor terminó sin
+ * cerrarlo, el pid del encabezado ya no existe.
+ */
+
+#define EVENTRING_MAGIC "DHCPEVT1"
+#define EVENTRING_HEADER_SIZE 4096
+#define EVENTRING_SLOTS ( 1 << 16 )  // potencia de 2
+
+// Tipo de evento; los mismos códigos que el registro de auditoría
+#define EVENTRING_GRANT 1
+#define EVENTRING_RENEW 2
+#define EVENTRING_RELEASE 3
+#define EVENTRING_EXPIRE 4
+#define EVENTRING_DECLINE 5
+
+typedef struct eventring_header {
+    char      magic[8];
+    u_int32_t version;
+    u_int32_t header_size;  // los registros empiezan aquí
+    u_int32_t rec_size;
+    u_int32_t slots;
+    u_int32_t pid;
+    u_int32_t reserved;
+    int64_t   started;                              // CLOCK_REALTIME
+    u_int64_t head __attribute__ ( ( aligned ( 64 ) ) );  // posición del siguiente evento; solo la escribe el servidor
+} eventring_header;
+
+typedef struct eventring_event {
+    u_int64_t seq;  // posición + 1 si está completo, 0 mientras se escribe
+    u_int32_t time;  // CLOCK_REALTIME en segundos
+    u_int32_t ip;    // orden de red
+    u_int32_t lease_time;
+    u_int32_t xid;
+    u_char    mac[6];
+    u_int8_t  type;
+    u_int8_t  class_id;  // 0 = pool general
+} eventring_event;
+
+typedef struct eventring {
+    char *            name;
+    u_char *          map;
+    size_t            size;
+    eventring_header *hdr;
+    eventring_event * events;
+} eventring;
+
+// Servidor
+int  eventring_create ( eventring *r, const char *name );
+void eventring_publish ( eventring *r, const eventring_event *ev );
+void eventring_close ( eventring *r );
+
+// Herramientas externas
+int       eventring_attach ( eventring *r, const char *name );
+u_int64_t eventring_head ( const eventring *r );
+size_t    eventring_read ( const eventring *r, u_int64_t *cursor, eventring_event *out, size_t max, u_int64_t *lost );
+void      eventring_detach ( eventring *r );
+
+#endif  // EVENTRING_H
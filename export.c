@@ -0,0 +1,454 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "export.h"
+#include "memuse.h"
+
+#define EXPORT_NAME_MAX 255   // bytes de nombre que se exportan
+#define EXPORT_TMP_SUFFIX ".tmp"
+
+static const char *export_states[] = {"leased", "reserved", "declined"};
+
+static const char export_digits[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                    "8081828384858687888990919293949596979899";
+
+static char           export_dec[256][4];  // "0".."255", sin terminador
+static u_int8_t       export_dec_len[256];
+static char           export_hex[256][2];
+static pthread_once_t export_once = PTHREAD_ONCE_INIT;
+
+static void export_init ( void ) {
+    for ( int i = 0; i < 256; ++i ) {
+        export_dec_len[i] = snprintf ( export_dec[i], sizeof ( export_dec[i] ), "%d", i );
+        export_hex[i][0]  = "0123456789abcdef"[i >> 4];
+        export_hex[i][1]  = "0123456789abcdef"[i & 15];
+    }
+}
+
+static u_char *export_str ( u_char *p, const char *s ) {
+    size_t len = strlen ( s );
+
+    memcpy ( p, s, len );
+    return p + len;
+}
+
+static u_char *export_u64 ( u_char *p, u_int64_t v ) {
+    u_char tmp[20], *t = tmp + sizeof ( tmp );
+
+    for ( ; v >= 100; v /= 100 ) {
+        t -= 2;
+        memcpy ( t, export_digits + v % 100 * 2, 2 );
+    }
+    if ( v >= 10 ) {
+        t -= 2;
+        memcpy ( t, export_digits + v * 2, 2 );
+    } else
+        *--t = '0' + v;
+
+    memcpy ( p, t, tmp + sizeof ( tmp ) - t );
+    return p + ( tmp + sizeof ( tmp ) - t );
+}
+
+static u_char *export_i64 ( u_char *p, int64_t v ) {
+    if ( v < 0 ) {
+        *p++ = '-';
+        return export_u64 ( p, -( u_int64_t ) v );
+    }
+    return export_u64 ( p, v );
+}
+
+// Se copian siempre 4 bytes por octeto y se avanza lo que mide
+static u_char *export_ip ( u_char *p, u_int32_t ip ) {
+    const u_char *b = ( const u_char * ) &ip;
+
+    for ( int i = 0; i < 4; ++i ) {
+        memcpy ( p, export_dec[b[i]], 4 );
+        p += export_dec_len[b[i]];
+        *p++ = '.';
+    }
+    return p - 1;
+}
+
+static u_char *export_mac ( u_char *p, const u_char *mac ) {
+    for ( int i = 0; i < 6; ++i ) {
+        memcpy ( p, export_hex[mac[i]], 2 );
+        p[2] = ':';
+        p += 3;
+    }
+    return p - 1;
+}
+
+// Kea escapa las comas como "&#x2c"; los caracteres de control se omiten
+static u_char *export_csv_str ( u_char *p, const char *s ) {
+    for ( size_t i = 0; i < EXPORT_NAME_MAX && s[i]; ++i ) {
+        u_char c = s[i];
+
+        if ( c == ',' )
+            p = export_str ( p, "&#x2c" );
+        else if ( c >= 0x20 )
+            *p++ = c;
+    }
+    return p;
+}
+
+static u_char *export_json_str ( u_char *p, const char *s ) {
+    *p++ = '"';
+    for ( size_t i = 0; i < EXPORT_NAME_MAX && s[i]; ++i ) {
+        u_char c = s[i];
+
+        if ( c == '"' || c == '\\' ) {
+            *p++ = '\\';
+            *p++ = c;
+        } else if ( c < 0x20 ) {
+            p    = export_str ( p, "\\u00" );
+            *p++ = export_hex[c][0];
+            *p++ = export_hex[c][1];
+        } else
+            *p++ = c;
+    }
+    *p++ = '"';
+    return p;
+}
+
+static int export_write_all ( int fd, const u_char *p, size_t len ) {
+    while ( len > 0 ) {
+        ssize_t n = write ( fd, p, len );
+
+        if ( n == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            return 0;
+        }
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
+// Pone el archivo terminado en su lugar
+static int export_sync ( export_writer *w ) {
+    char tmp[4096];
+
+    snprintf ( tmp, sizeof ( tmp ), "%s%s", w->path, EXPORT_TMP_SUFFIX );
+    return fdatasync ( w->fd ) == 0 && rename ( tmp, w->path ) == 0;
+}
+
+// Hilo escritor del archivo: una tarea a la vez, escribir wbuf o terminar
+static void *export_thread ( void *arg ) {
+    export_writer *w = arg;
+    int            ok;
+
+    pthread_mutex_lock ( &w->lock );
+    for ( ;; ) {
+        while ( !w->stop && !w->busy )
+            pthread_cond_wait ( &w->cond, &w->lock );
+        if ( w->stop )
+            break;
+        pthread_mutex_unlock ( &w->lock );
+
+        ok = w->finishing ? export_sync ( w ) : export_write_all ( w->fd, w->wbuf, w->wlen );
+
+        pthread_mutex_lock ( &w->lock );
+        if ( !ok && !w->err )
+            w->err = errno;
+        __atomic_store_n ( &w->busy, 0, __ATOMIC_RELEASE );
+        eventfd_write ( w->event_fd, 1 );
+    }
+    pthread_mutex_unlock ( &w->lock );
+    return NULL;
+}
+
+// Regresa 1 si el hilo está libre, -1 si sigue con una tarea y 0 con errno
+// si alguna falló
+static int export_idle ( export_writer *w ) {
+    eventfd_t count;
+
+    // Se vacía el aviso antes de ver busy: si el hilo termina después, el
+    // aviso nuevo despierta a poll()
+    eventfd_read ( w->event_fd, &count );
+    if ( __atomic_load_n ( &w->busy, __ATOMIC_ACQUIRE ) )
+        return -1;
+    if ( w->err ) {
+        errno = w->err;
+        return 0;
+    }
+    return 1;
+}
+
+// Pasa al hilo el buffer formateado (o, con finishing, el fdatasync() y el
+// rename()) y sigue con el otro. Regresa 1 si se pasó o no había nada, -1 si
+// el hilo sigue con la tarea anterior y 0 con errno si alguna falló.
+static int export_hand_off ( export_writer *w, int finishing ) {
+    u_char *buf;
+    int     r;
+
+    if ( !w->len && !finishing )
+        return 1;
+    if ( ( r = export_idle ( w ) ) != 1 )
+        return r;
+
+    pthread_mutex_lock ( &w->lock );
+    buf          = w->wbuf;
+    w->wbuf      = w->buf;
+    w->wlen      = w->len;
+    w->buf       = buf;
+    w->finishing = finishing;
+    __atomic_store_n ( &w->busy, 1, __ATOMIC_RELEASE );
+    pthread_cond_signal ( &w->cond );
+    pthread_mutex_unlock ( &w->lock );
+
+    w->bytes += w->len;
+    w->len = w->sent = 0;
+    return 1;
+}
+
+// Escribe lo que se pueda del buffer. Regresa 1 si quedó vacío, -1 si el
+// socket no acepta más (o el hilo no ha terminado el buffer anterior) y 0 con
+// errno si falla.
+static int export_flush ( export_writer *w ) {
+    if ( !w->unix_socket )
+        return export_hand_off ( w, 0 );
+
+    while ( w->sent < w->len ) {
+        ssize_t n = send ( w->fd, w->buf + w->sent, w->len - w->sent, MSG_DONTWAIT | MSG_NOSIGNAL );
+
+        if ( n == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? -1 : 0;
+        }
+        w->sent += n;
+        w->bytes += n;
+    }
+    w->len = w->sent = 0;
+    return 1;
+}
+
+static int export_connect ( const char *path ) {
+    struct sockaddr_un addr;
+    int                fd, err;
+
+    if ( strlen ( path ) >= sizeof ( addr.sun_path ) ) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if ( ( fd = socket ( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) == -1 )
+        return -1;
+
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.sun_family = AF_UNIX;
+    strcpy ( addr.sun_path, path );
+    if ( connect ( fd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) == -1 ) {
+        err = errno;
+        close ( fd );
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// Abre el destino y formatea el encabezado del formato. Regresa 0 con errno
+// si falla.
+int export_open ( export_writer *w, const char *target, int format ) {
+    char tmp[4096];
+    int  err;
+
+    pthread_once ( &export_once, export_init );
+
+    memset ( w, 0, sizeof ( export_writer ) );
+    w->fd       = -1;
+    w->event_fd = -1;
+    w->format   = format;
+    if ( !( w->buf = memuse_malloc ( MEMUSE_OTHER, EXPORT_BUF_SIZE ) ) )
+        return 0;
+
+    if ( !strncmp ( target, EXPORT_UNIX_PREFIX, strlen ( EXPORT_UNIX_PREFIX ) ) ) {
+        w->unix_socket = 1;
+        w->fd          = export_connect ( target + strlen ( EXPORT_UNIX_PREFIX ) );
+    } else if ( snprintf ( tmp, sizeof ( tmp ), "%s%s", target, EXPORT_TMP_SUFFIX ) >= ( int ) sizeof ( tmp ) )
+        errno = ENAMETOOLONG;
+    else if ( ( w->path = strdup ( target ) ) )
+        w->fd = open ( tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( w->fd == -1 )
+        goto fail;
+
+    // El archivo lo escribe un hilo, con un segundo buffer
+    if ( !w->unix_socket ) {
+        if ( !( w->wbuf = memuse_malloc ( MEMUSE_OTHER, EXPORT_BUF_SIZE ) )
+             || ( w->event_fd = eventfd ( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) == -1 )
+            goto fail;
+        pthread_mutex_init ( &w->lock, NULL );
+        pthread_cond_init ( &w->cond, NULL );
+        if ( ( errno = pthread_create ( &w->thread, NULL, export_thread, w ) ) ) {
+            pthread_mutex_destroy ( &w->lock );
+            pthread_cond_destroy ( &w->cond );
+            goto fail;
+        }
+        w->started = 1;
+    }
+
+    if ( format == EXPORT_CSV )
+        w->len = export_str ( w->buf, "address,hwaddr,client_id,valid_lifetime,expire,subnet_id,fqdn_fwd,fqdn_rev,"
+                                      "hostname,state,user_context\n" )
+                 - w->buf;
+    else if ( format == EXPORT_BINARY ) {
+        export_bin_header hdr;
+
+        memset ( &hdr, 0, sizeof ( hdr ) );
+        memcpy ( hdr.magic, EXPORT_MAGIC, sizeof ( hdr.magic ) );
+        hdr.byte_order = 0x01020304;
+        hdr.rec_size   = sizeof ( export_bin_rec );
+        memcpy ( w->buf, &hdr, sizeof ( hdr ) );
+        w->len = sizeof ( hdr );
+    }
+    return 1;
+
+fail:
+    err = errno;
+    export_close ( w );
+    errno = err;
+    return 0;
+}
+
+// Formatea una concesión en p, que tiene al menos EXPORT_REC_MAX bytes
+// libres, y regresa el final de lo escrito
+u_char *export_format ( int format, const export_lease *l, u_char *p ) {
+    pthread_once ( &export_once, export_init );
+
+    switch ( format ) {
+        case EXPORT_CSV:
+            // Sin vencimiento es el tiempo de vida "infinito" de Kea
+            p    = export_ip ( p, l->ip );
+            *p++ = ',';
+            p    = export_mac ( p, l->mac );
+            p    = export_str ( p, ",," );
+            p    = l->expires ? export_u64 ( p, l->lease_time ) : export_str ( p, "4294967295" );
+            *p++ = ',';
+            p    = export_i64 ( p, l->expires ? l->expires : time ( NULL ) );
+            p    = export_str ( p, ",1,0,0," );
+            p    = export_csv_str ( p, l->hostname );
+            p    = export_str ( p, l->state == EXPORT_DECLINED ? ",1,\n" : ",0,\n" );
+            break;
+
+        case EXPORT_JSON:
+            p    = export_str ( p, "{\"ip\":\"" );
+            p    = export_ip ( p, l->ip );
+            p    = export_str ( p, "\",\"mac\":\"" );
+            p    = export_mac ( p, l->mac );
+            p    = export_str ( p, "\",\"state\":\"" );
+            p    = export_str ( p, export_states[l->state] );
+            p    = export_str ( p, "\",\"expires\":" );
+            p    = export_i64 ( p, l->expires );
+            p    = export_str ( p, ",\"lease_time\":" );
+            p    = export_u64 ( p, l->lease_time );
+            p    = export_str ( p, ",\"class\":" );
+            p    = l->class_name ? export_json_str ( p, l->class_name ) : export_str ( p, "null" );
+            p    = export_str ( p, ",\"hostname\":" );
+            p    = export_json_str ( p, l->hostname );
+            p    = export_str ( p, "}\n" );
+            break;
+
+        case EXPORT_BINARY: {
+            export_bin_rec rec;
+
+            rec.ip           = l->ip;
+            rec.lease_time   = l->lease_time;
+            rec.expires      = l->expires;
+            rec.state        = l->state;
+            rec.class_id     = l->class_id;
+            rec.hostname_len = strnlen ( l->hostname, EXPORT_NAME_MAX );
+            memcpy ( rec.mac, l->mac, 6 );
+            memcpy ( p, &rec, sizeof ( rec ) );
+            memcpy ( p + sizeof ( rec ), l->hostname, rec.hostname_len );
+            p += sizeof ( rec ) + rec.hostname_len;
+            break;
+        }
+    }
+
+    return p;
+}
+
+// Agrega una concesión. Regresa 1 si se tomó, -1 si hay que esperar a que
+// el socket acepte más datos (la concesión no se tomó) y 0 con errno si falla.
+int export_add ( export_writer *w, const export_lease *l ) {
+    int r;
+
+    if ( EXPORT_BUF_SIZE - w->len < EXPORT_REC_MAX && ( r = export_flush ( w ) ) != 1 )
+        return r;
+
+    w->len = export_format ( w->format, l, w->buf + w->len ) - w->buf;
+    w->leases++;
+    return 1;
+}
+
+// Escribe lo que falta y, con archivo, lo sincroniza y lo pone en su lugar
+// (en el hilo). Regresa 1 al terminar, -1 si hay que esperar a
+// export_pollfd() y volver a llamar, y 0 con errno si falla.
+int export_finish ( export_writer *w ) {
+    int r = export_flush ( w );
+
+    if ( r != 1 || w->unix_socket )
+        return r;
+
+    if ( !w->finished ) {
+        if ( ( r = export_hand_off ( w, 1 ) ) != 1 )
+            return r;
+        w->finished = 1;
+        return -1;
+    }
+
+    // El hilo ya tiene (o terminó) el fdatasync() y el rename()
+    if ( ( r = export_idle ( w ) ) != 1 )
+        return r;
+    free ( w->path );
+    w->path = NULL;
+    return 1;
+}
+
+// Descriptor y eventos que indican cuándo volver a llamar a export_add() o
+// export_finish() después de que regresaron -1
+int export_pollfd ( export_writer *w, short *events ) {
+    *events = w->unix_socket ? POLLOUT : POLLIN;
+    return w->unix_socket ? w->fd : w->event_fd;
+}
+
+// Libera todo; si el archivo no se terminó, se borra. Si el hilo está
+// escribiendo, espera a que termine esa escritura.
+void export_close ( export_writer *w ) {
+    char tmp[4096];
+
+    if ( w->started ) {
+        pthread_mutex_lock ( &w->lock );
+        w->stop = 1;
+        pthread_cond_signal ( &w->cond );
+        pthread_mutex_unlock ( &w->lock );
+        pthread_join ( w->thread, NULL );
+        pthread_mutex_destroy ( &w->lock );
+        pthread_cond_destroy ( &w->cond );
+    }
+    if ( w->event_fd != -1 )
+        close ( w->event_fd );
+    memuse_free ( MEMUSE_OTHER, w->wbuf );
+
+    if ( w->path ) {
+        snprintf ( tmp, sizeof ( tmp ), "%s%s", w->path, EXPORT_TMP_SUFFIX );
+        unlink ( tmp );
+    }
+    if ( w->fd != -1 )
+        close ( w->fd );
+    free ( w->path );
+    memuse_free ( MEMUSE_OTHER, w->buf );
+    memset ( w, 0, sizeof ( export_writer ) );
+    w->fd       = -1;
+    w->event_fd = -1;
+}
@@ -0,0 +1,110 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Exportación de concesiones en flujo (CSV, JSON Lines o binario).
+ *
+ * Las concesiones se formatean en un buffer reservado una sola vez al abrir y
+ * se escriben cuando se llena, así que no hay una llamada al sistema por
+ * concesión. Direcciones, MAC y números se convierten con tablas (un octeto
+ * o dos dígitos por búsqueda) en lugar de inet_ntop() y printf().
+ *
+ * El destino es un archivo, que se escribe en <ruta>.tmp y aparece completo
+ * con rename() al terminar, o un socket Unix de flujo ("unix:<ruta>"). Nada
+ * bloquea al que llama, de modo que el servidor puede exportar por partes
+ * entre paquetes:
+ *
+ *   - el socket se escribe con MSG_DONTWAIT;
+ *   - el archivo lo escribe un hilo propio: cada buffer lleno se le pasa y
+ *     se sigue formateando en otro, y el fdatasync() y el rename() del final
+ *     también corren en el hilo.
+ *
+ * Si el lector del socket va atrás o el hilo aún no termina con el buffer
+ * anterior, export_add() y export_finish() regresan -1 (la concesión no se
+ * tomó) y se vuelven a llamar cuando export_pollfd() esté listo.
+ *
+ * CSV usa las columnas del memfile de Kea (se puede volver a importar con
+ * --import). El binario es un encabezado export_bin_header seguido de un
+ * export_bin_rec por concesión y hostname_len bytes del nombre.
+ */
+
+#define EXPORT_CSV 1
+#define EXPORT_JSON 2
+#define EXPORT_BINARY 3
+
+#define EXPORT_MAGIC "DHCPEXP1"
+#define EXPORT_BUF_SIZE ( 1 << 20 )
+#define EXPORT_REC_MAX 4096  // espacio para formatear una concesión
+#define EXPORT_UNIX_PREFIX "unix:"
+
+// Estado exportado
+#define EXPORT_LEASED 0
+#define EXPORT_RESERVED 1
+#define EXPORT_DECLINED 2
+
+typedef struct export_lease {
+    u_int32_t   ip;  // orden de red
+    u_int32_t   lease_time;
+    int64_t     expires;  // CLOCK_REALTIME, 0 si no vence
+    u_char      mac[6];
+    u_int8_t    state;  // EXPORT_*
+    u_int8_t    class_id;
+    const char *class_name;  // NULL para el pool general
+    const char *hostname;    // "" si no hay
+} export_lease;
+
+typedef struct export_bin_header {
+    char      magic[8];
+    u_int32_t byte_order;  // 0x01020304 en el orden del servidor
+    u_int32_t rec_size;
+} export_bin_header;
+
+typedef struct __attribute__ ( ( packed ) ) export_bin_rec {
+    u_int32_t ip;  // orden de red
+    u_int32_t lease_time;
+    int64_t   expires;
+    u_char    mac[6];
+    u_int8_t  state;
+    u_int8_t  class_id;
+    u_int8_t  hostname_len;
+} export_bin_rec;
+
+typedef struct export_writer {
+    int       fd;
+    int       format;
+    int       unix_socket;
+    char *    path;  // archivo final, NULL con socket
+    u_char *  buf;
+    size_t    len;   // bytes formateados en buf
+    size_t    sent;  // de ellos, ya escritos
+    u_int64_t leases;
+    u_int64_t bytes;
+
+    // Hilo escritor del archivo
+    pthread_t       thread;
+    int             started;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             event_fd;   // eventfd que el hilo marca al terminar cada tarea
+    u_char *        wbuf;       // buffer que escribe el hilo
+    size_t          wlen;
+    int             busy;       // el hilo tiene una tarea (atómico)
+    int             finishing;  // la tarea es el fdatasync() y el rename()
+    int             finished;   // ya se pasó esa tarea
+    int             err;        // errno de la primera falla del hilo
+    int             stop;
+} export_writer;
+
+int     export_open ( export_writer *w, const char *target, int format );
+u_char *export_format ( int format, const export_lease *lease, u_char *p );
+int     export_add ( export_writer *w, const export_lease *lease );
+int     export_finish ( export_writer *w );
+int     export_pollfd ( export_writer *w, short *events );
+void    export_close ( export_writer *w );
+
+#endif  // EXPORT_H
@@ -0,0 +1,323 @@
+#define _GNU_SOURCE  // pipe2()
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "hooks.h"
+#include "memuse.h"
+
+#define HOOKS_IDLE_NS 2000000
+#define HOOKS_WAIT_MIN_NS 100000
+#define HOOKS_WAIT_MAX_NS 10000000
+
+#define HOOKS_OK 0
+#define HOOKS_FAILED 1
+#define HOOKS_TIMEOUT 2
+
+extern char **environ;
+
+static const char *hooks_type_names[] = {"unknown", "grant", "renew", "release", "expire", "decline"};
+
+static u_int64_t hooks_now ( void ) {
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+    return ( u_int64_t ) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void hooks_sleep ( u_int64_t ns ) {
+    struct timespec ts = {ns / 1000000000, ns % 1000000000};
+
+    nanosleep ( &ts, NULL );
+}
+
+// Una línea por evento: "tipo ip mac tiempo xid clase hora"
+static size_t hooks_format ( const eventring_event *events, size_t count, char *buf ) {
+    char *p = buf;
+
+    for ( size_t i = 0; i < count; ++i ) {
+        const eventring_event *ev = &events[i];
+        char                   ip[INET_ADDRSTRLEN];
+
+        inet_ntop ( AF_INET, &ev->ip, ip, sizeof ( ip ) );
+        p += sprintf ( p, "%s %s %02x:%02x:%02x:%02x:%02x:%02x %u %08x %u %u\n",
+                       hooks_type_names[ev->type <= EVENTRING_DECLINE ? ev->type : 0], ip, ev->mac[0], ev->mac[1],
+                       ev->mac[2], ev->mac[3], ev->mac[4], ev->mac[5], ev->lease_time, ev->xid, ev->class_id, ev->time );
+    }
+    return p - buf;
+}
+
+// Escribe buf en la tubería no bloqueante hasta deadline. Regresa 0 si el
+// programa dejó de leer (cerró su entrada o se venció el tiempo).
+static int hooks_write ( int fd, const char *buf, size_t len, u_int64_t deadline ) {
+    struct pollfd pfd = {fd, POLLOUT, 0};
+
+    for ( size_t done = 0; done < len; ) {
+        ssize_t   n = write ( fd, buf + done, len - done );
+        u_int64_t now;
+
+        if ( n > 0 ) {
+            done += n;
+            continue;
+        }
+        if ( n == -1 && errno == EINTR )
+            continue;
+        if ( n == -1 && errno != EAGAIN )
+            return 0;  // EPIPE: terminó sin leer todo
+
+        if ( ( now = hooks_now () ) >= deadline )
+            return 0;
+        poll ( &pfd, 1, ( deadline - now ) / 1000000 + 1 );
+    }
+    return 1;
+}
+
+// Lanza el programa con el lote en su entrada estándar y espera a que
+// termine, a lo más hasta deadline
+static int hooks_run_program ( hooks *h, hooks_worker *w, size_t count, u_int64_t deadline ) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t          attr;
+    sigset_t                   none, defaults;
+    char *                     argv[] = {h->path, NULL};
+    char *                     text   = ( char * ) ( w->batch + h->batch );
+    int                        pipefd[2], status, err;
+    pid_t                      pid;
+    u_int64_t                  wait = HOOKS_WAIT_MIN_NS;
+
+    if ( pipe2 ( pipefd, O_CLOEXEC ) == -1 )
+        return HOOKS_FAILED;
+
+    // El hijo empieza sin señales bloqueadas (el hilo las bloquea todas) y
+    // con SIGPIPE y SIGCHLD en su acción normal
+    sigemptyset ( &none );
+    sigemptyset ( &defaults );
+    sigaddset ( &defaults, SIGPIPE );
+    sigaddset ( &defaults, SIGCHLD );
+    posix_spawn_file_actions_init ( &actions );
+    posix_spawn_file_actions_adddup2 ( &actions, pipefd[0], STDIN_FILENO );
+    posix_spawnattr_init ( &attr );
+    posix_spawnattr_setsigmask ( &attr, &none );
+    posix_spawnattr_setsigdefault ( &attr, &defaults );
+    posix_spawnattr_setflags ( &attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF );
+
+    err = posix_spawn ( &pid, h->path, &actions, &attr, argv, environ );
+    posix_spawn_file_actions_destroy ( &actions );
+    posix_spawnattr_destroy ( &attr );
+    close ( pipefd[0] );
+    if ( err ) {
+        close ( pipefd[1] );
+        return HOOKS_FAILED;
+    }
+
+    fcntl ( pipefd[1], F_SETFL, O_NONBLOCK );
+    hooks_write ( pipefd[1], text, hooks_format ( w->batch, count, text ), deadline );
+    close ( pipefd[1] );
+
+    // Espera con intervalos crecientes: casi todos terminan pronto
+    while ( waitpid ( pid, &status, WNOHANG ) == 0 ) {
+        u_int64_t now = hooks_now ();
+
+        if ( now >= deadline ) {
+            kill ( pid, SIGKILL );
+            waitpid ( pid, &status, 0 );
+            return HOOKS_TIMEOUT;
+        }
+        hooks_sleep ( wait < deadline - now ? wait : deadline - now );
+        if ( wait < HOOKS_WAIT_MAX_NS )
+            wait *= 2;
+    }
+    return WIFEXITED ( status ) && WEXITSTATUS ( status ) == 0 ? HOOKS_OK : HOOKS_FAILED;
+}
+
+// Entrega el lote con el programa o el módulo y cuenta el resultado
+static void hooks_deliver ( hooks *h, hooks_worker *w, size_t count ) {
+    u_int64_t start = hooks_now (), deadline = start + ( u_int64_t ) h->timeout_ms * 1000000, end;
+    int       result;
+
+    __atomic_store_n ( &w->busy, 1, __ATOMIC_RELAXED );
+    if ( h->fn ) {
+        result = h->fn ( w->batch, count ) ? HOOKS_FAILED : HOOKS_OK;
+        if ( result == HOOKS_OK && hooks_now () > deadline )
+            result = HOOKS_TIMEOUT;  // no se puede interrumpir; solo se cuenta
+    } else
+        result = hooks_run_program ( h, w, count, deadline );
+    end = hooks_now ();
+    __atomic_store_n ( &w->busy, 0, __ATOMIC_RELAXED );
+
+    metrics_observe ( &w->run, end - start );
+    metrics_inc ( &w->batches );
+    __atomic_store_n ( &w->events, w->events + count, __ATOMIC_RELAXED );
+    if ( result == HOOKS_FAILED )
+        metrics_inc ( &w->failures );
+    else if ( result == HOOKS_TIMEOUT )
+        metrics_inc ( &w->timeouts );
+}
+
+// Toma el siguiente lote de la cola. Regresa cuántos eventos copió; 0 si no
+// hay o si el lote incompleto todavía puede esperar más eventos.
+static size_t hooks_take ( hooks *h, hooks_worker *w, int stop ) {
+    u_int64_t       head, avail, count;
+    struct timespec now;
+
+    pthread_mutex_lock ( &h->lock );
+    head  = __atomic_load_n ( &h->head, __ATOMIC_ACQUIRE );
+    avail = head - h->tail;
+
+    if ( !avail ) {
+        h->since.tv_sec = h->since.tv_nsec = 0;
+        pthread_mutex_unlock ( &h->lock );
+        return 0;
+    }
+
+    if ( avail < ( u_int64_t ) h->batch && !stop ) {
+        clock_gettime ( CLOCK_MONOTONIC, &now );
+        if ( !h->since.tv_sec && !h->since.tv_nsec )
+            h->since = now;
+        if ( ( now.tv_sec - h->since.tv_sec ) * 1000 + ( now.tv_nsec - h->since.tv_nsec ) / 1000000 < HOOKS_LINGER_MS ) {
+            pthread_mutex_unlock ( &h->lock );
+            return 0;
+        }
+    }
+
+    count = avail < ( u_int64_t ) h->batch ? avail : ( u_int64_t ) h->batch;
+    for ( u_int64_t i = 0; i < count; ++i )
+        w->batch[i] = h->slots[( h->tail + i ) & ( HOOKS_SLOTS - 1 )];
+    __atomic_store_n ( &h->tail, h->tail + count, __ATOMIC_RELEASE );
+    if ( count == avail )
+        h->since.tv_sec = h->since.tv_nsec = 0;
+    pthread_mutex_unlock ( &h->lock );
+    return count;
+}
+
+// Hilo trabajador: toma lotes y los entrega; al cerrar vacía la cola
+static void *hooks_worker_run ( void *arg ) {
+    hooks_worker *w = arg;
+    hooks *       h = w->h;
+    sigset_t      all;
+
+    // Las señales del servidor las atienden los otros hilos
+    sigfillset ( &all );
+    pthread_sigmask ( SIG_BLOCK, &all, NULL );
+
+    for ( ;; ) {
+        int    stop  = __atomic_load_n ( &h->stop, __ATOMIC_ACQUIRE );
+        size_t count = hooks_take ( h, w, stop );
+
+        if ( count ) {
+            hooks_deliver ( h, w, count );
+            continue;
+        }
+        if ( stop && __atomic_load_n ( &h->head, __ATOMIC_ACQUIRE ) == __atomic_load_n ( &h->tail, __ATOMIC_ACQUIRE ) )
+            return NULL;
+        hooks_sleep ( HOOKS_IDLE_NS );
+    }
+}
+
+// Carga el módulo o verifica que el programa se pueda ejecutar
+static int hooks_load ( hooks *h ) {
+    size_t len = strlen ( h->path ), suffix = strlen ( HOOKS_PLUGIN_SUFFIX );
+
+    if ( len <= suffix || strcmp ( h->path + len - suffix, HOOKS_PLUGIN_SUFFIX ) )
+        return access ( h->path, X_OK ) == 0;
+
+    if ( !( h->plugin = dlopen ( h->path, RTLD_NOW | RTLD_LOCAL ) )
+         || !( h->fn = ( hooks_plugin_fn ) dlsym ( h->plugin, HOOKS_PLUGIN_SYMBOL ) ) ) {
+        errno = ENOEXEC;
+        return 0;
+    }
+    return 1;
+}
+
+// Prepara la cola y arranca workers hilos que entregan lotes de hasta batch
+// eventos a path (programa o módulo .so). Regresa 0 con errno si falla;
+// ENOEXEC si el módulo no carga o no tiene HOOKS_PLUGIN_SYMBOL.
+int hooks_open ( hooks *h, const char *path, int workers, int batch, int timeout_ms ) {
+    size_t batch_size = batch * ( sizeof ( eventring_event ) + HOOKS_LINE_MAX );
+    int    err;
+
+    memset ( h, 0, sizeof ( hooks ) );
+    h->batch      = batch;
+    h->timeout_ms = timeout_ms;
+    h->limit      = HOOKS_SLOTS;
+    pthread_mutex_init ( &h->lock, NULL );
+
+    if ( !( h->path = strdup ( path ) ) || !hooks_load ( h ) )
+        goto fail;
+
+    if ( !( h->slots = memuse_malloc ( MEMUSE_OTHER, HOOKS_SLOTS * sizeof ( eventring_event ) ) ) )
+        goto fail;
+    // Sin fallos de página en el ciclo al encolar
+    memset ( h->slots, 0, HOOKS_SLOTS * sizeof ( eventring_event ) );
+
+    // Cada trabajador tiene su lote y, detrás, el texto para un programa
+    for ( int i = 0; i < workers; ++i ) {
+        hooks_worker *w = &h->workers[i];
+
+        w->h = h;
+        if ( !( w->batch = memuse_malloc ( MEMUSE_OTHER, batch_size ) ) )
+            goto fail;
+        if ( ( err = pthread_create ( &w->thread, NULL, hooks_worker_run, w ) ) ) {
+            memuse_free ( MEMUSE_OTHER, w->batch );
+            errno = err;
+            goto fail;
+        }
+        __atomic_store_n ( &h->nworkers, i + 1, __ATOMIC_RELEASE );
+    }
+    return 1;
+
+fail:
+    err = errno;
+    hooks_close ( h );
+    errno = err;
+    return 0;
+}
+
+// Suma los contadores; se puede llamar desde cualquier hilo
+void hooks_stats_read ( hooks *h, hooks_stats *s ) {
+    int nworkers = __atomic_load_n ( &h->nworkers, __ATOMIC_ACQUIRE );
+
+    memset ( s, 0, sizeof ( hooks_stats ) );
+    s->queued  = __atomic_load_n ( &h->head, __ATOMIC_ACQUIRE ) - __atomic_load_n ( &h->tail, __ATOMIC_ACQUIRE );
+    s->dropped = __atomic_load_n ( &h->dropped, __ATOMIC_RELAXED );
+    s->workers = nworkers;
+
+    for ( int i = 0; i < nworkers; ++i ) {
+        const hooks_worker *w = &h->workers[i];
+
+        s->batches += __atomic_load_n ( &w->batches, __ATOMIC_RELAXED );
+        s->events += __atomic_load_n ( &w->events, __ATOMIC_RELAXED );
+        s->failures += __atomic_load_n ( &w->failures, __ATOMIC_RELAXED );
+        s->timeouts += __atomic_load_n ( &w->timeouts, __ATOMIC_RELAXED );
+        s->busy += __atomic_load_n ( &w->busy, __ATOMIC_RELAXED );
+        s->run.count += __atomic_load_n ( &w->run.count, __ATOMIC_RELAXED );
+        s->run.sum += __atomic_load_n ( &w->run.sum, __ATOMIC_RELAXED );
+        for ( int b = 0; b < METRICS_BUCKETS; ++b )
+            s->run.buckets[b] += __atomic_load_n ( &w->run.buckets[b], __ATOMIC_RELAXED );
+    }
+}
+
+// Entrega lo que quede en la cola, detiene los trabajadores y libera todo
+void hooks_close ( hooks *h ) {
+    if ( !h->path )
+        return;
+
+    __atomic_store_n ( &h->stop, 1, __ATOMIC_RELEASE );
+    for ( int i = 0; i < h->nworkers; ++i ) {
+        pthread_join ( h->workers[i].thread, NULL );
+        memuse_free ( MEMUSE_OTHER, h->workers[i].batch );
+    }
+    if ( h->plugin )
+        dlclose ( h->plugin );
+    memuse_free ( MEMUSE_OTHER, h->slots );
+    pthread_mutex_destroy ( &h->lock );
+    free ( h->path );
+    memset ( h, 0, sizeof ( hooks ) );
+}
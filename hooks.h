@@ -0,0 +1,118 @@
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+#include "eventring.h"
+#include "metrics.h"
+
+/*
+ * Ganchos de concesiones: acciones externas (reglas de firewall, DNS,
+ * contabilidad RADIUS) que corren fuera del ciclo de paquetes.
+ *
+ * El ciclo solo copia el evento a una cola acotada de un productor, sin
+ * candados ni llamadas al sistema; si la cola está llena el evento se cuenta
+ * como perdido y el ciclo sigue. Un grupo de hilos trabajadores toma los
+ * eventos por lotes de hasta batch (un candado que solo usan ellos reparte
+ * los lotes) y los entrega en una sola invocación:
+ *
+ *   - a un programa, que se lanza con posix_spawn() (no copia las tablas de
+ *     páginas del servidor, como fork()) y recibe un evento por línea en su
+ *     entrada estándar: "tipo ip mac tiempo xid clase hora". Si no termina
+ *     en timeout_ms se mata y se cuenta el vencimiento.
+ *   - a un módulo (ruta terminada en .so), cuya función HOOKS_PLUGIN_SYMBOL
+ *     se llama en el hilo trabajador; debe poder correr en varios hilos a la
+ *     vez. No se puede interrumpir: si tarda más de timeout_ms solo se
+ *     cuenta el vencimiento.
+ *
+ * Un lote incompleto espera a lo más HOOKS_LINGER_MS a que lleguen más
+ * eventos. Los contadores (cola, perdidos, lotes, fallas, vencimientos,
+ * hilos ocupados y la duración de cada invocación) se exportan con las
+ * métricas.
+ */
+
+#define HOOKS_SLOTS 16384  // potencia de 2
+#define HOOKS_WORKERS_MAX 16
+#define HOOKS_BATCH_MAX 1024
+#define HOOKS_LINGER_MS 50
+#define HOOKS_LINE_MAX 96  // una línea de evento para un programa
+#define HOOKS_PLUGIN_SYMBOL "dhcpd_t_hook"
+#define HOOKS_PLUGIN_SUFFIX ".so"
+
+// Función del módulo: regresa 0 si entregó los count eventos
+typedef int ( *hooks_plugin_fn ) ( const eventring_event *events, size_t count );
+
+typedef struct hooks hooks;
+
+typedef struct hooks_worker {
+    hooks *          h;
+    pthread_t        thread;
+    eventring_event *batch;
+
+    // Solo los escribe el hilo
+    u_int64_t    batches;
+    u_int64_t    events;
+    u_int64_t    failures;
+    u_int64_t    timeouts;
+    int          busy;
+    metrics_hist run;  // duración de cada invocación
+} __attribute__ ( ( aligned ( 64 ) ) ) hooks_worker;
+
+struct hooks {
+    // Productor
+    u_int64_t head;   // siguiente evento a escribir
+    u_int64_t limit;  // hasta dónde se puede escribir sin volver a leer tail
+    u_int64_t dropped;
+
+    // Consumidores, en otra línea de caché
+    u_int64_t       tail __attribute__ ( ( aligned ( 64 ) ) );
+    pthread_mutex_t lock;   // reparto de lotes entre trabajadores
+    struct timespec since;  // desde cuándo espera el evento más viejo, 0 si la cola estaba vacía
+    int             stop;
+
+    eventring_event *slots;
+    char *           path;
+    void *           plugin;  // dlopen(), NULL si es un programa
+    hooks_plugin_fn  fn;
+    int              batch;
+    int              timeout_ms;
+    int              nworkers;
+    hooks_worker     workers[HOOKS_WORKERS_MAX];
+};
+
+// Contadores sumados de todos los trabajadores
+typedef struct hooks_stats {
+    u_int64_t    queued;  // en la cola
+    u_int64_t    dropped;
+    u_int64_t    batches;
+    u_int64_t    events;
+    u_int64_t    failures;
+    u_int64_t    timeouts;
+    int          busy;
+    int          workers;
+    metrics_hist run;
+} hooks_stats;
+
+int  hooks_open ( hooks *h, const char *path, int workers, int batch, int timeout_ms );
+void hooks_stats_read ( hooks *h, hooks_stats *s );
+void hooks_close ( hooks *h );
+
+// Encola el evento para los trabajadores; si la cola está llena lo cuenta
+// como perdido. Solo la llama el ciclo de paquetes.
+static inline void hooks_push ( hooks *h, const eventring_event *ev ) {
+    if ( h->head == h->limit ) {
+        h->limit = __atomic_load_n ( &h->tail, __ATOMIC_ACQUIRE ) + HOOKS_SLOTS;
+        if ( h->head == h->limit ) {
+            __atomic_store_n ( &h->dropped, h->dropped + 1, __ATOMIC_RELAXED );
+            return;
+        }
+    }
+
+    h->slots[h->head & ( HOOKS_SLOTS - 1 )] = *ev;
+    __atomic_store_n ( &h->head, h->head + 1, __ATOMIC_RELEASE );
+}
+
+#endif  // HOOKS_H
@@ -0,0 +1,504 @@
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "import.h"
+#include "memuse.h"
+
+#define IMPORT_BUFSIZE ( 1 << 16 )
+#define IMPORT_TOKEN_MAX 1024  // lo que sobre de un token más largo se descarta
+#define IMPORT_LINE_INITIAL 1024
+#define KEA_MAX_COLUMNS 32
+
+enum import_token { TOK_EOF, TOK_WORD, TOK_STRING, TOK_LBRACE, TOK_RBRACE, TOK_SEMI };
+
+typedef struct import_reader {
+    int       fd;
+    u_char *  buf;
+    size_t    pos;
+    size_t    len;
+    u_int64_t bytes;
+    u_int64_t line;
+    int       err;  // errno de read() o de memoria; 0 si el archivo terminó bien
+    char      tok[IMPORT_TOKEN_MAX];
+    size_t    tok_len;
+} import_reader;
+
+static int import_fill ( import_reader *r ) {
+    ssize_t n;
+
+    do
+        n = read ( r->fd, r->buf, IMPORT_BUFSIZE );
+    while ( n == -1 && errno == EINTR );
+
+    if ( n <= 0 ) {
+        if ( n == -1 )
+            r->err = errno;
+        return 0;
+    }
+    r->pos = 0;
+    r->len = n;
+    r->bytes += n;
+    return 1;
+}
+
+static inline int import_getc ( import_reader *r ) {
+    if ( r->pos == r->len && !import_fill ( r ) )
+        return -1;
+    return r->buf[r->pos++];
+}
+
+static inline int import_peek ( import_reader *r ) {
+    if ( r->pos == r->len && !import_fill ( r ) )
+        return -1;
+    return r->buf[r->pos];
+}
+
+static inline void import_append ( import_reader *r, int c ) {
+    if ( r->tok_len < IMPORT_TOKEN_MAX - 1 )
+        r->tok[r->tok_len++] = c;
+}
+
+// Caracteres que terminan una palabra
+static const u_char import_delim[256] = {[' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1,
+                                         ['{'] = 1, ['}'] = 1,  [';'] = 1,  ['"'] = 1,  ['#'] = 1};
+
+// Siguiente token de dhcpd.leases; el texto de palabras y cadenas queda en
+// r->tok terminado en '\0'. Los comentarios van de '#' al fin de la línea.
+static int import_token ( import_reader *r ) {
+    int c;
+
+    r->tok_len = 0;
+    r->tok[0]  = '\0';
+
+    for ( ;; ) {
+        // Espacios seguidos directamente en el buffer
+        while ( r->pos < r->len && ( r->buf[r->pos] == ' ' || r->buf[r->pos] == '\t' ) )
+            r->pos++;
+        if ( ( c = import_getc ( r ) ) == -1 )
+            return TOK_EOF;
+        if ( c == '\n' )
+            r->line++;
+        else if ( c == '#' ) {
+            while ( ( c = import_getc ( r ) ) != -1 && c != '\n' )
+                ;
+            if ( c == -1 )
+                return TOK_EOF;
+            r->line++;
+        } else if ( !isspace ( c ) )
+            break;
+    }
+
+    switch ( c ) {
+        case '{':
+            return TOK_LBRACE;
+        case '}':
+            return TOK_RBRACE;
+        case ';':
+            return TOK_SEMI;
+        case '"':
+            while ( ( c = import_getc ( r ) ) != -1 && c != '"' ) {
+                if ( c == '\\' && ( c = import_getc ( r ) ) == -1 )
+                    break;
+                if ( c == '\n' )
+                    r->line++;
+                import_append ( r, c );
+            }
+            r->tok[r->tok_len] = '\0';
+            return TOK_STRING;
+    }
+
+    // Palabra: se copia por tramos directamente del buffer
+    import_append ( r, c );
+    while ( import_peek ( r ) != -1 ) {
+        size_t start = r->pos, n;
+
+        while ( r->pos < r->len && !import_delim[r->buf[r->pos]] )
+            r->pos++;
+        n = r->pos - start;
+        if ( n > IMPORT_TOKEN_MAX - 1 - r->tok_len )
+            n = IMPORT_TOKEN_MAX - 1 - r->tok_len;
+        memcpy ( r->tok + r->tok_len, r->buf + start, n );
+        r->tok_len += n;
+        if ( r->pos < r->len )
+            break;
+    }
+    r->tok[r->tok_len] = '\0';
+    return TOK_WORD;
+}
+
+// Entero decimal sin signo de s, que avanza; -1 si no hay dígitos
+static long import_number ( const char **s ) {
+    long v = -1;
+
+    for ( ; **s >= '0' && **s <= '9'; ++*s )
+        v = ( v < 0 ? 0 : v * 10 ) + ( **s - '0' );
+    return v;
+}
+
+// Segundos desde 1970 de una fecha y hora UTC (días desde la época por el
+// algoritmo de calendario civil, sin pasar por la zona horaria como timegm())
+static int64_t import_utc ( long year, long mon, long mday, long hour, long min, long sec ) {
+    long era, yoe, doy, doe;
+
+    year -= mon <= 2;
+    era = ( year >= 0 ? year : year - 399 ) / 400;
+    yoe = year - era * 400;
+    doy = ( 153 * ( mon + ( mon > 2 ? -3 : 9 ) ) + 2 ) / 5 + mday - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return ( ( int64_t ) ( era * 146097 + doe - 719468 ) * 24 + hour ) * 3600 + min * 60 + sec;
+}
+
+static int import_hex ( char c ) {
+    if ( c >= '0' && c <= '9' )
+        return c - '0';
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+static int import_mac ( const char *s, u_char *mac ) {
+    for ( int i = 0; i < 6; ++i ) {
+        unsigned v = 0;
+        int      digits, h;
+
+        for ( digits = 0; digits < 2 && ( h = import_hex ( *s ) ) >= 0; ++digits, ++s )
+            v = v * 16 + h;
+        if ( !digits )
+            return 0;
+        mac[i] = v;
+        if ( i < 5 && *s++ != ':' )
+            return 0;
+    }
+    return *s == '\0';
+}
+
+// Descarta el resto de una sentencia cuyo primer token ya se leyó: hasta el
+// ';' o hasta cerrar el bloque que abra. Regresa 0 si el archivo termina o
+// aparece un '}' que no le corresponde.
+static int isc_skip ( import_reader *r, int tok ) {
+    int depth = 0;
+
+    for ( ;; tok = import_token ( r ) ) {
+        switch ( tok ) {
+            case TOK_EOF:
+                return 0;
+            case TOK_SEMI:
+                if ( !depth )
+                    return 1;
+                break;
+            case TOK_LBRACE:
+                depth++;
+                break;
+            case TOK_RBRACE:
+                if ( --depth <= 0 )
+                    return depth == 0;
+                break;
+        }
+    }
+}
+
+// "[día] aaaa/mm/dd hh:mm:ss;" en UTC, "never;" o "epoch segundos;"
+static int isc_time ( import_reader *r, int64_t *t ) {
+    char        words[3][32];
+    int         nwords = 0, tok;
+    long        f[6];
+    const char *p = NULL;
+
+    while ( ( tok = import_token ( r ) ) == TOK_WORD ) {
+        if ( nwords == 3 )
+            memmove ( words[0], words[1], sizeof ( words[0] ) * 2 );
+        else
+            nwords++;
+        if ( r->tok_len >= sizeof ( words[0] ) )
+            return 0;
+        memcpy ( words[nwords - 1], r->tok, r->tok_len + 1 );
+    }
+    if ( tok != TOK_SEMI || !nwords )
+        return 0;
+
+    if ( !strcmp ( words[0], "never" ) ) {
+        *t = IMPORT_NEVER;
+        return 1;
+    }
+    if ( !strcmp ( words[0], "epoch" ) && nwords >= 2 ) {
+        *t = strtoll ( words[1], NULL, 10 );
+        return 1;
+    }
+    if ( nwords < 2 )
+        return 0;
+
+    for ( int i = 0; i < 6; ++i ) {
+        if ( i % 3 == 0 )
+            p = words[nwords - 2 + i / 3];
+        if ( ( f[i] = import_number ( &p ) ) < 0 || *p++ != ( i % 3 == 2 ? '\0' : i < 3 ? '/' : ':' ) )
+            return 0;
+    }
+    if ( f[1] < 1 || f[1] > 12 )
+        return 0;
+    *t = import_utc ( f[0], f[1], f[2], f[3], f[4], f[5] );
+    return 1;
+}
+
+static int isc_state ( const char *state ) {
+    if ( !strcmp ( state, "active" ) )
+        return IMPORT_ACTIVE;
+    if ( !strcmp ( state, "abandoned" ) )
+        return IMPORT_ABANDONED;
+    return IMPORT_FREE;  // free, expired, released, backup, reset
+}
+
+// "lease ip { ... }" con "lease" ya leído
+static int isc_lease ( import_reader *r, import_lease *l ) {
+    struct in_addr addr;
+    int            tok, ok;
+
+    memset ( l, 0, sizeof ( import_lease ) );
+    l->state = IMPORT_ACTIVE;  // archivos sin "binding state"
+
+    if ( import_token ( r ) != TOK_WORD || inet_pton ( AF_INET, r->tok, &addr ) != 1 )
+        return 0;
+    l->ip = addr.s_addr;
+
+    if ( import_token ( r ) != TOK_LBRACE )
+        return 0;
+
+    for ( ;; ) {
+        if ( ( tok = import_token ( r ) ) == TOK_RBRACE )
+            return 1;
+        if ( tok != TOK_WORD ) {
+            if ( !isc_skip ( r, tok ) )
+                return 0;
+            continue;
+        }
+
+        if ( !strcmp ( r->tok, "starts" ) )
+            ok = isc_time ( r, &l->starts );
+        else if ( !strcmp ( r->tok, "ends" ) )
+            ok = isc_time ( r, &l->ends );
+        else if ( !strcmp ( r->tok, "binding" ) ) {
+            // binding state <estado>;
+            if ( ( tok = import_token ( r ) ) == TOK_WORD && ( tok = import_token ( r ) ) == TOK_WORD ) {
+                l->state = isc_state ( r->tok );
+                tok      = import_token ( r );
+            }
+            ok = isc_skip ( r, tok );
+        } else if ( !strcmp ( r->tok, "hardware" ) ) {
+            // hardware ethernet <mac>;
+            if ( ( tok = import_token ( r ) ) == TOK_WORD && !strcmp ( r->tok, "ethernet" )
+                 && ( tok = import_token ( r ) ) == TOK_WORD ) {
+                l->has_mac = import_mac ( r->tok, l->mac );
+                tok        = import_token ( r );
+            }
+            ok = isc_skip ( r, tok );
+        } else if ( !strcmp ( r->tok, "client-hostname" ) ) {
+            if ( ( tok = import_token ( r ) ) == TOK_STRING ) {
+                snprintf ( l->hostname, sizeof ( l->hostname ), "%.*s", ( int ) sizeof ( l->hostname ) - 1, r->tok );
+                tok = import_token ( r );
+            }
+            ok = isc_skip ( r, tok );
+        } else
+            ok = isc_skip ( r, TOK_WORD );  // next binding state, uid, cltt, set, on ...
+
+        if ( !ok )
+            return 0;
+    }
+}
+
+static int import_isc ( import_reader *r, import_apply apply, void *ctx, import_stats *stats ) {
+    import_lease l;
+    int          tok;
+
+    for ( ;; ) {
+        if ( ( tok = import_token ( r ) ) == TOK_EOF )
+            return !r->err;
+
+        if ( tok == TOK_WORD && !strcmp ( r->tok, "lease" ) ) {
+            if ( !isc_lease ( r, &l ) )
+                return 0;
+            apply ( ctx, &l );
+            stats->leases++;
+        } else if ( !isc_skip ( r, tok ) )  // lease6, host, failover, server-duid...
+            return 0;
+    }
+}
+
+// Siguiente línea sin el fin de línea; regresa -1 al terminar el archivo
+static ssize_t import_line ( import_reader *r, char **line, size_t *cap ) {
+    size_t len = 0;
+    int    more;
+
+    while ( ( more = r->pos < r->len || import_fill ( r ) ) ) {
+        u_char *start = r->buf + r->pos;
+        u_char *nl    = memchr ( start, '\n', r->len - r->pos );
+        size_t  n     = nl ? ( size_t ) ( nl - start ) : r->len - r->pos;
+
+        if ( len + n + 1 > *cap ) {
+            size_t cap_new  = len + n + 1 > *cap * 2 ? len + n + 1 : *cap * 2;
+            char * line_new = memuse_realloc ( MEMUSE_OTHER, *line, cap_new );
+
+            if ( !line_new ) {
+                r->err = errno;
+                return -1;
+            }
+            *line = line_new;
+            *cap  = cap_new;
+        }
+        memcpy ( *line + len, start, n );
+        len += n;
+        r->pos += n;
+        if ( nl ) {
+            r->pos++;
+            break;
+        }
+    }
+    if ( !more && !len )
+        return -1;
+
+    if ( len && ( *line )[len - 1] == '\r' )
+        len--;
+    ( *line )[len] = '\0';
+    r->line++;
+    return len;
+}
+
+static int kea_split ( char *line, char **fields ) {
+    int n = 0;
+
+    fields[n++] = line;
+    for ( char *p = line; ( p = strchr ( p, ',' ) ); ) {
+        *p++ = '\0';
+        if ( n == KEA_MAX_COLUMNS )
+            break;
+        fields[n++] = p;
+    }
+    return n;
+}
+
+static int kea_column ( char **fields, int n, const char *name ) {
+    for ( int i = 0; i < n; ++i )
+        if ( !strcmp ( fields[i], name ) )
+            return i;
+    return -1;
+}
+
+// Kea escapa las comas dentro de un campo como "&#x2c"
+static void kea_unescape ( char *dst, size_t size, const char *src ) {
+    size_t len = 0;
+
+    while ( *src && len < size - 1 ) {
+        if ( !strncmp ( src, "&#x2c", 5 ) ) {
+            dst[len++] = ',';
+            src += 5;
+        } else
+            dst[len++] = *src++;
+    }
+    dst[len] = '\0';
+}
+
+static int import_kea ( import_reader *r, import_apply apply, void *ctx, import_stats *stats ) {
+    enum { COL_ADDRESS, COL_HWADDR, COL_VALID, COL_EXPIRE, COL_HOSTNAME, COL_STATE, COLS };
+    static const char *names[COLS] = {"address", "hwaddr", "valid_lifetime", "expire", "hostname", "state"};
+    char *             fields[KEA_MAX_COLUMNS], *line = NULL;
+    size_t             cap = IMPORT_LINE_INITIAL;
+    int                col[COLS], n, needed = 0, ok = 0;
+    import_lease       l;
+
+    if ( !( line = memuse_malloc ( MEMUSE_OTHER, cap ) ) ) {
+        r->err = errno;
+        return 0;
+    }
+
+    // Encabezado: las columnas se buscan por nombre; hwaddr, hostname y state
+    // pueden faltar
+    if ( import_line ( r, &line, &cap ) == -1 )
+        goto done;
+    n = kea_split ( line, fields );
+    for ( int c = 0; c < COLS; ++c )
+        if ( ( col[c] = kea_column ( fields, n, names[c] ) ) >= needed )
+            needed = col[c] + 1;
+    if ( col[COL_ADDRESS] == -1 || col[COL_VALID] == -1 || col[COL_EXPIRE] == -1 )
+        goto done;
+
+    while ( import_line ( r, &line, &cap ) != -1 ) {
+        struct in_addr addr;
+        u_int64_t      valid;
+
+        if ( !line[0] )
+            continue;
+        if ( kea_split ( line, fields ) < needed || inet_pton ( AF_INET, fields[col[COL_ADDRESS]], &addr ) != 1 )
+            goto done;
+
+        memset ( &l, 0, sizeof ( import_lease ) );
+        l.ip    = addr.s_addr;
+        valid   = strtoull ( fields[col[COL_VALID]], NULL, 10 );
+        l.ends  = strtoll ( fields[col[COL_EXPIRE]], NULL, 10 );
+        l.state = IMPORT_ACTIVE;
+        l.starts = l.ends - valid;
+        if ( valid == 0xffffffff )
+            l.ends = IMPORT_NEVER;
+
+        // 0 asignada, 1 rechazada, 2 expirada y recuperada, 3 liberada;
+        // un registro con tiempo de vida 0 es una concesión borrada
+        if ( col[COL_STATE] != -1 && atoi ( fields[col[COL_STATE]] ) == 1 )
+            l.state = IMPORT_ABANDONED;
+        else if ( !valid || ( col[COL_STATE] != -1 && atoi ( fields[col[COL_STATE]] ) != 0 ) )
+            l.state = IMPORT_FREE;
+
+        if ( col[COL_HWADDR] != -1 )
+            l.has_mac = import_mac ( fields[col[COL_HWADDR]], l.mac );
+        if ( col[COL_HOSTNAME] != -1 )
+            kea_unescape ( l.hostname, sizeof ( l.hostname ), fields[col[COL_HOSTNAME]] );
+
+        apply ( ctx, &l );
+        stats->leases++;
+    }
+    ok = !r->err;
+
+done:
+    memuse_free ( MEMUSE_OTHER, line );
+    return ok;
+}
+
+// Lee path completo entregando cada concesión a apply. Regresa 0 con errno
+// si falla; EINVAL si el archivo no se entiende (stats->line dice dónde).
+int import_leases ( const char *path, import_apply apply, void *ctx, import_stats *stats ) {
+    import_reader *r;
+    int            ok;
+
+    memset ( stats, 0, sizeof ( import_stats ) );
+    if ( !( r = memuse_calloc ( MEMUSE_OTHER, 1, sizeof ( import_reader ) ) ) )
+        return 0;
+    if ( !( r->buf = memuse_malloc ( MEMUSE_OTHER, IMPORT_BUFSIZE ) )
+         || ( r->fd = open ( path, O_RDONLY | O_CLOEXEC ) ) == -1 ) {
+        memuse_free ( MEMUSE_OTHER, r->buf );
+        memuse_free ( MEMUSE_OTHER, r );
+        return 0;
+    }
+    posix_fadvise ( r->fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+    import_fill ( r );
+    if ( r->len >= 8 && !memcmp ( r->buf, "address,", 8 ) ) {
+        stats->format = IMPORT_FORMAT_KEA;
+        ok            = import_kea ( r, apply, ctx, stats );
+    } else {
+        stats->format = IMPORT_FORMAT_ISC;
+        r->line       = 1;
+        ok            = import_isc ( r, apply, ctx, stats );
+    }
+
+    stats->bytes = r->bytes;
+    if ( !ok ) {
+        stats->line = r->line;
+        errno       = r->err ? r->err : EINVAL;
+    }
+
+    close ( r->fd );
+    memuse_free ( MEMUSE_OTHER, r->buf );
+    memuse_free ( MEMUSE_OTHER, r );
+    return ok;
+}
@@ -0,0 +1,52 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Importación de archivos de concesiones de ISC dhcpd (dhcpd.leases) y de
+ * Kea (memfile CSV de DHCPv4).
+ *
+ * El archivo se lee por bloques con read() y se recorre una sola vez con un
+ * tokenizador que no retrocede, así que la memoria no depende del tamaño del
+ * archivo. Cada concesión leída se entrega en orden a una función del
+ * servidor; los dos formatos agregan al final, por lo que si una dirección
+ * aparece varias veces, la última gana con solo aplicarlas en orden.
+ *
+ * El formato se detecta por el encabezado de columnas de Kea ("address,").
+ */
+
+#define IMPORT_FORMAT_ISC 1
+#define IMPORT_FORMAT_KEA 2
+
+// Estado de la concesión importada
+#define IMPORT_FREE 0
+#define IMPORT_ACTIVE 1
+#define IMPORT_ABANDONED 2  // abandonada (ISC) o rechazada con DHCPDECLINE (Kea)
+
+#define IMPORT_NEVER INT64_MAX  // concesión sin vencimiento
+
+typedef struct import_lease {
+    u_int32_t ip;       // orden de red
+    int64_t   starts;   // CLOCK_REALTIME, 0 si no viene
+    int64_t   ends;     // CLOCK_REALTIME, 0 si no viene, IMPORT_NEVER
+    u_char    mac[6];
+    u_int8_t  has_mac;
+    u_int8_t  state;    // IMPORT_*
+    char      hostname[256];
+} import_lease;
+
+typedef struct import_stats {
+    int       format;   // IMPORT_FORMAT_*
+    u_int64_t leases;   // concesiones entregadas
+    u_int64_t bytes;
+    u_int64_t line;     // línea del error si import_leases() falla con EINVAL
+} import_stats;
+
+typedef void ( *import_apply ) ( void *ctx, const import_lease *lease );
+
+int import_leases ( const char *path, import_apply apply, void *ctx, import_stats *stats );
+
+#endif  // IMPORT_H
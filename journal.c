@@ -0,0 +1,959 @@
+#define _GNU_SOURCE  // O_DIRECT, fallocate()
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "crc32c.h"
+#include "journal.h"
+#include "memuse.h"
+
+#define JOURNAL_VERSION 2
+#define JOURNAL_BUF_INITIAL ( 16 * JOURNAL_BLOCK )
+#define JOURNAL_REPLAY_CHUNK 4096  // registros por lectura
+#define JOURNAL_REPLAY_WINDOW ( 1 << 20 )  // registros por ventana de la reaplicación en paralelo
+#define JOURNAL_REPLAY_BLOCK 64            // direcciones consecutivas que reaplica el mismo hilo
+#define JOURNAL_COMPACT_SUFFIX ".compact"
+
+typedef struct journal_replay_job {
+    const journal_frame *frames;
+    u_int64_t            total;  // marcos que caben en el archivo, válidos o no
+    u_int64_t            valid;  // resultado: marcos válidos desde el principio
+    u_int32_t            epoch;
+    int                  threads;
+    u_int32_t *          order;    // índices de la ventana agrupados por hilo dentro de cada segmento
+    size_t *             start;    // [segmento][hilo] primer índice en order
+    size_t *             count;    // [segmento][hilo]
+    size_t *             invalid;  // [segmento] primer marco inválido, o el fin del segmento
+    journal_apply        apply;
+    void *               ctx;
+    pthread_mutex_t      lock;  // los hilos esperan a que se sepa cuántos arrancaron
+    pthread_cond_t       ready_cond;
+    int                  ready;
+    pthread_barrier_t    barrier;
+} journal_replay_job;
+
+typedef struct journal_replay_worker {
+    pthread_t           thread;
+    int                 id;
+    journal_replay_job *job;
+} journal_replay_worker;
+
+static off_t journal_offset ( u_int64_t record ) {
+    return JOURNAL_BLOCK + record * sizeof ( journal_frame );
+}
+
+static void *journal_alloc ( size_t size ) {
+    return memuse_memalign ( MEMUSE_JOURNAL, JOURNAL_BLOCK, size );
+}
+
+// Sin O_DIRECT (tmpfs) basta con O_DSYNC
+static int journal_open_fd ( const char *path, int flags ) {
+    int fd = open ( path, flags | O_DIRECT | O_DSYNC | O_CLOEXEC, 0644 );
+
+    if ( fd == -1 && errno == EINVAL )
+        fd = open ( path, flags | O_DSYNC | O_CLOEXEC, 0644 );
+    return fd;
+}
+
+static int journal_pwrite_all ( int fd, const void *data, size_t len, off_t off ) {
+    const u_char *p = data;
+
+    while ( len > 0 ) {
+        ssize_t n = pwrite ( fd, p, len, off );
+
+        if ( n == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            return 0;
+        }
+        p += n;
+        len -= n;
+        off += n;
+    }
+    return 1;
+}
+
+static int journal_write_header ( int fd, u_int32_t epoch ) {
+    journal_header *hdr = journal_alloc ( JOURNAL_BLOCK );
+    int             ok;
+
+    if ( !hdr )
+        return 0;
+
+    memset ( hdr, 0, JOURNAL_BLOCK );
+    memcpy ( hdr->magic, JOURNAL_MAGIC, sizeof ( hdr->magic ) );
+    hdr->version    = JOURNAL_VERSION;
+    hdr->rec_size   = sizeof ( journal_rec );
+    hdr->frame_size = sizeof ( journal_frame );
+    hdr->epoch      = epoch;
+
+    ok = journal_pwrite_all ( fd, hdr, JOURNAL_BLOCK, 0 );
+    memuse_free ( MEMUSE_JOURNAL, hdr );
+    return ok;
+}
+
+static u_int32_t journal_frame_crc ( const journal_frame *f ) {
+    return crc32c ( 0, &f->len, sizeof ( journal_frame ) - offsetof ( journal_frame, len ) );
+}
+
+// El marco index (desde 0) es válido si el CRC cuadra, está en su lugar y no
+// es de una época anterior a la del marco previo (prev, NULL en el primero)
+// ni posterior a la actual
+static int journal_frame_valid ( const journal_frame *f, const journal_frame *prev, u_int64_t index, u_int32_t epoch ) {
+    return f->seq == index + 1 && f->len == sizeof ( journal_rec ) && f->epoch && f->epoch <= epoch
+           && ( !prev || f->epoch >= prev->epoch ) && f->crc == journal_frame_crc ( f );
+}
+
+// Deja w listo para agregar después de los primeros records registros de fd
+static int journal_writer_init ( journal_writer *w, int fd, u_int64_t records, u_int32_t epoch ) {
+    off_t       end = journal_offset ( records );
+    struct stat st;
+    ssize_t     n;
+
+    memset ( w, 0, sizeof ( journal_writer ) );
+    w->fd      = fd;
+    w->seq     = records;
+    w->epoch   = epoch;
+    w->buf_off = end / JOURNAL_BLOCK * JOURNAL_BLOCK;
+    w->buf_len = w->flushed = end - w->buf_off;
+    w->buf_cap = JOURNAL_BUF_INITIAL;
+
+    if ( fstat ( fd, &st ) == -1 || !( w->buf = journal_alloc ( w->buf_cap ) ) )
+        return 0;
+    w->allocated = st.st_size;
+    memset ( w->buf, 0, w->buf_cap );
+
+    // El bloque parcial del final se reescribirá con lo que ya tiene al
+    // principio; lo que sigue a los registros válidos queda en ceros
+    if ( w->buf_len ) {
+        if ( ( n = pread ( fd, w->buf, JOURNAL_BLOCK, w->buf_off ) ) < ( ssize_t ) w->buf_len ) {
+            if ( n >= 0 )
+                errno = EIO;
+            return 0;
+        }
+        memset ( w->buf + w->buf_len, 0, JOURNAL_BLOCK - w->buf_len );
+    }
+    return 1;
+}
+
+// Vuelve a colocar w después de los primeros records registros
+static int journal_writer_seek ( journal_writer *w, u_int64_t records ) {
+    int       fd    = w->fd;
+    u_int32_t epoch = w->epoch;
+
+    memuse_free ( MEMUSE_JOURNAL, w->buf );
+    return journal_writer_init ( w, fd, records, epoch );
+}
+
+static void journal_writer_close ( journal_writer *w ) {
+    if ( w->fd != -1 )
+        close ( w->fd );
+    memuse_free ( MEMUSE_JOURNAL, w->buf );
+    memset ( w, 0, sizeof ( journal_writer ) );
+    w->fd = -1;
+}
+
+static int journal_writer_append ( journal_writer *w, const journal_rec *rec ) {
+    journal_frame f;
+
+    if ( w->buf_len + sizeof ( journal_frame ) > w->buf_cap ) {
+        size_t  cap = w->buf_cap * 2;
+        u_char *buf = journal_alloc ( cap );
+
+        if ( !buf )
+            return 0;
+        memcpy ( buf, w->buf, w->buf_len );
+        memset ( buf + w->buf_len, 0, cap - w->buf_len );
+        memuse_free ( MEMUSE_JOURNAL, w->buf );
+        w->buf     = buf;
+        w->buf_cap = cap;
+    }
+
+    f.len      = sizeof ( journal_rec );
+    f.epoch    = w->epoch;
+    f.reserved = 0;
+    f.seq      = ++w->seq;
+    f.rec      = *rec;
+    f.crc      = journal_frame_crc ( &f );
+
+    memcpy ( w->buf + w->buf_len, &f, sizeof ( f ) );
+    w->buf_len += sizeof ( f );
+    return 1;
+}
+
+// Escribe los bloques con registros nuevos con un solo pwrite(); con O_DSYNC
+// regresa cuando ya están en disco. El último bloque, si queda parcial, se
+// conserva en buf y se reescribe completo la próxima vez.
+static int journal_writer_flush ( journal_writer *w ) {
+    size_t size = ( w->buf_len + JOURNAL_BLOCK - 1 ) / JOURNAL_BLOCK * JOURNAL_BLOCK, full;
+    off_t  end  = w->buf_off + size;
+
+    if ( w->buf_len == w->flushed )
+        return 1;
+
+    if ( end > w->allocated ) {
+        off_t allocated = ( end + JOURNAL_PREALLOC - 1 ) / JOURNAL_PREALLOC * JOURNAL_PREALLOC;
+
+        // Sin soporte en el sistema de archivos el archivo crece con cada
+        // escritura, como antes
+        if ( fallocate ( w->fd, 0, w->allocated, allocated - w->allocated ) == -1 && errno != EOPNOTSUPP )
+            return 0;
+        w->allocated = allocated;
+    }
+
+    if ( !journal_pwrite_all ( w->fd, w->buf, size, w->buf_off ) )
+        return 0;
+
+    full = w->buf_len / JOURNAL_BLOCK * JOURNAL_BLOCK;
+    memmove ( w->buf, w->buf + full, w->buf_len - full );
+    w->buf_off += full;
+    w->buf_len -= full;
+    memset ( w->buf + w->buf_len, 0, size - w->buf_len );
+    w->flushed = w->buf_len;
+    return 1;
+}
+
+// Abre (o crea) la bitácora, valida su encabezado y empieza una época nueva.
+// Regresa 0 con errno si falla; EINVAL si el archivo no es una bitácora de
+// esta versión.
+int journal_open ( journal *j, const char *path ) {
+    journal_header *hdr   = NULL;
+    u_int32_t       epoch = 1;
+    ssize_t         n;
+    int             err;
+
+    memset ( j, 0, sizeof ( journal ) );
+    j->w.fd = -1;
+    if ( !( j->path = strdup ( path ) ) || !( hdr = journal_alloc ( JOURNAL_BLOCK ) ) )
+        goto fail;
+    if ( ( j->w.fd = journal_open_fd ( path, O_RDWR | O_CREAT ) ) == -1 )
+        goto fail;
+
+    if ( ( n = pread ( j->w.fd, hdr, JOURNAL_BLOCK, 0 ) ) == -1 )
+        goto fail;
+    if ( n > 0 ) {
+        if ( n != JOURNAL_BLOCK || memcmp ( hdr->magic, JOURNAL_MAGIC, sizeof ( hdr->magic ) )
+             || hdr->version != JOURNAL_VERSION || hdr->rec_size != sizeof ( journal_rec )
+             || hdr->frame_size != sizeof ( journal_frame ) ) {
+            errno = EINVAL;
+            goto fail;
+        }
+        epoch = hdr->epoch + 1;
+    }
+
+    // La época nueva queda en disco antes de cualquier registro que la use
+    if ( !journal_write_header ( j->w.fd, epoch ) || !journal_writer_init ( &j->w, j->w.fd, 0, epoch ) )
+        goto fail;
+
+    memuse_free ( MEMUSE_JOURNAL, hdr );
+    return 1;
+
+fail:
+    err = errno;
+    memuse_free ( MEMUSE_JOURNAL, hdr );
+    journal_writer_close ( &j->w );
+    errno = err;
+    return 0;
+}
+
+static int journal_replay_serial ( journal *j, int fd, journal_apply apply, void *ctx ) {
+    journal_frame *chunk = memuse_malloc ( MEMUSE_JOURNAL, JOURNAL_REPLAY_CHUNK * sizeof ( journal_frame ) );
+    journal_frame  prev;
+    u_int64_t      valid = 0;
+    ssize_t        n;
+
+    if ( !chunk )
+        return 0;
+
+    while ( ( n = pread ( fd, chunk, JOURNAL_REPLAY_CHUNK * sizeof ( journal_frame ), journal_offset ( valid ) ) ) > 0 ) {
+        size_t count = n / sizeof ( journal_frame );
+
+        for ( size_t i = 0; i < count; ++i ) {
+            if ( !journal_frame_valid ( &chunk[i], i ? &chunk[i - 1] : valid ? &prev : NULL, valid, j->w.epoch ) )
+                goto done;
+            apply ( ctx, &chunk[i].rec );
+            valid++;
+        }
+
+        if ( count < JOURNAL_REPLAY_CHUNK )
+            break;
+        prev = chunk[count - 1];
+    }
+    if ( n == -1 ) {
+        memuse_free ( MEMUSE_JOURNAL, chunk );
+        return 0;
+    }
+
+done:
+    j->records = valid;
+    memuse_free ( MEMUSE_JOURNAL, chunk );
+    return 1;
+}
+
+static int journal_replay_shard ( const journal_rec *rec, int threads ) {
+    return ntohl ( rec->ip ) / JOURNAL_REPLAY_BLOCK % threads;
+}
+
+// Cada ventana se reparte en segmentos contiguos, uno por hilo. Primero cada
+// hilo valida su segmento y lo ordena por hilo destino (estable); después
+// cada hilo aplica, segmento por segmento, los registros de sus direcciones
+// hasta el primer marco inválido de la ventana. Así cada dirección la
+// reaplica un solo hilo y en el orden de la bitácora.
+static void *journal_replay_worker_run ( void *arg ) {
+    journal_replay_worker *w   = arg;
+    journal_replay_job *   job = w->job;
+    int                    n, id = w->id;
+
+    pthread_mutex_lock ( &job->lock );
+    while ( !job->ready )
+        pthread_cond_wait ( &job->ready_cond, &job->lock );
+    pthread_mutex_unlock ( &job->lock );
+    n = job->threads;
+
+    for ( u_int64_t base = 0; base < job->total; base += JOURNAL_REPLAY_WINDOW ) {
+        const journal_frame *frames = job->frames + base;
+        size_t               len    = job->total - base < JOURNAL_REPLAY_WINDOW ? job->total - base : JOURNAL_REPLAY_WINDOW;
+        size_t               first = len * id / n, last = len * ( id + 1 ) / n, bad = last;
+        size_t *             start = job->start + id * n, *count = job->count + id * n;
+        size_t               next[JOURNAL_REPLAY_THREADS_MAX], pos = first;
+        int                  cut = 0;
+
+        for ( size_t i = first; i < last; ++i )
+            if ( !journal_frame_valid ( &frames[i], base + i ? &frames[i - 1] : NULL, base + i, job->epoch ) ) {
+                bad = i;
+                break;
+            }
+        job->invalid[id] = bad;
+
+        memset ( count, 0, n * sizeof ( size_t ) );
+        for ( size_t i = first; i < bad; ++i )
+            count[journal_replay_shard ( &frames[i].rec, n )]++;
+        for ( int t = 0; t < n; ++t ) {
+            start[t] = next[t] = pos;
+            pos += count[t];
+        }
+        for ( size_t i = first; i < bad; ++i )
+            job->order[next[journal_replay_shard ( &frames[i].rec, n )]++] = i;
+
+        pthread_barrier_wait ( &job->barrier );
+
+        for ( int s = 0; s < n && !cut; ++s ) {
+            for ( size_t k = 0; k < job->count[s * n + id]; ++k )
+                job->apply ( job->ctx, &frames[job->order[job->start[s * n + id] + k]].rec );
+            if ( job->invalid[s] < len * ( s + 1 ) / n ) {
+                cut = 1;
+                if ( id == 0 )
+                    job->valid = base + job->invalid[s];
+            }
+        }
+
+        pthread_barrier_wait ( &job->barrier );
+        if ( cut )
+            break;
+        if ( id == 0 )
+            job->valid = base + len;
+    }
+    return NULL;
+}
+
+static int journal_replay_parallel ( journal *j, int fd, journal_apply apply, void *ctx, int threads ) {
+    journal_replay_worker workers[JOURNAL_REPLAY_THREADS_MAX];
+    journal_replay_job    job;
+    struct stat           st;
+    void *                map;
+    int                   created, err = 0;
+
+    if ( fstat ( fd, &st ) == -1 )
+        return 0;
+
+    memset ( &job, 0, sizeof ( job ) );
+    if ( st.st_size > JOURNAL_BLOCK )
+        job.total = ( st.st_size - JOURNAL_BLOCK ) / sizeof ( journal_frame );
+    if ( !job.total )
+        return journal_replay_serial ( j, fd, apply, ctx );
+
+    map = mmap ( NULL, journal_offset ( job.total ), PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( map == MAP_FAILED )
+        return 0;
+
+    job.frames  = ( const journal_frame * ) ( ( const u_char * ) map + JOURNAL_BLOCK );
+    job.epoch   = j->w.epoch;
+    job.apply   = apply;
+    job.ctx     = ctx;
+    job.order   = memuse_malloc (
+        MEMUSE_JOURNAL, ( job.total < JOURNAL_REPLAY_WINDOW ? job.total : JOURNAL_REPLAY_WINDOW ) * sizeof ( u_int32_t ) );
+    job.start   = memuse_malloc ( MEMUSE_JOURNAL, threads * threads * sizeof ( size_t ) );
+    job.count   = memuse_malloc ( MEMUSE_JOURNAL, threads * threads * sizeof ( size_t ) );
+    job.invalid = memuse_malloc ( MEMUSE_JOURNAL, threads * sizeof ( size_t ) );
+    if ( !job.order || !job.start || !job.count || !job.invalid ) {
+        err = errno;
+        goto done;
+    }
+    pthread_mutex_init ( &job.lock, NULL );
+    pthread_cond_init ( &job.ready_cond, NULL );
+
+    // Si no arrancan todos los hilos se trabaja con los que haya
+    pthread_mutex_lock ( &job.lock );
+    for ( created = 1; created < threads; ++created ) {
+        workers[created].id  = created;
+        workers[created].job = &job;
+        if ( pthread_create ( &workers[created].thread, NULL, journal_replay_worker_run, &workers[created] ) )
+            break;
+    }
+    job.threads = created;
+    pthread_barrier_init ( &job.barrier, NULL, created );
+    job.ready = 1;
+    pthread_cond_broadcast ( &job.ready_cond );
+    pthread_mutex_unlock ( &job.lock );
+
+    workers[0].id  = 0;
+    workers[0].job = &job;
+    journal_replay_worker_run ( &workers[0] );
+    for ( int i = 1; i < created; ++i )
+        pthread_join ( workers[i].thread, NULL );
+
+    pthread_barrier_destroy ( &job.barrier );
+    pthread_cond_destroy ( &job.ready_cond );
+    pthread_mutex_destroy ( &job.lock );
+
+    j->records = job.valid;
+
+done:
+    munmap ( map, journal_offset ( job.total ) );
+    memuse_free ( MEMUSE_JOURNAL, job.order );
+    memuse_free ( MEMUSE_JOURNAL, job.start );
+    memuse_free ( MEMUSE_JOURNAL, job.count );
+    memuse_free ( MEMUSE_JOURNAL, job.invalid );
+    errno = err;
+    return !err;
+}
+
+// Aplica en orden (por dirección, con threads hilos) los registros hasta el
+// primer marco inválido y deja la bitácora lista para agregar a partir de
+// ahí; lo que sigue se sobrescribe. apply debe poder llamarse desde varios
+// hilos a la vez para direcciones distintas.
+int journal_replay ( journal *j, journal_apply apply, void *ctx, int threads ) {
+    int fd = open ( j->path, O_RDONLY | O_CLOEXEC ), ok, err;
+
+    if ( fd == -1 )
+        return 0;
+
+    if ( threads > JOURNAL_REPLAY_THREADS_MAX )
+        threads = JOURNAL_REPLAY_THREADS_MAX;
+    if ( threads <= 1 )
+        ok = journal_replay_serial ( j, fd, apply, ctx );
+    else
+        ok = journal_replay_parallel ( j, fd, apply, ctx, threads );
+
+    err = errno;
+    close ( fd );
+    errno = err;
+
+    return ok && journal_writer_seek ( &j->w, j->records );
+}
+
+int journal_append ( journal *j, const journal_rec *rec ) {
+
+    if ( !journal_writer_append ( &j->w, rec ) )
+        return 0;
+    j->npending++;
+    return 1;
+}
+
+// fsync() del directorio de path, para que un rename() sobreviva a una caída
+static int journal_sync_dir ( const char *path ) {
+    const char *slash = strrchr ( path, '/' );
+    char        dir[4096];
+    int         fd, ok, err;
+
+    if ( !slash )
+        strcpy ( dir, "." );
+    else
+        snprintf ( dir, sizeof ( dir ), "%.*s", slash == path ? 1 : ( int ) ( slash - path ), path );
+    if ( ( fd = open ( dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC ) ) == -1 )
+        return 0;
+    ok  = fsync ( fd ) == 0;
+    err = errno;
+    close ( fd );
+    errno = err;
+    return ok;
+}
+
+// Escribe todo lo pendiente con un solo pwrite() sincrónico
+int journal_commit ( journal *j ) {
+
+    if ( !j->npending )
+        return 1;
+
+    // Si no se pudo confirmar el reemplazo de la última compactación, ningún
+    // registro nuevo cuenta como escrito hasta lograrlo
+    if ( j->dir_sync ) {
+        if ( !journal_sync_dir ( j->path ) )
+            return 0;
+        j->dir_sync = 0;
+    }
+
+    if ( !journal_writer_flush ( &j->w ) )
+        return 0;
+
+    __atomic_store_n ( &j->records, j->records + j->npending, __ATOMIC_RELEASE );
+    j->commits++;
+    j->npending = 0;
+    return 1;
+}
+
+static void journal_compact_cleanup ( journal_compaction *c, const char *path ) {
+    journal_writer_close ( &c->w );
+    if ( c->read_fd != -1 )
+        close ( c->read_fd );
+    c->read_fd = -1;
+    unlink ( path );
+}
+
+void journal_close ( journal *j ) {
+    if ( __atomic_load_n ( &j->compact.state, __ATOMIC_ACQUIRE ) != JOURNAL_COMPACT_IDLE ) {
+        pthread_join ( j->compact.thread, NULL );
+        journal_writer_close ( &j->compact.w );
+        close ( j->compact.read_fd );
+    }
+    journal_writer_close ( &j->w );
+    free ( j->path );
+    memset ( j, 0, sizeof ( journal ) );
+    j->w.fd = -1;
+}
+
+// Copia los registros [from, to) de la bitácora al final del archivo nuevo
+static int journal_copy ( journal *j, u_int64_t from, u_int64_t to ) {
+    journal_compaction *c     = &j->compact;
+    journal_frame *     chunk = memuse_malloc ( MEMUSE_JOURNAL, JOURNAL_REPLAY_CHUNK * sizeof ( journal_frame ) );
+
+    if ( !chunk )
+        return 0;
+
+    while ( from < to ) {
+        size_t  count = to - from < JOURNAL_REPLAY_CHUNK ? to - from : JOURNAL_REPLAY_CHUNK;
+        ssize_t n     = pread ( c->read_fd, chunk, count * sizeof ( journal_frame ), journal_offset ( from ) );
+
+        if ( n != ( ssize_t ) ( count * sizeof ( journal_frame ) ) ) {
+            if ( n >= 0 )
+                errno = EIO;
+            memuse_free ( MEMUSE_JOURNAL, chunk );
+            return 0;
+        }
+        for ( size_t i = 0; i < count; ++i )
+            if ( !journal_writer_append ( &c->w, &chunk[i].rec ) ) {
+                memuse_free ( MEMUSE_JOURNAL, chunk );
+                return 0;
+            }
+        if ( !journal_writer_flush ( &c->w ) ) {
+            memuse_free ( MEMUSE_JOURNAL, chunk );
+            return 0;
+        }
+        from += count;
+    }
+
+    memuse_free ( MEMUSE_JOURNAL, chunk );
+    return 1;
+}
+
+static void *journal_compact_thread ( void *arg ) {
+    journal *           j     = arg;
+    journal_compaction *c     = &j->compact;
+    journal_rec *       chunk = NULL;
+    size_t              pos   = 0, count;
+    u_int64_t           records;
+    int                 state = JOURNAL_COMPACT_FAILED;
+
+    // Snapshot de la tabla
+    if ( !c->tail ) {
+        if ( !( chunk = memuse_malloc ( MEMUSE_JOURNAL, JOURNAL_REPLAY_CHUNK * sizeof ( journal_rec ) ) ) )
+            goto done;
+        while ( ( count = c->snapshot ( c->ctx, &pos, chunk, JOURNAL_REPLAY_CHUNK ) ) > 0 ) {
+            for ( size_t i = 0; i < count; ++i )
+                if ( !journal_writer_append ( &c->w, &chunk[i] ) )
+                    goto done;
+            if ( !journal_writer_flush ( &c->w ) )
+                goto done;
+        }
+    }
+
+    // Cola de la bitácora: se copia lo confirmado hasta que falten a lo más
+    // JOURNAL_COMPACT_TAIL registros, que copia el servidor al cerrar
+    while ( ( records = __atomic_load_n ( &j->records, __ATOMIC_ACQUIRE ) ) - c->copied > JOURNAL_COMPACT_TAIL ) {
+        if ( !journal_copy ( j, c->copied, records ) )
+            goto done;
+        c->copied = records;
+    }
+
+    state = JOURNAL_COMPACT_READY;
+
+done:
+    if ( state == JOURNAL_COMPACT_FAILED )
+        c->err = errno;
+    memuse_free ( MEMUSE_JOURNAL, chunk );
+    __atomic_store_n ( &c->state, state, __ATOMIC_RELEASE );
+    return NULL;
+}
+
+// Empieza una compactación en segundo plano. No debe haber registros sin
+// confirmar. Regresa 0 con errno si no se pudo iniciar.
+int journal_compact_start ( journal *j, journal_snapshot snapshot, void *ctx ) {
+    journal_compaction *c = &j->compact;
+    char                path[4096];
+    int                 fd, err;
+
+    if ( c->state != JOURNAL_COMPACT_IDLE || j->npending ) {
+        errno = EBUSY;
+        return 0;
+    }
+
+    snprintf ( path, sizeof ( path ), "%s%s", j->path, JOURNAL_COMPACT_SUFFIX );
+    if ( ( fd = journal_open_fd ( path, O_RDWR | O_CREAT | O_TRUNC ) ) == -1 )
+        return 0;
+    memset ( &c->w, 0, sizeof ( c->w ) );
+    c->w.fd    = fd;
+    c->read_fd = -1;
+    if ( !journal_write_header ( fd, 1 ) || !journal_writer_init ( &c->w, fd, 0, 1 )
+         || ( c->read_fd = open ( j->path, O_RDONLY | O_CLOEXEC ) ) == -1 )
+        goto fail;
+
+    clock_gettime ( CLOCK_MONOTONIC, &c->start );
+    c->snapshot = snapshot;
+    c->ctx      = ctx;
+    c->cut      = j->records;
+    c->copied   = c->cut;
+    c->tail     = 0;
+    c->err      = 0;
+    c->state    = JOURNAL_COMPACT_RUNNING;
+
+    if ( ( errno = pthread_create ( &c->thread, NULL, journal_compact_thread, j ) ) ) {
+        c->state = JOURNAL_COMPACT_IDLE;
+        goto fail;
+    }
+    return 1;
+
+fail:
+    err = errno;
+    journal_compact_cleanup ( c, path );
+    errno = err;
+    return 0;
+}
+
+// Si la compactación terminó, copia la cola que falta (a lo más
+// JOURNAL_COMPACT_TAIL registros) y reemplaza la bitácora; si falta más,
+// relanza el hilo para alcanzarla. Se llama sin registros pendientes.
+// Regresa 1 si se reemplazó, 0 si sigue corriendo (o no hay ninguna) y -1
+// con errno si falló, incluso si se reemplazó pero falló el fsync() del
+// directorio.
+int journal_compact_poll ( journal *j ) {
+    journal_compaction *c     = &j->compact;
+    int                 state = __atomic_load_n ( &c->state, __ATOMIC_ACQUIRE );
+    char                path[4096];
+    struct timespec     now;
+    double              ms, total;
+
+    if ( state == JOURNAL_COMPACT_IDLE || state == JOURNAL_COMPACT_RUNNING )
+        return 0;
+
+    pthread_join ( c->thread, NULL );
+    c->state = JOURNAL_COMPACT_IDLE;
+    snprintf ( path, sizeof ( path ), "%s%s", j->path, JOURNAL_COMPACT_SUFFIX );
+
+    if ( state == JOURNAL_COMPACT_READY && !j->npending && j->records - c->copied > JOURNAL_COMPACT_TAIL ) {
+        c->tail  = 1;
+        c->state = JOURNAL_COMPACT_RUNNING;
+        if ( !( errno = pthread_create ( &c->thread, NULL, journal_compact_thread, j ) ) )
+            return 0;
+        c->err   = errno;
+        c->state = JOURNAL_COMPACT_IDLE;
+        state    = JOURNAL_COMPACT_FAILED;
+    }
+
+    if ( state == JOURNAL_COMPACT_FAILED || j->npending || !journal_copy ( j, c->copied, j->records )
+         || rename ( path, j->path ) == -1 ) {
+        int err = state == JOURNAL_COMPACT_FAILED ? c->err : j->npending ? EBUSY : errno;
+
+        journal_compact_cleanup ( c, path );
+        errno = err;
+        return -1;
+    }
+
+    // Sin el fsync() del directorio, una caída puede deshacer el rename() y
+    // con él todo lo confirmado en el archivo nuevo. Si falla, el nombre ya es
+    // del archivo nuevo, así que se sigue con él, pero journal_commit() no
+    // confirma nada hasta que el directorio quede en disco.
+    if ( !journal_sync_dir ( j->path ) ) {
+        c->err      = errno;
+        j->dir_sync = 1;
+    }
+
+    // El archivo nuevo ya es la bitácora; se sigue agregando al final
+    journal_writer_close ( &j->w );
+    j->w       = c->w;
+    j->records = c->w.seq;
+    c->w.fd    = -1;
+    c->w.buf   = NULL;
+    close ( c->read_fd );
+    c->read_fd = -1;
+
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    ms    = ( now.tv_sec - c->start.tv_sec ) * 1e3 + ( now.tv_nsec - c->start.tv_nsec ) / 1e6;
+    total = j->compact_total_ms + ms;
+    __atomic_store ( &j->compact_last_ms, &ms, __ATOMIC_RELAXED );
+    __atomic_store ( &j->compact_total_ms, &total, __ATOMIC_RELAXED );
+    __atomic_store_n ( &j->compactions, j->compactions + 1, __ATOMIC_RELEASE );
+    if ( j->dir_sync ) {
+        errno = c->err;
+        return -1;
+    }
+    return 1;
+}
+
+// Contadores de compactación de la bitácora; se puede llamar desde cualquier
+// hilo
+void journal_compact_read ( journal *j, journal_compact_stats *s ) {
+    s->compactions = __atomic_load_n ( &j->compactions, __ATOMIC_ACQUIRE );
+    __atomic_load ( &j->compact_last_ms, &s->last_ms, __ATOMIC_RELAXED );
+    __atomic_load ( &j->compact_total_ms, &s->total_ms, __ATOMIC_RELAXED );
+    s->running = __atomic_load_n ( &j->compact.state, __ATOMIC_ACQUIRE ) != JOURNAL_COMPACT_IDLE;
+}
+
+typedef struct journal_group_worker {
+    pthread_t      thread;
+    journal_group *g;
+    int            id;
+    int            started;
+    // Reaplicación
+    journal_apply apply;
+    void *        ctx;
+    int           threads;
+    int           ok;
+    int           err;
+} journal_group_worker;
+
+static void journal_shard_path ( char *name, size_t size, const char *path, int count, int shard ) {
+    if ( count == 1 )
+        snprintf ( name, size, "%s", path );
+    else
+        snprintf ( name, size, "%s.%d", path, shard );
+}
+
+// Los archivos que existan tienen que ser justo los de count particiones: con
+// otro reparto una dirección quedaría en dos bitácoras sin orden entre ellas
+static int journal_group_check ( const char *path, int count ) {
+    char name[4096];
+    int  present = 0;
+
+    for ( int i = 0; i < count; ++i ) {
+        journal_shard_path ( name, sizeof ( name ), path, count, i );
+        present += access ( name, F_OK ) == 0;
+    }
+    if ( present && present != count )
+        return 0;
+
+    if ( count == 1 )
+        snprintf ( name, sizeof ( name ), "%s.0", path );
+    else {
+        snprintf ( name, sizeof ( name ), "%s.%d", path, count );
+        if ( access ( name, F_OK ) == 0 )
+            return 0;
+        snprintf ( name, sizeof ( name ), "%s", path );
+    }
+    return access ( name, F_OK ) != 0;
+}
+
+static void *journal_group_worker_run ( void *arg ) {
+    journal_group_worker *w     = arg;
+    journal_group *       g     = w->g;
+    u_int64_t             round = 0;
+    int                   ok;
+
+    pthread_mutex_lock ( &g->lock );
+    for ( ;; ) {
+        while ( !g->stop && g->round == round )
+            pthread_cond_wait ( &g->start, &g->lock );
+        if ( g->stop )
+            break;
+        round = g->round;
+        pthread_mutex_unlock ( &g->lock );
+
+        ok = journal_commit ( &g->shards[w->id] );
+
+        pthread_mutex_lock ( &g->lock );
+        if ( !ok && !g->err )
+            g->err = errno;
+        if ( --g->running == 0 )
+            pthread_cond_signal ( &g->done );
+    }
+    pthread_mutex_unlock ( &g->lock );
+    return NULL;
+}
+
+// Abre (o crea) las count particiones de la bitácora; con una sola es el
+// archivo path tal cual. Regresa 0 con errno si falla; EINVAL si los archivos
+// existentes son de otro número de particiones.
+int journal_group_open ( journal_group *g, const char *path, int count ) {
+    char name[4096];
+    int  err;
+
+    memset ( g, 0, sizeof ( journal_group ) );
+    if ( count < 1 || count > JOURNAL_SHARDS_MAX || !journal_group_check ( path, count ) ) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    if ( !( g->shards = memuse_calloc ( MEMUSE_JOURNAL, count, sizeof ( journal ) ) ) )
+        return 0;
+    for ( int i = 0; i < count; ++i )
+        g->shards[i].w.fd = -1;
+    g->count = count;
+
+    for ( int i = 0; i < count; ++i ) {
+        journal_shard_path ( name, sizeof ( name ), path, count, i );
+        if ( !journal_open ( &g->shards[i], name ) )
+            goto fail;
+    }
+
+    if ( count == 1 )
+        return 1;
+
+    if ( !( g->workers = memuse_calloc ( MEMUSE_JOURNAL, count, sizeof ( journal_group_worker ) ) ) )
+        goto fail;
+    pthread_mutex_init ( &g->lock, NULL );
+    pthread_cond_init ( &g->start, NULL );
+    pthread_cond_init ( &g->done, NULL );
+
+    for ( int i = 0; i < count; ++i ) {
+        g->workers[i].g  = g;
+        g->workers[i].id = i;
+        if ( ( errno = pthread_create ( &g->workers[i].thread, NULL, journal_group_worker_run, &g->workers[i] ) ) )
+            goto fail;
+        g->workers[i].started = 1;
+    }
+    return 1;
+
+fail:
+    err = errno;
+    journal_group_close ( g );
+    errno = err;
+    return 0;
+}
+
+static void *journal_group_replay_run ( void *arg ) {
+    journal_group_worker *w = arg;
+
+    w->ok  = journal_replay ( &w->g->shards[w->id], w->apply, w->ctx, w->threads );
+    w->err = errno;
+    return NULL;
+}
+
+// Reaplica todas las particiones a la vez, repartiendo los hilos entre ellas
+int journal_group_replay ( journal_group *g, journal_apply apply, void *ctx, int threads ) {
+    journal_group_worker *replay;
+    int                   err = 0;
+
+    if ( g->count == 1 )
+        return journal_replay ( &g->shards[0], apply, ctx, threads );
+
+    if ( !( replay = memuse_calloc ( MEMUSE_JOURNAL, g->count, sizeof ( journal_group_worker ) ) ) )
+        return 0;
+
+    for ( int i = 0; i < g->count; ++i ) {
+        replay[i].g       = g;
+        replay[i].id      = i;
+        replay[i].apply   = apply;
+        replay[i].ctx     = ctx;
+        replay[i].threads = threads / g->count > 1 ? threads / g->count : 1;
+        // Si no hay hilo, la partición se reaplica aquí mismo
+        if ( pthread_create ( &replay[i].thread, NULL, journal_group_replay_run, &replay[i] ) )
+            journal_group_replay_run ( &replay[i] );
+        else
+            replay[i].started = 1;
+    }
+
+    for ( int i = 0; i < g->count; ++i ) {
+        if ( replay[i].started )
+            pthread_join ( replay[i].thread, NULL );
+        if ( !replay[i].ok && !err )
+            err = replay[i].err;
+    }
+
+    memuse_free ( MEMUSE_JOURNAL, replay );
+    errno = err;
+    return !err;
+}
+
+int journal_group_append ( journal_group *g, int shard, const journal_rec *rec ) {
+    if ( !journal_append ( &g->shards[shard], rec ) )
+        return 0;
+    g->npending++;
+    return 1;
+}
+
+// Confirma todas las particiones: cada hilo escribe y sincroniza la suya y
+// aquí se espera a que terminen todos
+int journal_group_commit ( journal_group *g ) {
+    int err;
+
+    if ( !g->npending )
+        return 1;
+
+    if ( g->count == 1 ) {
+        if ( !journal_commit ( &g->shards[0] ) )
+            return 0;
+        g->npending = 0;
+        return 1;
+    }
+
+    pthread_mutex_lock ( &g->lock );
+    g->running = g->count;
+    g->err     = 0;
+    g->round++;
+    pthread_cond_broadcast ( &g->start );
+    while ( g->running )
+        pthread_cond_wait ( &g->done, &g->lock );
+    err = g->err;
+    pthread_mutex_unlock ( &g->lock );
+
+    g->npending = 0;
+    for ( int i = 0; i < g->count; ++i )
+        g->npending += g->shards[i].npending;
+
+    errno = err;
+    return !err;
+}
+
+void journal_group_close ( journal_group *g ) {
+    if ( g->workers ) {
+        pthread_mutex_lock ( &g->lock );
+        g->stop = 1;
+        pthread_cond_broadcast ( &g->start );
+        pthread_mutex_unlock ( &g->lock );
+
+        for ( int i = 0; i < g->count; ++i )
+            if ( g->workers[i].started )
+                pthread_join ( g->workers[i].thread, NULL );
+
+        pthread_cond_destroy ( &g->done );
+        pthread_cond_destroy ( &g->start );
+        pthread_mutex_destroy ( &g->lock );
+        memuse_free ( MEMUSE_JOURNAL, g->workers );
+    }
+
+    for ( int i = 0; i < g->count; ++i )
+        journal_close ( &g->shards[i] );
+    memuse_free ( MEMUSE_JOURNAL, g->shards );
+    memset ( g, 0, sizeof ( journal_group ) );
+}
+
+// Memoria de un grupo de count particiones recién abierto: los búferes de
+// escritura crecen si un grupo de commit no cabe, y la reaplicación y la
+// compactación reservan aparte mientras duran
+size_t journal_group_footprint ( int count ) {
+    return count * ( sizeof ( journal ) + JOURNAL_BUF_INITIAL + ( count > 1 ? sizeof ( journal_group_worker ) : 0 ) );
+}
@@ -0,0 +1,188 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Bitácora de concesiones (solo se agrega al final).
+ *
+ * Cada cambio de estado de una concesión se guarda como un registro de tamaño
+ * fijo. Los registros se acumulan en memoria y journal_commit() los escribe
+ * con una sola escritura sincrónica: el servidor llama al commit una vez por
+ * grupo de paquetes y retiene las respuestas del grupo hasta que el commit
+ * termina (group commit), así que un ACK nunca sale antes de que su concesión
+ * esté en disco y el costo de la escritura se reparte entre todo el grupo.
+ *
+ * El archivo se abre con O_DIRECT | O_DSYNC (solo O_DSYNC donde no hay
+ * O_DIRECT, como en tmpfs) y se escribe por bloques alineados de
+ * JOURNAL_BLOCK: no pasa por la caché de páginas y no hace falta fdatasync().
+ * El bloque parcial del final se reescribe en el siguiente commit con los
+ * mismos bytes al principio, así que una escritura rota no puede dañar lo ya
+ * confirmado. El espacio se reserva con fallocate() de JOURNAL_PREALLOC en
+ * JOURNAL_PREALLOC, de modo que un commit normal no cambia el tamaño del
+ * archivo ni asigna bloques.
+ *
+ * Cada registro va en un marco con su longitud, un número de secuencia (su
+ * posición en el archivo, desde 1), la época (aperturas del archivo) y un
+ * CRC32C. Al arrancar se reaplican los registros en orden hasta el primer
+ * marco inválido: una escritura rota, el espacio reservado en ceros, o restos
+ * de una escritura que no se confirmó antes de una caída, que son de una
+ * época anterior a la del registro previo. Con varios hilos
+ * la bitácora se mapea y cada hilo reaplica un subconjunto fijo de
+ * direcciones (bloques de direcciones consecutivas repartidos entre los
+ * hilos), de modo que el orden por dirección se conserva.
+ *
+ * Compactación: un hilo escribe en un archivo nuevo un snapshot (un registro
+ * por concesión ocupada, obtenido con una función del servidor) seguido de la
+ * cola de la bitácora, es decir, los registros que se confirmaron desde el
+ * corte. El snapshot se toma de la tabla viva sin detener al servidor: toda
+ * concesión que cambie durante la copia tiene además un registro en la cola,
+ * que se aplica después y deja el estado correcto. El hilo sigue copiando la
+ * cola mientras el servidor confirma registros nuevos, hasta que faltan a lo
+ * más JOURNAL_COMPACT_TAIL; el servidor copia solo esos y reemplaza la
+ * bitácora con rename(). Si para entonces la cola volvió a crecer, el hilo
+ * se relanza para alcanzarla, así que el ciclo de paquetes nunca copia más
+ * de JOURNAL_COMPACT_TAIL registros. Tras el rename() se hace fsync() del
+ * directorio antes de confirmar un registro más en el archivo nuevo.
+ *
+ * Particiones: un journal_group reparte las concesiones por rango de
+ * direcciones entre varias bitácoras (<ruta>.0, <ruta>.1, ...), cada una con
+ * un hilo propio que hace su escritura sincrónica. El commit del grupo
+ * despierta a todos los hilos y espera a que terminen, así que las
+ * escrituras van en paralelo. Como cada dirección vive en una sola
+ * partición, al arrancar las particiones se reaplican a la vez y el
+ * resultado es la tabla completa.
+ * El número de particiones no puede cambiar mientras existan los archivos.
+ */
+
+#define JOURNAL_MAGIC "DHCPJRN1"
+#define JOURNAL_BLOCK 4096              // alineación de O_DIRECT; el encabezado ocupa un bloque
+#define JOURNAL_PREALLOC ( 64 << 20 )  // espacio que se reserva cada vez
+#define JOURNAL_REPLAY_THREADS_MAX 64
+#define JOURNAL_SHARDS_MAX 16
+#define JOURNAL_COMPACT_TAIL 1024  // registros que a lo más copia el servidor al cerrar una compactación
+
+typedef struct journal_header {
+    char      magic[8];
+    u_int32_t version;
+    u_int32_t rec_size;
+    u_int32_t frame_size;
+    u_int32_t epoch;  // se incrementa en cada apertura
+} journal_header;
+
+typedef struct journal_rec {
+    u_int32_t ip;          // orden de red
+    u_int32_t xid;
+    int64_t   expires;     // fin de la concesión en tiempo real (CLOCK_REALTIME), 0 si no aplica
+    u_int32_t lease_time;
+    u_char    mac[6];
+    u_int8_t  state;       // enum dhcp_lease_state
+    u_int8_t  reserved[5];
+} journal_rec;
+
+typedef struct journal_frame {
+    u_int32_t   crc;  // CRC32C de todo lo que sigue
+    u_int32_t   len;  // sizeof ( journal_rec )
+    u_int32_t   epoch;
+    u_int32_t   reserved;
+    u_int64_t   seq;
+    journal_rec rec;
+} journal_frame;
+
+// Escritura por bloques alineados al final de un archivo de bitácora
+typedef struct journal_writer {
+    int       fd;
+    u_char *  buf;        // desde el bloque que contiene el final del archivo
+    size_t    buf_len;    // bytes de registros en buf
+    size_t    buf_cap;    // múltiplo de JOURNAL_BLOCK
+    size_t    flushed;    // bytes de buf que ya están en disco
+    off_t     buf_off;    // posición de buf en el archivo, múltiplo de JOURNAL_BLOCK
+    off_t     allocated;  // bytes reservados con fallocate()
+    u_int64_t seq;        // secuencia del último registro agregado
+    u_int32_t epoch;
+} journal_writer;
+
+// Estado de la compactación
+#define JOURNAL_COMPACT_IDLE 0
+#define JOURNAL_COMPACT_RUNNING 1
+#define JOURNAL_COMPACT_READY 2
+#define JOURNAL_COMPACT_FAILED 3
+
+typedef void ( *journal_apply ) ( void *ctx, const journal_rec *rec );
+
+// Llena hasta max registros del snapshot a partir de *pos y avanza *pos;
+// regresa 0 cuando ya no hay más
+typedef size_t ( *journal_snapshot ) ( void *ctx, size_t *pos, journal_rec *out, size_t max );
+
+typedef struct journal_compaction {
+    pthread_t        thread;
+    int              state;    // JOURNAL_COMPACT_*, se lee y escribe con atómicos
+    journal_writer   w;        // archivo nuevo
+    int              read_fd;  // bitácora actual, para copiar la cola
+    int              err;
+    journal_snapshot snapshot;
+    void *           ctx;
+    u_int64_t        cut;     // registros de la bitácora cubiertos por el snapshot
+    u_int64_t        copied;  // registros de la bitácora ya copiados al archivo nuevo
+    int              tail;    // el hilo solo alcanza la cola; el snapshot ya está
+    struct timespec  start;
+} journal_compaction;
+
+typedef struct journal {
+    journal_writer w;
+    char *         path;
+    size_t         npending;  // registros agregados aún no escritos
+    u_int64_t      records;   // registros ya en disco (atómico: lo lee el hilo de compactación)
+    u_int64_t      commits;
+    int            dir_sync;  // falta el fsync() del directorio tras reemplazar la bitácora
+    // Compactación; los contadores se leen desde otros hilos con journal_compact_read()
+    journal_compaction compact;
+    u_int64_t          compactions;
+    double             compact_last_ms;  // duración de la última
+    double             compact_total_ms;
+} journal;
+
+typedef struct journal_compact_stats {
+    u_int64_t compactions;
+    double    last_ms;
+    double    total_ms;
+    int       running;
+} journal_compact_stats;
+
+struct journal_group_worker;
+
+typedef struct journal_group {
+    journal *                    shards;
+    int                          count;
+    size_t                       npending;  // registros sin confirmar en todas las particiones
+    struct journal_group_worker *workers;   // uno por partición, solo con más de una
+    pthread_mutex_t              lock;
+    pthread_cond_t               start;  // empieza una ronda de commit
+    pthread_cond_t               done;   // terminó la ronda
+    u_int64_t                    round;
+    int                          running;  // hilos que no han terminado la ronda
+    int                          err;
+    int                          stop;
+} journal_group;
+
+int  journal_open ( journal *j, const char *path );
+int  journal_replay ( journal *j, journal_apply apply, void *ctx, int threads );
+int  journal_append ( journal *j, const journal_rec *rec );
+int  journal_commit ( journal *j );
+void journal_close ( journal *j );
+int  journal_compact_start ( journal *j, journal_snapshot snapshot, void *ctx );
+int  journal_compact_poll ( journal *j );
+void journal_compact_read ( journal *j, journal_compact_stats *s );
+int  journal_group_open ( journal_group *g, const char *path, int count );
+int  journal_group_replay ( journal_group *g, journal_apply apply, void *ctx, int threads );
+int  journal_group_append ( journal_group *g, int shard, const journal_rec *rec );
+int  journal_group_commit ( journal_group *g );
+void journal_group_close ( journal_group *g );
+
+size_t journal_group_footprint ( int count );
+
+#endif  // JOURNAL_H
@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "leasedb.h"
+#include "memuse.h"
+
+#define LEASEDB_VERSION 1
+
+static u_int32_t leasedb_checksum ( const leasedb_header *hdr ) {
+    const u_char *p = ( const u_char * ) hdr;
+    u_int32_t     h = 2166136261u;
+
+    for ( size_t i = 0; i < offsetof ( leasedb_header, checksum ); ++i ) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int leasedb_same_pool ( const leasedb_geometry *a, const leasedb_geometry *b ) {
+    return a->rec_size == b->rec_size && a->count == b->count && a->first_ip == b->first_ip
+           && a->last_ip == b->last_ip;
+}
+
+// Mapea la base en path. Si no existe, está dañada o el pool es otro, se
+// crea de nuevo con la tabla en ceros. Regresa LEASEDB_ERROR con errno si
+// falla.
+int leasedb_open ( leasedb *db, const char *path, const leasedb_geometry *geometry ) {
+    struct stat    st;
+    leasedb_header hdr;
+    int            result = LEASEDB_VALID;
+
+    memset ( db, 0, sizeof ( leasedb ) );
+    db->size = LEASEDB_HEADER_SIZE + ( size_t ) geometry->rec_size * geometry->count;
+
+    if ( ( db->fd = open ( path, O_RDWR | O_CREAT | O_CLOEXEC, 0644 ) ) == -1 || fstat ( db->fd, &st ) == -1 )
+        goto fail;
+
+    memset ( &hdr, 0, sizeof ( hdr ) );
+    if ( pread ( db->fd, &hdr, sizeof ( hdr ), 0 ) == -1 )
+        goto fail;
+
+    if ( ( size_t ) st.st_size < db->size || memcmp ( hdr.magic, LEASEDB_MAGIC, sizeof ( hdr.magic ) )
+         || hdr.version != LEASEDB_VERSION || hdr.checksum != leasedb_checksum ( &hdr )
+         || !leasedb_same_pool ( &hdr.geometry, geometry ) ) {
+        // Tabla nueva: truncar a 0 deja todos los registros en ceros
+        if ( ftruncate ( db->fd, 0 ) == -1 || ftruncate ( db->fd, db->size ) == -1 )
+            goto fail;
+        result = LEASEDB_CREATED;
+    } else if ( hdr.geometry.layout != geometry->layout )
+        result = LEASEDB_LAYOUT;
+
+    db->map = mmap ( NULL, db->size, PROT_READ | PROT_WRITE, MAP_SHARED, db->fd, 0 );
+    if ( db->map == MAP_FAILED ) {
+        db->map = NULL;
+        goto fail;
+    }
+    memuse_add ( MEMUSE_LEASES, db->size );
+    db->hdr     = ( leasedb_header * ) db->map;
+    db->records = db->map + LEASEDB_HEADER_SIZE;
+
+    if ( result == LEASEDB_CREATED ) {
+        memset ( db->hdr, 0, sizeof ( leasedb_header ) );
+        memcpy ( db->hdr->magic, LEASEDB_MAGIC, sizeof ( db->hdr->magic ) );
+        db->hdr->version  = LEASEDB_VERSION;
+        db->hdr->geometry = *geometry;
+        db->hdr->checksum = leasedb_checksum ( db->hdr );
+    }
+
+    return result;
+
+fail:
+    leasedb_close ( db );
+    return LEASEDB_ERROR;
+}
+
+void leasedb_set_layout ( leasedb *db, u_int32_t layout ) {
+    db->hdr->geometry.layout = layout;
+    db->hdr->checksum        = leasedb_checksum ( db->hdr );
+}
+
+void leasedb_set_clock ( leasedb *db, int64_t realtime, int64_t clock ) {
+    db->hdr->saved_realtime = realtime;
+    db->hdr->saved_clock    = clock;
+    db->hdr->checksum       = leasedb_checksum ( db->hdr );
+}
+
+// Fuerza a disco todo lo que se haya modificado de la tabla
+int leasedb_sync ( leasedb *db ) {
+    return msync ( db->map, db->size, MS_SYNC ) == 0;
+}
+
+void leasedb_close ( leasedb *db ) {
+    if ( db->map ) {
+        munmap ( db->map, db->size );
+        memuse_add ( MEMUSE_LEASES, -( int64_t ) db->size );
+    }
+    if ( db->fd > 0 )
+        close ( db->fd );
+    memset ( db, 0, sizeof ( leasedb ) );
+}
@@ -0,0 +1,62 @@
+#ifndef LEASEDB_H
+#define LEASEDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Base de concesiones en un archivo mapeado en memoria.
+ *
+ * El archivo es un encabezado de una página seguido directamente por la tabla
+ * de concesiones tal como la usa el servidor (registros de tamaño fijo sin
+ * punteros). Abrirla es un mmap más la validación del encabezado: versión,
+ * geometría del pool (tamaño de registro, número de concesiones y rango) y
+ * una suma de verificación del encabezado. No se lee ni se toca la tabla, así
+ * que reiniciar no depende del número de concesiones.
+ *
+ * El encabezado guarda también un punto del reloj de concesiones para que los
+ * temporizadores continúen entre reinicios sin ajustar registro por registro.
+ */
+
+#define LEASEDB_MAGIC "DHCPLDB1"
+#define LEASEDB_HEADER_SIZE 4096
+
+// Resultado de leasedb_open()
+#define LEASEDB_ERROR 0
+#define LEASEDB_VALID 1    // tabla recuperada
+#define LEASEDB_CREATED 2  // tabla nueva en ceros: hay que inicializarla
+#define LEASEDB_LAYOUT 3   // tabla recuperada, pero cambió la asignación de clases
+
+typedef struct leasedb_geometry {
+    u_int32_t rec_size;
+    u_int32_t count;
+    u_int32_t first_ip;  // orden de red
+    u_int32_t last_ip;
+    u_int32_t layout;    // hash de la asignación de clases al pool
+} leasedb_geometry;
+
+typedef struct leasedb_header {
+    char             magic[8];
+    u_int32_t        version;
+    leasedb_geometry geometry;
+    int64_t          saved_realtime;  // CLOCK_REALTIME ...
+    int64_t          saved_clock;     // ... y reloj de concesiones en el mismo instante
+    u_int32_t        checksum;        // FNV-1a de todo lo anterior
+} leasedb_header;
+
+typedef struct leasedb {
+    int             fd;
+    u_char *        map;
+    size_t          size;
+    leasedb_header *hdr;
+    void *          records;
+} leasedb;
+
+int  leasedb_open ( leasedb *db, const char *path, const leasedb_geometry *geometry );
+void leasedb_set_layout ( leasedb *db, u_int32_t layout );
+void leasedb_set_clock ( leasedb *db, int64_t realtime, int64_t clock );
+int  leasedb_sync ( leasedb *db );
+void leasedb_close ( leasedb *db );
+
+#endif  // LEASEDB_H
@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "leaseview.h"
+#include "memuse.h"
+
+#define LEASEVIEW_VERSION 1
+
+// Crea (o reemplaza) el segmento name con count registros en ceros. Regresa
+// 0 con errno si falla.
+int leaseview_create ( leaseview *v, const char *name, u_int32_t count, u_int32_t first_ip ) {
+    int fd, err;
+
+    memset ( v, 0, sizeof ( leaseview ) );
+    v->size = LEASEVIEW_HEADER_SIZE + ( size_t ) count * sizeof ( leaseview_rec );
+    if ( !( v->name = strdup ( name ) ) )
+        return 0;
+
+    // Un lector que aún tenga mapeado el segmento anterior lo conserva; los
+    // nuevos abren este
+    shm_unlink ( name );
+    if ( ( fd = shm_open ( name, O_RDWR | O_CREAT | O_EXCL, 0644 ) ) == -1 )
+        goto fail;
+    if ( ftruncate ( fd, v->size ) == -1 ) {
+        err = errno;
+        close ( fd );
+        shm_unlink ( name );
+        errno = err;
+        goto fail;
+    }
+
+    v->map = mmap ( NULL, v->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    err    = errno;
+    close ( fd );
+    if ( v->map == MAP_FAILED ) {
+        v->map = NULL;
+        shm_unlink ( name );
+        errno = err;
+        goto fail;
+    }
+    memuse_add ( MEMUSE_LEASES, v->size );
+    v->hdr  = ( leaseview_header * ) v->map;
+    v->recs = ( leaseview_rec * ) ( v->map + LEASEVIEW_HEADER_SIZE );
+
+    memcpy ( v->hdr->magic, LEASEVIEW_MAGIC, sizeof ( v->hdr->magic ) );
+    v->hdr->version     = LEASEVIEW_VERSION;
+    v->hdr->header_size = LEASEVIEW_HEADER_SIZE;
+    v->hdr->rec_size    = sizeof ( leaseview_rec );
+    v->hdr->count       = count;
+    v->hdr->first_ip    = first_ip;
+    v->hdr->pid         = getpid ();
+    v->hdr->started     = time ( NULL );
+    return 1;
+
+fail:
+    err = errno;
+    free ( v->name );
+    v->name = NULL;
+    errno   = err;
+    return 0;
+}
+
+// Publica el registro index; solo lo llama el servidor, desde un solo hilo
+void leaseview_update ( leaseview *v, size_t index, const leaseview_rec *rec ) {
+    leaseview_rec *r   = &v->recs[index];
+    u_int32_t      seq = v->hdr->seq, rseq = r->seq;
+
+    __atomic_store_n ( &v->hdr->seq, seq + 1, __ATOMIC_RELAXED );
+    __atomic_store_n ( &r->seq, rseq + 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence ( __ATOMIC_RELEASE );
+
+    memcpy ( ( u_char * ) r + sizeof ( r->seq ), ( const u_char * ) rec + sizeof ( rec->seq ),
+             sizeof ( leaseview_rec ) - sizeof ( rec->seq ) );
+
+    __atomic_store_n ( &r->seq, rseq + 2, __ATOMIC_RELEASE );
+    __atomic_store_n ( &v->hdr->seq, seq + 2, __ATOMIC_RELEASE );
+}
+
+void leaseview_close ( leaseview *v ) {
+    if ( v->map ) {
+        munmap ( v->map, v->size );
+        memuse_add ( MEMUSE_LEASES, -( int64_t ) v->size );
+    }
+    if ( v->name )
+        shm_unlink ( v->name );
+    free ( v->name );
+    memset ( v, 0, sizeof ( leaseview ) );
+}
+
+// Mapea en solo lectura el segmento que publica un servidor. Regresa 0 con
+// errno si falla; EINVAL si no es una vista de esta versión.
+int leaseview_attach ( leaseview *v, const char *name ) {
+    struct stat st;
+    int         fd, err;
+
+    memset ( v, 0, sizeof ( leaseview ) );
+    if ( ( fd = shm_open ( name, O_RDONLY, 0 ) ) == -1 )
+        return 0;
+    err = fstat ( fd, &st ) == -1 ? errno : ( size_t ) st.st_size < LEASEVIEW_HEADER_SIZE ? EINVAL : 0;
+    if ( err ) {
+        close ( fd );
+        errno = err;
+        return 0;
+    }
+
+    v->size = st.st_size;
+    v->map  = mmap ( NULL, v->size, PROT_READ, MAP_SHARED, fd, 0 );
+    err     = errno;
+    close ( fd );
+    if ( v->map == MAP_FAILED ) {
+        memset ( v, 0, sizeof ( leaseview ) );
+        errno = err;
+        return 0;
+    }
+    v->hdr  = ( leaseview_header * ) v->map;
+    v->recs = ( leaseview_rec * ) ( v->map + LEASEVIEW_HEADER_SIZE );
+
+    if ( memcmp ( v->hdr->magic, LEASEVIEW_MAGIC, sizeof ( v->hdr->magic ) ) || v->hdr->version != LEASEVIEW_VERSION
+         || v->hdr->header_size != LEASEVIEW_HEADER_SIZE || v->hdr->rec_size != sizeof ( leaseview_rec )
+         || v->size < LEASEVIEW_HEADER_SIZE + ( size_t ) v->hdr->count * sizeof ( leaseview_rec ) ) {
+        leaseview_detach ( v );
+        errno = EINVAL;
+        return 0;
+    }
+    return 1;
+}
+
+// Copia el registro index sin que cambie a la mitad. Regresa 0 con EAGAIN si
+// en tries intentos siempre estuvo cambiando.
+int leaseview_read_rec ( const leaseview *v, size_t index, leaseview_rec *out, int tries ) {
+    const leaseview_rec *r = &v->recs[index];
+
+    for ( ; tries > 0; --tries ) {
+        u_int32_t seq = __atomic_load_n ( &r->seq, __ATOMIC_ACQUIRE );
+
+        if ( !( seq & 1 ) ) {
+            memcpy ( out, r, sizeof ( leaseview_rec ) );
+            __atomic_thread_fence ( __ATOMIC_ACQUIRE );
+            if ( __atomic_load_n ( &r->seq, __ATOMIC_RELAXED ) == seq )
+                return 1;
+        }
+        sched_yield ();
+    }
+    errno = EAGAIN;
+    return 0;
+}
+
+// Copia la tabla completa (hdr->count registros) como estaba en un instante.
+// Regresa 0 con EAGAIN si en tries intentos siempre hubo cambios durante la
+// copia.
+int leaseview_read ( const leaseview *v, leaseview_rec *out, int tries ) {
+
+    for ( ; tries > 0; --tries ) {
+        u_int32_t seq = __atomic_load_n ( &v->hdr->seq, __ATOMIC_ACQUIRE );
+
+        if ( !( seq & 1 ) ) {
+            memcpy ( out, v->recs, v->hdr->count * sizeof ( leaseview_rec ) );
+            __atomic_thread_fence ( __ATOMIC_ACQUIRE );
+            if ( __atomic_load_n ( &v->hdr->seq, __ATOMIC_RELAXED ) == seq )
+                return 1;
+        }
+        sched_yield ();
+    }
+    errno = EAGAIN;
+    return 0;
+}
+
+void leaseview_detach ( leaseview *v ) {
+    if ( v->map )
+        munmap ( v->map, v->size );
+    memset ( v, 0, sizeof ( leaseview ) );
+}
@@ -0,0 +1,74 @@
+#ifndef LEASEVIEW_H
+#define LEASEVIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Vista de solo lectura de la tabla de concesiones en memoria compartida.
+ *
+ * El servidor crea un segmento POSIX (shm_open()) con un encabezado de una
+ * página seguido de un registro de tamaño fijo por dirección del pool, en el
+ * mismo orden que la tabla. El formato es independiente de la estructura
+ * interna del servidor, de modo que una herramienta externa lo mapea con
+ * PROT_READ y lee el estado directamente, sin copias ni llamadas al servidor.
+ *
+ * Cada cambio de una concesión se publica con dos seqlocks: el del registro y
+ * el de toda la tabla (seq del encabezado). Los dos son impares mientras la
+ * escritura está en curso. Un lector que quiere una concesión copia el
+ * registro entre dos lecturas del seq del registro; uno que quiere la tabla
+ * completa y consistente hace lo mismo con el seq del encabezado y reintenta
+ * si cambió (leaseview_read_rec() y leaseview_read()).
+ *
+ * El segmento se borra al cerrar el servidor. Si el servidor terminó sin
+ * cerrarlo, el pid del encabezado ya no existe.
+ */
+
+#define LEASEVIEW_MAGIC "DHCPVIW1"
+#define LEASEVIEW_HEADER_SIZE 4096
+
+typedef struct leaseview_header {
+    char      magic[8];
+    u_int32_t version;
+    u_int32_t header_size;  // los registros empiezan aquí
+    u_int32_t rec_size;
+    u_int32_t count;
+    u_int32_t first_ip;  // orden de red; el registro i es first_ip + i
+    u_int32_t pid;
+    int64_t   started;    // CLOCK_REALTIME
+    u_int32_t seq;        // seqlock de la tabla
+    u_int32_t reserved;
+} leaseview_header;
+
+typedef struct leaseview_rec {
+    u_int32_t seq;         // seqlock del registro
+    u_int32_t ip;          // orden de red
+    int64_t   expires;     // CLOCK_REALTIME, 0 si no aplica
+    u_int32_t lease_time;
+    u_int32_t xid;
+    u_char    mac[6];
+    u_int8_t  state;     // enum dhcp_lease_state: 0 libre, 1 concedida, 2 reservada, 3 prohibida, ...
+    u_int8_t  class_id;  // 0 = pool general
+} leaseview_rec;
+
+typedef struct leaseview {
+    char *            name;
+    u_char *          map;
+    size_t            size;
+    leaseview_header *hdr;
+    leaseview_rec *   recs;
+} leaseview;
+
+// Servidor
+int  leaseview_create ( leaseview *v, const char *name, u_int32_t count, u_int32_t first_ip );
+void leaseview_update ( leaseview *v, size_t index, const leaseview_rec *rec );
+void leaseview_close ( leaseview *v );
+
+// Herramientas externas
+int  leaseview_attach ( leaseview *v, const char *name );
+int  leaseview_read_rec ( const leaseview *v, size_t index, leaseview_rec *out, int tries );
+int  leaseview_read ( const leaseview *v, leaseview_rec *out, int tries );
+void leaseview_detach ( leaseview *v );
+
+#endif  // LEASEVIEW_H
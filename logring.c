@@ -0,0 +1,190 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "logring.h"
+#include "memuse.h"
+
+#define LOGRING_LINE_MAX 1024  // espacio que se deja libre para formatear un evento
+#define LOGRING_IDLE_NS 2000000
+
+static char *logring_put_str ( char *p, const char *s, size_t max ) {
+    size_t len = strnlen ( s, max );
+
+    memcpy ( p, s, len );
+    return p + len;
+}
+
+// Formatea un evento en p; regresa el fin de la línea
+static char *logring_format ( const logring *r, const logring_rec *rec, char *p ) {
+    const char *  fmt = rec->id < r->nevents ? r->events[rec->id].fmt : "evento desconocido";
+    const u_char *ip;
+    u_int32_t     ip4;
+    struct tm     tm;
+    time_t        t   = rec->time.tv_sec;
+    int           arg = 0;
+    u_int64_t     v;
+
+    localtime_r ( &t, &tm );
+    p += strftime ( p, 32, "%Y-%m-%d %H:%M:%S", &tm );
+    p += sprintf ( p, ".%03ld ", rec->time.tv_nsec / 1000000 );
+
+    for ( char *end = p + LOGRING_LINE_MAX - 64; *fmt && p < end; ++fmt ) {
+        if ( *fmt != '%' || !fmt[1] ) {
+            *p++ = *fmt;
+            continue;
+        }
+        if ( *++fmt == '%' ) {
+            *p++ = '%';
+            continue;
+        }
+
+        v = arg < LOGRING_ARGS ? rec->args[arg++] : 0;
+        switch ( *fmt ) {
+            case 'u':
+                p += sprintf ( p, "%llu", ( unsigned long long ) v );
+                break;
+            case 'd':
+                p += sprintf ( p, "%lld", ( long long ) v );
+                break;
+            case 'x':
+                p += sprintf ( p, "%llx", ( unsigned long long ) v );
+                break;
+            case 'i':
+                ip4 = v;
+                ip  = ( const u_char * ) &ip4;
+                p += sprintf ( p, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3] );
+                break;
+            case 'm':
+                p += sprintf ( p, "%02x:%02x:%02x:%02x:%02x:%02x", ( u_int8_t ) ( v >> 40 ), ( u_int8_t ) ( v >> 32 ),
+                               ( u_int8_t ) ( v >> 24 ), ( u_int8_t ) ( v >> 16 ), ( u_int8_t ) ( v >> 8 ),
+                               ( u_int8_t ) v );
+                break;
+            case 's':
+                p = logring_put_str ( p, v ? ( const char * ) ( uintptr_t ) v : "(null)", end - p );
+                break;
+            default:
+                *p++ = '%';
+                *p++ = *fmt;
+        }
+    }
+    *p++ = '\n';
+    return p;
+}
+
+static void logring_write ( logring *r, char *buf, size_t len ) {
+    for ( size_t done = 0; done < len; ) {
+        ssize_t n = write ( r->fd, buf + done, len - done );
+
+        if ( n == -1 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            return;  // la salida no acepta más; las líneas se pierden
+        done += n;
+    }
+}
+
+// Hilo escritor: vacía el anillo por bloques y duerme mientras no hay nada
+static void *logring_writer ( void *arg ) {
+    logring *             r    = arg;
+    char *                p    = r->buf;
+    u_int64_t             tail = r->tail, head, dropped = 0;
+    const struct timespec idle = {0, LOGRING_IDLE_NS};
+
+    for ( ;; ) {
+        head = __atomic_load_n ( &r->head, __ATOMIC_ACQUIRE );
+
+        for ( ; tail != head; ++tail ) {
+            if ( r->buf + LOGRING_BUF_SIZE - p < LOGRING_LINE_MAX ) {
+                logring_write ( r, r->buf, p - r->buf );
+                p = r->buf;
+            }
+            p = logring_format ( r, &r->slots[tail & ( LOGRING_SLOTS - 1 )], p );
+
+            // Se libera por tramos para no tocar la línea del productor en
+            // cada evento
+            if ( !( tail & 255 ) )
+                __atomic_store_n ( &r->tail, tail + 1, __ATOMIC_RELEASE );
+        }
+        __atomic_store_n ( &r->tail, tail, __ATOMIC_RELEASE );
+
+        if ( __atomic_load_n ( &r->dropped, __ATOMIC_RELAXED ) != dropped ) {
+            u_int64_t now = __atomic_load_n ( &r->dropped, __ATOMIC_RELAXED );
+
+            if ( r->buf + LOGRING_BUF_SIZE - p < LOGRING_LINE_MAX ) {
+                logring_write ( r, r->buf, p - r->buf );
+                p = r->buf;
+            }
+            p += sprintf ( p, "[%llu eventos perdidos: el anillo estaba lleno]\n",
+                           ( unsigned long long ) ( now - dropped ) );
+            dropped = now;
+        }
+        if ( p != r->buf ) {
+            logring_write ( r, r->buf, p - r->buf );
+            p = r->buf;
+        }
+
+        if ( __atomic_load_n ( &r->stop, __ATOMIC_ACQUIRE ) && __atomic_load_n ( &r->head, __ATOMIC_ACQUIRE ) == tail )
+            return NULL;
+        nanosleep ( &idle, NULL );
+    }
+}
+
+// Reserva el anillo y arranca el escritor, que escribe en fd con la tabla
+// events. Regresa 0 con errno si falla.
+int logring_open ( logring *r, const logring_event *events, size_t nevents, int fd, int level, u_int32_t sample ) {
+    int err;
+
+    memset ( r, 0, sizeof ( logring ) );
+    r->events  = events;
+    r->nevents = nevents;
+    r->fd      = fd;
+    r->sample  = sample ? sample : 1;
+    r->limit   = LOGRING_SLOTS;
+
+    if ( !( r->slots = memuse_malloc ( MEMUSE_LOG, LOGRING_SLOTS * sizeof ( logring_rec ) ) )
+         || !( r->buf = memuse_malloc ( MEMUSE_LOG, LOGRING_BUF_SIZE ) ) )
+        goto fail;
+
+    // Se tocan todas las páginas ahora para que el ciclo no tenga fallos de
+    // página al escribir
+    memset ( r->slots, 0, LOGRING_SLOTS * sizeof ( logring_rec ) );
+    if ( ( err = pthread_create ( &r->thread, NULL, logring_writer, r ) ) ) {
+        errno = err;
+        goto fail;
+    }
+    logring_set_level ( r, level );
+    return 1;
+
+fail:
+    err = errno;
+    memuse_free ( MEMUSE_LOG, r->slots );
+    memuse_free ( MEMUSE_LOG, r->buf );
+    memset ( r, 0, sizeof ( logring ) );
+    errno = err;
+    return 0;
+}
+
+// Cambia el nivel; rige desde el siguiente paquete
+void logring_set_level ( logring *r, int level ) {
+    if ( !r->slots )
+        return;
+    if ( level < LOGRING_OFF )
+        level = LOGRING_OFF;
+    if ( level > LOGRING_DEBUG )
+        level = LOGRING_DEBUG;
+    __atomic_store_n ( &r->level, level, __ATOMIC_RELAXED );
+}
+
+// Espera a que se escriba lo pendiente y libera todo
+void logring_close ( logring *r ) {
+    if ( !r->slots )
+        return;
+
+    __atomic_store_n ( &r->stop, 1, __ATOMIC_RELEASE );
+    pthread_join ( r->thread, NULL );
+    memuse_free ( MEMUSE_LOG, r->slots );
+    memuse_free ( MEMUSE_LOG, r->buf );
+    memset ( r, 0, sizeof ( logring ) );
+}
@@ -0,0 +1,125 @@
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Registro asíncrono de eventos para el ciclo de paquetes.
+ *
+ * El ciclo no formatea ni escribe: logring_log() copia el número de evento,
+ * la hora y hasta LOGRING_ARGS argumentos enteros a un anillo de un solo
+ * productor y un solo consumidor, sin candados ni llamadas al sistema (si
+ * el anillo está lleno el evento se cuenta como perdido). Un hilo escritor
+ * vacía el anillo, formatea cada evento con la cadena de su tabla y escribe
+ * por bloques.
+ *
+ * En las cadenas de formato %u, %d y %x toman un entero, %i una dirección
+ * IPv4 en orden de red, %m una MAC (los 48 bits de abajo, como la da
+ * logring_mac()) y %s una cadena que no cambia (constante o de la
+ * configuración).
+ *
+ * El nivel se puede cambiar en ejecución (logring_set_level() se puede
+ * llamar desde un manejador de señal). Con muestreo, los eventos de nivel
+ * LOGRING_DEBUG se guardan solo para uno de cada sample paquetes; la
+ * decisión se toma por paquete en logring_packet() para no partir la traza
+ * de un mismo mensaje.
+ */
+
+#define LOGRING_OFF 0
+#define LOGRING_ERROR 1
+#define LOGRING_INFO 2
+#define LOGRING_DEBUG 3
+
+#define LOGRING_SLOTS 8192  // potencia de 2; 512 KB, cabe en caché
+#define LOGRING_BUF_SIZE ( 1 << 16 )
+#define LOGRING_ARGS 4
+
+typedef struct logring_event {
+    int         level;
+    const char *fmt;
+} logring_event;
+
+typedef struct logring_rec {
+    struct timespec time;  // CLOCK_REALTIME_COARSE del paquete
+    u_int32_t       id;
+    u_int32_t       pad;
+    u_int64_t       args[LOGRING_ARGS];
+} logring_rec;
+
+typedef struct logring {
+    // Productor
+    u_int64_t       head;   // siguiente registro a escribir
+    u_int64_t       limit;  // hasta dónde se puede escribir sin volver a leer tail
+    int             active;  // nivel para el paquete en curso
+    int             level;
+    struct timespec now;     // hora del paquete en curso
+    u_int32_t       sample;  // 1 de cada sample paquetes lleva sus eventos LOGRING_DEBUG
+    u_int32_t       countdown;
+    u_int64_t       dropped;
+
+    // Consumidor, en otra línea de caché
+    u_int64_t tail __attribute__ ( ( aligned ( 64 ) ) );
+    int       stop;
+
+    logring_rec *        slots;
+    const logring_event *events;
+    size_t               nevents;
+    int                  fd;
+    pthread_t            thread;
+    char *               buf;
+} logring;
+
+int  logring_open ( logring *r, const logring_event *events, size_t nevents, int fd, int level, u_int32_t sample );
+void logring_set_level ( logring *r, int level );
+void logring_close ( logring *r );
+
+static inline u_int64_t logring_mac ( const u_char *mac ) {
+    return ( u_int64_t ) mac[0] << 40 | ( u_int64_t ) mac[1] << 32 | ( u_int64_t ) mac[2] << 24
+           | ( u_int64_t ) mac[3] << 16 | ( u_int64_t ) mac[4] << 8 | mac[5];
+}
+
+// Decide si los eventos LOGRING_DEBUG del paquete que empieza se guardan y
+// toma la hora que llevan todos sus eventos
+static inline void logring_packet ( logring *r ) {
+    int level = __atomic_load_n ( &r->level, __ATOMIC_RELAXED );
+
+    if ( level == LOGRING_DEBUG && r->sample > 1 ) {
+        if ( r->countdown )
+            level = LOGRING_INFO;
+        r->countdown = r->countdown ? r->countdown - 1 : r->sample - 1;
+    }
+    r->active = level;
+    if ( level != LOGRING_OFF )
+        clock_gettime ( CLOCK_REALTIME_COARSE, &r->now );
+}
+
+// Registra el evento id de la tabla; no hace nada si su nivel no está activo
+static inline void logring_log ( logring *r, u_int32_t id, u_int64_t a0, u_int64_t a1, u_int64_t a2, u_int64_t a3 ) {
+    logring_rec *rec;
+
+    if ( r->active == LOGRING_OFF || r->events[id].level > r->active )
+        return;
+
+    if ( r->head == r->limit ) {
+        r->limit = __atomic_load_n ( &r->tail, __ATOMIC_ACQUIRE ) + LOGRING_SLOTS;
+        if ( r->head == r->limit ) {
+            __atomic_store_n ( &r->dropped, r->dropped + 1, __ATOMIC_RELAXED );
+            return;
+        }
+    }
+
+    rec = &r->slots[r->head & ( LOGRING_SLOTS - 1 )];
+    rec->time    = r->now;
+    rec->id      = id;
+    rec->args[0] = a0;
+    rec->args[1] = a1;
+    rec->args[2] = a2;
+    rec->args[3] = a3;
+    __atomic_store_n ( &r->head, r->head + 1, __ATOMIC_RELEASE );
+}
+
+#endif  // LOGRING_H
@@ -1,13 +1,18 @@
 ﻿
 #include <arpa/inet.h>  //funciones usadas para internet
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>  //constantes tipo O_*
+#include <linux/errqueue.h>  // struct scm_timestamping
+#include <linux/net_tstamp.h>
 #include <net/if.h>
 #include <net/if_arp.h>
 #include <net/route.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <resolv.h>  //resolutores
+#include <sched.h>
 #include <signal.h>  //señales
 #include <stdarg.h>  //Manejar argumentos del tipo " ... "
 #include <stdbool.h>
@@ -24,10 +29,84 @@
 #include <syslog.h>    //log del sistema
 #include <time.h>
 #include <unistd.h>  //llamadas al sistema
+#include "audit.h"
+#include "capture.h"
+#include "classify.h"
 #include "cmdline.h"
+#include "control.h"
+#include "eventring.h"
+#include "export.h"
+#include "hooks.h"
+#include "import.h"
+#include "journal.h"
+#include "leasedb.h"
+#include "leaseview.h"
+#include "logring.h"
+#include "memuse.h"
+#include "metrics.h"
+#include "profile.h"
+#include "strtab.h"
+#include "xtrace.h"
 
 #define MAX_BUFSIZE 1500
 
+// Campos del encabezado BOOTP usados por la sobrecarga de opciones (52) y
+// por el arranque por red
+#define DHCP_SIADDR_OFFSET 20
+#define DHCP_SNAME_OFFSET 44
+#define DHCP_SNAME_LEN 64
+#define DHCP_FILE_OFFSET 108
+#define DHCP_FILE_LEN 128
+#define DHCP_OPTIONS_OFFSET 240
+
+#define OVERLOAD_FILE 1
+#define OVERLOAD_SNAME 2
+
+// Banderas de la opción 81, Client FQDN (RFC 4702)
+#define FQDN_S 0x01  // el servidor debe actualizar el registro A
+#define FQDN_O 0x02  // el servidor ignoró la petición del cliente
+#define FQDN_E 0x04  // nombre en formato de etiquetas DNS
+#define FQDN_N 0x08  // el servidor no hará ninguna actualización
+
+// Tamaño mínimo que todo cliente acepta (RFC 2131) y cabeceras IP + UDP
+#define DHCP_MIN_MSG_SIZE 576
+#define DHCP_IP_UDP_HEADERS 28
+
+// Clases de clientes (la 0 es la general) y tamaño de su plantilla de opciones
+#define CLASS_MAX 32
+#define CLASS_TEMPLATE_MAX 512
+
+// Parámetros de arranque por red (PXE); la arquitectura es la de la opción 93
+#define BOOT_MAX 32
+#define BOOT_ARCH_ANY 0xffff
+
+// Respuestas retenidas como máximo por grupo de la bitácora (group commit)
+#define REPLY_BATCH_MAX 64
+
+// Envíos recientes cuya marca de envío del kernel se espera (potencia de 2)
+#define TX_TRACK 256
+
+// Registros de la bitácora por commit al importar concesiones de otro servidor
+#define IMPORT_COMMIT_RECORDS 65536
+
+// Concesiones que recorre una exportación por vuelta del ciclo principal
+#define EXPORT_CHUNK 16384
+
+// Concesiones que recorre cada parte de una respuesta del socket de control
+// (una ronda recorre a lo más CONTROL_RUN_FILLS partes) y ms entre revisiones
+// del socket mientras el ciclo no espera en poll()
+#define CONTROL_CHUNK 4096
+#define CONTROL_INTERVAL_MS 10
+
+// Nombres vivos por debajo de los cuales no se recolecta la tabla
+#define NAMES_COLLECT_MIN 4096
+
+// Largo medio supuesto de los nombres de cliente en la previsión de memoria
+#define MEMORY_PLAN_NAME_LEN 24
+
+// Máximo de fragmentos de opción por mensaje (cada uno ocupa al menos 2 bytes)
+#define MAX_OPT_FRAGS ( MAX_BUFSIZE / 2 )
+
 #define MODE_CONFIG_FILE 0     // Archivo de configuración + línea de comandos
 #define MODE_ONLY_CMDLINE 1    // Solo línea de comandos
 #define MODE_NET_PARAMETERS 2  // Obtener parámetros de red
@@ -62,25 +141,73 @@ enum dhcp_lease_state {
     S_OWN      = 6
 };
 
+// Eventos del ciclo de paquetes (ver log_events)
+enum log_event {
+    EV_RECEIVED,
+    EV_DECODED,
+    EV_OPTIONS,
+    EV_DISCOVER,
+    EV_NO_FREE,
+    EV_OFFER,
+    EV_REQUEST,
+    EV_REQUEST_CHECK,
+    EV_REQUEST_VALID,
+    EV_REGISTERED,
+    EV_REGISTER_FAILED,
+    EV_ACK,
+    EV_RENEW_CHECK,
+    EV_RENEW,
+    EV_NOT_FOUND,
+    EV_DECLINE,
+    EV_RELEASE,
+    EV_RELEASED,
+    EV_INFORM,
+    EV_LEASE,
+    EV_SLOW_EXCHANGE,
+    EV_NAMES_COLLECTED,
+    EV_COUNT
+};
+
+// Formato y nivel de cada evento; los argumentos se formatean en el hilo
+// escritor (ver logring.h)
+static const logring_event log_events[EV_COUNT] = {
+    [EV_RECEIVED]        = {LOGRING_DEBUG, "Mensaje DHCP recibido: %u bytes de %i"},
+    [EV_DECODED]         = {LOGRING_DEBUG, "Mensaje DHCP decodificado: tipo %u, xid %x, chaddr %m, clase %u"},
+    [EV_OPTIONS]         = {LOGRING_DEBUG, "Opciones: %u, IP solicitada %i, hostname de %u bytes"},
+    [EV_DISCOVER]        = {LOGRING_INFO, "DHCPDISCOVER de %m, xid %x"},
+    [EV_NO_FREE]         = {LOGRING_ERROR, "No hay IP libres por el momento para %m (clase %u)"},
+    [EV_OFFER]           = {LOGRING_INFO, "DHCPOFFER enviado: %i a %m"},
+    [EV_REQUEST]         = {LOGRING_INFO, "DHCPREQUEST de %m, xid %x"},
+    [EV_REQUEST_CHECK]   = {LOGRING_DEBUG, "ciaddr: %i, search_xid(): %u, server identifier: %u"},
+    [EV_REQUEST_VALID]   = {LOGRING_DEBUG, "DHCPREQUEST válido"},
+    [EV_REGISTERED]      = {LOGRING_DEBUG, "Registrado alquiler correctamente"},
+    [EV_REGISTER_FAILED] = {LOGRING_ERROR, "Fallo en registrar alquiler de %m, xid %x"},
+    [EV_ACK]             = {LOGRING_INFO, "DHCPACK enviado: %i a %m"},
+    [EV_RENEW_CHECK]     = {LOGRING_DEBUG, "search_lease(%i): %u"},
+    [EV_RENEW]           = {LOGRING_DEBUG, "Reconfirmamos concesión %i"},
+    [EV_NOT_FOUND]       = {LOGRING_ERROR, "Registro no encontrado para %i, DHCPNAK a %m"},
+    [EV_DECLINE]         = {LOGRING_INFO, "DHCPDECLINE de %m para %i"},
+    [EV_RELEASE]         = {LOGRING_INFO, "DHCPRELEASE de %m para %i"},
+    [EV_RELEASED]        = {LOGRING_INFO, "Liberamos dirección %i"},
+    [EV_INFORM]          = {LOGRING_INFO, "DHCPINFORM de %m (%i)"},
+    [EV_LEASE]           = {LOGRING_DEBUG, "Concesión %i: %s, mac %m, t3 %u"},
+    [EV_SLOW_EXCHANGE]   = {LOGRING_INFO, "Intercambio lento xid %x de %m: servidor %u µs, cliente %u µs"},
+    [EV_NAMES_COLLECTED] = {LOGRING_INFO, "Tabla de nombres: %u recuperados, %u en uso"},
+};
+
+// Concesión. Sin punteros ni copias de la configuración: la tabla completa
+// es un arreglo indexado por dirección que puede vivir en la base mapeada.
 typedef struct dhcp_lease {
     enum dhcp_lease_state state;
     struct in_addr        ip;
-    struct in_addr        broadcast;
-    struct in_addr        netmask;
-    struct in_addr        gateway;
-    struct in_addr        dns1;
-    struct in_addr        dns2;
-    time_t                renewal;
-    time_t                rebinding;
     time_t                lease_time;
-    struct timespec       elapsed;
-    struct timespec       start;
-    struct timespec       now;
+    struct timespec       start;  // en el reloj de concesiones, ver lease_clock()
     u_char                mac[6];
-    char                  hostname[255];
+    u_int8_t              class_id;  // clase dueña de la dirección (0 = pool general)
+    u_int32_t             hostname;  // handle en la tabla de nombres (0 = sin nombre)
+    u_int32_t             fqdn;      // handle del FQDN del cliente (opción 81)
     // int                   max_msg_size;
-    u_int32_t          xid;
-    struct dhcp_lease *next;
+    u_int32_t xid;
 
 } dhcp_lease;
 
@@ -88,7 +215,7 @@ typedef struct dhcp_options {
 
     struct in_addr     requested_address;        // 50
     char *             hostname;                 // 12
-    bool               overload;                 // 52
+    u_int8_t           overload;                 // 52
     char *             tftp_sv_name;             // 66
     char *             boot_filename;            // 67
     enum dhcp_msg_type type;                     // 53
@@ -97,6 +224,10 @@ typedef struct dhcp_options {
     u_int16_t          max_message_size;         // 57
     char *             vendor_class_identifier;  // 60
     u_char *           client_identifier;        // 61
+    u_int16_t          client_identifier_len;
+    u_int8_t           fqdn_flags;               // 81
+    char *             fqdn;
+    u_int16_t          client_arch;              // 93, la primera de la lista
     //
     struct in_addr netmask;  // 1
     struct in_addr router;   // 3
@@ -111,6 +242,43 @@ typedef struct dhcp_options {
 
 } dhcp_options;
 
+// Fragmento de una opción dentro del buffer de recepción. Una opción puede
+// venir partida en varias instancias (RFC 3396) y repartida entre el área de
+// opciones y los campos file/sname (opción 52); los fragmentos se encadenan
+// sin copiar nada.
+typedef struct dhcp_opt_frag {
+    const u_char *data;
+    u_int8_t      len;
+    u_int16_t     next;  // índice + 1 del siguiente fragmento, 0 si es el último
+} dhcp_opt_frag;
+
+typedef struct dhcp_opt_list {
+    u_int16_t     nfrags;
+    u_int16_t     ncodes;
+    u_int8_t      codes[256];  // códigos en orden de aparición
+    u_int16_t     head[256];   // índice + 1 del primer fragmento, 0 si no vino
+    u_int16_t     tail[256];
+    u_int16_t     len[256];    // longitud total ya concatenada
+    dhcp_opt_frag frag[MAX_OPT_FRAGS];
+    // Copias contiguas (terminadas en '\0') de las opciones de texto; válidas
+    // hasta que llegue el siguiente mensaje
+    u_char    arena[MAX_BUFSIZE + 256];
+    u_int16_t arena_len;
+} dhcp_opt_list;
+
+// Escritor de opciones de respuesta. Cuando el área de opciones se llena se
+// continúa en file y luego en sname, marcándolo con la opción 52.
+typedef struct dhcp_opt_writer {
+    u_char * buf;
+    u_char * p;
+    u_char * end;       // último byte utilizable de la región actual
+    u_char * opt_end;   // fin del área de opciones una vez cerrada
+    u_char * overload;  // byte de valor de la opción 52 en el área de opciones
+    u_int8_t region;    // 0 opciones, 1 file, 2 sname, 3 sin espacio
+    u_int8_t avail;     // campos que se pueden sobrecargar (OVERLOAD_*)
+    u_int8_t used;      // campos sobrecargados
+} dhcp_opt_writer;
+
 typedef struct dhcp_msg {
 
     u_int8_t  op;
@@ -132,6 +300,8 @@ typedef struct dhcp_msg {
     u_char *            options_requested;
     size_t              len_requested;
     struct dhcp_options options;
+    u_int8_t            class_id;  // resultado de classify_msg()
+    struct dhcp_boot *  boot;      // parámetros de arranque, NULL si no hay
 
 } dhcp_msg;
 
@@ -147,11 +317,36 @@ typedef struct net_config {
     struct in_addr     initial_ip;
     struct in_addr     last_ip;
     char               config_file[255];
+    char               journal_file[255];  // bitácora de concesiones, vacío si no se usa
+    char               lease_db_file[255];  // base de concesiones mapeada, vacío si no se usa
+    char               lease_view[255];     // segmento de memoria compartida con la vista, vacío si no se usa
+    char               lease_events[255];   // segmento con el anillo de eventos, vacío si no se usa
     char               hostname[1024];
     u_int16_t          port;
     time_t             renewal;
     time_t             rebinding;
     time_t             lease;
+    time_t             compact_interval;  // segundos entre compactaciones de la bitácora, 0 = nunca
+    u_int32_t          compact_size;      // MB que puede crecer la bitácora antes de compactarla
+    int                journal_shards;    // particiones de la bitácora por rango de direcciones
+    char               export_target[255];  // archivo o unix:ruta de la exportación, vacío si no se usa
+    int                export_format;       // EXPORT_*
+    time_t             export_interval;     // segundos entre exportaciones
+    char               audit_dir[255];      // directorio del registro de auditoría, vacío si no se usa
+    int                audit_days;          // días que se conservan
+    int                log_level;           // LOGRING_*
+    u_int32_t          log_sample;          // 1 de cada N paquetes lleva sus eventos de depuración
+    char               metrics_listen[255];  // puerto local o unix:ruta de las métricas, vacío si no se sirven
+    u_int32_t          trace_slow;           // ms desde los que un intercambio se registra como lento
+    char               capture_file[255];    // pcapng de los mensajes, vacío si no se captura
+    capture_filter     capture_filter;
+    bool               capture_start;        // la captura empieza encendida
+    bool               profile;              // perfil de ciclos por etapa
+    char               control_socket[255];  // socket Unix de control, vacío si no se usa
+    char               hook_path[255];       // programa o módulo .so de los ganchos, vacío si no hay
+    int                hook_workers;         // hilos que entregan eventos a los ganchos
+    int                hook_batch;           // eventos por invocación, a lo más
+    int                hook_timeout;         // ms que puede tardar una invocación
     u_char             mac[6];
 
 } net_config;
@@ -165,6 +360,55 @@ typedef struct dhcp_config {
 
 } dhcp_config;
 
+typedef struct dhcp_class {
+    char           name[32];
+    struct in_addr first;  // pool propio; 0 si usa el general
+    struct in_addr last;
+    u_char         tmpl[CLASS_TEMPLATE_MAX];  // opciones de la clase ya codificadas
+    u_int16_t      tmpl_len;
+} dhcp_class;
+
+// Respuesta de arranque por red para una clase y arquitectura. Todo queda
+// codificado al leer la configuración: siaddr, el campo file y una copia de
+// la plantilla de la clase con las opciones 66 y 67 ya agregadas.
+typedef struct dhcp_boot {
+    u_int8_t       class_id;
+    u_int16_t      arch;  // BOOT_ARCH_ANY para cualquiera
+    struct in_addr next_server;
+    char           file[DHCP_FILE_LEN];
+    u_int8_t       file_len;
+    u_char         tmpl[CLASS_TEMPLATE_MAX];
+    u_int16_t      tmpl_len;
+} dhcp_boot;
+
+// Respuesta retenida hasta que la bitácora confirme el grupo
+typedef struct dhcp_reply {
+    in_addr_t ip;
+    ssize_t   size;
+    u_int8_t  type;
+    u_int64_t read_ns;  // hora en que se leyó el msg que la originó
+    u_char    buf[MAX_BUFSIZE];
+} dhcp_reply;
+
+// Partición de la bitácora: un rango contiguo de la tabla de concesiones
+typedef struct dhcp_shard {
+    struct dhcp_server *server;
+    struct dhcp_lease * first;
+    struct dhcp_lease * end;
+    time_t              compact_at;       // CLOCK_MONOTONIC de la última compactación
+    u_int64_t           compact_records;  // registros que dejó la última compactación
+} dhcp_shard;
+
+// Exportación periódica de la tabla; avanza por tramos entre paquetes
+typedef struct dhcp_export {
+    export_writer   w;
+    int             active;
+    int             blocked;  // el socket no aceptó más; se espera POLLOUT en poll()
+    size_t          pos;      // siguiente concesión de la tabla
+    time_t          last;  // CLOCK_MONOTONIC del inicio de la última
+    struct timespec start;
+} dhcp_export;
+
 typedef struct dhcp_server {
 
     int descriptor;
@@ -177,14 +421,53 @@ typedef struct dhcp_server {
     socklen_t size_addr;
     socklen_t remote_size;
 
-    u_char             buf[MAX_BUFSIZE];  // tamaño min de msg a recibir
-    char               interface_name[255];
-    enum dhcp_mode     mode;
-    struct dhcp_msg    msg;
-    struct net_config  config;
-    struct dhcp_lease *head;
-    struct dhcp_config dhcp_config;
-    ssize_t            size_msg;
+    u_char               buf[MAX_BUFSIZE];  // tamaño min de msg a recibir
+    char                 interface_name[255];
+    enum dhcp_mode       mode;
+    struct dhcp_msg      msg;
+    struct dhcp_opt_list opts;  // opciones del último msg recibido
+    struct net_config    config;
+    struct dhcp_lease *  head;
+    struct dhcp_lease *  end;  // una después de la última
+    struct leasedb       leasedb;
+    struct leaseview     view;  // vista de solo lectura para herramientas externas
+    struct eventring     events;  // anillo de eventos de concesiones para herramientas externas
+    struct hooks         hooks;  // acciones externas por evento de concesión
+    time_t               clock_bias;  // reloj de concesiones - CLOCK_MONOTONIC
+    struct dhcp_config   dhcp_config;
+    u_int32_t            lease_counts[CLASS_MAX][S_OWN + 1];  // concesiones por clase y estado
+    u_int32_t *          mac_buckets;  // índice por MAC (solo con control): concesión + 1, 0 = vacía
+    u_int32_t *          mac_next;  // siguiente concesión + 1 de la misma cubeta
+    u_int32_t            mac_mask;
+    ssize_t              size_msg;
+    struct strtab        names;  // nombres de host y FQDN internados
+    u_int32_t            names_live;  // nombres en uso tras la última recolección
+    struct dhcp_class    classes[CLASS_MAX];
+    u_int8_t             nclasses;
+    struct classifier    classifier;
+    struct dhcp_boot     boots[BOOT_MAX];
+    u_int8_t             nboots;
+    struct journal_group journal;
+    struct dhcp_shard    shards[JOURNAL_SHARDS_MAX];
+    struct dhcp_export   export;
+    struct audit_log     audit;
+    struct logring       log;  // eventos del ciclo de paquetes
+    struct metrics       metrics;
+    struct metrics_worker counters;  // del ciclo de paquetes
+    struct xtrace        trace;  // intercambios DISCOVER..ACK abiertos
+    struct capture       capture;  // pcapng de lo recibido y enviado
+    struct profile       profile;  // ciclos por etapa del ciclo de paquetes
+    struct control       control;  // consultas y órdenes en ejecución
+    bool                 control_ready;  // poll() vio actividad en el socket de control
+    u_int64_t            control_at;  // CLOCK_MONOTONIC_COARSE de la siguiente revisión
+    u_int64_t            rx_ns;  // hora de llegada del msg en curso (CLOCK_REALTIME)
+    u_int64_t            read_ns;  // y hora en que el servidor lo leyó
+    u_int64_t            tx_sent[TX_TRACK];  // hora de cada envío por su número
+    u_int32_t            tx_id;  // número del siguiente envío (SOF_TIMESTAMPING_OPT_ID)
+    u_int32_t            tx_waiting;  // envíos sin su marca de envío
+    u_int8_t             reply_type;  // tipo de la respuesta en buf
+    struct dhcp_reply *  replies;  // REPLY_BATCH_MAX, solo con bitácora
+    u_int16_t            nreplies;
 
 } dhcp_server;
 
@@ -220,64 +503,66 @@ const char *get_state ( enum dhcp_lease_state state ) {
 int probe_address ( dhcp_lease *lease ) {
 }
 
-void print_range ( dhcp_lease *head ) {
-    dhcp_lease *tmp = head;
-    // Imprimimos
-    for ( tmp = head; tmp->next != NULL; tmp = tmp->next ) {
-
-        char str[255];
-        printf ( "ip: %s ", inet_ntop ( AF_INET, &tmp->ip, str, INET_ADDRSTRLEN ) );
-        printf ( "state: %s ", get_state ( tmp->state ) );
-        printf ( "netmask: %s ", inet_ntop ( AF_INET, &tmp->netmask, str, INET_ADDRSTRLEN ) );
-        printf ( "dns: %s ", inet_ntop ( AF_INET, &tmp->dns1, str, INET_ADDRSTRLEN ) );
-        printf ( "dns2: %s\n", inet_ntop ( AF_INET, &tmp->dns2, str, INET_ADDRSTRLEN ) );
-        printf ( "broadcast: %s ", inet_ntop ( AF_INET, &tmp->broadcast, str, INET_ADDRSTRLEN ) );
-        printf ( "gateway: %s ", inet_ntop ( AF_INET, &tmp->gateway, str, INET_ADDRSTRLEN ) );
-        printf ( "hostname: %s ", tmp->hostname );
-        printf ( "mac: %02x:%02x:%02x:%02x:%02x:%02x\n", tmp->mac[0], tmp->mac[1], tmp->mac[2], tmp->mac[3],
-                 tmp->mac[4], tmp->mac[5] );
-        printf ( "t1: %li ", tmp->renewal );
-        printf ( "t2: %li ", tmp->rebinding );
-        printf ( "t3: %li\n\n", tmp->lease_time );
-    }
-}
-
-void print_lease_info ( dhcp_lease *tmp ) {
+void print_lease_info ( dhcp_server *server, dhcp_lease *tmp ) {
 
-    // Imprimimos
+    // Imprimimos; los parámetros de red son los mismos para todo el pool
     char str[255];
     printf ( "ip: %s \n", inet_ntop ( AF_INET, &tmp->ip, str, INET_ADDRSTRLEN ) );
     printf ( "state: %s \n", get_state ( tmp->state ) );
-    printf ( "netmask: %s \n", inet_ntop ( AF_INET, &tmp->netmask, str, INET_ADDRSTRLEN ) );
-    printf ( "dns: %s ", inet_ntop ( AF_INET, &tmp->dns1, str, INET_ADDRSTRLEN ) );
-    printf ( "dns2: %s\n", inet_ntop ( AF_INET, &tmp->dns2, str, INET_ADDRSTRLEN ) );
-    printf ( "broadcast: %s \n", inet_ntop ( AF_INET, &tmp->broadcast, str, INET_ADDRSTRLEN ) );
-    printf ( "gateway: %s \n", inet_ntop ( AF_INET, &tmp->gateway, str, INET_ADDRSTRLEN ) );
-    printf ( "hostname: %s \n", tmp->hostname );
+    printf ( "netmask: %s \n", inet_ntop ( AF_INET, &server->config.netmask, str, INET_ADDRSTRLEN ) );
+    printf ( "dns: %s ", inet_ntop ( AF_INET, &server->config.dns1, str, INET_ADDRSTRLEN ) );
+    printf ( "dns2: %s\n", inet_ntop ( AF_INET, &server->config.dns2, str, INET_ADDRSTRLEN ) );
+    printf ( "broadcast: %s \n", inet_ntop ( AF_INET, &server->config.broadcast, str, INET_ADDRSTRLEN ) );
+    printf ( "gateway: %s \n", inet_ntop ( AF_INET, &server->config.gateway, str, INET_ADDRSTRLEN ) );
+    printf ( "hostname: %s \n", strtab_get ( &server->names, tmp->hostname ) );
+    printf ( "fqdn: %s \n", strtab_get ( &server->names, tmp->fqdn ) );
     printf ( "mac: %02x:%02x:%02x:%02x:%02x:%02x\n", tmp->mac[0], tmp->mac[1], tmp->mac[2], tmp->mac[3],
             tmp->mac[4], tmp->mac[5] );
-    printf ( "t1: %li \n", tmp->renewal );
-    printf ( "t2: %li \n", tmp->rebinding );
+    printf ( "t1: %li \n", server->config.renewal );
+    printf ( "t2: %li \n", server->config.rebinding );
     printf ( "t3: %li\n", tmp->lease_time );
 
 }
 
-struct dhcp_lease *get_free_lease ( dhcp_lease *head ) {
-    for ( dhcp_lease *tmp = head; tmp->next != NULL; tmp = tmp->next )
-        if ( tmp->state == S_FREE )
+// Versión de print_lease_info() para el ciclo de paquetes
+void log_lease ( dhcp_server *server, dhcp_lease *lease ) {
+    logring_log ( &server->log, EV_LEASE, lease->ip.s_addr, ( uintptr_t ) get_state ( lease->state ),
+                  logring_mac ( lease->mac ), lease->lease_time );
+}
+
+void print_range ( dhcp_server *server ) {
+    // Imprimimos
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp ) {
+        print_lease_info ( server, tmp );
+        putchar ( '\n' );
+    }
+}
+
+// Reloj de los temporizadores de concesión: el monotónico más un
+// desplazamiento que, con la base de concesiones, lo hace continuar entre
+// reinicios (ver open_lease_db())
+void lease_clock ( dhcp_server *server, struct timespec *ts ) {
+    if ( clock_gettime ( CLOCK_MONOTONIC, ts ) == -1 )
+        dhcp_error ( "Error from clock_gettime() in lease_clock()" );
+    ts->tv_sec += server->clock_bias;
+}
+
+struct dhcp_lease *get_free_lease ( dhcp_server *server, u_int8_t class_id ) {
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
+        if ( tmp->state == S_FREE && tmp->class_id == class_id )
             return tmp;
     return NULL;
 }
 
-u_char search_xid ( u_int32_t xid, dhcp_lease *head ) {
+u_char search_xid ( dhcp_server *server, u_int32_t xid ) {
 
-    for ( dhcp_lease *tmp = head; tmp->next != NULL; tmp = tmp->next )
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
         if ( xid == tmp->xid )
             return 1;
     return 0;
 }
-u_char search_lease ( in_addr_t addr, dhcp_lease *head ) {
-    for ( dhcp_lease *tmp = head; tmp->next != NULL; tmp = tmp->next )
+u_char search_lease ( dhcp_server *server, in_addr_t addr ) {
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
         if ( tmp->ip.s_addr == addr
              && tmp->state == S_LEASED/*
              && *(tmp->mac + 0) == *(mac + 0)
@@ -291,26 +576,375 @@ u_char search_lease ( in_addr_t addr, dhcp_lease *head ) {
 
     return 0;
 }
-struct dhcp_lease * confirm_lease ( dhcp_lease *head, in_addr_t addr ) {
+struct dhcp_lease * confirm_lease ( dhcp_server *server, in_addr_t addr ) {
 
-    for ( dhcp_lease *tmp = head; tmp != NULL; tmp = tmp->next )
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
         if ( tmp->ip.s_addr == addr && tmp->state == S_LEASED ) {
 
             // ReIniciamos temporizador
-            if ( clock_gettime ( CLOCK_MONOTONIC, &tmp->start ) == -1 )
-                dhcp_error ( "Error from clock_gettime() in confirm_lease()" );
+            lease_clock ( server, &tmp->start );
             return tmp;
         }
+    return NULL;
+}
+void opt_list_reset ( dhcp_opt_list *l ) {
+    // Solo limpiamos los códigos que vinieron en el mensaje anterior
+    for ( u_int16_t i = 0; i < l->ncodes; ++i )
+        l->head[l->codes[i]] = 0;
+
+    l->ncodes    = 0;
+    l->nfrags    = 0;
+    l->arena_len = 0;
+}
+
+void opt_list_add ( dhcp_opt_list *l, u_int8_t code, const u_char *data, u_int8_t len ) {
+    dhcp_opt_frag *frag;
+
+    if ( l->nfrags == MAX_OPT_FRAGS )
+        return;
+
+    frag       = &l->frag[l->nfrags++];
+    frag->data = data;
+    frag->len  = len;
+    frag->next = 0;
+
+    if ( !l->head[code] ) {
+        l->codes[l->ncodes++] = code;
+        l->head[code]         = l->nfrags;
+        l->len[code]          = 0;
+    } else
+        l->frag[l->tail[code] - 1].next = l->nfrags;
+
+    l->tail[code] = l->nfrags;
+    l->len[code] += len;
+}
+
+// Recorre un área de opciones [p, end) sin salirse del mensaje recibido
+void opt_list_scan ( dhcp_opt_list *l, const u_char *p, const u_char *end ) {
+
+    while ( p < end && *p != 255 ) {
+        // Relleno
+        if ( *p == 0 ) {
+            p++;
+            continue;
+        }
+        // Opción truncada, descartamos el resto
+        if ( p + 2 > end || p + 2 + *( p + 1 ) > end )
+            break;
+
+        opt_list_add ( l, *p, p + 2, *( p + 1 ) );
+        p += *( p + 1 ) + 2;
+    }
+}
+
+// Copia hasta max bytes de la opción ya concatenada; regresa lo copiado
+size_t opt_gather ( const dhcp_opt_list *l, u_int8_t code, u_char *dst, size_t max ) {
+    size_t n = 0;
+
+    for ( u_int16_t i = l->head[code]; i && n < max; i = l->frag[i - 1].next ) {
+        size_t len = l->frag[i - 1].len;
+
+        if ( len > max - n )
+            len = max - n;
+        memcpy ( dst + n, l->frag[i - 1].data, len );
+        n += len;
+    }
+    return n;
+}
+
+// Datos contiguos de la opción: apunta directo al buffer de recepción si vino
+// en un solo fragmento; solo las opciones partidas se juntan en la arena.
+const u_char *opt_data ( dhcp_opt_list *l, u_int8_t code ) {
+    u_char *dst;
+
+    if ( !l->head[code] )
+        return NULL;
+
+    if ( !l->frag[l->head[code] - 1].next )
+        return l->frag[l->head[code] - 1].data;
+
+    if ( l->arena_len + l->len[code] > sizeof ( l->arena ) )
+        return NULL;
+
+    dst = l->arena + l->arena_len;
+    l->arena_len += opt_gather ( l, code, dst, l->len[code] );
+    return dst;
+}
+
+// Copia terminada en '\0' de una opción de texto
+char *opt_string ( dhcp_opt_list *l, u_int8_t code ) {
+    char *dst;
+
+    if ( !l->head[code] || ( size_t ) l->arena_len + l->len[code] + 1 > sizeof ( l->arena ) )
+        return NULL;
+
+    dst = ( char * ) l->arena + l->arena_len;
+    l->arena_len += opt_gather ( l, code, ( u_char * ) dst, l->len[code] );
+    l->arena[l->arena_len++] = '\0';
+    return dst;
+}
+
+// Nombre de la opción 81 como texto con puntos; si viene en formato de
+// etiquetas DNS (bandera E) se convierte.
+char *opt_fqdn ( dhcp_opt_list *l, u_int8_t flags ) {
+    const u_char *data = opt_data ( l, 81 );
+    u_int16_t     len  = l->len[81];
+    char *        dst, *q;
+
+    if ( !data || len <= 3 || ( size_t ) l->arena_len + len + 1 > sizeof ( l->arena ) )
+        return NULL;
+
+    data += 3;
+    len -= 3;
+    dst = q = ( char * ) l->arena + l->arena_len;
+
+    if ( flags & FQDN_E ) {
+        for ( u_int16_t i = 0; i < len && data[i]; i += data[i] + 1 ) {
+            if ( i + 1 + data[i] > len )
+                break;
+            if ( q != dst )
+                *q++ = '.';
+            memcpy ( q, data + i + 1, data[i] );
+            q += data[i];
+        }
+    } else {
+        memcpy ( q, data, len );
+        q += len;
+    }
+
+    *q++ = '\0';
+    l->arena_len += q - dst;
+    return *dst ? dst : NULL;
+}
+
+u_int32_t opt_get_u32 ( const dhcp_opt_list *l, u_int8_t code ) {
+    u_char v[4] = {0};
+
+    opt_gather ( l, code, v, 4 );
+    return ( *( v + 0 ) << 24 ) | ( *( v + 1 ) << 16 ) | ( *( v + 2 ) << 8 ) | *( v + 3 );
+}
+
+u_int16_t opt_get_u16 ( const dhcp_opt_list *l, u_int8_t code ) {
+    u_char v[2] = {0};
+
+    opt_gather ( l, code, v, 2 );
+    return ( *( v + 0 ) << 8 ) | *( v + 1 );
+}
+
+u_int8_t opt_get_u8 ( const dhcp_opt_list *l, u_int8_t code ) {
+    u_char v = 0;
+
+    opt_gather ( l, code, &v, 1 );
+    return v;
+}
+
+// Tamaño máximo de la respuesta: lo que indique el cliente en la opción 57
+// (mensaje IP completo) o, si no la envió, el mínimo de 576 bytes.
+size_t get_reply_limit ( dhcp_msg *msg ) {
+    size_t limit = DHCP_MIN_MSG_SIZE;
+
+    if ( msg->options.max_message_size > DHCP_MIN_MSG_SIZE )
+        limit = msg->options.max_message_size;
+
+    limit -= DHCP_IP_UDP_HEADERS;
+
+    return limit > MAX_BUFSIZE ? MAX_BUFSIZE : limit;
+}
+
+void opt_writer_init ( dhcp_opt_writer *w, u_char *buf, size_t limit, u_int8_t avail ) {
+    w->buf      = buf;
+    w->p        = buf + DHCP_OPTIONS_OFFSET;
+    w->opt_end  = NULL;
+    w->overload = NULL;
+    w->region   = 0;
+    w->avail    = avail;
+    w->used     = 0;
+
+    // Reservamos el byte de fin y, si se puede sobrecargar, los 3 de la opción 52
+    w->end = buf + limit - 1 - ( avail ? 3 : 0 );
+}
+
+// Cierra la región actual y pasa a la siguiente disponible: file y luego
+// sname, que es el orden en que el cliente las concatena (RFC 3396).
+int opt_next_region ( dhcp_opt_writer *w ) {
+
+    if ( w->region == 0 ) {
+        w->overload = NULL;
+        if ( w->avail ) {
+            *( w->p + 0 ) = 52;
+            *( w->p + 1 ) = 1;
+            w->overload   = w->p + 2;
+            w->p += 3;
+        }
+        *w->p      = 0xff;
+        w->opt_end = w->p + 1;
+    } else if ( w->region < 3 )
+        *w->p = 0xff;
+
+    for ( w->region++; w->region < 3; w->region++ ) {
+        if ( w->region == 1 && ( w->avail & OVERLOAD_FILE ) ) {
+            w->p   = w->buf + DHCP_FILE_OFFSET;
+            w->end = w->p + DHCP_FILE_LEN - 1;
+            w->used |= OVERLOAD_FILE;
+            return 1;
+        }
+        if ( w->region == 2 && ( w->avail & OVERLOAD_SNAME ) ) {
+            w->p   = w->buf + DHCP_SNAME_OFFSET;
+            w->end = w->p + DHCP_SNAME_LEN - 1;
+            w->used |= OVERLOAD_SNAME;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Agrega una opción. Las mayores de 255 bytes se parten en varias instancias
+// (RFC 3396); las largas que no quepan en la región actual se continúan en la
+// siguiente, las cortas se mueven completas. Si no cabe completa no se escribe
+// nada y se regresa 0.
+int opt_put ( dhcp_opt_writer *w, u_int8_t code, const void *data, size_t len ) {
+    const u_char *  src   = data;
+    dhcp_opt_writer saved = *w;
+    size_t          room, chunk;
+
+    do {
+        if ( w->region == 3 ) {
+            // Deshacemos: los campos file/sname que se hayan tocado vuelven a
+            // quedar en ceros para que el cliente no los interprete
+            if ( ( w->used & OVERLOAD_FILE ) && !( saved.used & OVERLOAD_FILE ) )
+                memset ( w->buf + DHCP_FILE_OFFSET, 0, DHCP_FILE_LEN );
+            if ( ( w->used & OVERLOAD_SNAME ) && !( saved.used & OVERLOAD_SNAME ) )
+                memset ( w->buf + DHCP_SNAME_OFFSET, 0, DHCP_SNAME_LEN );
+            *w = saved;
+            return 0;
+        }
+
+        chunk = len > 255 ? 255 : len;
+        room  = w->end > w->p + 2 ? ( size_t ) ( w->end - w->p - 2 ) : 0;
+
+        if ( chunk > room ) {
+            if ( len <= 16 || room == 0 ) {
+                opt_next_region ( w );
+                continue;
+            }
+            chunk = room;
+        }
+
+        *( w->p + 0 ) = code;
+        *( w->p + 1 ) = chunk;
+        memcpy ( w->p + 2, src, chunk );
+        w->p += chunk + 2;
+        src += chunk;
+        len -= chunk;
+    } while ( len > 0 );
+
+    return 1;
+}
+
+int opt_put_u32 ( dhcp_opt_writer *w, u_int8_t code, u_int32_t value ) {
+    u_char v[4];
+
+    *( v + 0 ) = ( value >> 24 ) & 0xff;
+    *( v + 1 ) = ( value >> 16 ) & 0xff;
+    *( v + 2 ) = ( value >> 8 ) & 0xff;
+    *( v + 3 ) = ( value >> 0 ) & 0xff;
+
+    return opt_put ( w, code, v, 4 );
+}
+
+int opt_put_addr ( dhcp_opt_writer *w, u_int8_t code, struct in_addr addr ) {
+    // s_addr ya está en orden de red
+    return opt_put ( w, code, &addr.s_addr, 4 );
+}
+
+// Escribe el fin de opciones y, si se usaron file/sname, el valor de la 52.
+// Regresa el tamaño final del mensaje.
+size_t opt_finish ( dhcp_opt_writer *w ) {
+
+    if ( w->region == 0 ) {
+        *w->p = 0xff;
+        return w->p + 1 - w->buf;
+    }
+
+    if ( w->region < 3 )
+        *w->p = 0xff;
+
+    if ( w->overload )
+        *w->overload = w->used;
+
+    return w->opt_end - w->buf;
+}
+
+// Copia una plantilla de opciones ya codificadas. Si cabe en la región actual
+// es un solo memcpy; si no, se agrega opción por opción para poder seguir en
+// file/sname.
+void put_template ( dhcp_opt_writer *w, const u_char *tmpl, size_t len ) {
+
+    if ( w->region == 0 && w->p + len <= w->end ) {
+        memcpy ( w->p, tmpl, len );
+        w->p += len;
+        return;
+    }
+
+    for ( size_t i = 0; i + 2 <= len && i + 2 + tmpl[i + 1] <= len; i += tmpl[i + 1] + 2 )
+        opt_put ( w, tmpl[i], tmpl + i + 2, tmpl[i + 1] );
 }
-void build_msg ( struct dhcp_server *server, struct dhcp_lease *lease, enum dhcp_msg_type type ) {
 
+// siaddr y file del arranque por red del cliente, ya preparados. Regresa los
+// campos que quedan libres para sobrecargar.
+u_int8_t put_boot_fields ( struct dhcp_server *server ) {
+    dhcp_boot *boot = server->msg.boot;
+
+    if ( !boot )
+        return OVERLOAD_FILE | OVERLOAD_SNAME;
+
+    memcpy ( server->buf + DHCP_SIADDR_OFFSET, &boot->next_server.s_addr, 4 );
+    memcpy ( server->buf + DHCP_FILE_OFFSET, boot->file, boot->file_len );
+
+    return OVERLOAD_SNAME;
+}
+
+// Opciones de la clase del cliente; si arranca por red, la plantilla de
+// arranque que ya las incluye junto con la 66 y la 67
+void put_class_options ( struct dhcp_server *server, dhcp_opt_writer *w ) {
+    dhcp_boot * boot = server->msg.boot;
+    dhcp_class *cls  = &server->classes[server->msg.class_id];
+
+    if ( boot )
+        put_template ( w, boot->tmpl, boot->tmpl_len );
+    else
+        put_template ( w, cls->tmpl, cls->tmpl_len );
+}
+
+// Si el cliente mandó la opción 81 se la regresamos con el mismo nombre. No
+// hacemos actualizaciones DNS: N encendida y, si nos pidió el registro A, O.
+void put_fqdn_reply ( struct dhcp_server *server, dhcp_opt_writer *w ) {
+    const u_char *data  = opt_data ( &server->opts, 81 );
+    u_int16_t     len   = server->opts.len[81];
+    u_int8_t      flags = server->msg.options.fqdn_flags;
+    u_char        reply[3 + 255];
+
+    if ( !data || len < 3 )
+        return;
+    if ( len > sizeof ( reply ) )
+        len = sizeof ( reply );
+
+    *( reply + 0 ) = ( flags & FQDN_E ) | FQDN_N | ( flags & FQDN_S ? FQDN_O : 0 );
+    *( reply + 1 ) = 255;  // rcode1 y rcode2 obsoletos
+    *( reply + 2 ) = 255;
+    memcpy ( reply + 3, data + 3, len - 3 );
+
+    opt_put ( w, 81, reply, len );
+}
+
+// Encabezado BOOTP de la respuesta. Se escriben todos sus campos, incluidos
+// los que van en cero, para no limpiar el buffer completo en cada mensaje:
+// lo que sigue a las opciones nunca se envía (opt_finish regresa el tamaño).
+void put_reply_header ( struct dhcp_server *server, struct in_addr yiaddr ) {
     u_char *  p   = server->buf;
     dhcp_msg *msg = &server->msg;
-    u_int32_t tmp = ntohl ( lease->ip.s_addr );
-
-    memset ( p, 0, MAX_BUFSIZE );
 
-    *p = DHCPOFFER;
+    *p = DHCPOFFER;  // op: BOOTREPLY
     p++;
     *p = msg->htype;
     p++;
@@ -328,340 +962,497 @@ void build_msg ( struct dhcp_server *server, struct dhcp_lease *lease, enum dhcp
     p++;
     *p = 0x00;
     p++;
-    p += 4;                             // ciaddr
-    *( p + 0 ) = ( tmp >> 24 ) & 0xff;  // your ip
-    *( p + 1 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 2 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 0 ) & 0xff;
+    memset ( p, 0, 4 );  // ciaddr
     p += 4;
-    p += 4;                         // next ip address
-    p += 4;                         // relay address
+    memcpy ( p, &yiaddr.s_addr, 4 );  // your ip
+    p += 4;
+    memset ( p, 0, 8 );  // next ip address y relay address
+    p += 8;
     memcpy ( p, &msg->chaddr, 6 );  // mac
-    p = server->buf + 236;          // DHCP magic cookie
+    p += 6;
+    // resto de chaddr, sname y file
+    memset ( p, 0, DHCP_FILE_OFFSET + DHCP_FILE_LEN - ( p - server->buf ) );
+    p = server->buf + 236;  // DHCP magic cookie
 
     *( p + 0 ) = 99;
     *( p + 1 ) = 130;
     *( p + 2 ) = 83;
     *( p + 3 ) = 99;
-    p += 4;
-    *p = 53;  // DHCP Message Type
-    p++;
-    *p = 1;
-    p++;
-    *p = type;
-    p++;
+}
 
-    *( p + 0 ) = 54;  // ip server identifier
-    *( p + 1 ) = 4;
-    p += 2;
+void build_msg ( struct dhcp_server *server, struct dhcp_lease *lease, enum dhcp_msg_type type ) {
 
-    tmp        = ntohl ( server->config.ip.s_addr );  // dhcp server address
-    *( p + 0 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 1 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 2 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 0 ) & 0xff;
-    p += 4;
+    dhcp_msg *      msg      = &server->msg;
+    u_int8_t        msg_type = type;
+    dhcp_opt_writer w;
+    struct in_addr  dns[2];
+
+    profile_enter ( &server->profile );
+    metrics_inc ( &server->counters.sent[type] );
+    server->reply_type = type;
+    put_reply_header ( server, lease->ip );
+
+    opt_writer_init ( &w, server->buf, get_reply_limit ( msg ), put_boot_fields ( server ) );
+
+    // DHCP Message Type
+    opt_put ( &w, 53, &msg_type, 1 );
+    // ip server identifier
+    opt_put_addr ( &w, 54, server->config.ip );
+    // lease
+    opt_put_u32 ( &w, 51, server->config.lease );
+    // subnet
+    opt_put_addr ( &w, 1, server->config.netmask );
+    // router
+    opt_put_addr ( &w, 3, server->config.gateway );
+    // dns
+    dns[0] = server->config.dns1;
+    dns[1] = server->config.dns2;
+    opt_put ( &w, 6, dns, 8 );
+    // opciones de la clase del cliente
+    put_class_options ( server, &w );
+    // client FQDN
+    put_fqdn_reply ( server, &w );
+
+    server->size_msg = opt_finish ( &w );
+    profile_leave ( &server->profile, PROFILE_BUILD );
+}
 
-    *( p + 0 ) = 51;  // lease
-    *( p + 1 ) = 4;
-    *( p + 2 ) = ( server->config.lease >> 24 ) & 0xff;
-    *( p + 3 ) = ( server->config.lease >> 16 ) & 0xff;
-    *( p + 4 ) = ( server->config.lease >> 8 ) & 0xff;
-    *( p + 5 ) = ( server->config.lease >> 0 ) & 0xff;
+void build_config_msg ( struct dhcp_server *server, enum dhcp_msg_type type ) {
+
+    dhcp_msg *      msg      = &server->msg;
+    u_int8_t        msg_type = type;
+    dhcp_opt_writer w;
+    struct in_addr  dns[2], none;
+
+    profile_enter ( &server->profile );
+    metrics_inc ( &server->counters.sent[type] );
+    server->reply_type = type;
+
+    // No se llena yiaddr en la respuesta a DHCPINFORM
+    none.s_addr = 0;
+    put_reply_header ( server, none );
+
+    opt_writer_init ( &w, server->buf, get_reply_limit ( msg ), put_boot_fields ( server ) );
+
+    // DHCP Message Type
+    opt_put ( &w, 53, &msg_type, 1 );
+    // ip server identifier
+    opt_put_addr ( &w, 54, server->config.ip );
+    // subnet
+    opt_put_addr ( &w, 1, server->config.netmask );
+    // router
+    opt_put_addr ( &w, 3, server->config.gateway );
+    // dns
+    dns[0] = server->config.dns1;
+    dns[1] = server->config.dns2;
+    opt_put ( &w, 6, dns, 8 );
+    // opciones de la clase del cliente
+    put_class_options ( server, &w );
+
+    server->size_msg = opt_finish ( &w );
+    profile_leave ( &server->profile, PROFILE_BUILD );
+}
+// Concesión de esa dirección (en orden de red), o NULL si está fuera del rango
+struct dhcp_lease *get_lease_by_ip ( dhcp_server *server, in_addr_t addr ) {
+    u_int32_t index = ntohl ( addr ) - ntohl ( server->config.initial_ip.s_addr );
 
-    p += 6;
+    return index < ( u_int32_t ) ( server->end - server->head ) ? server->head + index : NULL;
+}
 
-    *( p + 0 ) = 1;  // subnet
-    *( p + 1 ) = 4;
-    tmp        = ntohl ( server->config.netmask.s_addr );
-    *( p + 2 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 4 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 5 ) = ( tmp >> 0 ) & 0xff;
+// Fin de la concesión en tiempo real; los temporizadores son monotónicos y
+// no sobreviven a un reinicio
+time_t lease_expires ( dhcp_server *server, dhcp_lease *lease ) {
+    struct timespec now;
 
-    p += 6;
+    if ( lease->state != S_LEASED )
+        return 0;
 
-    *( p + 0 ) = 3;  // router
-    *( p + 1 ) = 4;
+    lease_clock ( server, &now );
 
-    tmp        = ntohl ( server->config.gateway.s_addr );
-    *( p + 2 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 4 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 5 ) = ( tmp >> 0 ) & 0xff;
+    return time ( NULL ) + lease->lease_time - ( now.tv_sec - lease->start.tv_sec );
+}
 
-    p += 6;
+void lease_to_rec ( dhcp_server *server, dhcp_lease *lease, journal_rec *rec ) {
+    memset ( rec, 0, sizeof ( journal_rec ) );
+    rec->ip         = lease->ip.s_addr;
+    rec->xid        = lease->xid;
+    rec->expires    = lease_expires ( server, lease );
+    rec->lease_time = lease->lease_time;
+    rec->state      = lease->state;
+    memcpy ( rec->mac, lease->mac, 6 );
+}
 
-    *( p + 0 ) = 6;  // dns
-    *( p + 1 ) = 8;
+// Partición de la bitácora a la que pertenece la concesión; cada una lleva un
+// rango contiguo de la tabla (ver open_journal())
+int lease_shard ( dhcp_server *server, dhcp_lease *lease ) {
+    return ( size_t ) ( lease - server->head ) * server->journal.count / ( size_t ) ( server->end - server->head );
+}
 
-    tmp        = ntohl ( server->config.dns1.s_addr );
-    *( p + 2 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 4 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 5 ) = ( tmp >> 0 ) & 0xff;
+// Publica el estado actual de la concesión en la vista compartida
+void publish_lease ( dhcp_server *server, dhcp_lease *lease ) {
+    leaseview_rec rec;
 
-    tmp        = ntohl ( server->config.dns2.s_addr );
-    *( p + 6 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 7 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 8 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 9 ) = ( tmp >> 0 ) & 0xff;
+    if ( !server->view.map )
+        return;
 
-    p += 10;
-    *p = 0xff;  // fin
-    p++;
-    server->size_msg = p - server->buf;
+    memset ( &rec, 0, sizeof ( leaseview_rec ) );
+    rec.ip         = lease->ip.s_addr;
+    rec.expires    = lease_expires ( server, lease );
+    rec.lease_time = lease->lease_time;
+    rec.xid        = lease->xid;
+    rec.state      = lease->state;
+    rec.class_id   = lease->class_id;
+    memcpy ( rec.mac, lease->mac, 6 );
+
+    leaseview_update ( &server->view, lease - server->head, &rec );
 }
 
-void build_config_msg ( struct dhcp_server *server, struct dhcp_lease *lease, enum dhcp_msg_type type ) {
+// Agrega el estado actual de la concesión a la bitácora, donde queda en disco
+// con el siguiente commit_batch(), y lo publica en la vista
+void journal_lease ( dhcp_server *server, dhcp_lease *lease ) {
+    journal_rec rec;
 
-    u_char *  p   = server->buf;
-    dhcp_msg *msg = &server->msg;
-    u_int32_t tmp = ntohl ( lease->ip.s_addr );
+    publish_lease ( server, lease );
 
-    memset ( p, 0, MAX_BUFSIZE );
+    if ( !server->config.journal_file[0] )
+        return;
 
-    *p = DHCPOFFER;
-    p++;
-    *p = msg->htype;
-    p++;
-    *p = msg->hlen;
-    p++;
-    *p = msg->hops;
-    p++;
-    memcpy ( p, &msg->xid, 4 );
-    p += 4;
-    *p = 0;
-    p++;  // usa 2 bytes; primero
-    *p = msg->secs;
-    p++;  // segundo
-    *p = 0x80;
-    p++;
-    *p = 0x00;
-    p++;
-    p += 4;                         // ciaddr
-    p += 4;                         // your ip
-    p += 4;                         // next ip address
-    p += 4;                         // relay address
-    memcpy ( p, &msg->chaddr, 6 );  // mac
-    p = server->buf + 236;          // DHCP magic cookie
+    lease_to_rec ( server, lease, &rec );
 
-    *( p + 0 ) = 99;
-    *( p + 1 ) = 130;
-    *( p + 2 ) = 83;
-    *( p + 3 ) = 99;
-    p += 4;
-    *p = 53;  // DHCP Message Type
-    p++;
-    *p = 1;
-    p++;
-    *p = type;
-    p++;
+    if ( !journal_group_append ( &server->journal, lease_shard ( server, lease ), &rec ) )
+        dhcp_fatal ( "Error from journal_append() in journal_lease()", strerror ( errno ) );
+}
 
-    *( p + 0 ) = 54;  // ip server identifier
-    *( p + 1 ) = 4;
-    p += 2;
+// Publica el evento de la concesión en el anillo compartido y lo encola para
+// los ganchos
+void notify_lease ( dhcp_server *server, dhcp_lease *lease, u_int8_t type ) {
+    eventring_event ev;
+
+    ev.time       = time ( NULL );
+    ev.ip         = lease->ip.s_addr;
+    ev.lease_time = lease->lease_time;
+    ev.xid        = lease->xid;
+    ev.type       = type;
+    ev.class_id   = lease->class_id;
+    memcpy ( ev.mac, lease->mac, 6 );
+
+    if ( server->events.map )
+        eventring_publish ( &server->events, &ev );
+    if ( server->hooks.slots )
+        hooks_push ( &server->hooks, &ev );
+}
 
-    tmp        = ntohl ( server->config.ip.s_addr );  // dhcp server address
-    *( p + 0 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 1 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 2 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 0 ) & 0xff;
-    p += 4;
+// Agrega el evento de la concesión al registro de auditoría y lo publica en
+// el anillo de eventos y para los ganchos
+void audit_lease ( dhcp_server *server, dhcp_lease *lease, u_int8_t type ) {
+    audit_event ev;
 
-    *( p + 0 ) = 1;  // subnet
-    *( p + 1 ) = 4;
-    tmp        = ntohl ( server->config.netmask.s_addr );
-    *( p + 2 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 4 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 5 ) = ( tmp >> 0 ) & 0xff;
+    if ( server->events.map || server->hooks.slots )
+        notify_lease ( server, lease, type );
 
-    p += 6;
+    if ( !server->config.audit_dir[0] )
+        return;
 
-    *( p + 0 ) = 3;  // router
-    *( p + 1 ) = 4;
+    ev.time       = time ( NULL );
+    ev.ip         = lease->ip.s_addr;
+    ev.lease_time = lease->lease_time;
+    ev.type       = type;
+    memcpy ( ev.mac, lease->mac, 6 );
 
-    tmp        = ntohl ( server->config.gateway.s_addr );
-    *( p + 2 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 4 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 5 ) = ( tmp >> 0 ) & 0xff;
+    if ( !audit_add ( &server->audit, &ev ) )
+        syslog ( LOG_ERR, "Error al escribir el registro de auditoría: %s", strerror ( errno ) );
+}
 
-    p += 6;
+// Reaplica un registro de la bitácora al arrancar
+void replay_lease ( void *ctx, const journal_rec *rec ) {
+    dhcp_server *   server = ctx;
+    dhcp_lease *    lease  = get_lease_by_ip ( server, rec->ip );
+    struct timespec now;
+    time_t          remaining;
+
+    if ( !lease )
+        return;
+
+    lease->state      = rec->state;
+    lease->xid        = rec->xid;
+    lease->lease_time = rec->lease_time;
+    memcpy ( lease->mac, rec->mac, 6 );
+
+    if ( lease->state != S_LEASED )
+        return;
+
+    // Lo que le queda a la concesión se traslada al reloj monotónico
+    remaining = rec->expires - time ( NULL );
+    if ( remaining <= 0 ) {
+        lease->state = S_FREE;
+        lease->xid   = 0;
+        memset ( lease->mac, 0, 6 );
+        return;
+    }
+
+    lease_clock ( server, &now );
+    lease->start.tv_sec  = now.tv_sec - ( lease->lease_time - remaining );
+    lease->start.tv_nsec = now.tv_nsec;
+}
 
-    *( p + 0 ) = 6;  // dns
-    *( p + 1 ) = 8;
+// Snapshot para la compactación; corre en el hilo de la bitácora mientras el
+// servidor sigue atendiendo. Un registro puede salir a medio actualizar, pero
+// todo cambio posterior al corte está también en la cola de la bitácora, que
+// se aplica después. Las concesiones libres no se escriben: al reaplicar, la
+// tabla parte de libres (o de la base mapeada, que se sincroniza aquí).
+size_t snapshot_leases ( void *ctx, size_t *pos, journal_rec *out, size_t max ) {
+    dhcp_shard * shard  = ctx;
+    dhcp_server *server = shard->server;
+    size_t       total  = shard->end - shard->first, count = 0;
 
-    tmp        = ntohl ( server->config.dns1.s_addr );
-    *( p + 2 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 3 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 4 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 5 ) = ( tmp >> 0 ) & 0xff;
+    if ( *pos == 0 && server->config.lease_db_file[0] && !leasedb_sync ( &server->leasedb ) )
+        return 0;
 
-    tmp        = ntohl ( server->config.dns2.s_addr );
-    *( p + 6 ) = ( tmp >> 24 ) & 0xff;
-    *( p + 7 ) = ( tmp >> 16 ) & 0xff;
-    *( p + 8 ) = ( tmp >> 8 ) & 0xff;
-    *( p + 9 ) = ( tmp >> 0 ) & 0xff;
+    for ( ; *pos < total && count < max; ++*pos ) {
+        dhcp_lease *lease = shard->first + *pos;
 
-    p += 10;
-    *p = 0xff;  // fin
-    p++;
-    server->size_msg = p - server->buf;
+        if ( lease->state != S_FREE )
+            lease_to_rec ( server, lease, &out[count++] );
+    }
+    return count;
 }
-void check_status ( dhcp_lease *head ) {
 
-    for ( dhcp_lease *tmp = head; tmp != NULL; tmp = tmp->next )
-        if ( tmp->state != S_FREE ) {
+// Recupera los nombres que ya no tiene ninguna concesión activa. Corre cuando
+// la tabla llegó al doble de lo que quedó en la última recolección, así que
+// su costo (recorrer concesiones y arena) se reparte entre los nombres
+// internados desde entonces. Las concesiones que no están activas sueltan
+// sus nombres.
+void collect_names ( dhcp_server *server ) {
+    u_int32_t live = server->names_live > NAMES_COLLECT_MIN ? server->names_live : NAMES_COLLECT_MIN;
+    u_char *  marks;
+    u_int32_t freed;
+
+    if ( server->names.count < 2 * live )
+        return;
+
+    if ( !( marks = strtab_mark_begin ( &server->names ) ) ) {
+        syslog ( LOG_ERR, "Sin memoria para recolectar la tabla de nombres: %s", strerror ( errno ) );
+        server->names_live = server->names.count;  // se reintenta al volver a crecer
+        return;
+    }
+
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp ) {
+        if ( tmp->state != S_LEASED )
+            tmp->hostname = tmp->fqdn = 0;
+        strtab_mark ( &server->names, marks, tmp->hostname );
+        strtab_mark ( &server->names, marks, tmp->fqdn );
+    }
+
+    freed              = strtab_sweep ( &server->names, marks );
+    server->names_live = server->names.count;
+    logring_log ( &server->log, EV_NAMES_COLLECTED, freed, server->names_live, 0, 0 );
+}
+
+// Cubeta de la MAC en el índice (FNV-1a)
+u_int32_t mac_bucket ( dhcp_server *server, const u_char *mac ) {
+    u_int32_t h = 2166136261u;
 
-            if ( clock_gettime ( CLOCK_MONOTONIC, &tmp->now ) == -1 )
-                dhcp_error ( "Error from clock_gettime() in check_status()" );
+    for ( int i = 0; i < 6; ++i ) {
+        h ^= mac[i];
+        h *= 16777619u;
+    }
+    return h & server->mac_mask;
+}
+
+// Saca la concesión de los contadores por clase y estado y, si no está libre,
+// del índice por MAC. Va antes de cambiar su estado o su MAC, y después
+// index_lease() la vuelve a poner.
+void unindex_lease ( dhcp_server *server, dhcp_lease *lease ) {
+    u_int32_t *slot;
+
+    if ( lease->class_id < CLASS_MAX && lease->state <= S_OWN )
+        server->lease_counts[lease->class_id][lease->state]--;
+    if ( !server->mac_buckets || lease->state == S_FREE )
+        return;
+
+    for ( slot = &server->mac_buckets[mac_bucket ( server, lease->mac )]; *slot; slot = &server->mac_next[*slot - 1] )
+        if ( server->head + *slot - 1 == lease ) {
+            *slot = server->mac_next[lease - server->head];
+            return;
+        }
+}
+
+void index_lease ( dhcp_server *server, dhcp_lease *lease ) {
+    u_int32_t *slot;
+
+    if ( lease->class_id < CLASS_MAX && lease->state <= S_OWN )
+        server->lease_counts[lease->class_id][lease->state]++;
+    if ( !server->mac_buckets || lease->state == S_FREE )
+        return;
+
+    slot                                   = &server->mac_buckets[mac_bucket ( server, lease->mac )];
+    server->mac_next[lease - server->head] = *slot;
+    *slot                                  = lease - server->head + 1;
+}
+
+void check_status ( dhcp_server *server ) {
+    struct timespec now;
 
-            tmp->elapsed.tv_sec  = tmp->now.tv_sec - tmp->start.tv_sec;
-            tmp->elapsed.tv_nsec = tmp->now.tv_nsec - tmp->start.tv_nsec;
+    profile_enter ( &server->profile );
+    lease_clock ( server, &now );
+
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
+        if ( tmp->state != S_FREE ) {
 
-            if ( tmp->elapsed.tv_sec >= tmp->lease_time )
+            if ( now.tv_sec - tmp->start.tv_sec >= tmp->lease_time ) {
+                if ( tmp->state == S_LEASED )
+                    audit_lease ( server, tmp, AUDIT_EXPIRE );
+                unindex_lease ( server, tmp );
                 tmp->state = S_FREE;
+                index_lease ( server, tmp );
+                journal_lease ( server, tmp );
+            }
         }
+    collect_names ( server );
+    profile_leave ( &server->profile, PROFILE_STATUS );
+}
+
+// Asocia los nombres del cliente (ya internados) a la concesión y deja el
+// índice de la concesión en la tabla para buscarla por nombre en O(1)
+void set_lease_names ( struct strtab *names, dhcp_lease *head, dhcp_lease *lease, u_int32_t hostname,
+                       u_int32_t fqdn ) {
+    lease->hostname = hostname;
+    lease->fqdn     = fqdn;
+    strtab_set_value ( names, hostname, lease - head + 1 );
+    strtab_set_value ( names, fqdn, lease - head + 1 );
+}
+
+// Concesión activa con ese nombre de host o FQDN, o NULL
+struct dhcp_lease *find_lease_by_name ( dhcp_server *server, const char *name ) {
+    u_int32_t   handle = strtab_find ( &server->names, name, strlen ( name ) );
+    u_int32_t   index  = strtab_get_value ( &server->names, handle );
+    dhcp_lease *lease;
+
+    if ( !index || index > ( u_int32_t ) server->dhcp_config.total )
+        return NULL;
+
+    // El índice pudo quedar viejo si la concesión se liberó o cambió de nombre
+    lease = server->head + index - 1;
+    if ( lease->state != S_LEASED || ( lease->hostname != handle && lease->fqdn != handle ) )
+        return NULL;
+
+    return lease;
 }
 
-u_int8_t register_lease ( dhcp_lease *head, u_int32_t xid, u_char *mac ) {
+u_int8_t register_lease ( dhcp_server *server, u_int32_t xid, u_char *mac ) {
+    dhcp_options *options = &server->msg.options;
+    u_int32_t     hostname, fqdn;
 
-    for ( dhcp_lease *tmp = head; tmp != NULL; tmp = tmp->next )
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
         if ( tmp->xid == xid ) {
 
-            tmp->state = S_LEASED;
+            // Los nombres del cliente se internan solo si hay concesión; los
+            // que dejan de usarse los recupera collect_names()
+            hostname = fqdn = 0;
+            if ( options->hostname )
+                hostname = strtab_intern ( &server->names, options->hostname, strlen ( options->hostname ) );
+            if ( options->fqdn )
+                fqdn = strtab_intern ( &server->names, options->fqdn, strlen ( options->fqdn ) );
+
+            unindex_lease ( server, tmp );
+            tmp->state      = S_LEASED;
+            tmp->lease_time = server->config.lease;
             memcpy(tmp->mac,mac, 6);
+            index_lease ( server, tmp );
+            set_lease_names ( &server->names, server->head, tmp, hostname, fqdn );
             // Iniciamos temporizador
-            if ( clock_gettime ( CLOCK_MONOTONIC, &tmp->start ) == -1 )
-                dhcp_error ( "Error from clock_gettime() in register_lease()" );
+            lease_clock ( server, &tmp->start );
+            journal_lease ( server, tmp );
+            audit_lease ( server, tmp, AUDIT_GRANT );
 
             return 1;
         }
     return 0;
 }
 
-void dec_dhcp_client_options ( u_char *v, dhcp_msg *msg ) {
-
-    syslog ( LOG_NOTICE, "Option number: %d, len: %d", *v, *( v + 1 ) );
-    size_t  size;
-    u_char *tmp;
+// Devuelve la concesión al pool (DHCPRELEASE del cliente o desde el socket
+// de control)
+void release_lease ( dhcp_server *server, dhcp_lease *lease ) {
+    audit_lease ( server, lease, AUDIT_RELEASE );
+    unindex_lease ( server, lease );
+    lease->state = S_FREE;
+    lease->xid   = 0;
+    log_lease ( server, lease );
+    memset ( lease->mac, 0, 6 );
+    index_lease ( server, lease );
+    memset ( &lease->start, 0, sizeof ( struct timespec ) );
+    journal_lease ( server, lease );
+}
 
-    switch ( *v ) {
+// Sin trazas por opción: corre para cada opción de cada paquete. Lo que se
+// decodificó se registra después con EV_DECODED y EV_OPTIONS.
+void dec_dhcp_client_options ( dhcp_opt_list *l, u_int8_t code, dhcp_msg *msg ) {
+    switch ( code ) {
         case 12:
-            size                  = *( v + 1 );
-            msg->options.hostname = malloc ( size + 1 );
-
-            if ( !msg->options.hostname )
-                dhcp_fatal (
-                    "Error from malloc() in case 12, "
-                    "dec_dhcp_client_options %s",
-                    strerror ( errno ) );
-
-            tmp = v + 2;
-
-            memcpy ( &msg->options.hostname, tmp, size );
-            *( &msg->options.hostname + size + 1 ) = '\0';
-            syslog ( LOG_NOTICE, "Option: 12 size: %d hostname: %s", size, &msg->options.hostname );
+            msg->options.hostname = opt_string ( l, code );
             break;
         case 50:
-            msg->options.requested_address.s_addr
-                = htonl ( ( *( v + 2 ) << 24 ) | ( *( v + 3 ) << 16 ) | ( *( v + 4 ) << 8 ) | *( v + 5 ) );
-            char str[INET_ADDRSTRLEN];
-
-            syslog ( LOG_NOTICE, "Requested adress: %s",
-                     inet_ntop ( AF_INET, &msg->options.requested_address, str, INET_ADDRSTRLEN ) );
+            msg->options.requested_address.s_addr = htonl ( opt_get_u32 ( l, code ) );
             break;
         case 51:
-            msg->options.lease_time = ( *( v + 2 ) << 24 ) | ( *( v + 3 ) << 16 ) | ( *( v + 4 ) << 8 ) | *( v + 5 );
+            msg->options.lease_time = opt_get_u32 ( l, code );
             break;
         case 52:
-            msg->options.overload = *( v + 2 );
-            // falta leer campos file y sname
+            // Los campos file y sname ya se leyeron en dec_dhcp_msg()
+            msg->options.overload = opt_get_u8 ( l, code );
             break;
         case 53:
-            msg->options.type = *( v + 2 );
+            msg->options.type = opt_get_u8 ( l, code );
 
             break;
         case 54:
-            msg->options.sv_identifier.s_addr
-                = htonl ( ( *( v + 2 ) << 24 ) | ( *( v + 3 ) << 16 ) | ( *( v + 4 ) << 8 ) | *( v + 5 ) );
+            msg->options.sv_identifier.s_addr = htonl ( opt_get_u32 ( l, code ) );
             break;
         case 55:
-            /*size                   = *( v + 1 );
-            msg->len_requested     = size;
-            msg->options_requested = malloc ( size );
-
-            if ( !msg->options_requested )
-                err_log_exit ( LOG_ERR,
-                               "Error from malloc() in case 55, "
-                               "dec_dhcp_client_options %s",
-                               strerror ( errno ) );
-            tmp = v + 2;
-
-            for ( int i                          = 0; i < size; ++i )
-                *( &msg->options_requested + i ) = *( tmp + i );
-
-            tmp = NULL;*/
-            // getchar();
+            msg->options_requested = ( u_char * ) opt_data ( l, code );
+            msg->len_requested     = msg->options_requested ? l->len[code] : 0;
             break;
         case 56:  // sv-cl
-            tmp  = v + 1;
-            size = *( tmp );
-            tmp++;
-            msg->options.msg_err = malloc ( size + 1 );
-
-            if ( !msg->options.msg_err )
-                dhcp_fatal (
-                    "Error from malloc() in case 56, "
-                    "dec_dhcp_client_options %s",
-                    strerror ( errno ) );
-
-            memcpy ( &msg->options.msg_err, tmp, size );
-            *( &msg->options.msg_err + size + 1 ) = '\0';  // agregamos el fin de línea
-            tmp                                   = NULL;
+            msg->options.msg_err = opt_string ( l, code );
             break;
         case 57:
-            msg->options.max_message_size = ( *( v + 2 ) << 8 ) | *( v + 3 );
+            msg->options.max_message_size = opt_get_u16 ( l, code );
             break;
         case 60:
-            size                                 = *( v + 1 );
-            tmp                                  = v + 2;
-            msg->options.vendor_class_identifier = malloc ( size + 1 );
-            memcpy ( msg->options.vendor_class_identifier, tmp, size );
-
-            *( &msg->options.vendor_class_identifier + size + 1 ) = '\0';
-            tmp                                                   = NULL;
+            msg->options.vendor_class_identifier = opt_string ( l, code );
             break;
         case 61:
             // Si viene, no alterar; en caso contrario, eliminar la opción
             // en la respuesta.
-            size = *( v + 1 );
-            tmp  = v + 2;
-
-            msg->options.client_identifier = malloc ( size );
-            if ( !msg->options.client_identifier )
-                dhcp_fatal ( "Error from malloc() in case 61, dec_dhcp_msg %s", strerror ( errno ) );
-
-            memcpy ( msg->options.client_identifier, tmp, size );
-
+            msg->options.client_identifier     = ( u_char * ) opt_data ( l, code );
+            msg->options.client_identifier_len = msg->options.client_identifier ? l->len[code] : 0;
             break;
         case 66:
-
-            size                      = *( v + 1 );
-            tmp                       = v + 2;
-            msg->options.tftp_sv_name = malloc ( size + 1 );
-            memcpy ( &msg->options.tftp_sv_name, tmp, size );
-            *( &msg->options.tftp_sv_name + size + 1 ) = '\0';
-
+            msg->options.tftp_sv_name = opt_string ( l, code );
+            break;
+        case 67:
+            msg->options.boot_filename = opt_string ( l, code );
+            break;
+        case 81:
+            msg->options.fqdn_flags = opt_get_u8 ( l, code );
+            msg->options.fqdn       = opt_fqdn ( l, msg->options.fqdn_flags );
+            break;
+        case 93:
+            msg->options.client_arch = opt_get_u16 ( l, code );
             break;
     }
 }
 
-void dec_dhcp_msg ( dhcp_msg *msg, u_char *buf ) {
-    u_char *p = buf;
-    u_char *tmp;
+// Decodifica un mensaje de al menos DHCP_OPTIONS_OFFSET bytes. Los campos del
+// encabezado siempre se sobreescriben; solo se limpian las opciones, que
+// pueden no venir.
+void dec_dhcp_msg ( dhcp_msg *msg, dhcp_opt_list *opts, u_char *buf, size_t size ) {
+    u_char * p = buf;
+    u_int8_t overload;
+
+    memset ( &msg->options, 0, sizeof ( struct dhcp_options ) );
+    msg->options_requested = NULL;
+    msg->len_requested     = 0;
 
     // Message op code
     msg->op = *( p + 0 );
@@ -710,12 +1501,47 @@ void dec_dhcp_msg ( dhcp_msg *msg, u_char *buf ) {
     /*  Procesamos solo las opciones restantes que son indispensables para el
      * funcionamiento de DHCP */
 
-    for ( u_char *v = buf + 240; *v != 255; v += *( v + 1 ) + 2 )
-        dec_dhcp_client_options ( v, msg );
+    // Primero el área de opciones; si trae la opción 52, las opciones siguen
+    // en file y después en sname (RFC 3396, orden de concatenación)
+    opt_list_reset ( opts );
+    opt_list_scan ( opts, buf + DHCP_OPTIONS_OFFSET, buf + size );
+
+    overload = opt_get_u8 ( opts, 52 );
+    if ( overload & OVERLOAD_FILE )
+        opt_list_scan ( opts, buf + DHCP_FILE_OFFSET, buf + DHCP_FILE_OFFSET + DHCP_FILE_LEN );
+    if ( overload & OVERLOAD_SNAME )
+        opt_list_scan ( opts, buf + DHCP_SNAME_OFFSET, buf + DHCP_SNAME_OFFSET + DHCP_SNAME_LEN );
+
+    for ( u_int16_t i = 0; i < opts->ncodes; ++i )
+        dec_dhcp_client_options ( opts, opts->codes[i], msg );
 }
 
-void send_msg ( dhcp_server *server, in_addr_t ip ) {
-    ssize_t sent;
+u_int64_t timespec_ns ( const struct timespec *ts ) {
+    return ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+// Anota el paso del intercambio que lleva la respuesta en buf, enviada a la
+// hora ns; al cerrarlo reparte su tiempo y, si fue lento, lo registra
+void trace_reply ( dhcp_server *server, const u_char *buf, u_int8_t type, u_int64_t ns ) {
+    xtrace_done done;
+    u_int32_t   xid;
+
+    memcpy ( &xid, buf + 4, 4 );
+    if ( !xtrace_sent ( &server->trace, xid, logring_mac ( buf + 28 ), type, ns, &done ) )
+        return;
+
+    metrics_observe ( &server->counters.exchange_server, done.server );
+    if ( done.full )
+        metrics_observe ( &server->counters.exchange_client, done.client );
+    if ( done.total >= server->config.trace_slow * 1000000ull )
+        logring_log ( &server->log, EV_SLOW_EXCHANGE, ntohl ( xid ), done.mac, done.server / 1000,
+                      done.client / 1000 );
+}
+
+void send_reply ( dhcp_server *server, in_addr_t ip, const u_char *buf, ssize_t size, u_int8_t type,
+                  u_int64_t read_ns ) {
+    ssize_t         sent;
+    struct timespec now;
 
     struct sockaddr_in addr;
     memset ( &addr, 0, sizeof ( struct in_addr ) );
@@ -724,214 +1550,646 @@ void send_msg ( dhcp_server *server, in_addr_t ip ) {
     addr.sin_addr.s_addr = ip;
     addr.sin_port        = htons ( 68 );
 
-    sent = sendto ( server->descriptor, server->buf, server->size_msg, 0, ( struct sockaddr * ) &addr,
-                    sizeof ( struct sockaddr_in ) );
+    clock_gettime ( CLOCK_REALTIME, &now );
+    sent = sendto ( server->descriptor, buf, size, 0, ( struct sockaddr * ) &addr, sizeof ( struct sockaddr_in ) );
 
-    if ( sent != server->size_msg )
+    if ( sent != size )
         dhcp_fatal ( "Error in sendto from send_dhcpoffer: %s", strerror ( errno ) );
-}
+    capture_packet ( &server->capture, CAPTURE_TX, buf, size, server->config.ip.s_addr, server->config.port, ip, 68,
+                     timespec_ns ( &now ) );
 
-void change_lease ( dhcp_lease *head, in_addr_t addr ) {
-    for ( dhcp_lease *tmp = head; tmp != NULL; tmp = tmp->next )
-        if ( addr == tmp->ip.s_addr ) {
-            tmp->state = S_LEASED;
+    // El kernel numera los envíos en el mismo orden y con ese número regresa
+    // la marca de envío por la cola de errores
+    server->tx_sent[server->tx_id++ & ( TX_TRACK - 1 )] = timespec_ns ( &now );
+    ++server->tx_waiting;
 
-            if ( clock_gettime ( CLOCK_MONOTONIC, &tmp->start ) == -1 )
-                dhcp_error ( "Error from clock_gettime() in register_lease()" );
-        }
+    if ( timespec_ns ( &now ) > read_ns )
+        metrics_observe ( &server->counters.stage[METRICS_STAGE_PROCESS], timespec_ns ( &now ) - read_ns );
+    trace_reply ( server, buf, type, timespec_ns ( &now ) );
 }
 
-void wait_request ( dhcp_server *server ) {
-    ssize_t     received;
-    dhcp_lease *tmp;
+// Cierra el grupo: un solo write + fdatasync por partición para todos los
+// cambios pendientes y después salen todas las respuestas retenidas
+void commit_batch ( dhcp_server *server ) {
 
-    // Limpiamos el buffer y esperamos msg válido
-    memset ( server->buf, 0, MAX_BUFSIZE );
-    memset ( &server->msg, 0, sizeof ( struct dhcp_msg ) );
+    if ( !journal_group_commit ( &server->journal ) )
+        dhcp_fatal ( "Error from journal_commit() in commit_batch()", strerror ( errno ) );
 
-    received = recvfrom ( server->descriptor, server->buf, MAX_BUFSIZE, 0, ( struct sockaddr * ) &server->remote_addr,
-                          &server->remote_size );
+    for ( u_int16_t i = 0; i < server->nreplies; ++i )
+        send_reply ( server, server->replies[i].ip, server->replies[i].buf, server->replies[i].size,
+                     server->replies[i].type, server->replies[i].read_ns );
+    server->nreplies = 0;
+}
 
-    if ( received != -1 && received != EWOULDBLOCK && server->buf[0] == 1 && server->buf[236] == 99
-         && server->buf[237] == 130 && server->buf[238] == 83 && server->buf[239] == 99 ) {
+// Termina la compactación en curso de la partición o empieza otra cuando su
+// bitácora creció compact_size MB o pasó compact_interval desde la última
+void check_shard_compaction ( dhcp_server *server, int i ) {
+    journal *       j     = &server->journal.shards[i];
+    dhcp_shard *    shard = &server->shards[i];
+    struct timespec now;
+    u_int64_t       grown;
+
+    switch ( journal_compact_poll ( j ) ) {
+        case 1:
+            shard->compact_records = j->records;
+            syslog ( LOG_INFO, "Bitácora %d compactada a %llu registros en %.1f ms", i,
+                     ( unsigned long long ) j->records, j->compact_last_ms );
+            return;
+        case -1:
+            // La bitácora anterior sigue siendo válida y se reintenta después;
+            // si solo faltó el fsync() del directorio, el siguiente commit lo
+            // repite antes de confirmar nada
+            syslog ( LOG_ERR, "Error al compactar la bitácora %d: %s", i, strerror ( errno ) );
+            return;
+    }
 
-        puts ( "Mensaje DHCP recibido" );
-
-        // Revisamos si ha llegado un msg DHCPDISCOVER o DHCPREQUEST
-        dec_dhcp_msg ( &server->msg, server->buf );
-        puts ( "Mensaje DHCP decodificado" );
-
-        switch ( server->msg.options.type ) {
-            //        DHCPDISCOVER
-            //        El cliente está buscando servidores DHCP
-            //        disponibles.
-            //        DHCPOFFER
-            //                El servidor responde al cliente DHCPDISCOVER.
-            //        DHCPREQUEST
-            //        El cliente transmite al servidor y solicita los
-            //        parámetros ofrecidos desde un servidor en concreto,
-            //        como se define en el paquete.
-            //        DHCPDECLINE
-            //                La comunicación cliente a servidor, indica que la
-            //        dirección de red ya está en uso.
-            //        DHCPACK
-            //        La comunicación servidor a cliente con los
-            //        parámetros de configuración, incluida la dirección
-            //        de red comprometida.
-            //        DHCPNAK
-            //                La comunicación servidor a cliente, en la que se
-            //        rechaza la petición del parámetro de configuración.
-            //        DHCPRELEASE
-            //        La comunicación cliente a servidor, en la que se
-            //        renuncia a la dirección de red y se cancela la
-            //        concesión restante.
-            //        DHCPINFORM
-            //        La comunicación cliente a servidor, donde se
-            //        solicitan parámetros de configuración local que el
-            //        cliente ya ha configurado externamente como una
-            //        dirección.
-            case DHCPDISCOVER:
-                puts ( "Mensaje DHCPDiscover recibido" );
-
-                if ( server->dhcp_config.free && server->msg.giaddr.s_addr == 0 ) {
-
-                    // Si no encontramos una ip libre, avisamos y regresamos
-                    tmp = get_free_lease ( server->head );
-                    if ( !tmp ) {
-                        puts ( "No hay IP libres por el momento" );
-                        return;
-                    }
-                    // Guardamos el xid y enviamos
-                    tmp->state = S_WAIT;
-                    tmp->xid   = server->msg.xid;
+    if ( j->compact.state != JOURNAL_COMPACT_IDLE || j->npending )
+        return;
 
-                    build_msg ( server, tmp, DHCPOFFER );
-                    send_msg ( server, INADDR_BROADCAST );
-                    puts ( "DHCPOffer enviado" );
-                }
-                break;
-            case DHCPREQUEST:
-                puts ( "Mensaje DHCPRequest recibido" );
-
-                // Para una respuesta a un DHCPOffer válido:
-                // 1 - Client IP Address debe ser cero
-                // 2 - El xid debe estar registrado
-                // 3 - El identificador del servidor debe tener la IP correspondiente al del servidor DHCP
-
-                printf("ciaddr: %d\n", server->msg.ciaddr.s_addr);
-                printf ("search xid(): %d\n",search_xid ( server->msg.xid, server->head ));
-                printf("server identifier: %d\n", server->msg.options.sv_identifier.s_addr == server->config.ip.s_addr);
-
-                if ( server->msg.ciaddr.s_addr == 0 && search_xid ( server->msg.xid, server->head )
-                     && server->msg.options.sv_identifier.s_addr == server->config.ip.s_addr ) {
-                    puts ( "DHCPRequest válido" );
-
-                    // Registramos el alquiler
-                    if (register_lease ( server->head, server->msg.xid, server->msg.chaddr ))
-                        puts("Registrado alquiler correctamente");
-                    else
-                        puts("Fallo en registrar alquiler");
-
-                    // Buscamos dirección para enviar DHCPACK
-                    for ( tmp = server->head; tmp != NULL; tmp = tmp->next )
-                        if ( tmp->xid == server->msg.xid )
-                            break;
-
-                    // Construimos DHCPACK
-                    build_msg ( server, tmp, DHCPACK );
-
-                    // Enviamos DHCPACK
-                    send_msg ( server, INADDR_BROADCAST );
-                    puts("DHCPACK enviado");
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    grown = ( j->records - shard->compact_records ) * sizeof ( journal_frame );
+
+    if ( grown < ( u_int64_t ) server->config.compact_size << 20
+         && ( !server->config.compact_interval || !grown
+              || now.tv_sec - shard->compact_at < server->config.compact_interval ) )
+        return;
+
+    shard->compact_at = now.tv_sec;
+    if ( !journal_compact_start ( j, snapshot_leases, shard ) )
+        syslog ( LOG_ERR, "Error al iniciar la compactación de la bitácora %d: %s", i, strerror ( errno ) );
+}
+
+// Se llama justo después de commit_batch(), sin registros pendientes
+void check_compaction ( dhcp_server *server ) {
+
+    if ( !server->config.journal_file[0] )
+        return;
+
+    for ( int i = 0; i < server->journal.count; ++i )
+        check_shard_compaction ( server, i );
+}
+
+// Llena l con la concesión; regresa 0 si su estado no se exporta (libres,
+// ofrecidas y estados internos)
+int lease_to_export ( dhcp_server *server, dhcp_lease *lease, export_lease *l ) {
+    switch ( lease->state ) {
+        case S_LEASED:
+            l->state = EXPORT_LEASED;
+            break;
+        case S_RESERVED:
+            l->state = EXPORT_RESERVED;
+            break;
+        case S_PROHIBIT:
+            l->state = EXPORT_DECLINED;
+            break;
+        default:
+            return 0;
+    }
+
+    l->ip         = lease->ip.s_addr;
+    l->lease_time = lease->lease_time;
+    l->expires    = lease_expires ( server, lease );
+    l->class_id   = lease->class_id;
+    l->class_name = lease->class_id ? server->classes[lease->class_id].name : NULL;
+    l->hostname   = strtab_get ( &server->names, lease->hostname );
+    memcpy ( l->mac, lease->mac, 6 );
+    return 1;
+}
+
+// Avanza la exportación en curso EXPORT_CHUNK concesiones, o empieza otra si
+// pasó export_interval desde la anterior. Mientras hay una en curso el ciclo
+// principal no se bloquea esperando paquetes, salvo que el lector del socket
+// vaya atrás o el hilo que escribe el archivo no haya terminado con el buffer
+// anterior: entonces se espera en poll() a que acepte más (ver
+// recv_or_control()).
+void check_export ( dhcp_server *server ) {
+    dhcp_export *   ex    = &server->export;
+    size_t          total = server->end - server->head, n = 0;
+    struct timespec now;
+    export_lease    l;
+    int             r = 1;
+
+    if ( !server->config.export_target[0] || ex->blocked )
+        return;
+
+    if ( !ex->active ) {
+        clock_gettime ( CLOCK_MONOTONIC, &now );
+        if ( ex->last && now.tv_sec - ex->last < server->config.export_interval )
+            return;
+        ex->last = now.tv_sec;
+        if ( !export_open ( &ex->w, server->config.export_target, server->config.export_format ) ) {
+            syslog ( LOG_ERR, "Error al iniciar la exportación de concesiones: %s", strerror ( errno ) );
+            return;
+        }
+        ex->start  = now;
+        ex->pos    = 0;
+        ex->active = 1;
+    }
+
+    // Una concesión que el socket no aceptó se vuelve a entregar en la
+    // siguiente vuelta
+    for ( ; n < EXPORT_CHUNK && ex->pos < total; ++n, ++ex->pos )
+        if ( lease_to_export ( server, server->head + ex->pos, &l ) && ( r = export_add ( &ex->w, &l ) ) != 1 )
+            break;
+
+    if ( r == 1 && ex->pos == total )
+        r = export_finish ( &ex->w );
+    if ( r == -1 )
+        ex->blocked = 1;
+    if ( r == -1 || ( r == 1 && ex->pos < total ) )
+        return;
+
+    if ( r == 1 ) {
+        clock_gettime ( CLOCK_MONOTONIC, &now );
+        syslog ( LOG_INFO, "Exportadas %llu concesiones (%llu bytes) a %s en %.1f ms",
+                 ( unsigned long long ) ex->w.leases, ( unsigned long long ) ex->w.bytes, server->config.export_target,
+                 ( now.tv_sec - ex->start.tv_sec ) * 1e3 + ( now.tv_nsec - ex->start.tv_nsec ) / 1e6 );
+    } else
+        syslog ( LOG_ERR, "Error al exportar las concesiones a %s: %s", server->config.export_target,
+                 strerror ( errno ) );
+    export_close ( &ex->w );
+    ex->active = 0;
+}
+
+// Escribe los eventos de auditoría que llevan más de AUDIT_FLUSH_SECONDS en
+// memoria, para que un servidor con poco tráfico no los retenga
+void check_audit ( dhcp_server *server ) {
+    if ( server->config.audit_dir[0] && !audit_tick ( &server->audit, time ( NULL ) ) )
+        syslog ( LOG_ERR, "Error al escribir el registro de auditoría: %s", strerror ( errno ) );
+}
+
+void send_msg ( dhcp_server *server, in_addr_t ip ) {
+    dhcp_reply *reply;
+
+    profile_enter ( &server->profile );
+    if ( server->nreplies == REPLY_BATCH_MAX )
+        commit_batch ( server );
+
+    // Si hay cambios sin confirmar en la bitácora, la respuesta (que puede
+    // depender de ellos) espera al commit del grupo; las que ya esperan
+    // conservan su orden
+    if ( !server->journal.npending && !server->nreplies ) {
+        send_reply ( server, ip, server->buf, server->size_msg, server->reply_type, server->read_ns );
+        profile_leave ( &server->profile, PROFILE_SEND );
+        return;
+    }
+
+    reply          = &server->replies[server->nreplies++];
+    reply->ip      = ip;
+    reply->size    = server->size_msg;
+    reply->type    = server->reply_type;
+    reply->read_ns = server->read_ns;
+    profile_leave ( &server->profile, PROFILE_SEND );
+    memcpy ( reply->buf, server->buf, server->size_msg );
+}
+
+void change_lease ( dhcp_server *server, in_addr_t addr ) {
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
+        if ( addr == tmp->ip.s_addr ) {
+            unindex_lease ( server, tmp );
+            tmp->state = S_LEASED;
+            index_lease ( server, tmp );
+            lease_clock ( server, &tmp->start );
+        }
+}
+
+// Clase del cliente: una sola pasada del autómata sobre las opciones 60, 77
+// y 61 (directo sobre sus fragmentos en el buffer) y el OUI de chaddr
+u_int8_t classify_msg ( dhcp_server *server ) {
+    static const u_int8_t codes[] = {60, 77, 61};
+    static const u_int8_t fields[] = {CLASSIFY_FIELD_VENDOR, CLASSIFY_FIELD_USER, CLASSIFY_FIELD_CLIENT};
+    dhcp_opt_list *       l        = &server->opts;
+    classify_run          run;
+
+    if ( !server->classifier.nrules )
+        return 0;
+
+    classify_begin ( &run, &server->classifier );
+
+    for ( int i = 0; i < 3; ++i ) {
+        if ( !l->head[codes[i]] )
+            continue;
+        classify_field ( &run, fields[i] );
+        for ( u_int16_t j = l->head[codes[i]]; j; j = l->frag[j - 1].next )
+            classify_feed ( &run, l->frag[j - 1].data, l->frag[j - 1].len );
+    }
+
+    classify_field ( &run, CLASSIFY_FIELD_OUI );
+    classify_feed ( &run, server->msg.chaddr, 3 );
+
+    return classify_end ( &run );
+}
+
+// Pool del que se toman direcciones para la clase del mensaje: el propio si
+// la clase tiene rango, si no el general
+u_int8_t get_pool ( dhcp_server *server ) {
+    return server->classes[server->msg.class_id].first.s_addr ? server->msg.class_id : 0;
+}
+
+// Parámetros de arranque para la clase del mensaje: primero los de su
+// arquitectura exacta y si no, los que sirven para cualquiera. Los clientes
+// que no mandan la opción 93 solo reciben los de cualquier arquitectura.
+dhcp_boot *get_boot ( dhcp_server *server ) {
+    dhcp_msg * msg      = &server->msg;
+    bool       has_arch = server->opts.len[93] >= 2;
+    dhcp_boot *any      = NULL;
+
+    for ( u_int8_t i = 0; i < server->nboots; ++i ) {
+        dhcp_boot *boot = &server->boots[i];
+
+        if ( boot->class_id != msg->class_id )
+            continue;
+        if ( has_arch && boot->arch == msg->options.client_arch )
+            return boot;
+        if ( boot->arch == BOOT_ARCH_ANY && !any )
+            any = boot;
+    }
+    return any;
+}
+
+// Atiende un mensaje DHCP ya validado de received bytes en server->buf
+void handle_msg ( dhcp_server *server, ssize_t received ) {
+    dhcp_lease *tmp;
+
+    logring_packet ( &server->log );
+    logring_log ( &server->log, EV_RECEIVED, received, server->remote_addr.sin_addr.s_addr, 0, 0 );
+
+    // Revisamos si ha llegado un msg DHCPDISCOVER o DHCPREQUEST
+    profile_enter ( &server->profile );
+    dec_dhcp_msg ( &server->msg, &server->opts, server->buf, received );
+    profile_leave ( &server->profile, PROFILE_DECODE );
+
+    // Clase del cliente: elige pool y plantilla de respuesta
+    server->msg.class_id = classify_msg ( server );
+    server->msg.boot     = get_boot ( server );
+    logring_log ( &server->log, EV_DECODED, server->msg.options.type, ntohl ( server->msg.xid ),
+                  logring_mac ( server->msg.chaddr ), server->msg.class_id );
+    logring_log ( &server->log, EV_OPTIONS, server->opts.ncodes, server->msg.options.requested_address.s_addr,
+                  server->opts.len[12], 0 );
+
+    if ( xtrace_received ( &server->trace, server->msg.xid, logring_mac ( server->msg.chaddr ),
+                           server->msg.options.type, server->rx_ns ) )
+        metrics_inc ( &server->counters.exchange_evicted );
+
+    switch ( server->msg.options.type ) {
+        //        DHCPDISCOVER
+        //        El cliente está buscando servidores DHCP
+        //        disponibles.
+        //        DHCPOFFER
+        //                El servidor responde al cliente DHCPDISCOVER.
+        //        DHCPREQUEST
+        //        El cliente transmite al servidor y solicita los
+        //        parámetros ofrecidos desde un servidor en concreto,
+        //        como se define en el paquete.
+        //        DHCPDECLINE
+        //                La comunicación cliente a servidor, indica que la
+        //        dirección de red ya está en uso.
+        //        DHCPACK
+        //        La comunicación servidor a cliente con los
+        //        parámetros de configuración, incluida la dirección
+        //        de red comprometida.
+        //        DHCPNAK
+        //                La comunicación servidor a cliente, en la que se
+        //        rechaza la petición del parámetro de configuración.
+        //        DHCPRELEASE
+        //        La comunicación cliente a servidor, en la que se
+        //        renuncia a la dirección de red y se cancela la
+        //        concesión restante.
+        //        DHCPINFORM
+        //        La comunicación cliente a servidor, donde se
+        //        solicitan parámetros de configuración local que el
+        //        cliente ya ha configurado externamente como una
+        //        dirección.
+        case DHCPDISCOVER:
+            logring_log ( &server->log, EV_DISCOVER, logring_mac ( server->msg.chaddr ), ntohl ( server->msg.xid ),
+                          0, 0 );
+
+            if ( server->dhcp_config.free && server->msg.giaddr.s_addr == 0 ) {
+
+                // Si no encontramos una ip libre, avisamos y regresamos
+                profile_enter ( &server->profile );
+                tmp = get_free_lease ( server, get_pool ( server ) );
+                profile_leave ( &server->profile, PROFILE_LOOKUP );
+                if ( !tmp ) {
+                    logring_log ( &server->log, EV_NO_FREE, logring_mac ( server->msg.chaddr ),
+                                  server->msg.class_id, 0, 0 );
                     return;
                 }
+                // Guardamos el xid y enviamos
+                unindex_lease ( server, tmp );
+                tmp->state = S_WAIT;
+                tmp->xid   = server->msg.xid;
+                index_lease ( server, tmp );
+                publish_lease ( server, tmp );
+
+                build_msg ( server, tmp, DHCPOFFER );
+                send_msg ( server, INADDR_BROADCAST );
+                logring_log ( &server->log, EV_OFFER, tmp->ip.s_addr, logring_mac ( server->msg.chaddr ), 0, 0 );
+            }
+            break;
+        case DHCPREQUEST:
+            logring_log ( &server->log, EV_REQUEST, logring_mac ( server->msg.chaddr ), ntohl ( server->msg.xid ), 0,
+                          0 );
+
+            // Para una respuesta a un DHCPOffer válido:
+            // 1 - Client IP Address debe ser cero
+            // 2 - El xid debe estar registrado
+            // 3 - El identificador del servidor debe tener la IP correspondiente al del servidor DHCP
+
+            if ( server->log.active >= LOGRING_DEBUG )
+                logring_log ( &server->log, EV_REQUEST_CHECK, server->msg.ciaddr.s_addr,
+                              search_xid ( server, server->msg.xid ),
+                              server->msg.options.sv_identifier.s_addr == server->config.ip.s_addr, 0 );
+
+            profile_enter ( &server->profile );
+            if ( server->msg.ciaddr.s_addr == 0 && search_xid ( server, server->msg.xid )
+                 && server->msg.options.sv_identifier.s_addr == server->config.ip.s_addr ) {
+                logring_log ( &server->log, EV_REQUEST_VALID, 0, 0, 0, 0 );
+
+                // Registramos el alquiler
+                if (register_lease ( server, server->msg.xid, server->msg.chaddr ))
+                    logring_log ( &server->log, EV_REGISTERED, 0, 0, 0, 0 );
+                else
+                    logring_log ( &server->log, EV_REGISTER_FAILED, logring_mac ( server->msg.chaddr ),
+                                  ntohl ( server->msg.xid ), 0, 0 );
 
-                // Si es una petición para verificar o extender una concesión
-                // Se debe añadir el mismo identificador de cliente
-                // y todos los parametros de su DHCPDISCOVER
-                printf("search_lease(): %d\n",search_lease ( server->msg.ciaddr.s_addr, server->head ));
+                // Buscamos dirección para enviar DHCPACK
+                for ( tmp = server->head; tmp != server->end; ++tmp )
+                    if ( tmp->xid == server->msg.xid )
+                        break;
+                profile_leave ( &server->profile, PROFILE_LOOKUP );
+
+                // Construimos DHCPACK
+                build_msg ( server, tmp, DHCPACK );
+
+                // Enviamos DHCPACK
+                send_msg ( server, INADDR_BROADCAST );
+                if ( tmp != server->end )
+                    logring_log ( &server->log, EV_ACK, tmp->ip.s_addr, logring_mac ( server->msg.chaddr ), 0, 0 );
+                return;
+            }
+            profile_leave ( &server->profile, PROFILE_LOOKUP );
+
+            // Si es una petición para verificar o extender una concesión
+            // Se debe añadir el mismo identificador de cliente
+            // y todos los parametros de su DHCPDISCOVER
+            if ( server->log.active >= LOGRING_DEBUG )
+                logring_log ( &server->log, EV_RENEW_CHECK, server->msg.ciaddr.s_addr,
+                              search_lease ( server, server->msg.ciaddr.s_addr ), 0, 0 );
+
+            profile_enter ( &server->profile );
+            if ( server->msg.ciaddr.s_addr != 0 && search_lease ( server, server->msg.ciaddr.s_addr )
+                 ) {
+                logring_log ( &server->log, EV_RENEW, server->msg.ciaddr.s_addr, 0, 0, 0 );
+
+                // Confirmamos concesión
+                tmp = confirm_lease ( server, server->msg.ciaddr.s_addr );
+                profile_leave ( &server->profile, PROFILE_LOOKUP );
+
+                if (!tmp ) {
+                    logring_log ( &server->log, EV_NOT_FOUND, server->msg.ciaddr.s_addr,
+                                  logring_mac ( server->msg.chaddr ), 0, 0 );
+                    build_msg(server, tmp, DHCPNAK);
+                    send_msg(server, INADDR_BROADCAST);
+                    return;
+                }
+                journal_lease ( server, tmp );
+                audit_lease ( server, tmp, AUDIT_RENEW );
+                log_lease ( server, tmp );
+                // Construimos DHCPACK
+                build_msg ( server, tmp, DHCPACK );
 
-                if ( server->msg.ciaddr.s_addr != 0 && search_lease ( server->msg.ciaddr.s_addr, server->head )
-                     ) {
-                    puts("Reconfirmamos concesión");// Confirmamos concesión
+                // Enviamos DHCPACK
+                send_msg ( server, INADDR_BROADCAST );
+                logring_log ( &server->log, EV_ACK, tmp->ip.s_addr, logring_mac ( server->msg.chaddr ), 0, 0 );
+            } else
+                profile_leave ( &server->profile, PROFILE_LOOKUP );
 
-                    // Confirmamos concesión
-                    tmp = confirm_lease ( server->head, server->msg.ciaddr.s_addr );
 
-                    if (!tmp ) {
-                        puts ( "Registro no encontrado" );
-                        build_msg(server, tmp, DHCPNAK);
-                        send_msg(server, INADDR_BROADCAST);
-                        return;
-                    }
-                    print_lease_info(tmp);
-                    // Construimos DHCPACK
-                    build_msg ( server, tmp, DHCPACK );
+            break;
 
-                    // Enviamos DHCPACK
-                    send_msg ( server, INADDR_BROADCAST );
+        case DHCPDECLINE:
+            logring_log ( &server->log, EV_DECLINE, logring_mac ( server->msg.chaddr ), server->msg.ciaddr.s_addr, 0,
+                          0 );
+            // Buscamos dirección para enviar DHCPACK
+            for ( tmp = server->head; tmp != server->end; ++tmp )
+                if ( tmp->ip.s_addr == server->msg.ciaddr.s_addr ) {
+                    change_lease ( server, tmp->ip.s_addr );
+                    journal_lease ( server, tmp );
+                    audit_lease ( server, tmp, AUDIT_DECLINE );
                 }
+        break;
+
+        case DHCPRELEASE:
+            logring_log ( &server->log, EV_RELEASE, logring_mac ( server->msg.chaddr ), server->msg.ciaddr.s_addr, 0,
+                          0 );
+            if ( server->msg.options.sv_identifier.s_addr == server->config.ip.s_addr )
+                for ( tmp = server->head; tmp != server->end; ++tmp )
+                    if ( tmp->ip.s_addr == server->msg.ciaddr.s_addr
+                         && *(tmp->mac + 0) == *(server->msg.chaddr + 0)
+                         && *(tmp->mac + 1) == *(server->msg.chaddr + 1)
+                         && *(tmp->mac + 2) == *(server->msg.chaddr + 2)
+                         && *(tmp->mac + 3) == *(server->msg.chaddr + 3)
+                         && *(tmp->mac + 4) == *(server->msg.chaddr + 4)
+                         && *(tmp->mac + 5) == *(server->msg.chaddr + 5)
+                         ) {
+                        logring_log ( &server->log, EV_RELEASED, tmp->ip.s_addr, 0, 0, 0 );
+                        release_lease ( server, tmp );
+                    }
 
+            break;
 
-                break;
+        case DHCPINFORM:
+            logring_log ( &server->log, EV_INFORM, logring_mac ( server->msg.chaddr ), server->msg.ciaddr.s_addr, 0,
+                          0 );
+            // The server responds to a DHCPINFORM message by sending a DHCPACK
+            // message directly to the address given in the 'ciaddr' field of the
+            // DHCPINFORM message.  The server MUST NOT send a lease expiration time
+            // to the client and SHOULD NOT fill in 'yiaddr'.  The server includes
+            // other parameters in the DHCPACK message as defined in section 4.3.1.
+
+            // Buscamos dirección para enviar DHCPACK
+            for ( tmp = server->head; tmp != server->end; ++tmp )
+                if ( tmp->ip.s_addr == server->msg.ciaddr.s_addr ) {
+                    build_config_msg ( server, DHCPACK );
+                    break;
+                }
 
-            case DHCPDECLINE:
-                puts ( "DHCPDECLINE recibido" );
-                // Buscamos dirección para enviar DHCPACK
-                for ( tmp = server->head; tmp != NULL; tmp = tmp->next )
-                    if ( tmp->ip.s_addr == server->msg.ciaddr.s_addr )
-                        change_lease ( server->head, tmp->ip.s_addr );
+            // Enviamos DHCPACK a la IP
+            send_msg ( server, server->msg.ciaddr.s_addr );
             break;
+        default:
+            // No nos interesa otro tipo de msg DHCP, salimos
+            return;
+    }
+}
 
-            case DHCPRELEASE:
-                puts ( "DHCPRELEASE recibido" );
-                if ( server->msg.options.sv_identifier.s_addr == server->config.ip.s_addr )
-                    for ( tmp = server->head; tmp != NULL; tmp = tmp->next )
-                        if ( tmp->ip.s_addr == server->msg.ciaddr.s_addr
-                             && *(tmp->mac + 0) == *(server->msg.chaddr + 0)
-                             && *(tmp->mac + 1) == *(server->msg.chaddr + 1)
-                             && *(tmp->mac + 2) == *(server->msg.chaddr + 2)
-                             && *(tmp->mac + 3) == *(server->msg.chaddr + 3)
-                             && *(tmp->mac + 4) == *(server->msg.chaddr + 4)
-                             && *(tmp->mac + 5) == *(server->msg.chaddr + 5)
-                             ) {
-                            puts("Liberamos dirección");
-                            tmp->state = S_FREE;
-                            tmp->xid   = 0;
-                            print_lease_info(tmp);
-                            memset ( tmp->mac, 0, 6 );
-                            memset ( &tmp->start, 0, sizeof ( struct timespec ) );
-
-                        }
+// Atiende un mensaje. Regresa 0 si no llegó ninguno: con respuestas
+// retenidas no se bloquea, para cerrar el grupo en cuanto se vacía la cola
+// Marca de software del kernel que trae el mensaje, 0 si no trae
+u_int64_t kernel_timestamp ( struct msghdr *mh ) {
+    struct scm_timestamping *tss;
 
-                break;
+    for ( struct cmsghdr *c = CMSG_FIRSTHDR ( mh ); c; c = CMSG_NXTHDR ( mh, c ) )
+        if ( c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPING ) {
+            tss = ( struct scm_timestamping * ) CMSG_DATA ( c );
+            return timespec_ns ( &tss->ts[0] );
+        }
+    return 0;
+}
+
+// Recoge las marcas de envío que el kernel dejó en la cola de errores. Si
+// no hay ninguna (la interfaz no las da o aún no llegan) se deja de
+// preguntar hasta el siguiente envío, así que cuesta a lo más una llamada
+// por respuesta.
+void drain_tx_timestamps ( dhcp_server *server ) {
+    char                      control[CMSG_SPACE ( sizeof ( struct scm_timestamping ) )
+                                      + CMSG_SPACE ( sizeof ( struct sock_extended_err ) + sizeof ( struct sockaddr_in ) )];
+    struct msghdr             mh;
+    struct sock_extended_err *err;
+    u_int64_t                 ns;
+
+    while ( server->tx_waiting ) {
+        memset ( &mh, 0, sizeof ( mh ) );
+        mh.msg_control    = control;
+        mh.msg_controllen = sizeof ( control );
+        if ( recvmsg ( server->descriptor, &mh, MSG_ERRQUEUE | MSG_DONTWAIT ) == -1 ) {
+            server->tx_waiting = 0;
+            return;
+        }
 
-            case DHCPINFORM:
-                puts ( "DHCPINFORM recibido" );
-                // The server responds to a DHCPINFORM message by sending a DHCPACK
-                // message directly to the address given in the 'ciaddr' field of the
-                // DHCPINFORM message.  The server MUST NOT send a lease expiration time
-                // to the client and SHOULD NOT fill in 'yiaddr'.  The server includes
-                // other parameters in the DHCPACK message as defined in section 4.3.1.
+        ns  = kernel_timestamp ( &mh );
+        err = NULL;
+        for ( struct cmsghdr *c = CMSG_FIRSTHDR ( &mh ); c; c = CMSG_NXTHDR ( &mh, c ) )
+            if ( c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR )
+                err = ( struct sock_extended_err * ) CMSG_DATA ( c );
+        if ( !ns || !err || err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING )
+            continue;
 
-                // Buscamos dirección para enviar DHCPACK
-                for ( tmp = server->head; tmp != NULL; tmp = tmp->next )
-                    if ( tmp->ip.s_addr == server->msg.ciaddr.s_addr )
-                        build_config_msg ( server, tmp, DHCPACK );
+        // Solo los envíos que siguen en tx_sent
+        if ( server->tx_id - err->ee_data - 1 < TX_TRACK ) {
+            u_int64_t sent = server->tx_sent[err->ee_data & ( TX_TRACK - 1 )];
 
-                // Enviamos DHCPACK a la IP
-                send_msg ( server, server->msg.ciaddr.s_addr );
-                break;
-            default:
-                // No nos interesa otro tipo de msg DHCP, salimos
-                return;
+            metrics_observe ( &server->counters.stage[METRICS_STAGE_TX], ns > sent ? ns - sent : 0 );
         }
+        --server->tx_waiting;
     }
 }
 
+// recvmsg() que también atiende el socket de control y la exportación
+// detenida: si no hay msg, espera en poll() el socket DHCP junto con los de
+// control y el de la exportación, con el mismo tiempo máximo que SO_RCVTIMEO.
+// La etapa PROFILE_RECV empieza antes de cada recvmsg(), así que la espera
+// no cuenta en ella.
+ssize_t recv_or_control ( dhcp_server *server, struct msghdr *mh ) {
+    struct pollfd fds[3 + CONTROL_CLIENTS_MAX];
+    socklen_t     namelen    = mh->msg_namelen;
+    size_t        controllen = mh->msg_controllen;
+    ssize_t       received;
+    int           n = 1, control_n = 1;
+
+    profile_enter ( &server->profile );
+    received = recvmsg ( server->descriptor, mh, MSG_DONTWAIT );
+    if ( received != -1 || ( errno != EAGAIN && errno != EWOULDBLOCK ) )
+        return received;
+
+    fds[0].fd     = server->descriptor;
+    fds[0].events = POLLIN;
+    if ( server->export.blocked ) {
+        fds[n].fd = export_pollfd ( &server->export.w, &fds[n].events );
+        control_n = ++n;
+    }
+    if ( server->config.control_socket[0] )
+        n += control_pollfds ( &server->control, fds + n );
+    if ( poll ( fds, n, server->timeout.tv_sec * 1000 + server->timeout.tv_usec / 1000 ) <= 0 ) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    // Con error o cierre del lector también se reintenta: export_add() lo
+    // reporta y termina la exportación
+    if ( control_n > 1 && fds[1].revents )
+        server->export.blocked = 0;
+    for ( int i = control_n; i < n; ++i )
+        if ( fds[i].revents )
+            server->control_ready = 1;
+    if ( !( fds[0].revents & POLLIN ) ) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    mh->msg_namelen    = namelen;
+    mh->msg_controllen = controllen;
+    profile_enter ( &server->profile );
+    return recvmsg ( server->descriptor, mh, MSG_DONTWAIT );
+}
+
+int wait_request ( dhcp_server *server ) {
+    ssize_t         received;
+    int             flags;
+    struct timespec start, end, now;
+    u_int8_t        type;
+    char            control[CMSG_SPACE ( sizeof ( struct scm_timestamping ) )];
+    struct iovec    iov = {server->buf, MAX_BUFSIZE};
+    struct msghdr   mh  = {&server->remote_addr, sizeof ( server->remote_addr ), &iov, 1, control, sizeof ( control ),
+                          0};
+
+    // Esperamos msg válido. El buffer no se limpia: solo se lee hasta lo
+    // recibido y un mensaje más corto que el encabezado se descarta
+    drain_tx_timestamps ( server );
+    flags = server->nreplies || server->journal.npending || ( server->export.active && !server->export.blocked )
+                    || control_pending ( &server->control )
+                ? MSG_DONTWAIT
+                : 0;
+    if ( flags ) {
+        profile_enter ( &server->profile );
+        received = recvmsg ( server->descriptor, &mh, flags );
+    } else
+        received = recv_or_control ( server, &mh );
+    if ( received > 0 )
+        profile_leave ( &server->profile, PROFILE_RECV );
+    server->remote_size = mh.msg_namelen;
+
+    if ( received > 0 ) {
+        clock_gettime ( CLOCK_REALTIME, &now );
+        server->read_ns = timespec_ns ( &now );
+
+        // Sin marca del kernel el mensaje cuenta como leído al llegar
+        server->rx_ns = kernel_timestamp ( &mh );
+        if ( server->rx_ns )
+            metrics_observe ( &server->counters.stage[METRICS_STAGE_QUEUE],
+                              server->read_ns > server->rx_ns ? server->read_ns - server->rx_ns : 0 );
+        else
+            server->rx_ns = server->read_ns;
+
+        // Antes de atenderlo: la respuesta se construye sobre el mismo buffer
+        capture_packet ( &server->capture, CAPTURE_RX, server->buf, received, server->remote_addr.sin_addr.s_addr,
+                         ntohs ( server->remote_addr.sin_port ), server->config.ip.s_addr, server->config.port,
+                         server->rx_ns );
+    }
+
+    if ( received >= DHCP_OPTIONS_OFFSET && server->buf[0] == 1 && server->buf[236] == 99
+         && server->buf[237] == 130 && server->buf[238] == 83 && server->buf[239] == 99 ) {
+
+        // El tiempo llega hasta que la respuesta queda lista; la espera del
+        // commit del grupo no cuenta
+        clock_gettime ( CLOCK_MONOTONIC, &start );
+        handle_msg ( server, received );
+        clock_gettime ( CLOCK_MONOTONIC, &end );
+
+        type = server->msg.options.type < METRICS_TYPES ? server->msg.options.type : 0;
+        metrics_inc ( &server->counters.received[type] );
+        metrics_observe ( &server->counters.handle[type],
+                          ( end.tv_sec - start.tv_sec ) * 1000000000ll + ( end.tv_nsec - start.tv_nsec ) );
+    } else if ( received != -1 )
+        metrics_inc ( &server->counters.invalid );
+
+    return received != -1;
+}
+
 void get_lease_count ( dhcp_server *server ) {
 
-    for ( dhcp_lease *tmp = server->head; tmp != NULL; tmp = tmp->next ) {
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp ) {
 
         switch ( tmp->state ) {
             case S_FREE:
@@ -954,35 +2212,154 @@ void get_lease_count ( dhcp_server *server ) {
     }
 }
 
+// Cuenta las concesiones por clase y estado y, con socket de control, arma el
+// índice por MAC; desde aquí los mantienen unindex_lease() e index_lease()
+void index_leases ( dhcp_server *server ) {
+    size_t count = server->end - server->head, buckets = 1;
+
+    memset ( server->lease_counts, 0, sizeof ( server->lease_counts ) );
+    if ( server->config.control_socket[0] ) {
+        while ( buckets < count )
+            buckets <<= 1;
+        if ( !( server->mac_buckets = memuse_calloc ( MEMUSE_INDEX, buckets, sizeof ( u_int32_t ) ) )
+             || !( server->mac_next = memuse_calloc ( MEMUSE_INDEX, count, sizeof ( u_int32_t ) ) ) )
+            dhcp_fatal ( "Error from memuse_calloc() in index_leases()", strerror ( errno ) );
+        server->mac_mask = buckets - 1;
+    }
+
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
+        index_lease ( server, tmp );
+}
+
+// Hash de la asignación de direcciones a clases; si cambia, las concesiones
+// de la base se conservan pero hay que reasignar las clases
+u_int32_t get_pool_layout ( dhcp_server *server ) {
+    u_int32_t h = 2166136261u;
+
+    for ( u_int8_t c = 1; c < server->nclasses; ++c ) {
+        u_int32_t range[2] = {server->classes[c].first.s_addr, server->classes[c].last.s_addr};
+
+        for ( size_t i = 0; i < sizeof ( range ); ++i ) {
+            h ^= ( ( u_char * ) range )[i];
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+// Las direcciones dentro del rango de una clase son de su pool
+void assign_classes ( dhcp_server *server ) {
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp ) {
+        tmp->class_id = 0;
+        for ( u_int8_t c = 1; c < server->nclasses; ++c )
+            if ( server->classes[c].first.s_addr && ntohl ( tmp->ip.s_addr ) >= ntohl ( server->classes[c].first.s_addr )
+                 && ntohl ( tmp->ip.s_addr ) <= ntohl ( server->classes[c].last.s_addr ) ) {
+                tmp->class_id = c;
+                break;
+            }
+    }
+}
+
+// Mapea la tabla de concesiones y la tabla de nombres desde la base. Regresa
+// 1 si la tabla es nueva y hay que inicializarla.
+int open_lease_db ( dhcp_server *server, size_t count ) {
+    leasedb_geometry geometry;
+    struct timespec  now;
+    time_t           realtime = time ( NULL );
+    int64_t          clock;
+    char             names[sizeof ( server->config.lease_db_file ) + 8];
+    int              result;
+
+    geometry.rec_size = sizeof ( struct dhcp_lease );
+    geometry.count    = count;
+    geometry.first_ip = server->config.initial_ip.s_addr;
+    geometry.last_ip  = server->config.last_ip.s_addr;
+    geometry.layout   = get_pool_layout ( server );
+
+    result = leasedb_open ( &server->leasedb, server->config.lease_db_file, &geometry );
+    if ( result == LEASEDB_ERROR )
+        dhcp_fatal ( "Error from leasedb_open() in open_lease_db()", strerror ( errno ) );
+    if ( result == LEASEDB_CREATED )
+        printf ( "Base de concesiones %s nueva\n", server->config.lease_db_file );
+
+    server->head = server->leasedb.records;
+    server->end  = server->head + count;
+
+    // Los handles de nombre guardados en la tabla apuntan a esta arena
+    snprintf ( names, sizeof ( names ), "%s.names", server->config.lease_db_file );
+    if ( !strtab_map ( &server->names, names ) )
+        dhcp_fatal ( "Error from strtab_map() in open_lease_db()", strerror ( errno ) );
+
+    // El reloj de concesiones sigue desde donde se quedó más lo que avanzó el
+    // reloj real mientras el servidor no corría, así los temporizadores
+    // guardados siguen valiendo sin tocar la tabla
+    if ( clock_gettime ( CLOCK_MONOTONIC, &now ) == -1 )
+        dhcp_error ( "Error from clock_gettime() in open_lease_db()" );
+    if ( result == LEASEDB_CREATED )
+        clock = now.tv_sec;
+    else
+        clock = server->leasedb.hdr->saved_clock + ( realtime - server->leasedb.hdr->saved_realtime );
+    server->clock_bias = clock - now.tv_sec;
+    leasedb_set_clock ( &server->leasedb, realtime, clock );
+
+    if ( result == LEASEDB_LAYOUT ) {
+        assign_classes ( server );
+        leasedb_set_layout ( &server->leasedb, geometry.layout );
+    }
+
+    return result == LEASEDB_CREATED;
+}
+
 void up_service ( dhcp_server *server ) {
-    dhcp_lease *tmp;
+    u_int32_t first = ntohl ( server->config.initial_ip.s_addr );
+    size_t    count;
+    bool      fresh = true;
+
+    if ( ntohl ( server->config.last_ip.s_addr ) <= first )
+        dhcp_error ( "Rango a administrar inválido" );
+    count = ntohl ( server->config.last_ip.s_addr ) - first;
+
+    // Todas las concesiones van en un arreglo indexado por dirección; con base
+    // de concesiones el arreglo es el archivo mapeado y, si ya existía, no hay
+    // nada más que hacer
+    if ( server->config.lease_db_file[0] )
+        fresh = open_lease_db ( server, count );
+    else {
+        server->head = memuse_calloc ( MEMUSE_LEASES, count, sizeof ( struct dhcp_lease ) );
+        if ( !server->head )
+            dhcp_fatal ( "Error from calloc() in up_service()", strerror ( errno ) );
+        server->end = server->head + count;
+    }
+    server->dhcp_config.total = count;
 
-    tmp          = malloc ( sizeof ( struct dhcp_lease ) );
-    server->head = tmp;
+    if ( !fresh )
+        return;
 
     // Generamos ip a administrar
-    for ( in_addr_t i = server->config.initial_ip.s_addr; i != server->config.last_ip.s_addr; i += htonl ( 1 ) ) {
-        server->dhcp_config.total++;
-        tmp->state            = S_FREE;
-        tmp->ip.s_addr        = i;
-        tmp->broadcast.s_addr = server->config.broadcast.s_addr;
-        tmp->netmask.s_addr   = server->config.netmask.s_addr;
-        tmp->gateway.s_addr   = server->config.gateway.s_addr;
-        tmp->dns1.s_addr      = server->config.dns1.s_addr;
-        tmp->dns2.s_addr      = server->config.dns2.s_addr;
-        tmp->rebinding        = server->config.rebinding;
-        tmp->renewal          = server->config.renewal;
-        tmp->lease_time       = server->config.lease;
-        tmp->next             = malloc ( sizeof ( struct dhcp_lease ) );
-        memset ( tmp->next, 0, sizeof ( struct dhcp_lease ) );
-
-        tmp = tmp->next;
+    for ( size_t i = 0; i < count; ++i ) {
+        server->head[i].state      = S_FREE;
+        server->head[i].ip.s_addr  = htonl ( first + i );
+        server->head[i].lease_time = server->config.lease;
     }
+    assign_classes ( server );
 }
 
 void get_used_addresses ( dhcp_server *server ) {
 }
 
+// Marcas de software del kernel al recibir y al enviar; las de envío llegan
+// por la cola de errores, sin el datagrama y con el número de envío
+int enable_timestamps ( int fd ) {
+    const int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE
+                      | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    if ( setsockopt ( fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof ( flags ) ) == -1 ) {
+        syslog ( LOG_WARNING, "Sin marcas de tiempo del kernel: %s", strerror ( errno ) );
+        return 0;
+    }
+    return 1;
+}
+
 void dhcp_init ( dhcp_server *server ) {
 
     const int flag = 1;
@@ -990,7 +2367,7 @@ void dhcp_init ( dhcp_server *server ) {
     // Iniciamos resolutores locales
     res_init ();
 
-    server->descriptor = socket ( AF_INET, SOCK_DGRAM, 0 );
+    server->descriptor = socket ( AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
 
     if ( server->descriptor == -1 )
         dhcp_fatal ( "Error from socket() in dhcp_init()", strerror ( errno ) );
@@ -1019,6 +2396,10 @@ void dhcp_init ( dhcp_server *server ) {
     if ( setsockopt ( server->descriptor, SOL_SOCKET, SO_BROADCAST, ( char * ) &flag, sizeof ( flag ) ) < 0 )
         dhcp_fatal ( "Can't set SO_BROADCAST option on dhcp socket", strerror ( errno ) );
 
+    // Marcas del kernel: separan la espera en la cola del socket, la atención
+    // y el envío; sin ellas se usa la hora en que el servidor lee el msg
+    enable_timestamps ( server->descriptor );
+
     // Bind a una única interfaz de red
     if ( setsockopt ( server->descriptor, SOL_SOCKET, SO_BINDTODEVICE, ( void * ) &server->ifr,
                       sizeof ( struct ifreq ) )
@@ -1125,6 +2506,75 @@ void print_options ( struct net_config *config ) {
     printf ( "t3: %li\n", config->lease );
 }
 
+// Parte de dhcp_server que son búferes de mensajes y plantillas de opciones
+size_t server_option_bytes ( void ) {
+    dhcp_server *server = NULL;
+
+    return sizeof ( server->buf ) + sizeof ( server->msg ) + sizeof ( server->opts ) + sizeof ( server->classes )
+           + sizeof ( server->boots );
+}
+
+// Memoria prevista por subsistema para el rango configurado, antes de
+// reservarla: lo ya reservado (el servidor, el clasificador) más lo que
+// reservarán la tabla, los índices y cada módulo que esté configurado. Los
+// nombres se estiman como uno de MEMORY_PLAN_NAME_LEN bytes por concesión.
+void print_memory_plan ( dhcp_server *server ) {
+    u_int32_t  first = ntohl ( server->config.initial_ip.s_addr ), last = ntohl ( server->config.last_ip.s_addr );
+    size_t     count = last > first ? last - first : 0;
+    memuse_tag now[MEMUSE_TAGS], total;
+    u_int64_t  plan[MEMUSE_TAGS], sum = 0;
+
+    memuse_read ( now, &total );
+    for ( int i = 0; i < MEMUSE_TAGS; ++i )
+        plan[i] = now[i].current;
+
+    plan[MEMUSE_LEASES] += count * sizeof ( dhcp_lease );
+    if ( server->config.lease_db_file[0] )
+        plan[MEMUSE_LEASES] += LEASEDB_HEADER_SIZE;
+    if ( server->config.lease_view[0] )
+        plan[MEMUSE_LEASES] += LEASEVIEW_HEADER_SIZE + count * sizeof ( leaseview_rec );
+
+    plan[MEMUSE_INDEX] += strtab_footprint ( count, MEMORY_PLAN_NAME_LEN );
+
+    if ( server->config.journal_file[0] ) {
+        plan[MEMUSE_OPTIONS] += REPLY_BATCH_MAX * sizeof ( dhcp_reply );
+        plan[MEMUSE_JOURNAL] += journal_group_footprint ( server->config.journal_shards );
+    }
+
+    plan[MEMUSE_LOG] += LOGRING_SLOTS * sizeof ( logring_rec ) + LOGRING_BUF_SIZE + XTRACE_SLOTS * sizeof ( xtrace_entry );
+    if ( server->config.audit_dir[0] )
+        plan[MEMUSE_LOG] += AUDIT_BLOCK_EVENTS * sizeof ( audit_event ) + AUDIT_BUF_SIZE;
+    if ( server->config.capture_file[0] )
+        plan[MEMUSE_LOG] += CAPTURE_SLOTS * sizeof ( capture_rec ) + CAPTURE_BUF_SIZE;
+    if ( server->config.lease_events[0] )
+        plan[MEMUSE_LOG] += EVENTRING_HEADER_SIZE + EVENTRING_SLOTS * sizeof ( eventring_event );
+
+    if ( server->config.export_target[0] )
+        plan[MEMUSE_OTHER] += EXPORT_BUF_SIZE;
+    if ( server->config.metrics_listen[0] )
+        plan[MEMUSE_OTHER] += METRICS_BUF_SIZE;
+    if ( server->config.control_socket[0] ) {
+        size_t buckets = 1;
+
+        // Índice por MAC de index_leases()
+        while ( buckets < count )
+            buckets <<= 1;
+        plan[MEMUSE_INDEX] += ( buckets + count ) * sizeof ( u_int32_t );
+        plan[MEMUSE_OTHER] += CONTROL_CLIENTS_MAX * CONTROL_OUT_SIZE;
+    }
+    if ( server->config.hook_path[0] )
+        plan[MEMUSE_OTHER] += HOOKS_SLOTS * sizeof ( eventring_event )
+                              + ( size_t ) server->config.hook_workers * server->config.hook_batch
+                                    * ( sizeof ( eventring_event ) + HOOKS_LINE_MAX );
+
+    printf ( "Memoria prevista para %zu concesiones (nombres de %d bytes):\n", count, MEMORY_PLAN_NAME_LEN );
+    for ( int i = 0; i < MEMUSE_TAGS; ++i ) {
+        printf ( "  %-8s %10.1f MB\n", memuse_names[i], plan[i] / 1048576.0 );
+        sum += plan[i];
+    }
+    printf ( "  %-8s %10.1f MB\n", "total", sum / 1048576.0 );
+}
+
 void get_network_config ( dhcp_server *server ) {
 
     // Dirección IPv4 en uso
@@ -1168,6 +2618,296 @@ void get_network_config ( dhcp_server *server ) {
     }
 }
 
+// Clase con ese nombre ("default" es la 0); si no existe y create es
+// verdadero se agrega. Regresa -1 si no se encontró o ya no hay lugar.
+int get_class ( dhcp_server *server, const char *name, size_t len, bool create ) {
+    dhcp_class *cls;
+
+    if ( !len || len >= sizeof ( cls->name ) )
+        return -1;
+
+    for ( u_int8_t i = 0; i < server->nclasses; ++i )
+        if ( strncmp ( server->classes[i].name, name, len ) == 0 && !server->classes[i].name[len] )
+            return i;
+
+    if ( !create || server->nclasses == CLASS_MAX )
+        return -1;
+
+    cls = &server->classes[server->nclasses];
+    memcpy ( cls->name, name, len );
+    cls->name[len] = '\0';
+    return server->nclasses++;
+}
+
+u_int8_t hex_value ( char c ) {
+    return isdigit ( ( u_char ) c ) ? c - '0' : tolower ( ( u_char ) c ) - 'a' + 10;
+}
+
+// Bytes en hexadecimal; se ignoran separadores ':' y '-' (útil para OUI)
+size_t parse_hex ( const char *str, u_char *dst, size_t max ) {
+    size_t n = 0;
+
+    if ( str[0] == '0' && ( str[1] == 'x' || str[1] == 'X' ) )
+        str += 2;
+
+    while ( *str && n < max ) {
+        if ( *str == ':' || *str == '-' ) {
+            str++;
+            continue;
+        }
+        if ( !isxdigit ( ( u_char ) str[0] ) )
+            return 0;
+
+        if ( isxdigit ( ( u_char ) str[1] ) ) {
+            dst[n++] = hex_value ( str[0] ) << 4 | hex_value ( str[1] );
+            str += 2;
+        } else
+            dst[n++] = hex_value ( *str++ );
+    }
+    return *str ? 0 : n;
+}
+
+// Separa "a:b:c:resto" en n campos; el último se queda con los ':' que tenga
+int split_fields ( char *str, char **fields, int n ) {
+    for ( int i = 0; i < n - 1; ++i ) {
+        fields[i] = str;
+        if ( !( str = strchr ( str, ':' ) ) )
+            return 0;
+        *str++ = '\0';
+    }
+    fields[n - 1] = str;
+    return 1;
+}
+
+// Agrega una opción ya codificada a una plantilla, partiéndola en
+// instancias de 255 bytes si hace falta (RFC 3396)
+int tmpl_put ( u_char *tmpl, u_int16_t *tmpl_len, u_int8_t code, const void *value, size_t len ) {
+    const u_char *data = value;
+
+    do {
+        size_t chunk = len > 255 ? 255 : len;
+
+        if ( *tmpl_len + chunk + 2 > CLASS_TEMPLATE_MAX )
+            return 0;
+        tmpl[( *tmpl_len )++] = code;
+        tmpl[( *tmpl_len )++] = chunk;
+        memcpy ( tmpl + *tmpl_len, data, chunk );
+        *tmpl_len += chunk;
+        data += chunk;
+        len -= chunk;
+    } while ( len > 0 );
+
+    return 1;
+}
+
+// "nombre:campo:tipo:patrón", campo: 60|vendor, 77|user, 61|client-id, oui;
+// tipo: prefix o substr; el patrón es texto o hexadecimal si empieza con 0x
+// (el OUI siempre es hexadecimal, p. ej. 00:40:8c)
+void parse_class_rule ( dhcp_server *server, const char *arg ) {
+    char *   str = strdup ( arg );
+    char *   f[4];
+    u_char   pattern[255];
+    size_t   len;
+    u_int8_t field;
+    int      id;
+
+    if ( !str || !split_fields ( str, f, 4 ) )
+        dhcp_fatal ( "Regla de clase inválida", arg );
+
+    if ( !strcmp ( f[1], "60" ) || !strcmp ( f[1], "vendor" ) )
+        field = CLASSIFY_FIELD_VENDOR;
+    else if ( !strcmp ( f[1], "77" ) || !strcmp ( f[1], "user" ) )
+        field = CLASSIFY_FIELD_USER;
+    else if ( !strcmp ( f[1], "61" ) || !strcmp ( f[1], "client-id" ) )
+        field = CLASSIFY_FIELD_CLIENT;
+    else if ( !strcmp ( f[1], "oui" ) )
+        field = CLASSIFY_FIELD_OUI;
+    else
+        dhcp_fatal ( "Campo de regla de clase inválido", arg );
+
+    if ( field == CLASSIFY_FIELD_OUI || !strncmp ( f[3], "0x", 2 ) )
+        len = parse_hex ( f[3], pattern, sizeof ( pattern ) );
+    else {
+        len = strlen ( f[3] );
+        if ( len > sizeof ( pattern ) )
+            dhcp_fatal ( "Patrón de clase demasiado largo", arg );
+        memcpy ( pattern, f[3], len );
+    }
+
+    if ( strcmp ( f[2], "prefix" ) && strcmp ( f[2], "substr" ) )
+        dhcp_fatal ( "Tipo de regla de clase inválido (prefix o substr)", arg );
+
+    if ( ( id = get_class ( server, f[0], strlen ( f[0] ), true ) ) <= 0 )
+        dhcp_fatal ( "Demasiadas clases o nombre inválido", arg );
+
+    if ( !classifier_add ( &server->classifier, field, !strcmp ( f[2], "prefix" ), pattern, len, id ) )
+        dhcp_fatal ( "No se pudo agregar la regla de clase", arg );
+
+    free ( str );
+}
+
+// "nombre:ip-ip"
+void parse_class_range ( dhcp_server *server, const char *arg ) {
+    char *      str = strdup ( arg );
+    char *      f[2], *last;
+    dhcp_class *cls;
+    int         id;
+
+    if ( !str || !split_fields ( str, f, 2 ) || !( last = strchr ( f[1], '-' ) ) )
+        dhcp_fatal ( "Rango de clase inválido", arg );
+    *last++ = '\0';
+
+    if ( ( id = get_class ( server, f[0], strlen ( f[0] ), false ) ) <= 0 )
+        dhcp_fatal ( "Rango para una clase sin reglas", arg );
+
+    cls = &server->classes[id];
+    if ( inet_pton ( AF_INET, f[1], &cls->first ) != 1 || inet_pton ( AF_INET, last, &cls->last ) != 1
+         || ntohl ( cls->first.s_addr ) > ntohl ( cls->last.s_addr ) )
+        dhcp_fatal ( "Rango de clase inválido", arg );
+
+    free ( str );
+}
+
+// "nombre:código:tipo:valor", tipo: text, hex, ip (varias separadas por
+// espacios), u8, u16 o u32
+void parse_class_option ( dhcp_server *server, const char *arg ) {
+    char *   str = strdup ( arg );
+    char *   f[4], *ip, *save;
+    u_char   value[CLASS_TEMPLATE_MAX];
+    size_t   len = 0;
+    long     code, num;
+    int      id;
+
+    if ( !str || !split_fields ( str, f, 4 ) )
+        dhcp_fatal ( "Opción de clase inválida", arg );
+
+    if ( ( id = get_class ( server, f[0], strlen ( f[0] ), false ) ) < 0 )
+        dhcp_fatal ( "Opción para una clase desconocida", arg );
+
+    code = strtol ( f[1], NULL, 0 );
+    if ( code <= 0 || code >= 255 || code == 52 || code == 53 )
+        dhcp_fatal ( "Código de opción de clase inválido", arg );
+
+    num = strtol ( f[3], NULL, 0 );
+    if ( !strcmp ( f[2], "text" ) ) {
+        len = strlen ( f[3] );
+        if ( len > sizeof ( value ) )
+            dhcp_fatal ( "Opción de clase demasiado larga", arg );
+        memcpy ( value, f[3], len );
+    } else if ( !strcmp ( f[2], "hex" ) ) {
+        if ( !( len = parse_hex ( f[3], value, sizeof ( value ) ) ) )
+            dhcp_fatal ( "Valor hexadecimal inválido", arg );
+    } else if ( !strcmp ( f[2], "ip" ) ) {
+        for ( ip = strtok_r ( f[3], " ", &save ); ip; ip = strtok_r ( NULL, " ", &save ) ) {
+            if ( len + 4 > sizeof ( value ) || inet_pton ( AF_INET, ip, value + len ) != 1 )
+                dhcp_fatal ( "Dirección inválida en opción de clase", arg );
+            len += 4;
+        }
+    } else if ( !strcmp ( f[2], "u8" ) ) {
+        *value = num;
+        len    = 1;
+    } else if ( !strcmp ( f[2], "u16" ) ) {
+        *( value + 0 ) = ( num >> 8 ) & 0xff;
+        *( value + 1 ) = ( num >> 0 ) & 0xff;
+        len            = 2;
+    } else if ( !strcmp ( f[2], "u32" ) ) {
+        *( value + 0 ) = ( num >> 24 ) & 0xff;
+        *( value + 1 ) = ( num >> 16 ) & 0xff;
+        *( value + 2 ) = ( num >> 8 ) & 0xff;
+        *( value + 3 ) = ( num >> 0 ) & 0xff;
+        len            = 4;
+    } else
+        dhcp_fatal ( "Tipo de opción de clase inválido", arg );
+
+    if ( !tmpl_put ( server->classes[id].tmpl, &server->classes[id].tmpl_len, code, value, len ) )
+        dhcp_fatal ( "No caben más opciones en la clase", arg );
+
+    free ( str );
+}
+
+// "clase:arquitectura:next-server:archivo", arquitectura: valor de la opción
+// 93 o '*' para cualquiera. La plantilla se arma sobre la de la clase, así
+// que se llama después de leer todas las opciones de clase.
+void parse_boot ( dhcp_server *server, const char *arg ) {
+    char *     str = strdup ( arg );
+    char *     f[4], *end;
+    char       next_server[INET_ADDRSTRLEN];
+    dhcp_boot *boot;
+    size_t     len;
+    int        id;
+
+    if ( !str || !split_fields ( str, f, 4 ) )
+        dhcp_fatal ( "Parámetros de arranque inválidos", arg );
+
+    if ( server->nboots == BOOT_MAX )
+        dhcp_fatal ( "Demasiados parámetros de arranque", arg );
+
+    if ( ( id = get_class ( server, f[0], strlen ( f[0] ), false ) ) < 0 )
+        dhcp_fatal ( "Arranque para una clase desconocida", arg );
+
+    boot           = &server->boots[server->nboots];
+    boot->class_id = id;
+
+    if ( !strcmp ( f[1], "*" ) )
+        boot->arch = BOOT_ARCH_ANY;
+    else {
+        long arch = strtol ( f[1], &end, 0 );
+
+        if ( !*f[1] || *end || arch < 0 || arch >= BOOT_ARCH_ANY )
+            dhcp_fatal ( "Arquitectura de arranque inválida", arg );
+        boot->arch = arch;
+    }
+
+    for ( u_int8_t i = 0; i < server->nboots; ++i )
+        if ( server->boots[i].class_id == boot->class_id && server->boots[i].arch == boot->arch )
+            dhcp_fatal ( "Parámetros de arranque repetidos", arg );
+
+    if ( inet_pton ( AF_INET, f[2], &boot->next_server ) != 1 )
+        dhcp_fatal ( "Dirección de next-server inválida", arg );
+
+    // El campo file lleva el '\0' final dentro de sus 128 bytes
+    len = strlen ( f[3] );
+    if ( !len || len >= DHCP_FILE_LEN )
+        dhcp_fatal ( "Archivo de arranque inválido", arg );
+    memcpy ( boot->file, f[3], len + 1 );
+    boot->file_len = len + 1;
+
+    inet_ntop ( AF_INET, &boot->next_server, next_server, sizeof ( next_server ) );
+    memcpy ( boot->tmpl, server->classes[id].tmpl, server->classes[id].tmpl_len );
+    boot->tmpl_len = server->classes[id].tmpl_len;
+    if ( !tmpl_put ( boot->tmpl, &boot->tmpl_len, 66, next_server, strlen ( next_server ) )
+         || !tmpl_put ( boot->tmpl, &boot->tmpl_len, 67, f[3], len ) )
+        dhcp_fatal ( "No caben las opciones de arranque en la clase", arg );
+
+    server->nboots++;
+    free ( str );
+}
+
+// Compila las reglas de clase en el autómata y arma las plantillas de
+// respuesta de cada clase
+void parse_classes ( dhcp_server *server, struct gengetopt_args_info *args_info ) {
+
+    // La clase 0 es la general: clientes sin clase y pool principal
+    strcpy ( server->classes[0].name, "default" );
+    server->nclasses = 1;
+    classifier_init ( &server->classifier );
+
+    for ( unsigned int i = 0; i < args_info->class_given; ++i )
+        parse_class_rule ( server, args_info->class_arg[i] );
+
+    for ( unsigned int i = 0; i < args_info->class_range_given; ++i )
+        parse_class_range ( server, args_info->class_range_arg[i] );
+
+    for ( unsigned int i = 0; i < args_info->class_option_given; ++i )
+        parse_class_option ( server, args_info->class_option_arg[i] );
+
+    for ( unsigned int i = 0; i < args_info->boot_given; ++i )
+        parse_boot ( server, args_info->boot_arg[i] );
+
+    if ( server->classifier.nrules && !classifier_compile ( &server->classifier ) )
+        dhcp_fatal ( "Error from classifier_compile() in parse_classes()", strerror ( errno ) );
+}
+
 void parse_config ( int argc, char *argv[], struct gengetopt_args_info *args_info, struct cmdline_parser_params *params,
                     struct dhcp_server *server ) {
 
@@ -1189,8 +2929,13 @@ void parse_config ( int argc, char *argv[], struct gengetopt_args_info *args_inf
     if ( args_info->net_config_given )
         server->mode = GET_NETWORK_PARAMETERS;
 
-    // Copiamos el nombre de la interfaz
-    strcpy ( server->interface_name, args_info->interface_arg );
+    // Copiamos el nombre de la interfaz; solo la prueba de rendimiento
+    // puede correr sin ella
+    if ( !args_info->interface_given && !args_info->codec_bench_given && !args_info->recover_bench_given
+         && !args_info->audit_query_given && !args_info->log_bench_given && !args_info->events_bench_given )
+        dhcp_error ( "Falta la interfaz a usar (-i)" );
+    if ( args_info->interface_given )
+        strcpy ( server->interface_name, args_info->interface_arg );
 
     // Verificamos qué puerto usar
     if ( args_info->port_given && args_info->port_arg >= 0 && args_info->port_arg <= 65536 )
@@ -1322,18 +3067,1226 @@ void parse_config ( int argc, char *argv[], struct gengetopt_args_info *args_inf
             server->config.dns2.s_addr = inet_addr ( "8.8.8.8" );
         }
     }
+
+    // Base de concesiones
+    if ( args_info->lease_db_given ) {
+        if ( strlen ( args_info->lease_db_arg ) >= sizeof ( server->config.lease_db_file ) )
+            dhcp_error ( "Ruta de la base de concesiones demasiado larga" );
+        strcpy ( server->config.lease_db_file, args_info->lease_db_arg );
+    }
+
+    // Vista de concesiones en memoria compartida
+    if ( args_info->lease_view_given ) {
+        if ( strlen ( args_info->lease_view_arg ) >= sizeof ( server->config.lease_view ) )
+            dhcp_error ( "Nombre de la vista de concesiones demasiado largo" );
+        if ( args_info->lease_view_arg[0] != '/' || strchr ( args_info->lease_view_arg + 1, '/' ) )
+            dhcp_error ( "La vista de concesiones debe llamarse /nombre" );
+        strcpy ( server->config.lease_view, args_info->lease_view_arg );
+    }
+
+    // Anillo de eventos de concesiones en memoria compartida
+    if ( args_info->lease_events_given ) {
+        if ( strlen ( args_info->lease_events_arg ) >= sizeof ( server->config.lease_events ) )
+            dhcp_error ( "Nombre del anillo de eventos demasiado largo" );
+        if ( args_info->lease_events_arg[0] != '/' || strchr ( args_info->lease_events_arg + 1, '/' ) )
+            dhcp_error ( "El anillo de eventos debe llamarse /nombre" );
+        strcpy ( server->config.lease_events, args_info->lease_events_arg );
+    }
+
+    // Bitácora de concesiones
+    if ( args_info->journal_given ) {
+        if ( strlen ( args_info->journal_arg ) >= sizeof ( server->config.journal_file ) )
+            dhcp_error ( "Ruta de la bitácora demasiado larga" );
+        strcpy ( server->config.journal_file, args_info->journal_arg );
+    }
+
+    // Particiones de la bitácora
+    server->config.journal_shards = 1;
+    if ( args_info->journal_shards_given ) {
+        if ( args_info->journal_shards_arg < 1 || args_info->journal_shards_arg > JOURNAL_SHARDS_MAX )
+            dhcp_error ( "Número de particiones de la bitácora inválido" );
+        server->config.journal_shards = args_info->journal_shards_arg;
+    }
+
+    // Compactación de la bitácora
+    server->config.compact_interval = 3600;
+    server->config.compact_size     = 64;
+    if ( args_info->compact_interval_given ) {
+        if ( args_info->compact_interval_arg < 0 )
+            dhcp_error ( "Intervalo de compactación inválido" );
+        server->config.compact_interval = args_info->compact_interval_arg;
+    }
+    if ( args_info->compact_size_given ) {
+        if ( args_info->compact_size_arg <= 0 )
+            dhcp_error ( "Tamaño de compactación inválido" );
+        server->config.compact_size = args_info->compact_size_arg;
+    }
+
+    // Exportación periódica de concesiones
+    server->config.export_format   = EXPORT_CSV;
+    server->config.export_interval = 60;
+    if ( args_info->export_given ) {
+        if ( strlen ( args_info->export_arg ) >= sizeof ( server->config.export_target ) )
+            dhcp_error ( "Destino de la exportación demasiado largo" );
+        strcpy ( server->config.export_target, args_info->export_arg );
+    }
+    if ( args_info->export_format_given ) {
+        if ( !strcmp ( args_info->export_format_arg, "csv" ) )
+            server->config.export_format = EXPORT_CSV;
+        else if ( !strcmp ( args_info->export_format_arg, "json" ) )
+            server->config.export_format = EXPORT_JSON;
+        else if ( !strcmp ( args_info->export_format_arg, "binary" ) )
+            server->config.export_format = EXPORT_BINARY;
+        else
+            dhcp_error ( "Formato de exportación inválido (csv, json o binary)" );
+    }
+    if ( args_info->export_interval_given ) {
+        if ( args_info->export_interval_arg <= 0 )
+            dhcp_error ( "Intervalo de exportación inválido" );
+        server->config.export_interval = args_info->export_interval_arg;
+    }
+
+    // Registro de auditoría
+    server->config.audit_days = 90;
+    if ( args_info->audit_dir_given ) {
+        if ( strlen ( args_info->audit_dir_arg ) >= sizeof ( server->config.audit_dir ) )
+            dhcp_error ( "Directorio de auditoría demasiado largo" );
+        strcpy ( server->config.audit_dir, args_info->audit_dir_arg );
+    }
+    if ( args_info->audit_days_given ) {
+        if ( args_info->audit_days_arg <= 0 )
+            dhcp_error ( "Días de auditoría inválidos" );
+        server->config.audit_days = args_info->audit_days_arg;
+    }
+
+    // Métricas
+    if ( args_info->metrics_given ) {
+        if ( strlen ( args_info->metrics_arg ) >= sizeof ( server->config.metrics_listen ) )
+            dhcp_error ( "Destino de las métricas demasiado largo" );
+        strcpy ( server->config.metrics_listen, args_info->metrics_arg );
+    }
+
+    // Captura de paquetes
+    if ( args_info->capture_given ) {
+        if ( strlen ( args_info->capture_arg ) >= sizeof ( server->config.capture_file ) )
+            dhcp_error ( "Archivo de captura demasiado largo" );
+        strcpy ( server->config.capture_file, args_info->capture_arg );
+    }
+    if ( args_info->capture_filter_given
+         && !capture_parse_filter ( &server->config.capture_filter, args_info->capture_filter_arg ) )
+        dhcp_error ( "Filtro de captura inválido" );
+    server->config.capture_start = args_info->capture_start_given;
+
+    // Perfil por etapa
+    server->config.profile = args_info->profile_given;
+
+    // Socket de control
+    if ( args_info->control_given ) {
+        if ( strlen ( args_info->control_arg ) >= sizeof ( server->config.control_socket ) )
+            dhcp_error ( "Ruta del socket de control demasiado larga" );
+        strcpy ( server->config.control_socket, args_info->control_arg );
+    }
+
+    // Ganchos de concesiones
+    if ( args_info->hook_given ) {
+        if ( strlen ( args_info->hook_arg ) >= sizeof ( server->config.hook_path ) )
+            dhcp_error ( "Ruta del gancho demasiado larga" );
+        strcpy ( server->config.hook_path, args_info->hook_arg );
+    }
+    server->config.hook_workers = 2;
+    if ( args_info->hook_workers_given ) {
+        if ( args_info->hook_workers_arg < 1 || args_info->hook_workers_arg > HOOKS_WORKERS_MAX )
+            dhcp_error ( "Número de hilos de ganchos inválido (1-16)" );
+        server->config.hook_workers = args_info->hook_workers_arg;
+    }
+    server->config.hook_batch = 64;
+    if ( args_info->hook_batch_given ) {
+        if ( args_info->hook_batch_arg < 1 || args_info->hook_batch_arg > HOOKS_BATCH_MAX )
+            dhcp_error ( "Eventos por invocación de gancho inválidos (1-1024)" );
+        server->config.hook_batch = args_info->hook_batch_arg;
+    }
+    server->config.hook_timeout = 5000;
+    if ( args_info->hook_timeout_given ) {
+        if ( args_info->hook_timeout_arg < 1 )
+            dhcp_error ( "Tiempo máximo de gancho inválido" );
+        server->config.hook_timeout = args_info->hook_timeout_arg;
+    }
+
+    // Seguimiento de intercambios
+    server->config.trace_slow = 1000;
+    if ( args_info->trace_slow_given ) {
+        if ( args_info->trace_slow_arg < 0 )
+            dhcp_error ( "Umbral de intercambio lento inválido" );
+        server->config.trace_slow = args_info->trace_slow_arg;
+    }
+
+    // Registro de eventos del ciclo de paquetes
+    server->config.log_level  = LOGRING_INFO;
+    server->config.log_sample = 1;
+    if ( args_info->log_level_given ) {
+        if ( args_info->log_level_arg < LOGRING_OFF || args_info->log_level_arg > LOGRING_DEBUG )
+            dhcp_error ( "Nivel de registro inválido (0-3)" );
+        server->config.log_level = args_info->log_level_arg;
+    }
+    if ( args_info->log_sample_given ) {
+        if ( args_info->log_sample_arg <= 0 )
+            dhcp_error ( "Muestreo de registro inválido" );
+        server->config.log_sample = args_info->log_sample_arg;
+    }
+
+    // Clases de clientes
+    parse_classes ( server, args_info );
+}
+
+double bench_elapsed ( struct timespec *start ) {
+    struct timespec now;
+
+    if ( clock_gettime ( CLOCK_MONOTONIC, &now ) == -1 )
+        dhcp_error ( "Error from clock_gettime() in bench_elapsed()" );
+
+    return ( now.tv_sec - start->tv_sec ) * 1e9 + ( now.tv_nsec - start->tv_nsec );
 }
 
-void terminate ( struct dhcp_lease *head ) {
-    struct dhcp_lease *tmp = head;
-    struct dhcp_lease *tmp2;
-    while ( tmp->next != NULL ) {
-        tmp2 = tmp->next;
-        free ( tmp );
-        tmp = tmp2;
+// Prueba de rendimiento del ciclo de un mensaje sin red: copiar un
+// DHCPDISCOVER típico al buffer, decodificarlo, clasificarlo y construir el
+// DHCPOFFER. Se mide también con las limpiezas completas de buffer y mensaje
+// que se hacían antes en cada paquete, para comparar.
+void codec_bench ( dhcp_server *server, long iterations ) {
+    static const u_char options[] = {
+        53, 1,  DHCPDISCOVER,                                                // tipo
+        61, 7,  1,    0x52, 0x54, 0x00, 0x12, 0x34, 0x56,                    // identificador de cliente
+        57, 2,  0x05, 0xdc,                                                  // tamaño máximo
+        12, 8,  'b',  'e',  'n',  'c',  'h',  'p',  'c',  '1',               // hostname
+        60, 12, 'M',  'S',  'F',  'T',  ' ',  '5',  '.',  '0',  ' ', ' ', ' ', ' ',  // clase de fabricante
+        55, 14, 1,    3,    6,    15,   31,   33,   43,   44,   46,  47,  119, 121, 249, 252,  // parámetros
+        255};
+    u_char          packet[DHCP_OPTIONS_OFFSET + sizeof ( options )];
+    dhcp_lease      lease;
+    struct timespec start;
+    double          ns[2];
+    volatile size_t sink = 0;
+
+    if ( iterations <= 0 )
+        dhcp_error ( "El número de mensajes de la prueba debe ser positivo" );
+
+    memset ( packet, 0, sizeof ( packet ) );
+    *( packet + 0 ) = 1;  // BOOTREQUEST
+    *( packet + 1 ) = 1;
+    *( packet + 2 ) = 6;
+    memcpy ( packet + 4, "\x3a\x1f\x00\x01", 4 );
+    memcpy ( packet + 28, "\x52\x54\x00\x12\x34\x56", 6 );
+    *( packet + 236 ) = 99;
+    *( packet + 237 ) = 130;
+    *( packet + 238 ) = 83;
+    *( packet + 239 ) = 99;
+    memcpy ( packet + DHCP_OPTIONS_OFFSET, options, sizeof ( options ) );
+
+    memset ( &lease, 0, sizeof ( struct dhcp_lease ) );
+    lease.ip.s_addr = inet_addr ( "192.168.1.10" );
+
+    // 0: limpiando todo en cada paquete, 1: ciclo actual
+    for ( int mode = 0; mode < 2; ++mode ) {
+        if ( clock_gettime ( CLOCK_MONOTONIC, &start ) == -1 )
+            dhcp_error ( "Error from clock_gettime() in codec_bench()" );
+
+        for ( long i = 0; i < iterations; ++i ) {
+            if ( !mode ) {
+                memset ( server->buf, 0, MAX_BUFSIZE );
+                memset ( &server->msg, 0, sizeof ( struct dhcp_msg ) );
+            }
+            memcpy ( server->buf, packet, sizeof ( packet ) );
+            dec_dhcp_msg ( &server->msg, &server->opts, server->buf, sizeof ( packet ) );
+            server->msg.class_id = classify_msg ( server );
+            server->msg.boot     = get_boot ( server );
+            if ( !mode )
+                memset ( server->buf, 0, MAX_BUFSIZE );
+            build_msg ( server, &lease, DHCPOFFER );
+            sink += server->size_msg;
+        }
+        ns[mode] = bench_elapsed ( &start ) / iterations;
+    }
+
+    printf ( "Mensajes: %ld, respuesta de %zd bytes\n", iterations, server->size_msg );
+    printf ( "Limpiando buffer y mensaje: %8.1f ns/mensaje\n", ns[0] );
+    printf ( "Ciclo actual:               %8.1f ns/mensaje (%.2fx)\n", ns[1], ns[0] / ns[1] );
+}
+
+// Hilos para reaplicar la bitácora: uno por procesador
+int replay_threads ( void ) {
+    long cpus = sysconf ( _SC_NPROCESSORS_ONLN );
+
+    return cpus > 0 ? cpus : 1;
+}
+
+// Prueba de rendimiento de la recuperación: genera una bitácora sintética de
+// records registros sobre un pool de 2^20 concesiones y la reaplica con 1, 2,
+// 4... hilos hasta el número de procesadores. La bitácora se genera justo
+// antes, así que se lee desde la caché de páginas si cabe en memoria. Es un
+// archivo propio (mkstemp()) en el directorio de la bitácora configurada, o
+// en el actual; la bitácora configurada no se toca.
+void recover_bench ( dhcp_server *server, long records ) {
+    const u_int32_t pool    = 1 << 20;
+    const char *    slash   = strrchr ( server->config.journal_file, '/' );
+    int             dir_len = slash ? slash - server->config.journal_file + 1 : 0;
+    int             threads = 1, cpus = replay_threads (), fd, err;
+    char            path[sizeof ( server->config.journal_file ) + 32];
+    u_int32_t       first, seed = 1;
+    journal         j;
+    journal_rec     rec;
+    struct timespec start;
+    double          ns;
+
+    if ( records <= 0 )
+        dhcp_error ( "El número de registros de la prueba debe ser positivo" );
+
+    // Pool sintético en memoria
+    server->config.initial_ip.s_addr = inet_addr ( "10.0.0.0" );
+    server->config.last_ip.s_addr    = htonl ( ntohl ( server->config.initial_ip.s_addr ) + pool );
+    server->config.lease_db_file[0]  = '\0';
+    up_service ( server );
+    first = ntohl ( server->config.initial_ip.s_addr );
+
+    snprintf ( path, sizeof ( path ), "%.*srecover-bench.XXXXXX", dir_len, server->config.journal_file );
+    if ( ( fd = mkstemp ( path ) ) == -1 )
+        dhcp_fatal ( "Error from mkstemp() in recover_bench()", strerror ( errno ) );
+    close ( fd );
+    if ( !journal_open ( &j, path ) ) {
+        err = errno;
+        unlink ( path );
+        dhcp_fatal ( "Error from journal_open() in recover_bench()", strerror ( err ) );
+    }
+
+    memset ( &rec, 0, sizeof ( journal_rec ) );
+    rec.lease_time = 3600;
+    rec.expires    = time ( NULL ) + 3600;
+    for ( long i = 0; i < records; ++i ) {
+        seed      = seed * 1103515245 + 12345;
+        rec.ip    = htonl ( first + ( seed >> 8 ) % pool );
+        rec.xid   = i;
+        rec.state = seed >> 30 ? S_LEASED : S_FREE;
+        memcpy ( rec.mac, &seed, sizeof ( seed ) );
+        if ( !journal_append ( &j, &rec ) )
+            dhcp_fatal ( "Error from journal_append() in recover_bench()", strerror ( errno ) );
+        if ( ( j.npending == 1 << 20 || i == records - 1 ) && !journal_commit ( &j ) )
+            dhcp_fatal ( "Error from journal_commit() in recover_bench()", strerror ( errno ) );
+    }
+    journal_close ( &j );
+
+    printf ( "Registros: %ld, pool de %u concesiones, bitácora %s\n", records, pool, path );
+
+    for ( ;; ) {
+        for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp ) {
+            tmp->state = S_FREE;
+            tmp->xid   = 0;
+        }
+
+        if ( !journal_open ( &j, path ) )
+            dhcp_fatal ( "Error from journal_open() in recover_bench()", strerror ( errno ) );
+        if ( clock_gettime ( CLOCK_MONOTONIC, &start ) == -1 )
+            dhcp_error ( "Error from clock_gettime() in recover_bench()" );
+        if ( !journal_replay ( &j, replay_lease, server, threads ) )
+            dhcp_fatal ( "Error from journal_replay() in recover_bench()", strerror ( errno ) );
+        ns = bench_elapsed ( &start );
+        journal_close ( &j );
+
+        server->dhcp_config.active = server->dhcp_config.free = server->dhcp_config.reserved = 0;
+        get_lease_count ( server );
+        printf ( "Hilos %2d: %8.3f s, %12.0f registros/s, %d activas\n", threads, ns / 1e9, records / ( ns / 1e9 ),
+                 server->dhcp_config.active );
+
+        if ( threads >= cpus )
+            break;
+        threads = threads * 2 < cpus ? threads * 2 : cpus;
+    }
+
+    unlink ( path );
+    memuse_free ( MEMUSE_LEASES, server->head );
+}
+
+// Prueba de rendimiento de la exportación en los tres formatos: un pool
+// sintético con todas las concesiones activas, una de cada cuatro con nombre
+void export_bench ( dhcp_server *server, long leases ) {
+    static const char *formats[] = {NULL, "csv", "json", "binary"};
+    const char *       target    = server->config.export_target[0] ? server->config.export_target : "export-bench.out";
+    u_int32_t          seed      = 1;
+    char               name[32];
+    export_writer      w;
+    export_lease       l;
+    struct timespec    start;
+    double             ns;
+    int                r;
+
+    if ( leases <= 0 )
+        dhcp_error ( "El número de concesiones de la prueba debe ser positivo" );
+
+    server->config.initial_ip.s_addr = inet_addr ( "10.0.0.0" );
+    server->config.last_ip.s_addr    = htonl ( ntohl ( server->config.initial_ip.s_addr ) + leases );
+    server->config.lease_db_file[0]  = '\0';
+    strtab_init ( &server->names );
+    up_service ( server );
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp ) {
+        seed       = seed * 1103515245 + 12345;
+        tmp->state = S_LEASED;
+        lease_clock ( server, &tmp->start );
+        memcpy ( tmp->mac, &seed, sizeof ( seed ) );
+        if ( !( seed >> 30 ) )
+            tmp->hostname = strtab_intern ( &server->names, name, snprintf ( name, sizeof ( name ), "host-%u", seed >> 8 ) );
+    }
+
+    printf ( "Concesiones: %ld, destino %s\n", leases, target );
+
+    for ( int format = EXPORT_CSV; format <= EXPORT_BINARY; ++format ) {
+        // Sin el archivo anterior, el rename() no tiene que liberarlo
+        unlink ( target );
+        if ( clock_gettime ( CLOCK_MONOTONIC, &start ) == -1 )
+            dhcp_error ( "Error from clock_gettime() in export_bench()" );
+        if ( !export_open ( &w, target, format ) )
+            dhcp_fatal ( "Error from export_open() in export_bench()", strerror ( errno ) );
+
+        for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp ) {
+            if ( !lease_to_export ( server, tmp, &l ) )
+                continue;
+            while ( ( r = export_add ( &w, &l ) ) == -1 )
+                ;
+            if ( !r )
+                dhcp_fatal ( "Error from export_add() in export_bench()", strerror ( errno ) );
+        }
+        while ( ( r = export_finish ( &w ) ) == -1 )
+            ;
+        if ( !r )
+            dhcp_fatal ( "Error from export_finish() in export_bench()", strerror ( errno ) );
+
+        ns = bench_elapsed ( &start );
+        printf ( "%-6s: %8.3f s, %12.0f concesiones/s, %8.1f MB/s\n", formats[format], ns / 1e9, leases / ( ns / 1e9 ),
+                 w.bytes * 1e3 / ns );
+        export_close ( &w );
+    }
+
+    if ( !server->config.export_target[0] )
+        unlink ( target );
+    strtab_free ( &server->names );
+    memuse_free ( MEMUSE_LEASES, server->head );
+}
+
+// Abre la bitácora y recupera las concesiones que tenía; las respuestas se
+// retienen por grupos desde aquí
+void open_journal ( dhcp_server *server ) {
+    struct timespec now;
+    size_t          total   = server->end - server->head;
+    int             count   = server->config.journal_shards;
+    u_int64_t       records = 0;
+
+    if ( !server->config.journal_file[0] )
+        return;
+
+    if ( ( size_t ) count > total )
+        dhcp_error ( "Hay más particiones de la bitácora que concesiones" );
+
+    if ( !journal_group_open ( &server->journal, server->config.journal_file, count ) ) {
+        if ( errno == EINVAL )
+            dhcp_error ( "Las particiones de la bitácora no coinciden con --journal-shards" );
+        dhcp_fatal ( "Error from journal_group_open() in open_journal()", strerror ( errno ) );
+    }
+
+    // Partición i: índices k con k * count / total == i (ver lease_shard());
+    // el intervalo de compactación cuenta desde el arranque
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    for ( int i = 0; i < count; ++i ) {
+        server->shards[i].server          = server;
+        server->shards[i].first           = server->head + ( i * total + count - 1 ) / count;
+        server->shards[i].end             = server->head + ( ( i + 1 ) * total + count - 1 ) / count;
+        server->shards[i].compact_at      = now.tv_sec;
+        server->shards[i].compact_records = 0;
+    }
+
+    if ( !journal_group_replay ( &server->journal, replay_lease, server, replay_threads () ) )
+        dhcp_fatal ( "Error from journal_group_replay() in open_journal()", strerror ( errno ) );
+
+    for ( int i = 0; i < count; ++i )
+        records += server->journal.shards[i].records;
+    printf ( "Bitácora %s (%d particiones): %llu registros recuperados\n", server->config.journal_file, count,
+             ( unsigned long long ) records );
+
+    server->replies = memuse_calloc ( MEMUSE_OPTIONS, REPLY_BATCH_MAX, sizeof ( struct dhcp_reply ) );
+    if ( !server->replies )
+        dhcp_fatal ( "Error from calloc() in open_journal()", strerror ( errno ) );
+}
+
+typedef struct dhcp_import {
+    dhcp_server *server;
+    u_int64_t    applied;  // concesiones dentro del pool
+} dhcp_import;
+
+// Aplica una concesión importada igual que un registro de la bitácora (la
+// última de cada dirección gana) y la agrega a la bitácora propia
+void import_lease_apply ( void *ctx, const import_lease *imp ) {
+    dhcp_import *import = ctx;
+    dhcp_server *server = import->server;
+    dhcp_lease * lease  = get_lease_by_ip ( server, imp->ip );
+    journal_rec  rec;
+    time_t       now = time ( NULL );
+
+    if ( !lease )
+        return;
+
+    memset ( &rec, 0, sizeof ( journal_rec ) );
+    rec.ip = imp->ip;
+    if ( imp->has_mac )
+        memcpy ( rec.mac, imp->mac, 6 );
+
+    switch ( imp->state ) {
+        case IMPORT_ACTIVE:
+            rec.state = S_LEASED;
+            if ( imp->ends == IMPORT_NEVER || imp->ends - now > UINT32_MAX ) {
+                rec.lease_time = UINT32_MAX;
+                rec.expires    = now + UINT32_MAX;
+            } else {
+                rec.expires = imp->ends;
+                if ( imp->starts && imp->ends > imp->starts && imp->ends - imp->starts <= UINT32_MAX )
+                    rec.lease_time = imp->ends - imp->starts;
+                else
+                    rec.lease_time = server->config.lease;
+            }
+            break;
+        case IMPORT_ABANDONED:
+            rec.state = S_PROHIBIT;
+            break;
+        default:
+            rec.state = S_FREE;
+    }
+
+    // Una concesión ya vencida queda libre
+    replay_lease ( server, &rec );
+
+    lease->hostname = lease->fqdn = 0;
+    if ( lease->state == S_LEASED && imp->hostname[0] )
+        set_lease_names ( &server->names, server->head, lease,
+                          strtab_intern ( &server->names, imp->hostname, strlen ( imp->hostname ) ), 0 );
+
+    journal_lease ( server, lease );
+    if ( server->journal.npending >= IMPORT_COMMIT_RECORDS )
+        commit_batch ( server );
+    import->applied++;
+}
+
+// Importa los archivos de concesiones de ISC dhcpd o Kea antes de empezar a
+// atender; lo importado queda en la bitácora y en la base de concesiones
+void import_files ( dhcp_server *server, struct gengetopt_args_info *args_info ) {
+    dhcp_import     import;
+    import_stats    stats;
+    struct timespec start;
+    double          s;
+    char            msg[512];
+
+    for ( unsigned i = 0; i < args_info->import_given; ++i ) {
+        import.server  = server;
+        import.applied = 0;
+
+        if ( clock_gettime ( CLOCK_MONOTONIC, &start ) == -1 )
+            dhcp_error ( "Error from clock_gettime() in import_files()" );
+
+        if ( !import_leases ( args_info->import_arg[i], import_lease_apply, &import, &stats ) ) {
+            if ( errno != EINVAL )
+                dhcp_fatal ( "Error from import_leases() in import_files()", strerror ( errno ) );
+            snprintf ( msg, sizeof ( msg ), "Archivo de concesiones %s inválido en la línea %llu",
+                       args_info->import_arg[i], ( unsigned long long ) stats.line );
+            dhcp_error ( msg );
+        }
+
+        commit_batch ( server );
+        if ( server->config.lease_db_file[0] && !leasedb_sync ( &server->leasedb ) )
+            dhcp_fatal ( "Error from leasedb_sync() in import_files()", strerror ( errno ) );
+
+        s = bench_elapsed ( &start ) / 1e9;
+        printf ( "Importadas %llu concesiones de %s (%s, %llu fuera del pool) en %.3f s, %.1f MB/s\n",
+                 ( unsigned long long ) import.applied, args_info->import_arg[i],
+                 stats.format == IMPORT_FORMAT_KEA ? "Kea" : "ISC dhcpd",
+                 ( unsigned long long ) ( stats.leases - import.applied ), s, stats.bytes / s / 1e6 );
     }
 }
 
+// Prueba de rendimiento del registro: costo por evento en el ciclo con el
+// anillo, con el nivel apagado y, para comparar, con printf() y fflush() por
+// línea como se hacía antes. Se mide el tiempo de CPU del hilo que registra;
+// el anillo se llena por ráfagas de la mitad de su tamaño y se espera a que
+// el escritor (a /dev/null) lo vacíe entre una y otra.
+void log_bench ( dhcp_server *server, long events ) {
+    static const char *   modes[] = {"Anillo", "Apagado", "printf"};
+    const u_char          mac[6]  = {0x52, 0x54, 0x00, 0x12, 0x34, 0x56};
+    const struct timespec wait    = {0, 1000000};
+    struct timespec       start, end;
+    logring               ring;
+    FILE *                null;
+    double                ns;
+
+    if ( !( null = fopen ( "/dev/null", "w" ) ) )
+        dhcp_fatal ( "Error from fopen() in log_bench()", strerror ( errno ) );
+
+    for ( int mode = 0; mode < 3; ++mode ) {
+        if ( mode < 2 && !logring_open ( &ring, log_events, EV_COUNT, fileno ( null ), mode ? LOGRING_OFF : LOGRING_DEBUG,
+                                         server->config.log_sample ) )
+            dhcp_fatal ( "Error from logring_open() in log_bench()", strerror ( errno ) );
+
+        ns = 0;
+        for ( long done = 0; done < events; ) {
+            long burst = events - done < LOGRING_SLOTS / 2 ? events - done : LOGRING_SLOTS / 2;
+
+            if ( clock_gettime ( CLOCK_THREAD_CPUTIME_ID, &start ) == -1 )
+                dhcp_error ( "Error from clock_gettime() in log_bench()" );
+            for ( long i = done; i < done + burst; ++i ) {
+                if ( mode < 2 ) {
+                    // Cuatro eventos por paquete, como un DHCPREQUEST
+                    if ( !( i & 3 ) )
+                        logring_packet ( &ring );
+                    logring_log ( &ring, EV_DECODED, DHCPREQUEST, i, logring_mac ( mac ), 0 );
+                } else {
+                    fprintf ( null, "Mensaje DHCP decodificado: tipo %u, xid %lx, chaddr %02x:%02x:%02x:%02x:%02x:%02x, "
+                                    "clase %u\n", DHCPREQUEST, i, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], 0 );
+                    fflush ( null );
+                }
+            }
+            if ( clock_gettime ( CLOCK_THREAD_CPUTIME_ID, &end ) == -1 )
+                dhcp_error ( "Error from clock_gettime() in log_bench()" );
+            ns += ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec );
+            done += burst;
+
+            while ( mode < 2 && __atomic_load_n ( &ring.tail, __ATOMIC_ACQUIRE ) != ring.head )
+                nanosleep ( &wait, NULL );
+        }
+
+        printf ( "%-8s: %8.1f ns/evento", modes[mode], ns / events );
+        if ( mode < 2 ) {
+            printf ( " (%llu perdidos)", ( unsigned long long ) ring.dropped );
+            logring_close ( &ring );
+        }
+        putchar ( '\n' );
+    }
+    fclose ( null );
+}
+
+// Lector de la prueba del anillo de eventos: se conecta al segmento como lo
+// haría otro proceso y lee por lotes hasta la posición end
+typedef struct events_reader {
+    const char *    name;
+    u_int64_t       end;
+    u_int64_t       pos;  // cursor, para que la prueba espere al lector
+    u_int64_t       read;
+    u_int64_t       lost;
+    u_int64_t       checksum;
+    struct timespec done;
+} events_reader;
+
+void *events_bench_reader ( void *arg ) {
+    events_reader * reader = arg;
+    eventring       ring;
+    eventring_event batch[256];
+    u_int64_t       cursor = 0;
+
+    if ( !eventring_attach ( &ring, reader->name ) )
+        dhcp_fatal ( "Error from eventring_attach() in events_bench_reader()", strerror ( errno ) );
+
+    while ( cursor < reader->end ) {
+        size_t n = eventring_read ( &ring, &cursor, batch, sizeof ( batch ) / sizeof ( batch[0] ), &reader->lost );
+
+        for ( size_t i = 0; i < n; ++i )
+            reader->checksum += batch[i].xid;
+        reader->read += n;
+        __atomic_store_n ( &reader->pos, cursor, __ATOMIC_RELEASE );
+    }
+    clock_gettime ( CLOCK_MONOTONIC, &reader->done );
+    eventring_detach ( &ring );
+    return NULL;
+}
+
+// Prueba de rendimiento del anillo de eventos, con 1 y con 4 lectores en
+// otros hilos: costo por evento para el servidor (tiempo de CPU del hilo que
+// publica) y eventos por segundo que saca cada lector. Se publica por ráfagas
+// de la mitad del anillo y se espera a que los lectores alcancen la última.
+void events_bench ( long events ) {
+    char            name[64];
+    eventring       ring;
+    eventring_event ev;
+    events_reader   readers[4];
+    pthread_t       threads[4];
+    struct timespec start, cpu, cpu_end;
+    double          ns;
+
+    snprintf ( name, sizeof ( name ), "/dhcpd_t-events-bench-%d", ( int ) getpid () );
+    memset ( &ev, 0, sizeof ( ev ) );
+    ev.type = EVENTRING_GRANT;
+
+    for ( int nreaders = 1; nreaders <= 4; nreaders *= 4 ) {
+        u_int64_t expected = ( u_int64_t ) events * ( events + 1 ) / 2;
+
+        if ( !eventring_create ( &ring, name ) )
+            dhcp_fatal ( "Error from eventring_create() in events_bench()", strerror ( errno ) );
+
+        for ( int i = 0; i < nreaders; ++i ) {
+            memset ( &readers[i], 0, sizeof ( events_reader ) );
+            readers[i].name = name;
+            readers[i].end  = events;
+            if ( ( errno = pthread_create ( &threads[i], NULL, events_bench_reader, &readers[i] ) ) )
+                dhcp_fatal ( "Error from pthread_create() in events_bench()", strerror ( errno ) );
+        }
+        sleep ( 1 );  // que todos se conecten antes del primer evento
+
+        if ( clock_gettime ( CLOCK_MONOTONIC, &start ) == -1 || clock_gettime ( CLOCK_THREAD_CPUTIME_ID, &cpu ) == -1 )
+            dhcp_error ( "Error from clock_gettime() in events_bench()" );
+        ns = 0;
+        for ( long done = 0; done < events; ) {
+            long burst = events - done < EVENTRING_SLOTS / 2 ? events - done : EVENTRING_SLOTS / 2;
+
+            if ( clock_gettime ( CLOCK_THREAD_CPUTIME_ID, &cpu ) == -1 )
+                dhcp_error ( "Error from clock_gettime() in events_bench()" );
+            for ( long i = done + 1; i <= done + burst; ++i ) {
+                ev.xid = i;
+                ev.ip  = htonl ( 0x0a000000 + ( i & 0xffffff ) );
+                eventring_publish ( &ring, &ev );
+            }
+            if ( clock_gettime ( CLOCK_THREAD_CPUTIME_ID, &cpu_end ) == -1 )
+                dhcp_error ( "Error from clock_gettime() in events_bench()" );
+            ns += ( cpu_end.tv_sec - cpu.tv_sec ) * 1e9 + ( cpu_end.tv_nsec - cpu.tv_nsec );
+            done += burst;
+
+            for ( int i = 0; i < nreaders; ++i )
+                while ( __atomic_load_n ( &readers[i].pos, __ATOMIC_ACQUIRE ) < ( u_int64_t ) done )
+                    sched_yield ();
+        }
+
+        printf ( "%d lector(es): servidor %.1f ns/evento\n", nreaders, ns / events );
+        for ( int i = 0; i < nreaders; ++i ) {
+            double s;
+
+            pthread_join ( threads[i], NULL );
+            s = ( readers[i].done.tv_sec - start.tv_sec ) + ( readers[i].done.tv_nsec - start.tv_nsec ) / 1e9;
+            printf ( "  lector %d: %llu leídos, %llu perdidos, %.1f M eventos/s%s\n", i,
+                     ( unsigned long long ) readers[i].read, ( unsigned long long ) readers[i].lost,
+                     readers[i].read / s / 1e6,
+                     readers[i].lost || readers[i].checksum == expected ? "" : " (contenido inválido)" );
+        }
+        eventring_close ( &ring );
+    }
+}
+
+// Imprime un evento que encontró audit_search()
+void print_audit_event ( void *ctx, const audit_event *ev ) {
+    static const char *types[] = {"?", "GRANT", "RENEW", "RELEASE", "EXPIRE", "DECLINE"};
+    time_t             t       = ev->time;
+    struct tm          tm;
+    char               when[32], ip[INET_ADDRSTRLEN];
+
+    ( void ) ctx;
+    localtime_r ( &t, &tm );
+    strftime ( when, sizeof ( when ), "%Y-%m-%d %H:%M:%S", &tm );
+    inet_ntop ( AF_INET, &ev->ip, ip, sizeof ( ip ) );
+    printf ( "%s %-7s %-15s %02x:%02x:%02x:%02x:%02x:%02x %u\n", when, types[ev->type < 6 ? ev->type : 0], ip,
+             ev->mac[0], ev->mac[1], ev->mac[2], ev->mac[3], ev->mac[4], ev->mac[5], ev->lease_time );
+}
+
+// Fecha "AAAA-MM-DD[ HH:MM:SS]" en hora local; sin hora es el inicio del día,
+// o su último segundo con end_of_day
+int64_t parse_audit_time ( const char *str, int end_of_day ) {
+    struct tm tm;
+    int       n = 0, m = 0;
+
+    memset ( &tm, 0, sizeof ( tm ) );
+    if ( sscanf ( str, "%d-%d-%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &n ) != 3
+         || ( str[n] && ( sscanf ( str + n, " %d:%d:%d%n", &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &m ) != 3 || str[n + m] ) ) )
+        dhcp_error ( "Fecha inválida (AAAA-MM-DD o \"AAAA-MM-DD HH:MM:SS\")" );
+    if ( !str[n] && end_of_day ) {
+        tm.tm_hour = 23;
+        tm.tm_min = tm.tm_sec = 59;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return mktime ( &tm );
+}
+
+// Busca en el registro de auditoría los eventos de una dirección o MAC en
+// la ventana [--audit-from, --audit-to] y los imprime en orden de tiempo
+void audit_query_tool ( dhcp_server *server, struct gengetopt_args_info *args_info ) {
+    const char *    arg = args_info->audit_query_arg;
+    audit_query     q;
+    audit_stats     stats;
+    struct timespec start;
+    unsigned        mac[6];
+    int             n = 0;
+
+    if ( !server->config.audit_dir[0] )
+        dhcp_error ( "Falta el directorio de auditoría (--audit-dir)" );
+
+    memset ( &q, 0, sizeof ( q ) );
+    if ( inet_pton ( AF_INET, arg, &q.ip ) != 1 ) {
+        if ( sscanf ( arg, "%x:%x:%x:%x:%x:%x%n", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5], &n ) != 6
+             || arg[n] )
+            dhcp_error ( "Busque una dirección IPv4 o una MAC (aa:bb:cc:dd:ee:ff)" );
+        for ( int i = 0; i < 6; ++i ) {
+            if ( mac[i] > 0xff )
+                dhcp_error ( "Busque una dirección IPv4 o una MAC (aa:bb:cc:dd:ee:ff)" );
+            q.mac[i] = mac[i];
+        }
+        q.by_mac = 1;
+    }
+    q.from = args_info->audit_from_given ? parse_audit_time ( args_info->audit_from_arg, 0 ) : 0;
+    q.to   = args_info->audit_to_given ? parse_audit_time ( args_info->audit_to_arg, 1 ) : INT64_MAX;
+
+    if ( clock_gettime ( CLOCK_MONOTONIC, &start ) == -1 )
+        dhcp_error ( "Error from clock_gettime() in audit_query_tool()" );
+    if ( !audit_search ( server->config.audit_dir, &q, print_audit_event, NULL, &stats ) )
+        dhcp_fatal ( "Error from audit_search() in audit_query_tool()", strerror ( errno ) );
+
+    printf ( "%llu eventos; %llu archivos, %llu bloques (%llu descartados por índice), %llu eventos y %.1f KB "
+             "leídos en %.2f ms\n",
+             ( unsigned long long ) stats.matches, ( unsigned long long ) stats.files,
+             ( unsigned long long ) stats.blocks, ( unsigned long long ) stats.skipped,
+             ( unsigned long long ) stats.events, stats.bytes / 1e3, bench_elapsed ( &start ) / 1e6 );
+}
+
+// Crea la vista compartida y publica la tabla ya recuperada; a partir de aquí
+// cada cambio se publica al hacerse
+void open_lease_view ( dhcp_server *server ) {
+
+    if ( !server->config.lease_view[0] )
+        return;
+
+    if ( !leaseview_create ( &server->view, server->config.lease_view, server->end - server->head,
+                             server->config.initial_ip.s_addr ) )
+        dhcp_fatal ( "Error from leaseview_create() in open_lease_view()", strerror ( errno ) );
+
+    for ( dhcp_lease *tmp = server->head; tmp != server->end; ++tmp )
+        publish_lease ( server, tmp );
+
+    printf ( "Vista de concesiones en %s (%zu registros)\n", server->config.lease_view,
+             ( size_t ) ( server->end - server->head ) );
+}
+
+// Crea el anillo de eventos; las herramientas externas ven desde aquí cada
+// concesión que se otorga, renueva, libera, vence o se rechaza
+void open_lease_events ( dhcp_server *server ) {
+
+    if ( !server->config.lease_events[0] )
+        return;
+
+    if ( !eventring_create ( &server->events, server->config.lease_events ) )
+        dhcp_fatal ( "Error from eventring_create() in open_lease_events()", strerror ( errno ) );
+
+    printf ( "Anillo de eventos en %s (%d eventos)\n", server->config.lease_events, EVENTRING_SLOTS );
+}
+
+// Anillo que ajustan las señales: SIGUSR1 da más detalle y SIGUSR2 menos
+static logring *log_signal_ring;
+
+void log_signal ( int sig ) {
+    int level = __atomic_load_n ( &log_signal_ring->level, __ATOMIC_RELAXED );
+
+    logring_set_level ( log_signal_ring, sig == SIGUSR1 ? level + 1 : level - 1 );
+}
+
+// Arranca el hilo escritor del registro; se arranca aun con el nivel en
+// LOGRING_OFF para que las señales puedan encenderlo
+void open_log ( dhcp_server *server ) {
+    struct sigaction sa;
+
+    // Lo que ya se imprimió con stdio sale antes que los eventos
+    fflush ( stdout );
+
+    if ( !logring_open ( &server->log, log_events, EV_COUNT, STDOUT_FILENO, server->config.log_level,
+                         server->config.log_sample ) )
+        dhcp_fatal ( "Error from logring_open() in open_log()", strerror ( errno ) );
+
+    log_signal_ring = &server->log;
+    memset ( &sa, 0, sizeof ( sa ) );
+    sa.sa_handler = log_signal;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset ( &sa.sa_mask );
+    if ( sigaction ( SIGUSR1, &sa, NULL ) == -1 || sigaction ( SIGUSR2, &sa, NULL ) == -1 )
+        dhcp_fatal ( "Error from sigaction() in open_log()", strerror ( errno ) );
+}
+
+// Registra los contadores del ciclo y, si se pidió, empieza a servirlos
+void open_metrics ( dhcp_server *server ) {
+    const char *listen_on = server->config.metrics_listen[0] ? server->config.metrics_listen : NULL;
+
+    if ( !metrics_open ( &server->metrics, listen_on ) )
+        dhcp_fatal ( "Error from metrics_open() in open_metrics()", strerror ( errno ) );
+    if ( !metrics_add_worker ( &server->metrics, &server->counters ) )
+        dhcp_fatal ( "Error from metrics_add_worker() in open_metrics()", strerror ( errno ) );
+    if ( server->config.journal_file[0] )
+        __atomic_store_n ( &server->metrics.journal, &server->journal, __ATOMIC_RELEASE );
+
+    if ( listen_on )
+        printf ( "Métricas en %s\n", listen_on );
+}
+
+void open_trace ( dhcp_server *server ) {
+    if ( !xtrace_open ( &server->trace ) )
+        dhcp_fatal ( "Error from xtrace_open() in open_trace()", strerror ( errno ) );
+}
+
+static capture *capture_signal_ring;
+
+void capture_signal ( int sig ) {
+    ( void ) sig;
+    capture_set ( capture_signal_ring, !__atomic_load_n ( &capture_signal_ring->enabled, __ATOMIC_RELAXED ) );
+}
+
+// Abre la captura, si se pidió; SIGRTMIN la enciende o apaga
+void open_capture ( dhcp_server *server ) {
+    struct sigaction sa;
+
+    if ( !server->config.capture_file[0] )
+        return;
+
+    if ( !capture_open ( &server->capture, server->config.capture_file, &server->config.capture_filter,
+                         server->config.capture_start ) )
+        dhcp_fatal ( "Error from capture_open() in open_capture()", strerror ( errno ) );
+
+    capture_signal_ring = &server->capture;
+    memset ( &sa, 0, sizeof ( sa ) );
+    sa.sa_handler = capture_signal;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset ( &sa.sa_mask );
+    if ( sigaction ( SIGRTMIN, &sa, NULL ) == -1 )
+        dhcp_fatal ( "Error from sigaction() in open_capture()", strerror ( errno ) );
+
+    printf ( "Captura en %s (%s, SIGRTMIN la cambia)\n", server->config.capture_file,
+             server->config.capture_start ? "encendida" : "apagada" );
+}
+
+static profile *profile_signal_prof;
+
+void profile_signal ( int sig ) {
+    ( void ) sig;
+    __atomic_store_n ( &profile_signal_prof->dump, 1, __ATOMIC_RELAXED );
+}
+
+// Enciende el perfil por etapa, si se pidió; SIGRTMIN+1 pide el resumen
+void open_profile ( dhcp_server *server ) {
+    struct sigaction sa;
+
+    if ( !server->config.profile )
+        return;
+
+    profile_open ( &server->profile );
+
+    profile_signal_prof = &server->profile;
+    memset ( &sa, 0, sizeof ( sa ) );
+    sa.sa_handler = profile_signal;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset ( &sa.sa_mask );
+    if ( sigaction ( SIGRTMIN + 1, &sa, NULL ) == -1 )
+        dhcp_fatal ( "Error from sigaction() in open_profile()", strerror ( errno ) );
+
+    printf ( "Perfil por etapa con %s (SIGRTMIN+1 imprime el resumen)\n",
+             server->profile.nopen ? "perf_event" : "rdtsc" );
+}
+
+// Escribe el resumen del perfil de una vez, para no mezclarse con el registro
+void dump_profile ( dhcp_server *server ) {
+    char   buf[4096];
+    size_t len = profile_format ( &server->profile, buf, sizeof ( buf ) );
+
+    server->profile.dump = 0;
+    if ( write ( STDOUT_FILENO, buf, len ) == -1 )
+        syslog ( LOG_ERR, "Error al escribir el perfil: %s", strerror ( errno ) );
+}
+
+// Parte de "list": concesiones de cursor a end, a lo más arg más. Si se
+// corta por arg, antes del final va "next <ip>" para pedir la siguiente página.
+size_t control_list_fill ( void *ctx, control_client *cl, char *buf, size_t size ) {
+    dhcp_server *server = ctx;
+    u_char *     p = ( u_char * ) buf, *limit = p + size - EXPORT_REC_MAX - CONTROL_LINE_MAX;
+    export_lease l;
+
+    for ( int n = 0; n < CONTROL_CHUNK && cl->cursor < cl->end && cl->arg && p < limit; ++n, ++cl->cursor )
+        if ( lease_to_export ( server, server->head + cl->cursor, &l ) ) {
+            p = export_format ( EXPORT_JSON, &l, p );
+            --cl->arg;
+        }
+
+    if ( cl->cursor == cl->end || !cl->arg ) {
+        if ( cl->cursor < cl->end )
+            p += sprintf ( ( char * ) p, "next %s\n", inet_ntoa ( server->head[cl->cursor].ip ) );
+        p += sprintf ( ( char * ) p, ".\n" );
+        cl->fill = NULL;
+    }
+    return p - ( u_char * ) buf;
+}
+
+// Parte de "mac": recorre la cubeta de la MAC en el índice y escribe las
+// concesiones que la tienen, saltando las cursor que ya salieron; arg lleva
+// la MAC en sus 48 bits bajos
+size_t control_mac_fill ( void *ctx, control_client *cl, char *buf, size_t size ) {
+    dhcp_server *server = ctx;
+    u_char *     p      = ( u_char * ) buf;
+    u_int64_t    skip   = cl->cursor;
+    u_char       mac[6];
+    export_lease l;
+
+    for ( int i = 0; i < 6; ++i )
+        mac[i] = cl->arg >> ( 40 - 8 * i );
+
+    for ( u_int32_t i = server->mac_buckets[mac_bucket ( server, mac )]; i; i = server->mac_next[i - 1] ) {
+        if ( memcmp ( server->head[i - 1].mac, mac, 6 ) || !lease_to_export ( server, server->head + i - 1, &l ) )
+            continue;
+        if ( skip ) {
+            --skip;
+            continue;
+        }
+        if ( size - ( p - ( u_char * ) buf ) <= EXPORT_REC_MAX )
+            return p - ( u_char * ) buf;
+        p = export_format ( EXPORT_JSON, &l, p );
+        ++cl->cursor;
+    }
+
+    p += sprintf ( ( char * ) p, ".\n" );
+    cl->fill = NULL;
+    return p - ( u_char * ) buf;
+}
+
+// Parte de "stats": "<clase> <estado> <concesiones>" por cada combinación que
+// tenga alguna, de los contadores que mantiene index_lease()
+size_t control_stats_fill ( void *ctx, control_client *cl, char *buf, size_t size ) {
+    dhcp_server *server = ctx;
+    size_t       len    = 0;
+
+    // CLASS_MAX * 7 líneas de menos de 64 bytes caben en CONTROL_FILL_MIN
+    for ( int c = 0; c < server->nclasses; ++c )
+        for ( int st = 0; st <= S_OWN; ++st )
+            if ( server->lease_counts[c][st] )
+                len += snprintf ( buf + len, size - len, "%s %s %u\n", server->classes[c].name, get_state ( st ),
+                                  server->lease_counts[c][st] );
+    len += snprintf ( buf + len, size - len, ".\n" );
+    cl->fill = NULL;
+    return len;
+}
+
+// Escribe la concesión en formato JSON Lines; sin nada si está libre
+void control_print_lease ( dhcp_server *server, control_client *cl, dhcp_lease *lease ) {
+    u_char       line[EXPORT_REC_MAX];
+    export_lease l;
+
+    if ( lease && lease_to_export ( server, lease, &l ) )
+        control_printf ( cl, "%.*s", ( int ) ( export_format ( EXPORT_JSON, &l, line ) - line ), line );
+}
+
+// Atiende una petición del socket de control:
+//   list [ip [n]]  concesiones desde ip (n por página)
+//   ip <ip>, mac <mac>, name <nombre>
+//   stats          concesiones por clase y estado
+//   release <ip>   libera una concesión activa
+//   profile        resumen del perfil por etapa
+//   memory         memoria actual y máxima por subsistema
+//   journal        registros y compactaciones de cada partición de la bitácora
+void control_command ( void *ctx, control_client *cl, char *line ) {
+    dhcp_server *  server = ctx;
+    char *         save, *cmd = strtok_r ( line, " \t", &save ), *arg = strtok_r ( NULL, " \t", &save );
+    char *         count = strtok_r ( NULL, " \t", &save );
+    struct in_addr addr;
+    dhcp_lease *   lease = NULL;
+    u_char         mac[6];
+    u_int64_t      total = server->end - server->head;
+
+    if ( !cmd ) {
+        control_printf ( cl, "ERR petición vacía\n" );
+        return;
+    }
+
+    if ( arg && strcmp ( cmd, "name" ) && strcmp ( cmd, "mac" ) && inet_pton ( AF_INET, arg, &addr ) == 1 )
+        lease = get_lease_by_ip ( server, addr.s_addr );
+
+    if ( strcmp ( cmd, "list" ) == 0 ) {
+        char *    end;
+        u_int64_t n = count ? strtoull ( count, &end, 10 ) : UINT64_MAX;
+
+        if ( ( arg && !lease ) || ( count && ( *end || !n ) ) ) {
+            control_printf ( cl, "ERR uso: list [ip [n]]\n" );
+            return;
+        }
+        control_printf ( cl, "OK\n" );
+        control_stream ( cl, control_list_fill, lease ? ( u_int64_t ) ( lease - server->head ) : 0, total, n );
+
+    } else if ( strcmp ( cmd, "ip" ) == 0 ) {
+        if ( !lease ) {
+            control_printf ( cl, "ERR dirección fuera del rango\n" );
+            return;
+        }
+        control_printf ( cl, "OK\n" );
+        control_print_lease ( server, cl, lease );
+
+    } else if ( strcmp ( cmd, "mac" ) == 0 ) {
+        u_int64_t packed = 0;
+
+        if ( !arg || parse_hex ( arg, mac, 6 ) != 6 ) {
+            control_printf ( cl, "ERR uso: mac aa:bb:cc:dd:ee:ff\n" );
+            return;
+        }
+        for ( int i = 0; i < 6; ++i )
+            packed = packed << 8 | mac[i];
+        control_printf ( cl, "OK\n" );
+        control_stream ( cl, control_mac_fill, 0, 0, packed );
+
+    } else if ( strcmp ( cmd, "name" ) == 0 ) {
+        if ( !arg ) {
+            control_printf ( cl, "ERR uso: name <nombre>\n" );
+            return;
+        }
+        control_printf ( cl, "OK\n" );
+        control_print_lease ( server, cl, find_lease_by_name ( server, arg ) );
+
+    } else if ( strcmp ( cmd, "stats" ) == 0 ) {
+        control_printf ( cl, "OK\n" );
+        control_stream ( cl, control_stats_fill, 0, 0, 0 );
+
+    } else if ( strcmp ( cmd, "release" ) == 0 ) {
+        if ( !lease || lease->state != S_LEASED ) {
+            control_printf ( cl, "ERR no hay concesión activa en esa dirección\n" );
+            return;
+        }
+        release_lease ( server, lease );
+        control_printf ( cl, "OK\n" );
+
+    } else if ( strcmp ( cmd, "profile" ) == 0 ) {
+        char   buf[4096];
+        size_t len;
+
+        if ( !server->profile.enabled ) {
+            control_printf ( cl, "ERR perfil apagado (--profile)\n" );
+            return;
+        }
+        len = profile_format ( &server->profile, buf, sizeof ( buf ) );
+        control_printf ( cl, "OK\n%.*s", ( int ) len, buf );
+
+    } else if ( strcmp ( cmd, "memory" ) == 0 ) {
+        char   buf[1024];
+        size_t len = memuse_format ( buf, sizeof ( buf ) );
+
+        control_printf ( cl, "OK\n%.*s", ( int ) len, buf );
+
+    } else if ( strcmp ( cmd, "journal" ) == 0 ) {
+        journal_compact_stats js;
+
+        if ( !server->config.journal_file[0] ) {
+            control_printf ( cl, "ERR sin bitácora (--journal)\n" );
+            return;
+        }
+        control_printf ( cl, "OK\n%-9s %12s %12s %10s %12s %12s\n", "partición", "registros", "compactando",
+                         "veces", "última ms", "total ms" );
+        for ( int i = 0; i < server->journal.count; ++i ) {
+            journal_compact_read ( &server->journal.shards[i], &js );
+            control_printf ( cl, "%-9d %12llu %12s %10llu %12.1f %12.1f\n", i,
+                             ( unsigned long long ) server->journal.shards[i].records, js.running ? "sí" : "no",
+                             ( unsigned long long ) js.compactions, js.last_ms, js.total_ms );
+        }
+
+    } else
+        control_printf ( cl, "ERR orden desconocida: %s\n", cmd );
+}
+
+// Arranca los hilos de los ganchos; el ciclo solo encola los eventos
+void open_hooks ( dhcp_server *server ) {
+    if ( !server->config.hook_path[0] )
+        return;
+
+    if ( !hooks_open ( &server->hooks, server->config.hook_path, server->config.hook_workers,
+                       server->config.hook_batch, server->config.hook_timeout ) )
+        dhcp_fatal ( "Error from hooks_open() in open_hooks()", strerror ( errno ) );
+    __atomic_store_n ( &server->metrics.hooks, &server->hooks, __ATOMIC_RELEASE );
+
+    printf ( "Ganchos con %s (%s, %d hilos, lotes de %d, %d ms)\n", server->config.hook_path,
+             server->hooks.fn ? "módulo" : "programa", server->config.hook_workers, server->config.hook_batch,
+             server->config.hook_timeout );
+}
+
+void open_control ( dhcp_server *server ) {
+    if ( !server->config.control_socket[0] )
+        return;
+
+    if ( !control_open ( &server->control, server->config.control_socket, control_command, server ) )
+        dhcp_fatal ( "Error from control_open() in open_control()", strerror ( errno ) );
+
+    printf ( "Socket de control en %s\n", server->config.control_socket );
+}
+
+// Atiende el socket de control: enseguida si poll() vio actividad o hay
+// respuestas en curso y, si no, cada CONTROL_INTERVAL_MS (con tráfico el
+// ciclo no pasa por poll())
+void check_control ( dhcp_server *server ) {
+    struct timespec now;
+
+    if ( !server->config.control_socket[0] )
+        return;
+
+    if ( !server->control_ready && !control_pending ( &server->control ) ) {
+        clock_gettime ( CLOCK_MONOTONIC_COARSE, &now );
+        if ( timespec_ns ( &now ) < server->control_at )
+            return;
+        server->control_at = timespec_ns ( &now ) + CONTROL_INTERVAL_MS * 1000000ull;
+    }
+    server->control_ready = 0;
+    control_run ( &server->control );
+}
+
+void open_audit ( dhcp_server *server ) {
+
+    if ( !server->config.audit_dir[0] )
+        return;
+
+    if ( !audit_open ( &server->audit, server->config.audit_dir, server->config.audit_days ) )
+        dhcp_fatal ( "Error from audit_open() in open_audit()", strerror ( errno ) );
+
+    printf ( "Registro de auditoría en %s (%d días)\n", server->config.audit_dir, server->config.audit_days );
+}
+
+// SIGTERM y SIGINT: el ciclo termina la vuelta en curso y sale por
+// terminate(). Sin SA_RESTART, para que la espera en poll() no se reanude.
+static volatile sig_atomic_t stop_requested;
+
+void stop_signal ( int sig ) {
+    ( void ) sig;
+    stop_requested = 1;
+}
+
+void open_stop ( void ) {
+    struct sigaction sa;
+
+    memset ( &sa, 0, sizeof ( sa ) );
+    sa.sa_handler = stop_signal;
+    sigemptyset ( &sa.sa_mask );
+    if ( sigaction ( SIGTERM, &sa, NULL ) == -1 || sigaction ( SIGINT, &sa, NULL ) == -1 )
+        dhcp_fatal ( "Error from sigaction() in open_stop()", strerror ( errno ) );
+}
+
+// Se llama con el grupo de la bitácora ya confirmado; la exportación en curso
+// se descarta. La bitácora se cierra después de las métricas, cuyo hilo lee
+// sus compactaciones.
+void terminate ( dhcp_server *server ) {
+    if ( server->export.active )
+        export_close ( &server->export.w );
+    metrics_close ( &server->metrics );
+    journal_group_close ( &server->journal );
+    hooks_close ( &server->hooks );
+    xtrace_close ( &server->trace );
+    capture_close ( &server->capture );
+    profile_close ( &server->profile );
+    control_close ( &server->control );
+    memuse_free ( MEMUSE_INDEX, server->mac_buckets );
+    memuse_free ( MEMUSE_INDEX, server->mac_next );
+    logring_close ( &server->log );
+    leaseview_close ( &server->view );
+    eventring_close ( &server->events );
+    if ( server->config.audit_dir[0] )
+        audit_close ( &server->audit );
+
+    // up_service() reserva todas las concesiones en un solo bloque o las mapea
+    if ( server->config.lease_db_file[0] ) {
+        leasedb_close ( &server->leasedb );
+        strtab_free ( &server->names );
+    } else
+        memuse_free ( MEMUSE_LEASES, server->head );
+}
+
 int main ( int argc, char *argv[] ) {
 
     struct gengetopt_args_info    args_info;
@@ -1342,6 +4295,8 @@ int main ( int argc, char *argv[] ) {
     int                           signal = 0;
 
     memset ( &server, 0, sizeof ( struct dhcp_server ) );
+    memuse_add ( MEMUSE_OPTIONS, server_option_bytes () );
+    memuse_add ( MEMUSE_OTHER, sizeof ( struct dhcp_server ) - server_option_bytes () );
     params = cmdline_parser_params_create ();
 
     // Obtenemos configuración a usar:
@@ -1350,6 +4305,62 @@ int main ( int argc, char *argv[] ) {
     // 3 - Obtener datos actuales de la red (Para varios servidores DHCP activos)
     parse_config ( argc, argv, &args_info, params, &server );
 
+    // Prueba de rendimiento del codec, sin levantar el servicio
+    if ( args_info.codec_bench_given ) {
+        codec_bench ( &server, args_info.codec_bench_arg );
+        cmdline_parser_free ( &args_info );
+        free ( params );
+        return 0;
+    }
+
+    // Prueba de rendimiento de la recuperación de la bitácora
+    if ( args_info.recover_bench_given ) {
+        recover_bench ( &server, args_info.recover_bench_arg );
+        cmdline_parser_free ( &args_info );
+        free ( params );
+        return 0;
+    }
+
+    // Prueba de rendimiento de la exportación de concesiones
+    if ( args_info.export_bench_given ) {
+        export_bench ( &server, args_info.export_bench_arg );
+        cmdline_parser_free ( &args_info );
+        free ( params );
+        return 0;
+    }
+
+    // Prueba de rendimiento del registro de eventos
+    if ( args_info.log_bench_given ) {
+        log_bench ( &server, args_info.log_bench_arg );
+        cmdline_parser_free ( &args_info );
+        free ( params );
+        return 0;
+    }
+
+    // Prueba de rendimiento del anillo de eventos
+    if ( args_info.events_bench_given ) {
+        events_bench ( args_info.events_bench_arg );
+        cmdline_parser_free ( &args_info );
+        free ( params );
+        return 0;
+    }
+
+    // Previsión de memoria para la configuración, sin levantar el servicio
+    if ( args_info.memory_plan_given ) {
+        print_memory_plan ( &server );
+        cmdline_parser_free ( &args_info );
+        free ( params );
+        return 0;
+    }
+
+    // Consulta del registro de auditoría
+    if ( args_info.audit_query_given ) {
+        audit_query_tool ( &server, &args_info );
+        cmdline_parser_free ( &args_info );
+        free ( params );
+        return 0;
+    }
+
     // Inicializamos
     dhcp_init ( &server );
 
@@ -1362,23 +4373,62 @@ int main ( int argc, char *argv[] ) {
     }
 
     print_options ( &server.config );
+    print_memory_plan ( &server );
+
+    // Levantar servicio
+    strtab_init ( &server.names );
+    up_service ( &server );
+
+    // Recuperamos las concesiones de la bitácora
+    open_journal ( &server );
+
+    // Concesiones de otro servidor (migración)
+    import_files ( &server, &args_info );
+
+    // Vista de la tabla y eventos para herramientas externas
+    open_lease_view ( &server );
+    open_lease_events ( &server );
+
+    // Historial de concesiones
+    open_audit ( &server );
 
     // Liberamos memoria
     cmdline_parser_free ( &args_info );
     free ( params );
 
-    // Levantar servicio
-    up_service ( &server );
-
     // Obtenemos el número de IP reservadas, abandonadas y libres
     get_lease_count ( &server );
+    index_leases ( &server );
+
+    // Contadores e histogramas del ciclo
+    open_metrics ( &server );
+    open_trace ( &server );
+    open_capture ( &server );
+    open_profile ( &server );
+    open_hooks ( &server );
+    open_control ( &server );
+
+    // Desde aquí el ciclo no escribe directamente en stdout
+    open_log ( &server );
+    open_stop ();
     // Proveer y administrar servicio
-    for ( ;; ) {
-        wait_request ( &server );
-        check_status ( server.head );
+    while ( !stop_requested ) {
+        // Si ya no hay paquetes listos o el grupo se llenó, un solo fsync
+        // confirma todos los cambios y salen las respuestas retenidas
+        if ( !wait_request ( &server ) || server.nreplies == REPLY_BATCH_MAX ) {
+            commit_batch ( &server );
+            check_compaction ( &server );
+        }
+        check_status ( &server );
+        check_export ( &server );
+        check_audit ( &server );
+        check_control ( &server );
+        if ( server.profile.dump )
+            dump_profile ( &server );
     }
-    // Liberamos
-    /*
- */
+    // Lo que quedó en el grupo se confirma (y salen sus respuestas) antes
+    // de liberar
+    commit_batch ( &server );
+    terminate ( &server );
     return 0;
 }
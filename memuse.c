@@ -0,0 +1,98 @@
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "memuse.h"
+
+const char *memuse_names[MEMUSE_TAGS] = {"leases", "index", "options", "journal", "log", "other"};
+
+static memuse_tag memuse_tags[MEMUSE_TAGS];
+static memuse_tag memuse_total;  // el máximo del total no es la suma de los máximos
+
+static void memuse_tag_add ( memuse_tag *t, int64_t bytes ) {
+    u_int64_t now  = __atomic_add_fetch ( &t->current, bytes, __ATOMIC_RELAXED );
+    u_int64_t peak = __atomic_load_n ( &t->peak, __ATOMIC_RELAXED );
+
+    while ( now > peak
+            && !__atomic_compare_exchange_n ( &t->peak, &peak, now, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        ;
+}
+
+// Suma bytes (negativos al liberar) y sube el máximo si hace falta
+void memuse_add ( int tag, int64_t bytes ) {
+    memuse_tag_add ( &memuse_tags[tag], bytes );
+    memuse_tag_add ( &memuse_total, bytes );
+}
+
+void *memuse_malloc ( int tag, size_t size ) {
+    void *p = malloc ( size );
+
+    if ( p )
+        memuse_add ( tag, malloc_usable_size ( p ) );
+    return p;
+}
+
+void *memuse_calloc ( int tag, size_t n, size_t size ) {
+    void *p = calloc ( n, size );
+
+    if ( p )
+        memuse_add ( tag, malloc_usable_size ( p ) );
+    return p;
+}
+
+// Como realloc(): si falla, p queda igual y contado
+void *memuse_realloc ( int tag, void *p, size_t size ) {
+    size_t old = malloc_usable_size ( p );
+    void * q   = realloc ( p, size );
+
+    if ( q )
+        memuse_add ( tag, ( int64_t ) malloc_usable_size ( q ) - ( int64_t ) old );
+    return q;
+}
+
+// posix_memalign() que regresa NULL con errno
+void *memuse_memalign ( int tag, size_t align, size_t size ) {
+    void *p;
+    int   err = posix_memalign ( &p, align, size );
+
+    if ( err ) {
+        errno = err;
+        return NULL;
+    }
+    memuse_add ( tag, malloc_usable_size ( p ) );
+    return p;
+}
+
+void memuse_free ( int tag, void *p ) {
+    if ( !p )
+        return;
+    memuse_add ( tag, -( int64_t ) malloc_usable_size ( p ) );
+    free ( p );
+}
+
+// Copia los contadores de cada subsistema en tags y los del total en total
+void memuse_read ( memuse_tag *tags, memuse_tag *total ) {
+    for ( int i = 0; i < MEMUSE_TAGS; ++i ) {
+        tags[i].current = __atomic_load_n ( &memuse_tags[i].current, __ATOMIC_RELAXED );
+        tags[i].peak    = __atomic_load_n ( &memuse_tags[i].peak, __ATOMIC_RELAXED );
+    }
+    total->current = __atomic_load_n ( &memuse_total.current, __ATOMIC_RELAXED );
+    total->peak    = __atomic_load_n ( &memuse_total.peak, __ATOMIC_RELAXED );
+}
+
+// Tabla con lo actual y el máximo por subsistema; regresa su longitud (se
+// trunca a size)
+size_t memuse_format ( char *buf, size_t size ) {
+    memuse_tag tags[MEMUSE_TAGS], total;
+    size_t     len = 0;
+
+    memuse_read ( tags, &total );
+    len += snprintf ( buf, size, "%-10s %14s %14s\n", "subsistema", "bytes", "máximo" );
+    for ( int i = 0; i <= MEMUSE_TAGS && len < size; ++i ) {
+        const memuse_tag *t = i < MEMUSE_TAGS ? &tags[i] : &total;
+
+        len += snprintf ( buf + len, size - len, "%-10s %14llu %14llu\n", i < MEMUSE_TAGS ? memuse_names[i] : "total",
+                          ( unsigned long long ) t->current, ( unsigned long long ) t->peak );
+    }
+    return len < size ? len : size;
+}
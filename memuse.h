@@ -0,0 +1,46 @@
+#ifndef MEMUSE_H
+#define MEMUSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Contabilidad de memoria por subsistema.
+ *
+ * Cada módulo reserva con memuse_malloc() y compañía diciendo a qué
+ * subsistema pertenece la memoria, y registra con memuse_add() lo que mapea
+ * con mmap(). Por subsistema se lleva lo que ocupa ahora y el máximo que ha
+ * llegado a ocupar.
+ *
+ * Lo reservado se mide con malloc_usable_size(): liberar no necesita el
+ * tamaño y la cifra incluye el redondeo del asignador. Los contadores son
+ * globales y atómicos porque reservan el ciclo de paquetes, los hilos de
+ * escritura y el de métricas, que además los lee.
+ */
+
+#define MEMUSE_LEASES 0   // tabla de concesiones y su vista compartida
+#define MEMUSE_INDEX 1    // tabla de nombres, índices y el clasificador
+#define MEMUSE_OPTIONS 2  // búferes de mensajes, opciones y respuestas retenidas
+#define MEMUSE_JOURNAL 3  // búferes de la bitácora y de su reaplicación
+#define MEMUSE_LOG 4      // registro de eventos, auditoría, captura y seguimiento
+#define MEMUSE_OTHER 5    // exportación, importación, métricas y control
+#define MEMUSE_TAGS 6
+
+typedef struct memuse_tag {
+    u_int64_t current;
+    u_int64_t peak;
+} memuse_tag;
+
+extern const char *memuse_names[MEMUSE_TAGS];
+
+void   memuse_add ( int tag, int64_t bytes );
+void * memuse_malloc ( int tag, size_t size );
+void * memuse_calloc ( int tag, size_t n, size_t size );
+void * memuse_realloc ( int tag, void *p, size_t size );
+void * memuse_memalign ( int tag, size_t align, size_t size );
+void   memuse_free ( int tag, void *p );
+void   memuse_read ( memuse_tag *tags, memuse_tag *total );
+size_t memuse_format ( char *buf, size_t size );
+
+#endif  // MEMUSE_H
@@ -0,0 +1,444 @@
+#define _GNU_SOURCE  // accept4()
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "hooks.h"
+#include "journal.h"
+#include "memuse.h"
+#include "metrics.h"
+
+#define METRICS_REQ_MAX 4096
+#define METRICS_PREFIX "dhcpd_t_"
+#define METRICS_LE_FIRST 10  // cubetas exportadas: 2^10 ns (~1 µs) ...
+#define METRICS_LE_LAST 30   // ... 2^30 ns (~1 s)
+
+static const char *metrics_type_names[METRICS_TYPES] = {"unknown", "discover", "offer",   "request", "decline",
+                                                        "ack",     "nak",      "release", "inform"};
+
+// Tipos que llegan de los clientes y tipos que envía el servidor
+static const int metrics_rx_types[] = {1, 3, 4, 7, 8, 0};
+static const int metrics_tx_types[] = {2, 5, 6};
+
+static const char *metrics_stage_names[METRICS_STAGES] = {"queue", "process", "tx"};
+
+static const double metrics_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+typedef struct metrics_out {
+    char * buf;
+    size_t size;
+    size_t len;
+} metrics_out;
+
+static void metrics_printf ( metrics_out *o, const char *fmt, ... ) {
+    va_list ap;
+    int     n;
+
+    if ( o->len >= o->size )
+        return;
+    va_start ( ap, fmt );
+    n = vsnprintf ( o->buf + o->len, o->size - o->len, fmt, ap );
+    va_end ( ap );
+    o->len = n < 0 ? o->size : o->len + n;
+}
+
+static u_int64_t metrics_load ( const u_int64_t *c ) {
+    return __atomic_load_n ( c, __ATOMIC_RELAXED );
+}
+
+// Límites [lower, upper) en ns de la cubeta b
+static u_int64_t metrics_lower ( int b ) {
+    int g = b >> METRICS_SUB_BITS, sub = b & ( ( 1 << METRICS_SUB_BITS ) - 1 );
+
+    return g ? ( u_int64_t ) ( ( 1 << METRICS_SUB_BITS ) + sub ) << ( g - 1 ) : ( u_int64_t ) b;
+}
+
+static u_int64_t metrics_upper ( int b ) {
+    return b + 1 < METRICS_BUCKETS ? metrics_lower ( b + 1 ) : UINT64_MAX;
+}
+
+// Suma el histograma que está en offset de todos los hilos
+static void metrics_sum_hist ( metrics *m, size_t offset, metrics_hist *out ) {
+    memset ( out, 0, sizeof ( metrics_hist ) );
+    for ( int w = 0; w < m->nworkers; ++w ) {
+        const metrics_hist *h = ( const metrics_hist * ) ( ( const char * ) m->workers[w] + offset );
+
+        out->count += metrics_load ( &h->count );
+        out->sum += metrics_load ( &h->sum );
+        for ( int b = 0; b < METRICS_BUCKETS; ++b )
+            out->buckets[b] += metrics_load ( &h->buckets[b] );
+    }
+}
+
+// Cuantil q en ns (punto medio de su cubeta)
+static double metrics_quantile ( const metrics_hist *h, double q ) {
+    u_int64_t total = 0, target;
+
+    for ( int b = 0; b < METRICS_BUCKETS; ++b )
+        total += h->buckets[b];
+    if ( !total )
+        return 0;
+
+    target = q * total + 0.5;
+    if ( target < 1 )
+        target = 1;
+    for ( u_int64_t cum = 0, b = 0; b < METRICS_BUCKETS; ++b )
+        if ( ( cum += h->buckets[b] ) >= target )
+            return ( metrics_lower ( b ) + ( double ) ( metrics_upper ( b ) - metrics_lower ( b ) ) / 2 );
+    return 0;
+}
+
+static u_int64_t metrics_sum_counter ( metrics *m, size_t offset ) {
+    u_int64_t total = 0;
+
+    for ( int w = 0; w < m->nworkers; ++w )
+        total += metrics_load ( ( const u_int64_t * ) ( ( const char * ) m->workers[w] + offset ) );
+    return total;
+}
+
+// Cubetas de name{labels} y su suma y cuenta; labels puede ser ""
+static void metrics_print_hist ( metrics_out *o, const char *name, const char *labels, const metrics_hist *h ) {
+    const char *sep = *labels ? "," : "";
+    u_int64_t   cum = 0;
+    int         b   = 0;
+
+    for ( int le = METRICS_LE_FIRST; le <= METRICS_LE_LAST; ++le ) {
+        for ( ; b < METRICS_BUCKETS && metrics_upper ( b ) <= ( 1ull << le ); ++b )
+            cum += h->buckets[b];
+        metrics_printf ( o, METRICS_PREFIX "%s_bucket{%s%sle=\"%.9g\"} %llu\n", name, labels, sep,
+                         ( 1ull << le ) / 1e9, ( unsigned long long ) cum );
+    }
+    metrics_printf ( o,
+                     METRICS_PREFIX "%s_bucket{%s%sle=\"+Inf\"} %llu\n" METRICS_PREFIX "%s_sum{%s} %.9f\n" METRICS_PREFIX
+                                    "%s_count{%s} %llu\n",
+                     name, labels, sep, ( unsigned long long ) h->count, name, labels, h->sum / 1e9, name, labels,
+                     ( unsigned long long ) h->count );
+}
+
+static void metrics_print_quantiles ( metrics_out *o, const char *name, const char *labels, const metrics_hist *h ) {
+    const char *sep = *labels ? "," : "";
+
+    for ( size_t q = 0; q < sizeof ( metrics_quantiles ) / sizeof ( double ); ++q )
+        metrics_printf ( o, METRICS_PREFIX "%s_quantile{%s%squantile=\"%g\"} %.9f\n", name, labels, sep,
+                         metrics_quantiles[q], metrics_quantile ( h, metrics_quantiles[q] ) / 1e9 );
+}
+
+// Formatea en buf el texto de Prometheus con los contadores sumados de todos
+// los hilos; regresa su longitud (se trunca a size)
+size_t metrics_format ( metrics *m, char *buf, size_t size ) {
+    metrics_out           o = {buf, size, 0};
+    metrics_hist          h;
+    memuse_tag            mem[MEMUSE_TAGS], mem_total;
+    hooks *               hk = __atomic_load_n ( &m->hooks, __ATOMIC_ACQUIRE );
+    hooks_stats           hs;
+    journal_group *       jg = __atomic_load_n ( &m->journal, __ATOMIC_ACQUIRE );
+    journal_compact_stats js;
+    char                  labels[32];
+
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "received_total Mensajes DHCP recibidos por tipo.\n"
+                         "# TYPE " METRICS_PREFIX "received_total counter\n" );
+    for ( size_t i = 0; i < sizeof ( metrics_rx_types ) / sizeof ( int ); ++i ) {
+        int t = metrics_rx_types[i];
+
+        metrics_printf ( &o, METRICS_PREFIX "received_total{type=\"%s\"} %llu\n", metrics_type_names[t],
+                         ( unsigned long long ) metrics_sum_counter ( m, offsetof ( metrics_worker, received[t] ) ) );
+    }
+
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "sent_total Mensajes DHCP enviados por tipo.\n"
+                         "# TYPE " METRICS_PREFIX "sent_total counter\n" );
+    for ( size_t i = 0; i < sizeof ( metrics_tx_types ) / sizeof ( int ); ++i ) {
+        int t = metrics_tx_types[i];
+
+        metrics_printf ( &o, METRICS_PREFIX "sent_total{type=\"%s\"} %llu\n", metrics_type_names[t],
+                         ( unsigned long long ) metrics_sum_counter ( m, offsetof ( metrics_worker, sent[t] ) ) );
+    }
+
+    metrics_printf ( &o,
+                     "# HELP " METRICS_PREFIX "invalid_total Datagramas descartados por no ser un mensaje DHCP.\n"
+                     "# TYPE " METRICS_PREFIX "invalid_total counter\n" METRICS_PREFIX "invalid_total %llu\n",
+                     ( unsigned long long ) metrics_sum_counter ( m, offsetof ( metrics_worker, invalid ) ) );
+
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "handle_seconds Tiempo de atención de un mensaje por tipo.\n"
+                         "# TYPE " METRICS_PREFIX "handle_seconds histogram\n" );
+    for ( size_t i = 0; i < sizeof ( metrics_rx_types ) / sizeof ( int ); ++i ) {
+        int t = metrics_rx_types[i];
+
+        snprintf ( labels, sizeof ( labels ), "type=\"%s\"", metrics_type_names[t] );
+        metrics_sum_hist ( m, offsetof ( metrics_worker, handle[t] ), &h );
+        metrics_print_hist ( &o, "handle_seconds", labels, &h );
+    }
+
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "handle_seconds_quantile Cuantiles del tiempo de atención.\n"
+                         "# TYPE " METRICS_PREFIX "handle_seconds_quantile gauge\n" );
+    for ( size_t i = 0; i < sizeof ( metrics_rx_types ) / sizeof ( int ); ++i ) {
+        int t = metrics_rx_types[i];
+
+        snprintf ( labels, sizeof ( labels ), "type=\"%s\"", metrics_type_names[t] );
+        metrics_sum_hist ( m, offsetof ( metrics_worker, handle[t] ), &h );
+        metrics_print_quantiles ( &o, "handle_seconds", labels, &h );
+    }
+
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "packet_stage_seconds Etapas de un paquete: cola del socket, "
+                         "atención hasta sendto() y envío hasta el controlador.\n"
+                         "# TYPE " METRICS_PREFIX "packet_stage_seconds histogram\n" );
+    for ( int i = 0; i < METRICS_STAGES; ++i ) {
+        snprintf ( labels, sizeof ( labels ), "stage=\"%s\"", metrics_stage_names[i] );
+        metrics_sum_hist ( m, offsetof ( metrics_worker, stage[i] ), &h );
+        metrics_print_hist ( &o, "packet_stage_seconds", labels, &h );
+    }
+
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "packet_stage_seconds_quantile Cuantiles de las etapas.\n"
+                         "# TYPE " METRICS_PREFIX "packet_stage_seconds_quantile gauge\n" );
+    for ( int i = 0; i < METRICS_STAGES; ++i ) {
+        snprintf ( labels, sizeof ( labels ), "stage=\"%s\"", metrics_stage_names[i] );
+        metrics_sum_hist ( m, offsetof ( metrics_worker, stage[i] ), &h );
+        metrics_print_quantiles ( &o, "packet_stage_seconds", labels, &h );
+    }
+
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "exchange_seconds Intercambios DISCOVER..ACK por lado: servidor o "
+                         "cliente (OFFER -> REQUEST).\n"
+                         "# TYPE " METRICS_PREFIX "exchange_seconds histogram\n" );
+    metrics_sum_hist ( m, offsetof ( metrics_worker, exchange_server ), &h );
+    metrics_print_hist ( &o, "exchange_seconds", "side=\"server\"", &h );
+    metrics_sum_hist ( m, offsetof ( metrics_worker, exchange_client ), &h );
+    metrics_print_hist ( &o, "exchange_seconds", "side=\"client\"", &h );
+
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "exchange_evicted_total Intercambios que se dejaron de seguir antes "
+                         "de terminar.\n"
+                         "# TYPE " METRICS_PREFIX "exchange_evicted_total counter\n" METRICS_PREFIX
+                         "exchange_evicted_total %llu\n",
+                     ( unsigned long long ) metrics_sum_counter ( m, offsetof ( metrics_worker, exchange_evicted ) ) );
+
+    if ( hk ) {
+        hooks_stats_read ( hk, &hs );
+        metrics_printf ( &o, "# HELP " METRICS_PREFIX "hook_queue_events Eventos esperando a los ganchos.\n"
+                             "# TYPE " METRICS_PREFIX "hook_queue_events gauge\n" METRICS_PREFIX
+                             "hook_queue_events %llu\n"
+                             "# HELP " METRICS_PREFIX "hook_dropped_total Eventos perdidos por tener la cola llena.\n"
+                             "# TYPE " METRICS_PREFIX "hook_dropped_total counter\n" METRICS_PREFIX
+                             "hook_dropped_total %llu\n"
+                             "# HELP " METRICS_PREFIX "hook_events_total Eventos entregados a los ganchos.\n"
+                             "# TYPE " METRICS_PREFIX "hook_events_total counter\n" METRICS_PREFIX
+                             "hook_events_total %llu\n"
+                             "# HELP " METRICS_PREFIX "hook_runs_total Invocaciones por resultado.\n"
+                             "# TYPE " METRICS_PREFIX "hook_runs_total counter\n" METRICS_PREFIX
+                             "hook_runs_total{result=\"ok\"} %llu\n" METRICS_PREFIX
+                             "hook_runs_total{result=\"failed\"} %llu\n" METRICS_PREFIX
+                             "hook_runs_total{result=\"timeout\"} %llu\n"
+                             "# HELP " METRICS_PREFIX "hook_busy_workers Hilos de ganchos ocupados.\n"
+                             "# TYPE " METRICS_PREFIX "hook_busy_workers gauge\n" METRICS_PREFIX
+                             "hook_busy_workers %d\n"
+                             "# HELP " METRICS_PREFIX "hook_workers Hilos de ganchos.\n"
+                             "# TYPE " METRICS_PREFIX "hook_workers gauge\n" METRICS_PREFIX "hook_workers %d\n",
+                         ( unsigned long long ) hs.queued, ( unsigned long long ) hs.dropped,
+                         ( unsigned long long ) hs.events,
+                         ( unsigned long long ) ( hs.batches - hs.failures - hs.timeouts ),
+                         ( unsigned long long ) hs.failures, ( unsigned long long ) hs.timeouts, hs.busy, hs.workers );
+        metrics_printf ( &o, "# HELP " METRICS_PREFIX "hook_run_seconds Duración de cada invocación.\n"
+                             "# TYPE " METRICS_PREFIX "hook_run_seconds histogram\n" );
+        metrics_print_hist ( &o, "hook_run_seconds", "", &hs.run );
+    }
+
+    if ( jg ) {
+        metrics_printf ( &o, "# HELP " METRICS_PREFIX "journal_compactions_total Compactaciones terminadas por "
+                             "partición de la bitácora.\n"
+                             "# TYPE " METRICS_PREFIX "journal_compactions_total counter\n" );
+        for ( int i = 0; i < jg->count; ++i ) {
+            journal_compact_read ( &jg->shards[i], &js );
+            metrics_printf ( &o, METRICS_PREFIX "journal_compactions_total{shard=\"%d\"} %llu\n", i,
+                             ( unsigned long long ) js.compactions );
+        }
+        metrics_printf ( &o, "# HELP " METRICS_PREFIX "journal_compaction_seconds Duración de la última "
+                             "compactación y total de todas, por partición.\n"
+                             "# TYPE " METRICS_PREFIX "journal_compaction_seconds gauge\n" );
+        for ( int i = 0; i < jg->count; ++i ) {
+            journal_compact_read ( &jg->shards[i], &js );
+            metrics_printf ( &o, METRICS_PREFIX "journal_compaction_seconds{shard=\"%d\",kind=\"last\"} %.6f\n",
+                             i, js.last_ms / 1e3 );
+            metrics_printf ( &o, METRICS_PREFIX "journal_compaction_seconds{shard=\"%d\",kind=\"total\"} %.6f\n",
+                             i, js.total_ms / 1e3 );
+        }
+    }
+
+    memuse_read ( mem, &mem_total );
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "memory_bytes Memoria reservada por subsistema.\n"
+                         "# TYPE " METRICS_PREFIX "memory_bytes gauge\n" );
+    for ( int i = 0; i < MEMUSE_TAGS; ++i )
+        metrics_printf ( &o, METRICS_PREFIX "memory_bytes{subsystem=\"%s\"} %llu\n", memuse_names[i],
+                         ( unsigned long long ) mem[i].current );
+    metrics_printf ( &o, "# HELP " METRICS_PREFIX "memory_peak_bytes Máximo de memoria reservada por subsistema.\n"
+                         "# TYPE " METRICS_PREFIX "memory_peak_bytes gauge\n" );
+    for ( int i = 0; i < MEMUSE_TAGS; ++i )
+        metrics_printf ( &o, METRICS_PREFIX "memory_peak_bytes{subsystem=\"%s\"} %llu\n", memuse_names[i],
+                         ( unsigned long long ) mem[i].peak );
+    metrics_printf ( &o, METRICS_PREFIX "memory_peak_bytes{subsystem=\"total\"} %llu\n",
+                     ( unsigned long long ) mem_total.peak );
+
+    return o.len < size ? o.len : size;
+}
+
+static int metrics_write ( int fd, const char *buf, size_t len ) {
+    for ( size_t done = 0; done < len; ) {
+        ssize_t n = send ( fd, buf + done, len - done, MSG_NOSIGNAL );
+
+        if ( n == -1 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            return 0;
+        done += n;
+    }
+    return 1;
+}
+
+// Atiende una consulta: lee la petición HTTP (sin importar la ruta) y
+// responde con las métricas
+static void metrics_reply ( metrics *m, int fd, char *buf ) {
+    const struct timeval timeout = {1, 0};
+    char                 req[METRICS_REQ_MAX + 1], head[160];
+    size_t               len = 0, body;
+    ssize_t              n;
+
+    setsockopt ( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof ( timeout ) );
+    setsockopt ( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof ( timeout ) );
+
+    while ( len < METRICS_REQ_MAX && ( n = recv ( fd, req + len, METRICS_REQ_MAX - len, 0 ) ) > 0 ) {
+        len += n;
+        req[len] = '\0';
+        if ( strstr ( req, "\r\n\r\n" ) || strstr ( req, "\n\n" ) )
+            break;
+    }
+
+    body = metrics_format ( m, buf, METRICS_BUF_SIZE );
+    snprintf ( head, sizeof ( head ),
+               "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n"
+               "Connection: close\r\n\r\n",
+               body );
+    if ( metrics_write ( fd, head, strlen ( head ) ) )
+        metrics_write ( fd, buf, body );
+}
+
+static void *metrics_serve ( void *arg ) {
+    metrics *m   = arg;
+    char *   buf = memuse_malloc ( MEMUSE_OTHER, METRICS_BUF_SIZE );
+    int      fd;
+
+    while ( buf ) {
+        if ( ( fd = accept4 ( m->fd, NULL, NULL, SOCK_CLOEXEC ) ) == -1 ) {
+            if ( errno == EINTR || errno == ECONNABORTED )
+                continue;
+            break;  // metrics_close() cerró el socket
+        }
+        metrics_reply ( m, fd, buf );
+        close ( fd );
+    }
+    memuse_free ( MEMUSE_OTHER, buf );
+    return NULL;
+}
+
+static int metrics_listen ( metrics *m, const char *listen_on ) {
+    const int flag = 1;
+    char *    end;
+    long      port;
+
+    if ( !strncmp ( listen_on, METRICS_UNIX_PREFIX, strlen ( METRICS_UNIX_PREFIX ) ) ) {
+        struct sockaddr_un addr;
+        const char *       path = listen_on + strlen ( METRICS_UNIX_PREFIX );
+
+        if ( strlen ( path ) >= sizeof ( addr.sun_path ) ) {
+            errno = ENAMETOOLONG;
+            return 0;
+        }
+        memset ( &addr, 0, sizeof ( addr ) );
+        addr.sun_family = AF_UNIX;
+        strcpy ( addr.sun_path, path );
+
+        // Un socket que dejó una ejecución anterior
+        unlink ( path );
+        if ( ( m->fd = socket ( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) == -1
+             || bind ( m->fd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) == -1 )
+            return 0;
+        return ( m->path = strdup ( path ) ) != NULL;
+    }
+
+    // Solo en la interfaz local: las métricas no llevan autenticación
+    struct sockaddr_in addr;
+
+    port = strtol ( listen_on, &end, 10 );
+    if ( *end || port <= 0 || port > 65535 ) {
+        errno = EINVAL;
+        return 0;
+    }
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    addr.sin_port        = htons ( port );
+    if ( ( m->fd = socket ( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) == -1
+         || setsockopt ( m->fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof ( flag ) ) == -1
+         || bind ( m->fd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) == -1 )
+        return 0;
+    return 1;
+}
+
+// Empieza a servir las métricas en listen_on (puerto local o unix:ruta); con
+// NULL solo se preparan para metrics_format(). Regresa 0 con errno si falla.
+int metrics_open ( metrics *m, const char *listen_on ) {
+    int err;
+
+    memset ( m, 0, sizeof ( metrics ) );
+    m->fd = -1;
+    if ( !listen_on )
+        return 1;
+
+    if ( !metrics_listen ( m, listen_on ) || listen ( m->fd, 16 ) == -1 )
+        goto fail;
+    if ( ( err = pthread_create ( &m->thread, NULL, metrics_serve, m ) ) ) {
+        errno = err;
+        goto fail;
+    }
+    return 1;
+
+fail:
+    err = errno;
+    if ( m->fd != -1 )
+        close ( m->fd );
+    if ( m->path )
+        unlink ( m->path );
+    free ( m->path );
+    memset ( m, 0, sizeof ( metrics ) );
+    m->fd = -1;
+    errno = err;
+    return 0;
+}
+
+// Registra los contadores de un hilo. Se llama antes de que el hilo empiece a
+// contar; regresa 0 con ENOSPC si ya hay METRICS_WORKERS_MAX.
+int metrics_add_worker ( metrics *m, metrics_worker *w ) {
+    if ( m->nworkers == METRICS_WORKERS_MAX ) {
+        errno = ENOSPC;
+        return 0;
+    }
+    memset ( w, 0, sizeof ( metrics_worker ) );
+    __atomic_store_n ( &m->workers[m->nworkers], w, __ATOMIC_RELEASE );
+    __atomic_store_n ( &m->nworkers, m->nworkers + 1, __ATOMIC_RELEASE );
+    return 1;
+}
+
+void metrics_close ( metrics *m ) {
+    if ( m->fd != -1 ) {
+        // Despierta al hilo en accept()
+        shutdown ( m->fd, SHUT_RDWR );
+        pthread_join ( m->thread, NULL );
+        close ( m->fd );
+    }
+    if ( m->path )
+        unlink ( m->path );
+    free ( m->path );
+    memset ( m, 0, sizeof ( metrics ) );
+    m->fd = -1;
+}
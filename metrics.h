@@ -0,0 +1,99 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Contadores por tipo de mensaje e histogramas de latencia, servidos como
+ * texto de Prometheus.
+ *
+ * Cada hilo que atiende paquetes tiene su metrics_worker (alineado a línea
+ * de caché) y es el único que lo escribe: sumar es un incremento sin
+ * candados. Un hilo aparte atiende el punto de consulta (HTTP en
+ * 127.0.0.1:<puerto> o en un socket Unix, "unix:<ruta>"); al leer suma los
+ * de todos los hilos y formatea, así que el ciclo de paquetes nunca
+ * formatea ni espera a un cliente.
+ *
+ * Los histogramas son de tipo HDR: cada potencia de 2 se divide en
+ * 1 << METRICS_SUB_BITS partes iguales, con un error relativo de a lo más
+ * 12.5% desde 1 ns hasta 2^64 ns con 496 cubetas. Se exportan como histograma
+ * de Prometheus con cubetas de 2^10 a 2^30 ns (de 1 µs a 1 s, más o menos)
+ * y, además, los cuantiles 0.5, 0.9, 0.99 y 0.999 calculados con las
+ * cubetas finas.
+ */
+
+#define METRICS_TYPES 9  // tipos de mensaje DHCP 1-8; 0 = sin tipo o desconocido
+#define METRICS_SUB_BITS 3
+#define METRICS_BUCKETS ( ( 64 - METRICS_SUB_BITS + 1 ) << METRICS_SUB_BITS )
+#define METRICS_WORKERS_MAX 16
+#define METRICS_BUF_SIZE ( 1 << 16 )
+#define METRICS_UNIX_PREFIX "unix:"
+
+// Etapas de cada paquete, con las marcas de software del kernel
+#define METRICS_STAGE_QUEUE 0    // marca de recepción a lectura: espera en la cola del socket
+#define METRICS_STAGE_PROCESS 1  // lectura a sendto() de la respuesta, con la espera del commit
+#define METRICS_STAGE_TX 2       // sendto() a marca de envío: pila de red hasta el controlador
+#define METRICS_STAGES 3
+
+typedef struct metrics_hist {
+    u_int64_t count;
+    u_int64_t sum;  // ns
+    u_int64_t buckets[METRICS_BUCKETS];
+} metrics_hist;
+
+typedef struct metrics_worker {
+    u_int64_t    received[METRICS_TYPES];
+    u_int64_t    sent[METRICS_TYPES];
+    u_int64_t    invalid;  // datagramas que no son un mensaje DHCP
+    metrics_hist handle[METRICS_TYPES];  // de recibido a respuesta lista, por tipo recibido
+    metrics_hist exchange_server;  // intercambios terminados, tiempo del servidor
+    metrics_hist exchange_client;  // y del cliente
+    u_int64_t    exchange_evicted;
+    metrics_hist stage[METRICS_STAGES];
+} __attribute__ ( ( aligned ( 64 ) ) ) metrics_worker;
+
+struct hooks;
+struct journal_group;
+
+typedef struct metrics {
+    metrics_worker *      workers[METRICS_WORKERS_MAX];
+    int                   nworkers;
+    struct hooks *        hooks;    // ganchos de concesiones, NULL si no hay
+    struct journal_group *journal;  // bitácora, NULL si no hay
+    int                   fd;    // socket que escucha, -1 sin punto de consulta
+    char *                path;  // socket Unix a borrar al cerrar
+    pthread_t             thread;
+} metrics;
+
+int    metrics_open ( metrics *m, const char *listen );
+int    metrics_add_worker ( metrics *m, metrics_worker *w );
+size_t metrics_format ( metrics *m, char *buf, size_t size );
+void   metrics_close ( metrics *m );
+
+// Solo el dueño del contador lo escribe; el lector lo ve completo
+static inline void metrics_inc ( u_int64_t *c ) {
+    __atomic_store_n ( c, *c + 1, __ATOMIC_RELAXED );
+}
+
+static inline int metrics_bucket ( u_int64_t v ) {
+    int e;
+
+    if ( v < ( 1 << METRICS_SUB_BITS ) )
+        return v;
+    e = 63 - __builtin_clzll ( v );
+    return ( ( e - METRICS_SUB_BITS + 1 ) << METRICS_SUB_BITS )
+           + ( ( v >> ( e - METRICS_SUB_BITS ) ) & ( ( 1 << METRICS_SUB_BITS ) - 1 ) );
+}
+
+static inline void metrics_observe ( metrics_hist *h, u_int64_t ns ) {
+    u_int64_t *b = &h->buckets[metrics_bucket ( ns )];
+
+    __atomic_store_n ( b, *b + 1, __ATOMIC_RELAXED );
+    __atomic_store_n ( &h->sum, h->sum + ns, __ATOMIC_RELAXED );
+    __atomic_store_n ( &h->count, h->count + 1, __ATOMIC_RELAXED );
+}
+
+#endif  // METRICS_H
@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "profile.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+static const char *profile_stage_names[PROFILE_STAGES] = {"recv",      "dec_dhcp_msg", "lookup",
+                                                          "build_msg", "send_msg",     "check_status"};
+
+static const u_int64_t profile_events[PROFILE_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                           PERF_COUNT_HW_CACHE_MISSES};
+
+static int profile_perf_open ( u_int64_t config, int group, int kernel ) {
+    struct perf_event_attr attr;
+
+    memset ( &attr, 0, sizeof ( attr ) );
+    attr.size           = sizeof ( attr );
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = config;
+    attr.read_format    = PERF_FORMAT_GROUP;
+    attr.exclude_hv     = 1;
+    attr.exclude_kernel = !kernel;
+    return syscall ( SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC );
+}
+
+static u_int64_t profile_tsc ( void ) {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc ();
+#else
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Abre los contadores del hilo que llama (el del ciclo de paquetes) y
+// enciende el perfil. Sin perf_event_open() queda rdtsc, así que no falla.
+int profile_open ( profile *p ) {
+    memset ( p, 0, sizeof ( profile ) );
+    for ( int i = 0; i < PROFILE_COUNTERS; ++i )
+        p->fds[i] = -1;
+
+    // Primero con el kernel incluido (recv y send pasan casi todo ahí); si
+    // perf_event_paranoid no lo deja, solo espacio de usuario
+    p->kernel = 1;
+    if ( ( p->fds[0] = profile_perf_open ( profile_events[0], -1, 1 ) ) == -1 ) {
+        p->kernel = 0;
+        p->fds[0] = profile_perf_open ( profile_events[0], -1, 0 );
+    }
+
+    if ( p->fds[0] != -1 ) {
+        p->nopen = 1;
+        for ( int i = 1; i < PROFILE_COUNTERS; ++i )
+            if ( ( p->fds[i] = profile_perf_open ( profile_events[i], p->fds[0], p->kernel ) ) != -1 )
+                p->slot[i] = p->nopen++;
+    } else
+        p->kernel = 0;
+
+    p->enabled = 1;
+    return 1;
+}
+
+// Lee todos los contadores; los que no hay quedan en 0
+void profile_read ( profile *p, u_int64_t *v ) {
+    u_int64_t group[1 + PROFILE_COUNTERS];
+
+    if ( !p->nopen ) {
+        v[PROFILE_CYCLES] = profile_tsc ();
+        return;
+    }
+
+    if ( read ( p->fds[0], group, ( 1 + p->nopen ) * sizeof ( u_int64_t ) ) <= 0 ) {
+        memset ( v, 0, PROFILE_COUNTERS * sizeof ( u_int64_t ) );
+        return;
+    }
+    for ( int i = 0; i < PROFILE_COUNTERS; ++i )
+        v[i] = p->fds[i] != -1 ? group[1 + p->slot[i]] : 0;
+}
+
+// Suma a stage lo transcurrido desde profile_enter()
+void profile_add ( profile *p, int stage ) {
+    profile_stage *s = &p->stages[stage];
+    u_int64_t      now[PROFILE_COUNTERS] = {0};
+
+    profile_read ( p, now );
+    for ( int i = 0; i < PROFILE_COUNTERS; ++i )
+        s->sum[i] += now[i] - p->start[i];
+    if ( now[PROFILE_CYCLES] - p->start[PROFILE_CYCLES] > s->max_cycles )
+        s->max_cycles = now[PROFILE_CYCLES] - p->start[PROFILE_CYCLES];
+    ++s->count;
+}
+
+typedef struct profile_out {
+    char * buf;
+    size_t size;
+    size_t len;
+} profile_out;
+
+static void profile_printf ( profile_out *o, const char *fmt, ... ) {
+    va_list ap;
+    int     n;
+
+    if ( o->len >= o->size )
+        return;
+    va_start ( ap, fmt );
+    n = vsnprintf ( o->buf + o->len, o->size - o->len, fmt, ap );
+    va_end ( ap );
+    o->len = n < 0 ? o->size : o->len + n;
+}
+
+// Formatea el resumen en buf; regresa su longitud (se trunca a size)
+size_t profile_format ( profile *p, char *buf, size_t size ) {
+    profile_out o = {buf, size, 0};
+
+    if ( p->nopen )
+        profile_printf ( &o, "Perfil por etapa (perf_event, %s):\n", p->kernel ? "usuario y kernel" : "solo usuario" );
+    else
+        profile_printf ( &o, "Perfil por etapa (rdtsc: sin contadores del procesador, ciclos de reloj de pared):\n" );
+    profile_printf ( &o, "%-14s %12s %14s %14s %6s %14s %14s\n", "etapa", "tramos", "ciclos/tramo", "instr/tramo",
+                     "IPC", "fallos/tramo", "ciclos máx" );
+
+    for ( int i = 0; i < PROFILE_STAGES; ++i ) {
+        const profile_stage *s = &p->stages[i];
+        double               c = s->count ? ( double ) s->count : 1;
+
+        profile_printf ( &o, "%-14s %12llu %14.0f ", profile_stage_names[i], ( unsigned long long ) s->count,
+                         s->sum[PROFILE_CYCLES] / c );
+        if ( p->fds[PROFILE_INSTRUCTIONS] != -1 )
+            profile_printf ( &o, "%14.0f %6.2f ", s->sum[PROFILE_INSTRUCTIONS] / c,
+                             s->sum[PROFILE_CYCLES] ? ( double ) s->sum[PROFILE_INSTRUCTIONS] / s->sum[PROFILE_CYCLES]
+                                                    : 0 );
+        else
+            profile_printf ( &o, "%14s %6s ", "-", "-" );
+        if ( p->fds[PROFILE_CACHE_MISSES] != -1 )
+            profile_printf ( &o, "%14.1f ", s->sum[PROFILE_CACHE_MISSES] / c );
+        else
+            profile_printf ( &o, "%14s ", "-" );
+        profile_printf ( &o, "%14llu\n", ( unsigned long long ) s->max_cycles );
+    }
+
+    return o.len < size ? o.len : size;
+}
+
+void profile_close ( profile *p ) {
+    if ( !p->enabled )
+        return;
+    for ( int i = 0; i < PROFILE_COUNTERS; ++i )
+        if ( p->fds[i] != -1 )
+            close ( p->fds[i] );
+    memset ( p, 0, sizeof ( profile ) );
+    for ( int i = 0; i < PROFILE_COUNTERS; ++i )
+        p->fds[i] = -1;
+}
@@ -0,0 +1,69 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Perfil por etapa del ciclo de paquetes con contadores del procesador.
+ *
+ * Con perf_event_open() se abre un grupo de ciclos, instrucciones y fallos
+ * de caché del propio hilo (también en el kernel si el sistema lo permite)
+ * y se lee completo en cada límite de etapa. Si el procesador o la máquina
+ * virtual no exponen contadores se usa rdtsc: solo ciclos de reloj de pared,
+ * así que una etapa que bloquea (recv sin paquetes) también cuenta la
+ * espera.
+ *
+ * profile_enter() marca el inicio de un tramo y profile_leave() suma lo
+ * transcurrido a la etapa; los tramos no se anidan. Con el perfil apagado
+ * cada límite es una sola comparación.
+ */
+
+#define PROFILE_RECV 0
+#define PROFILE_DECODE 1  // dec_dhcp_msg()
+#define PROFILE_LOOKUP 2  // búsqueda y registro de la concesión
+#define PROFILE_BUILD 3   // build_msg()
+#define PROFILE_SEND 4    // send_msg()
+#define PROFILE_STATUS 5  // check_status()
+#define PROFILE_STAGES 6
+
+#define PROFILE_CYCLES 0
+#define PROFILE_INSTRUCTIONS 1
+#define PROFILE_CACHE_MISSES 2
+#define PROFILE_COUNTERS 3
+
+typedef struct profile_stage {
+    u_int64_t count;  // tramos medidos
+    u_int64_t sum[PROFILE_COUNTERS];
+    u_int64_t max_cycles;
+} profile_stage;
+
+typedef struct profile {
+    int           enabled;
+    int           dump;  // resumen pedido (se puede poner desde un manejador de señal)
+    int           fds[PROFILE_COUNTERS];  // -1 si ese contador no está; fds[0] es el líder
+    int           slot[PROFILE_COUNTERS];  // posición del contador en la lectura del grupo
+    int           nopen;  // 0 = rdtsc
+    int           kernel;  // los contadores incluyen el tiempo en el kernel
+    u_int64_t     start[PROFILE_COUNTERS];
+    profile_stage stages[PROFILE_STAGES];
+} profile;
+
+int    profile_open ( profile *p );
+void   profile_read ( profile *p, u_int64_t *v );
+void   profile_add ( profile *p, int stage );
+size_t profile_format ( profile *p, char *buf, size_t size );
+void   profile_close ( profile *p );
+
+static inline void profile_enter ( profile *p ) {
+    if ( __builtin_expect ( p->enabled, 0 ) )
+        profile_read ( p, p->start );
+}
+
+static inline void profile_leave ( profile *p, int stage ) {
+    if ( __builtin_expect ( p->enabled, 0 ) )
+        profile_add ( p, stage );
+}
+
+#endif  // PROFILE_H
@@ -0,0 +1,344 @@
+#define _GNU_SOURCE  // mremap()
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "memuse.h"
+#include "strtab.h"
+
+#define STRTAB_ARENA_INITIAL 4096
+#define STRTAB_INDEX_INITIAL 256
+#define STRTAB_DEAD 0x8000  // en len: entrada libre, en la lista de su tamaño
+
+typedef struct strtab_entry {
+    u_int32_t hash;
+    u_int32_t value;  // dato asociado (p. ej. índice + 1 de la concesión)
+    u_int16_t len;
+    char      str[];  // terminada en '\0'
+} strtab_entry;
+
+// FNV-1a sobre minúsculas
+static u_int32_t strtab_hash ( const char *str, size_t len ) {
+    u_int32_t h = 2166136261u;
+
+    for ( size_t i = 0; i < len; ++i ) {
+        h ^= ( u_char ) tolower ( ( u_char ) str[i] );
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static strtab_entry *strtab_entry_at ( const strtab *t, u_int32_t handle ) {
+    return ( strtab_entry * ) ( t->arena + handle );
+}
+
+// Tamaño que ocupa en la arena una cadena de len bytes
+static size_t strtab_entry_size ( size_t len ) {
+    return ( sizeof ( strtab_entry ) + len + 1 + 3 ) & ~( size_t ) 3;
+}
+
+static size_t strtab_entry_len ( const strtab_entry *e ) {
+    return e->len & ~STRTAB_DEAD;
+}
+
+// Agrega la entrada a la lista de libres de su tamaño; value guarda la
+// siguiente
+static void strtab_free_push ( strtab *t, u_int32_t handle ) {
+    strtab_entry *e = strtab_entry_at ( t, handle );
+    size_t        c = strtab_entry_size ( strtab_entry_len ( e ) ) / 4;
+
+    e->len |= STRTAB_DEAD;
+    e->value   = t->free[c];
+    t->free[c] = handle;
+    t->free_count++;
+}
+
+// Handle de la entrada que sigue a handle en la arena
+static u_int32_t strtab_next ( const strtab *t, u_int32_t handle ) {
+    return handle + strtab_entry_size ( strtab_entry_len ( strtab_entry_at ( t, handle ) ) );
+}
+
+static int strtab_equal ( const strtab_entry *e, u_int32_t hash, const char *str, size_t len ) {
+    return e->hash == hash && e->len == len && strncasecmp ( e->str, str, len ) == 0;
+}
+
+static int strtab_grow_index ( strtab *t ) {
+    u_int32_t  cap   = t->index_cap ? t->index_cap * 2 : STRTAB_INDEX_INITIAL;
+    u_int32_t *index = memuse_calloc ( MEMUSE_INDEX, cap, sizeof ( u_int32_t ) );
+
+    if ( !index )
+        return 0;
+
+    // Reinsertamos con el hash guardado en cada entrada
+    for ( u_int32_t i = 0; i < t->index_cap; ++i ) {
+        u_int32_t h = t->index[i];
+
+        if ( !h )
+            continue;
+        for ( u_int32_t j = strtab_entry_at ( t, h )->hash & ( cap - 1 );; j = ( j + 1 ) & ( cap - 1 ) )
+            if ( !index[j] ) {
+                index[j] = h;
+                break;
+            }
+    }
+
+    memuse_free ( MEMUSE_INDEX, t->index );
+    t->index     = index;
+    t->index_cap = cap;
+    return 1;
+}
+
+static void strtab_index_add ( strtab *t, u_int32_t handle ) {
+    u_int32_t j;
+
+    for ( j = strtab_entry_at ( t, handle )->hash & ( t->index_cap - 1 ); t->index[j]; j = ( j + 1 ) & ( t->index_cap - 1 ) )
+        ;
+    t->index[j] = handle;
+    t->count++;
+}
+
+// Reconstruye el índice con las entradas vivas de la arena
+static void strtab_reindex ( strtab *t ) {
+    memset ( t->index, 0, t->index_cap * sizeof ( u_int32_t ) );
+    t->count = 0;
+    for ( u_int32_t h = sizeof ( u_int32_t ); h < t->arena_len; h = strtab_next ( t, h ) )
+        if ( !( strtab_entry_at ( t, h )->len & STRTAB_DEAD ) )
+            strtab_index_add ( t, h );
+}
+
+// Cambia el tamaño de la arena; en el archivo o en el heap
+static int strtab_resize ( strtab *t, size_t cap ) {
+    char *arena;
+
+    if ( cap > UINT32_MAX )
+        return 0;
+
+    if ( t->fd == -1 )
+        arena = memuse_realloc ( MEMUSE_INDEX, t->arena, cap );
+    else if ( ftruncate ( t->fd, cap ) == -1 )
+        return 0;
+    else if ( !t->arena )
+        arena = mmap ( NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0 );
+    else
+        arena = mremap ( t->arena, t->arena_cap, cap, MREMAP_MAYMOVE );
+
+    if ( !arena || arena == MAP_FAILED )
+        return 0;
+
+    // Lo reservado con memuse_realloc() ya quedó contado
+    if ( t->fd != -1 )
+        memuse_add ( MEMUSE_INDEX, ( int64_t ) cap - ( int64_t ) t->arena_cap );
+    t->arena     = arena;
+    t->arena_cap = cap;
+    return 1;
+}
+
+void strtab_init ( strtab *t ) {
+    memset ( t, 0, sizeof ( strtab ) );
+    t->fd = -1;
+}
+
+// Usa como arena el archivo path (lo crea si no existe) y reconstruye el
+// índice con las cadenas que ya tenía. La tabla debe estar vacía. Regresa 0
+// con errno si falla; EINVAL si el archivo está dañado.
+int strtab_map ( strtab *t, const char *path ) {
+    struct stat st;
+    u_int32_t   len;
+
+    if ( ( t->fd = open ( path, O_RDWR | O_CREAT | O_CLOEXEC, 0644 ) ) == -1 || fstat ( t->fd, &st ) == -1 )
+        goto fail;
+
+    if ( !strtab_resize ( t, st.st_size >= STRTAB_ARENA_INITIAL ? ( size_t ) st.st_size : STRTAB_ARENA_INITIAL ) )
+        goto fail;
+
+    // Los primeros 4 bytes (el handle 0, que nunca se usa) guardan cuánto de
+    // la arena está ocupado
+    memcpy ( &len, t->arena, sizeof ( len ) );
+    if ( !len )
+        len = sizeof ( u_int32_t );
+    if ( len < sizeof ( u_int32_t ) || len > t->arena_cap ) {
+        errno = EINVAL;
+        goto fail;
+    }
+    t->arena_len = len;
+
+    for ( u_int32_t h = sizeof ( u_int32_t ); h < t->arena_len; h = strtab_next ( t, h ) ) {
+        if ( h + sizeof ( strtab_entry ) > t->arena_len
+             || strtab_entry_len ( strtab_entry_at ( t, h ) ) > STRTAB_MAX_LEN
+             || strtab_next ( t, h ) > t->arena_len ) {
+            errno = EINVAL;
+            goto fail;
+        }
+        if ( strtab_entry_at ( t, h )->len & STRTAB_DEAD ) {
+            strtab_free_push ( t, h );
+            continue;
+        }
+        if ( ( t->count + 1 ) * 2 > t->index_cap && !strtab_grow_index ( t ) )
+            goto fail;
+        strtab_index_add ( t, h );
+    }
+    return 1;
+
+fail:
+    strtab_free ( t );
+    return 0;
+}
+
+void strtab_free ( strtab *t ) {
+    if ( t->fd == -1 )
+        memuse_free ( MEMUSE_INDEX, t->arena );
+    else {
+        if ( t->arena ) {
+            munmap ( t->arena, t->arena_cap );
+            memuse_add ( MEMUSE_INDEX, -( int64_t ) t->arena_cap );
+        }
+        close ( t->fd );
+    }
+    memuse_free ( MEMUSE_INDEX, t->index );
+    strtab_init ( t );
+}
+
+u_int32_t strtab_find ( const strtab *t, const char *str, size_t len ) {
+    u_int32_t hash;
+
+    if ( !t->index_cap || !len || len > STRTAB_MAX_LEN )
+        return 0;
+
+    hash = strtab_hash ( str, len );
+    for ( u_int32_t j = hash & ( t->index_cap - 1 ); t->index[j]; j = ( j + 1 ) & ( t->index_cap - 1 ) )
+        if ( strtab_equal ( strtab_entry_at ( t, t->index[j] ), hash, str, len ) )
+            return t->index[j];
+
+    return 0;
+}
+
+// Regresa el handle de la cadena, agregándola si no existía; 0 si está vacía,
+// es demasiado larga o no hubo memoria.
+u_int32_t strtab_intern ( strtab *t, const char *str, size_t len ) {
+    u_int32_t     hash, handle;
+    size_t        need;
+    strtab_entry *e;
+
+    if ( !str || !len || len > STRTAB_MAX_LEN )
+        return 0;
+
+    if ( ( handle = strtab_find ( t, str, len ) ) )
+        return handle;
+
+    // Factor de carga máximo de 1/2
+    if ( ( t->count + 1 ) * 2 > t->index_cap && !strtab_grow_index ( t ) )
+        return 0;
+
+    hash = strtab_hash ( str, len );
+    need = strtab_entry_size ( len );
+
+    // Una entrada libre del mismo tamaño se reusa en su lugar; len se escribe
+    // al final, así que a la mitad sigue marcada como libre
+    if ( ( handle = t->free[need / 4] ) ) {
+        e                 = strtab_entry_at ( t, handle );
+        t->free[need / 4] = e->value;
+        t->free_count--;
+        e->hash  = hash;
+        e->value = 0;
+        memcpy ( e->str, str, len );
+        e->str[len] = '\0';
+        e->len      = len;
+        strtab_index_add ( t, handle );
+        return handle;
+    }
+
+    // El desplazamiento 0 queda reservado para "sin nombre"
+    if ( !t->arena_len )
+        t->arena_len = sizeof ( u_int32_t );
+
+    if ( t->arena_len + need > t->arena_cap ) {
+        size_t cap = t->arena_cap ? t->arena_cap : STRTAB_ARENA_INITIAL;
+
+        while ( t->arena_len + need > cap )
+            cap *= 2;
+        if ( !strtab_resize ( t, cap ) )
+            return 0;
+    }
+
+    handle   = t->arena_len;
+    e        = strtab_entry_at ( t, handle );
+    e->hash  = hash;
+    e->value = 0;
+    e->len   = len;
+    memcpy ( e->str, str, len );
+    e->str[len] = '\0';
+    t->arena_len += need;
+
+    // La longitud ocupada se publica después de escribir la entrada: si el
+    // proceso cae a la mitad, la entrada incompleta queda fuera
+    memcpy ( t->arena, &t->arena_len, sizeof ( u_int32_t ) );
+    strtab_index_add ( t, handle );
+
+    return handle;
+}
+
+// Los handles fuera de la arena (p. ej. de una base de concesiones cuyo
+// archivo de nombres se perdió) se tratan como "sin nombre"
+static int strtab_valid ( const strtab *t, u_int32_t handle ) {
+    return handle && handle < t->arena_len && !( strtab_entry_at ( t, handle )->len & STRTAB_DEAD );
+}
+
+const char *strtab_get ( const strtab *t, u_int32_t handle ) {
+    return strtab_valid ( t, handle ) ? strtab_entry_at ( t, handle )->str : "";
+}
+
+u_int32_t strtab_get_value ( const strtab *t, u_int32_t handle ) {
+    return strtab_valid ( t, handle ) ? strtab_entry_at ( t, handle )->value : 0;
+}
+
+void strtab_set_value ( strtab *t, u_int32_t handle, u_int32_t value ) {
+    if ( strtab_valid ( t, handle ) )
+        strtab_entry_at ( t, handle )->value = value;
+}
+
+// Memoria de la tabla con strings cadenas de len bytes en promedio, con el
+// mismo crecimiento que strtab_intern()
+size_t strtab_footprint ( size_t strings, size_t len ) {
+    size_t arena = STRTAB_ARENA_INITIAL, index = STRTAB_INDEX_INITIAL;
+
+    while ( sizeof ( u_int32_t ) + strings * strtab_entry_size ( len ) > arena )
+        arena *= 2;
+    while ( strings * 2 > index )
+        index *= 2;
+    return arena + index * sizeof ( u_int32_t );
+}
+
+// Mapa de bits en ceros, uno por entrada posible de la arena, para
+// strtab_mark(); NULL con errno si no hay memoria
+u_char *strtab_mark_begin ( const strtab *t ) {
+    return memuse_calloc ( MEMUSE_INDEX, t->arena_len / sizeof ( u_int32_t ) / 8 + 1, 1 );
+}
+
+// Marca el handle como en uso; los que no son de la tabla se ignoran
+void strtab_mark ( const strtab *t, u_char *marks, u_int32_t handle ) {
+    if ( strtab_valid ( t, handle ) && !( handle & 3 ) )
+        marks[handle / 4 / 8] |= 1 << ( handle / 4 % 8 );
+}
+
+// Libera las cadenas que no se marcaron, reconstruye el índice y libera
+// marks. Regresa cuántas se liberaron.
+u_int32_t strtab_sweep ( strtab *t, u_char *marks ) {
+    u_int32_t freed = 0;
+
+    for ( u_int32_t h = sizeof ( u_int32_t ); h < t->arena_len; h = strtab_next ( t, h ) )
+        if ( !( strtab_entry_at ( t, h )->len & STRTAB_DEAD ) && !( marks[h / 4 / 8] & 1 << ( h / 4 % 8 ) ) ) {
+            strtab_free_push ( t, h );
+            ++freed;
+        }
+
+    if ( freed )
+        strtab_reindex ( t );
+    memuse_free ( MEMUSE_INDEX, marks );
+    return freed;
+}
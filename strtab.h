@@ -0,0 +1,57 @@
+#ifndef STRTAB_H
+#define STRTAB_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Tabla de cadenas internadas (nombres de host y FQDN de los clientes).
+ *
+ * Cada cadena distinta se guarda una sola vez en una arena contigua y se
+ * identifica con un handle de 4 bytes (su desplazamiento en la arena; 0 es
+ * "sin nombre"). Un índice hash con direccionamiento abierto permite buscar
+ * por nombre en O(1); la comparación no distingue mayúsculas, como en DNS.
+ *
+ * Los punteros que regresa strtab_get() dejan de ser válidos al internar una
+ * cadena nueva (la arena puede moverse); los handles no cambian nunca.
+ *
+ * Con strtab_map() la arena vive en un archivo mapeado en memoria, así que los
+ * handles guardados en otro lado (p. ej. en la base de concesiones) siguen
+ * siendo válidos al reiniciar; solo el índice se reconstruye al abrir.
+ *
+ * Las cadenas que ya nadie usa se recuperan marcando y barriendo: el dueño de
+ * los handles marca los vivos (strtab_mark_begin() y strtab_mark()) y
+ * strtab_sweep() marca las demás entradas como libres. Una entrada libre
+ * conserva su lugar y se reusa para otra cadena que ocupe lo mismo, así que
+ * los handles vivos no se mueven.
+ */
+
+#define STRTAB_MAX_LEN 255
+#define STRTAB_FREE_CLASSES ( ( STRTAB_MAX_LEN + 16 ) / 4 + 1 )  // listas de libres por tamaño de entrada / 4
+
+typedef struct strtab {
+    char *     arena;
+    size_t     arena_len;
+    size_t     arena_cap;
+    u_int32_t *index;      // handles; 0 = casilla libre
+    u_int32_t  index_cap;  // potencia de 2
+    u_int32_t  count;      // cadenas vivas
+    u_int32_t  free_count;
+    u_int32_t  free[STRTAB_FREE_CLASSES];  // primera entrada libre de cada tamaño, 0 si no hay
+    int        fd;  // archivo de la arena, -1 si está en el heap
+} strtab;
+
+void        strtab_init ( strtab *t );
+int         strtab_map ( strtab *t, const char *path );
+void        strtab_free ( strtab *t );
+u_int32_t   strtab_intern ( strtab *t, const char *str, size_t len );
+u_int32_t   strtab_find ( const strtab *t, const char *str, size_t len );
+const char *strtab_get ( const strtab *t, u_int32_t handle );
+u_int32_t   strtab_get_value ( const strtab *t, u_int32_t handle );
+void        strtab_set_value ( strtab *t, u_int32_t handle, u_int32_t value );
+size_t      strtab_footprint ( size_t strings, size_t len );
+u_char *    strtab_mark_begin ( const strtab *t );
+void        strtab_mark ( const strtab *t, u_char *marks, u_int32_t handle );
+u_int32_t   strtab_sweep ( strtab *t, u_char *marks );
+
+#endif  // STRTAB_H
@@ -0,0 +1,102 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memuse.h"
+#include "xtrace.h"
+
+// Tipos de mensaje (RFC 2132, opción 53)
+#define XTRACE_DISCOVER 1
+#define XTRACE_OFFER 2
+#define XTRACE_REQUEST 3
+#define XTRACE_ACK 5
+#define XTRACE_NAK 6
+
+#define XTRACE_USED ( 1ull << 63 )  // marca de entrada ocupada; una MAC usa 48 bits
+
+static xtrace_entry *xtrace_slot ( xtrace *x, u_int32_t xid, u_int64_t mac ) {
+    return &x->slots[( ( ( xid ^ mac ) * 0x9e3779b97f4a7c15ull ) >> 32 ) & ( XTRACE_SLOTS - 1 )];
+}
+
+static int xtrace_match ( const xtrace_entry *e, u_int32_t xid, u_int64_t mac ) {
+    return e->mac == ( mac | XTRACE_USED ) && e->xid == xid;
+}
+
+static u_int64_t xtrace_diff ( u_int64_t to, u_int64_t from ) {
+    return to > from ? to - from : 0;  // el reloj pudo ajustarse entre las dos
+}
+
+// Reserva la tabla; regresa 0 con errno si falla
+int xtrace_open ( xtrace *x ) {
+    memset ( x, 0, sizeof ( xtrace ) );
+    return ( x->slots = memuse_calloc ( MEMUSE_LOG, XTRACE_SLOTS, sizeof ( xtrace_entry ) ) ) != NULL;
+}
+
+void xtrace_close ( xtrace *x ) {
+    memuse_free ( MEMUSE_LOG, x->slots );
+    memset ( x, 0, sizeof ( xtrace ) );
+}
+
+// Un mensaje del cliente llegó a la hora ns. Regresa 1 si para seguirlo se
+// dejó otro intercambio sin terminar.
+int xtrace_received ( xtrace *x, u_int32_t xid, u_int64_t mac, u_int8_t type, u_int64_t ns ) {
+    xtrace_entry *e;
+    int           evicted;
+
+    if ( !x->slots || ( type != XTRACE_DISCOVER && type != XTRACE_REQUEST ) )
+        return 0;
+
+    e = xtrace_slot ( x, xid, mac );
+    if ( xtrace_match ( e, xid, mac ) ) {
+        // Una retransmisión conserva la primera hora: lo que el cliente
+        // esperó por ella también cuenta
+        if ( type == XTRACE_DISCOVER && !e->discover )
+            e->discover = ns;
+        if ( type == XTRACE_REQUEST && !e->request )
+            e->request = ns;
+        return 0;
+    }
+
+    evicted     = e->mac != 0;
+    e->mac      = mac | XTRACE_USED;
+    e->xid      = xid;
+    e->discover = type == XTRACE_DISCOVER ? ns : 0;
+    e->offer    = 0;
+    e->request  = type == XTRACE_REQUEST ? ns : 0;
+    return evicted;
+}
+
+// El servidor envió una respuesta a la hora ns. Si cierra un intercambio lo
+// deja en done y regresa 1.
+int xtrace_sent ( xtrace *x, u_int32_t xid, u_int64_t mac, u_int8_t type, u_int64_t ns, xtrace_done *done ) {
+    xtrace_entry *e;
+
+    if ( !x->slots || ( type != XTRACE_OFFER && type != XTRACE_ACK && type != XTRACE_NAK ) )
+        return 0;
+
+    e = xtrace_slot ( x, xid, mac );
+    if ( !xtrace_match ( e, xid, mac ) )
+        return 0;
+
+    if ( type == XTRACE_OFFER ) {
+        if ( !e->offer )
+            e->offer = ns;
+        return 0;
+    }
+    if ( !e->request )
+        return 0;  // respuesta a otro mensaje con el mismo xid
+
+    done->xid    = xid;
+    done->reply  = type;
+    done->mac    = mac;
+    done->server = xtrace_diff ( ns, e->request );
+    done->client = 0;
+    done->full   = e->discover && e->offer;
+    if ( done->full ) {
+        done->server += xtrace_diff ( e->offer, e->discover );
+        done->client = xtrace_diff ( e->request, e->offer );
+    }
+    done->total = done->server + done->client;
+
+    e->mac = 0;
+    return 1;
+}
@@ -0,0 +1,59 @@
+#ifndef XTRACE_H
+#define XTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Seguimiento de intercambios DHCPDISCOVER -> DHCPOFFER -> DHCPREQUEST ->
+ * DHCPACK/DHCPNAK, correlacionados por (xid, chaddr).
+ *
+ * Cada intercambio abierto ocupa una entrada de una tabla de tamaño fijo
+ * indexada por un hash de (xid, chaddr); no se reserva memoria en el ciclo
+ * de paquetes. Si otro intercambio cae en la misma entrada antes de que el
+ * primero termine, el primero se pierde (xtrace_received() regresa 1).
+ *
+ * Las horas de recepción son las del kernel (SO_TIMESTAMPING) cuando las
+ * hay; las de envío se toman justo antes de sendto(). Todas en ns de
+ * CLOCK_REALTIME, el reloj de las marcas del kernel.
+ *
+ * Al enviar la respuesta final xtrace_sent() entrega el intercambio con el
+ * tiempo repartido entre el servidor (DISCOVER -> OFFER más REQUEST -> ACK)
+ * y el cliente (OFFER -> REQUEST: red de regreso y lo que el cliente tarda
+ * en decidirse). Una renovación (DHCPREQUEST sin DHCPDISCOVER) solo tiene
+ * tiempo del servidor.
+ */
+
+#define XTRACE_SLOTS 4096  // potencia de 2
+
+typedef struct xtrace_entry {
+    u_int64_t mac;  // 0 = libre
+    u_int32_t xid;
+    u_int32_t pad;
+    u_int64_t discover;  // 0 = no visto
+    u_int64_t offer;
+    u_int64_t request;
+} xtrace_entry;
+
+// Intercambio terminado
+typedef struct xtrace_done {
+    u_int32_t xid;  // en orden de red, como llega
+    u_int8_t  reply;  // DHCPACK o DHCPNAK
+    u_int8_t  full;   // empezó con DHCPDISCOVER y hubo DHCPOFFER: client tiene sentido
+    u_int64_t mac;
+    u_int64_t total;   // ns del primer mensaje del cliente a la respuesta final
+    u_int64_t server;  // ns
+    u_int64_t client;  // ns
+} xtrace_done;
+
+typedef struct xtrace {
+    xtrace_entry *slots;
+} xtrace;
+
+int  xtrace_open ( xtrace *x );
+void xtrace_close ( xtrace *x );
+int  xtrace_received ( xtrace *x, u_int32_t xid, u_int64_t mac, u_int8_t type, u_int64_t ns );
+int  xtrace_sent ( xtrace *x, u_int32_t xid, u_int64_t mac, u_int8_t type, u_int64_t ns, xtrace_done *done );
+
+#endif  // XTRACE_H